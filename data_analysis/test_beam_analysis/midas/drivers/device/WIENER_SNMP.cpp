@@ -726,6 +726,20 @@ double getOutputVoltage(HSNMP m_sessp, int channel) {
 	                           lengthOutputVoltage[channel] );
   return value; }
 
+int getChannelStatusList(HSNMP m_sessp, int n, const int* channel, double* value) {
+	return snmpGetDoubleList(m_sessp, n, oidOutputStatus, lengthOutputStatus, channel, value); }
+
+int getOutputSenseMeasurementList(HSNMP m_sessp, int n, const int* channel, double* value) {
+	return snmpGetDoubleList(m_sessp, n, oidOutputMeasurementSenseVoltage,
+	                         lengthOutputMeasurementSenseVoltage, channel, value); }
+
+int getCurrentMeasurementList(HSNMP m_sessp, int n, const int* channel, double* value) {
+	return snmpGetDoubleList(m_sessp, n, oidOutputMeasurementCurrent,
+	                         lengthOutputMeasurementCurrent, channel, value); }
+
+int getOutputVoltageList(HSNMP m_sessp, int n, const int* channel, double* value) {
+	return snmpGetDoubleList(m_sessp, n, oidOutputVoltage, lengthOutputVoltage, channel, value); }
+
 double setOutputVoltage(HSNMP m_sessp, int channel, double value) {
 	value = snmpSetDouble(m_sessp, oidOutputVoltage[channel],
 	                      lengthOutputVoltage[channel], value );
@@ -1090,6 +1104,57 @@ double snmpGetDouble(HSNMP m_sessp, const oid* parameter, size_t length) {
 }
 
 
+// Get one parameter of many channels with one request per SNMP_MAX_VARS_PER_PDU
+// channels instead of one request per channel. Returns the number of values
+// read, channels which could not be read get -1 like in snmpGetDouble.
+#define SNMP_MAX_VARS_PER_PDU 16
+
+int snmpGetDoubleList(HSNMP m_sessp, int n, oid (*parameter)[MAX_OID_LEN], const size_t* length,
+                      const int* channel, double* value) {
+  int i, j, m, n_read = 0;
+
+  for (i = 0; i < n; i += SNMP_MAX_VARS_PER_PDU) {
+    m = n - i < SNMP_MAX_VARS_PER_PDU ? n - i : SNMP_MAX_VARS_PER_PDU;
+
+    struct snmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_GET);    // prepare get-request pdu
+    for (j = 0; j < m; j++) {
+      value[i + j] = -1;
+      snmp_add_null_var(pdu, parameter[channel[i + j]], length[channel[i + j]]);
+    }
+
+    struct snmp_pdu* response = NULL;
+    int status = snmp_sess_synch_response(m_sessp, pdu, &response);
+
+    if (status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR) {
+      // variables come back in the order of the request
+      struct variable_list *vars;
+      for (vars = response->variables, j = 0; vars && j < m; vars = vars->next_variable, j++) {
+        if (vars->type == ASN_OPAQUE_FLOAT)                 // 0x78
+          value[i + j] = *vars->val.floatVal;
+        else if (vars->type == ASN_OPAQUE_DOUBLE)           // 0x79
+          value[i + j] = *vars->val.doubleVal;
+        else if (vars->type == ASN_INTEGER)                 // 0x02
+          value[i + j] = (double)*vars->val.integer;
+        else if (vars->type == ASN_OCTET_STR)               // 0x04
+          value[i + j] = vars->val.bitstring[0]*256+vars->val.bitstring[1];
+        else
+          continue;                                         // noSuchInstance etc.
+        n_read++;
+      }
+    } else if (status == STAT_SUCCESS) {
+      fprintf(stderr, "Error in packet\nReason: %s\n",
+      snmp_errstring(response->errstat));
+    }
+
+    if (response)
+      snmp_free_pdu(response);
+  }
+
+  return n_read;
+}
+
+
+
 double snmpSetDouble(HSNMP m_sessp, const oid* parameter, size_t length, double value) {
   struct snmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_SET);    // prepare set-request pdu
   pdu->community = (u_char*)strdup(writeCommunity);
@@ -32,6 +32,11 @@ int  getTemperatureMeasurement(HSNMP m_sessp, int channel);
 int  setChannelSwitch(HSNMP m_sessmp, int channel, int value);
 int  getChannelSwitch(HSNMP m_sessmp, int channel);
 double  getOutputVoltage(HSNMP m_sessp,int channel);
+//Multi channel reads, one request for many channels, -1 for channels which could not be read
+int  getChannelStatusList(HSNMP m_sessp, int n, const int* channel, double* value);
+int  getOutputSenseMeasurementList(HSNMP m_sessp, int n, const int* channel, double* value);
+int  getCurrentMeasurementList(HSNMP m_sessp, int n, const int* channel, double* value);
+int  getOutputVoltageList(HSNMP m_sessp, int n, const int* channel, double* value);
 double  setOutputVoltage(HSNMP m_sessp,int channel,double value);
 double  getOutputCurrent(HSNMP m_sessp,int channel);
 double  setOutputCurrent(HSNMP m_sessp,int channel,double value);
@@ -93,6 +98,7 @@ double  snmpSetDouble(HSNMP m_sessp, const oid* parameter, size_t length, double
 double  snmpGetDouble(HSNMP m_sessp, const oid* parameter, size_t length);
 int  snmpSetInt(HSNMP m_sessp, const oid* parameter, size_t length, int value);
 int  snmpGetInt(HSNMP m_sessp, const oid* parameter, size_t length);
+int  snmpGetDoubleList(HSNMP m_sessp, int n, oid (*parameter)[MAX_OID_LEN], const size_t* length, const int* channel, double* value);
 
 //##SR
 void init_mib(void);
@@ -18,6 +18,7 @@ $Id: dd_sy4527.c 2780 2005-10-19 13:20:29Z ritt $
 #include <stdbool.h>
 #define ALARM XALARM
 #include "midas.h"
+#include "dd_sy4527.h"
 #undef ALARM
 #include "CAENHVWrapper.h"
 
@@ -26,6 +27,7 @@ $Id: dd_sy4527.c 2780 2005-10-19 13:20:29Z ritt $
 #define CAEN_SYSTEM_TYPE  (CAENHV_SYSTEM_TYPE_t)2
 #define DEFAULT_TIMEOUT 10000	/* 10 sec. */
 #define SY4527_MAX_SLOTS   6
+#define SY4527_MAX_SLOT_CHANNELS 64
 
 #ifndef CAEN_HV_USER
 #define CAEN_HV_USER "admin"
@@ -76,6 +78,7 @@ typedef struct
   DDSY4527_SLOT slot[SY4527_MAX_SLOTS];
   float *array;
   INT num_channels;		// Total # of channels
+  INT max_channels;		// # of channels of the equipment, size of the CMD_GET_ALL/CMD_SET_ALL arrays
   INT (*bd) (INT cmd, ...);	/* bus driver entry function */
   void *bd_info;		/* private info of bus driver */
   HNDLE hkey;			/* ODB key for bus driver info */
@@ -110,6 +113,9 @@ INT dd_sy4527_init (HNDLE hkey, void **pinfo, WORD channels,
   info = (DDSY4527_INFO *) calloc (1, sizeof (DDSY4527_INFO));
   *pinfo = info;
 
+  // the equipment may declare fewer channels than the crate has
+  info->max_channels = channels;
+
   cm_get_experiment_database (&hDB, NULL);
 
   /*  create DDSY4527 settings record */
@@ -829,6 +835,169 @@ INT dd_sy4527_trip_time_get (DDSY4527_INFO * info, WORD channel, float *pvalue)
   }
 }
 
+/*----------------------------------------------------------------------------*/
+/* Bulk access for DF_BULK_ACCESS: one CAENHV call per slot instead of one
+   call per channel.  Channel parameters are read into values[] in
+   the global channel numbering, logical parameters (like "Status") are
+   stored bit-wise in the float array as for the single channel commands.
+   dd_sy4527_set_all uses values[] as scratch buffer.
+   values[] has the number of channels of the equipment, channels
+   beyond that are not accessed. */
+
+// channels of slot islot, starting at global channel "first", which
+// fit into values[]
+WORD dd_sy4527_slot_channels (DDSY4527_INFO * info, WORD islot, INT first)
+{
+  INT n = info->slot[islot].channels;
+  if (first + n > info->max_channels)
+    n = info->max_channels - first;
+  return n > 0 ? n : 0;
+}
+
+INT dd_sy4527_Param_get_all (DDSY4527_INFO * info, char const *ParName, float *values)
+{
+  WORD islot, i, n, chlist[SY4527_MAX_SLOT_CHANNELS];
+  INT first;
+  CAENHVRESULT ret;
+
+  first = 0;
+  for (islot = info->dd_sy4527_settings.begslot; islot < SY4527_MAX_SLOTS && first < info->max_channels; islot++) {
+    n = dd_sy4527_slot_channels (info, islot, first);
+    if (n == 0)
+      continue;
+    if (n > SY4527_MAX_SLOT_CHANNELS) {
+      cm_msg (MERROR, "Param_get_all", "Slot %d has %d channels, only %d supported", islot, n, SY4527_MAX_SLOT_CHANNELS);
+      return FE_ERR_DRIVER;
+    }
+    for (i = 0; i < n; i++)
+      chlist[i] = i;
+
+    ret = CAENHV_GetChParam (info->handle, islot, ParName, n, chlist, values + first);
+    if (ret != CAENHV_OK) {
+      cm_msg (MERROR, "Param_get_all", "GetChParam \"%s\" slot %d returns %d", ParName, islot, ret);
+      return FE_ERR_DRIVER;
+    }
+    first += n;
+  }
+
+  return FE_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------*/
+INT dd_sy4527_get_all (DDSY4527_INFO * info, INT cmd, float *values)
+{
+  WORD islot, i, n;
+  INT first, status;
+  float temp;
+  CAENHVRESULT ret;
+
+  switch (cmd) {
+  case CMD_GET:
+    return dd_sy4527_Param_get_all (info, "VMon", values);
+
+  case CMD_GET_DEMAND:
+    return dd_sy4527_Param_get_all (info, "V0Set", values);
+
+  case CMD_GET_STATUS:
+    return dd_sy4527_Param_get_all (info, "Status", values);
+
+  case CMD_GET_CURRENT:
+    status = dd_sy4527_Param_get_all (info, "IMon", values);
+    if (status != FE_SUCCESS)
+      return status;
+
+    // same as dd_sy4527_current_get: 48 channel cards report the current only on their first channel
+    first = 0;
+    for (islot = info->dd_sy4527_settings.begslot; islot < SY4527_MAX_SLOTS && first < info->max_channels; islot++) {
+      n = dd_sy4527_slot_channels (info, islot, first);
+      if (info->slot[islot].channels != 12 && info->slot[islot].channels != 24)
+        for (i = 1; i < n; i++)
+          values[first + i] = -9999;
+      first += n;
+    }
+    return FE_SUCCESS;
+
+  case CMD_GET_TEMPERATURE:
+    // board parameter, one value for all channels of a slot
+    first = 0;
+    for (islot = info->dd_sy4527_settings.begslot; islot < SY4527_MAX_SLOTS && first < info->max_channels; islot++) {
+      n = dd_sy4527_slot_channels (info, islot, first);
+      if (n == 0)
+        continue;
+      ret = CAENHV_GetBdParam (info->handle, 1, &islot, "Temp", &temp);
+      for (i = 0; i < n; i++)
+        values[first + i] = (ret == CAENHV_OK) ? temp : (float) ss_nan ();
+      first += n;
+    }
+    return FE_SUCCESS;
+
+  default:
+    // no bulk version, leave values at NaN as the single channel commands do
+    return FE_SUCCESS;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+INT dd_sy4527_set_all (DDSY4527_INFO * info, INT cmd, float *values)
+{
+  WORD islot, i, j, n, nlist, chlist[SY4527_MAX_SLOT_CHANNELS];
+  INT first, status;
+  DWORD pw;
+  float value;
+  CAENHVRESULT ret;
+
+  if (cmd != CMD_SET) {
+    // other settings change rarely, use the single channel commands
+    status = FE_SUCCESS;
+    for (i = 0; i < info->num_channels && i < info->max_channels; i++)
+      if (!ss_isnan (values[i]))
+        if (dd_sy4527 (cmd, info, i, (double) values[i]) != FE_SUCCESS)
+          status = FE_ERR_DRIVER;
+    return status;
+  }
+
+  // CAENHV_SetChParam writes the same value to a list of channels, so set
+  // all channels of a slot with the same demand value in one call
+  status = FE_SUCCESS;
+  first = 0;
+  for (islot = info->dd_sy4527_settings.begslot; islot < SY4527_MAX_SLOTS && first < info->max_channels; islot++) {
+    n = dd_sy4527_slot_channels (info, islot, first);
+    if (n > SY4527_MAX_SLOT_CHANNELS)
+      return FE_ERR_DRIVER;
+
+    for (i = 0; i < n; i++) {
+      if (ss_isnan (values[first + i]))
+        continue;
+
+      value = values[first + i];
+      nlist = 0;
+      for (j = i; j < n; j++)
+        if (values[first + j] == value) {
+          chlist[nlist++] = j;
+          values[first + j] = (float) ss_nan ();
+        }
+
+      // same order as dd_sy4527_set: switch off before, switch on after setting the voltage
+      if (value < 0.01) {
+        pw = 0;
+        CAENHV_SetChParam (info->handle, islot, "Pw", nlist, chlist, &pw);
+      }
+      ret = CAENHV_SetChParam (info->handle, islot, "V0Set", nlist, chlist, &value);
+      if (value >= 0.01) {
+        pw = 1;
+        CAENHV_SetChParam (info->handle, islot, "Pw", nlist, chlist, &pw);
+      }
+      if (ret != CAENHV_OK) {
+        cm_msg (MERROR, "set_all", "SetChParam \"V0Set\" slot %d returns %d", islot, ret);
+        status = FE_ERR_DRIVER;
+      }
+    }
+    first += n;
+  }
+
+  return status;
+}
+
 /*---- device driver entry point -----------------------------------*/
 INT dd_sy4527 (INT cmd, ...)
 {
@@ -1001,6 +1170,20 @@ INT dd_sy4527 (INT cmd, ...)
     status = dd_sy4527_trip_time_get ((DDSY4527_INFO *)info, channel, pvalue);
     break;
 
+  case CMD_GET_ALL:
+    info = va_arg (argptr, void *);
+    icmd = (WORD) va_arg (argptr, INT);
+    pvalue = va_arg (argptr, float *);
+    status = dd_sy4527_get_all ((DDSY4527_INFO *)info, icmd, pvalue);
+    break;
+
+  case CMD_SET_ALL:
+    info = va_arg (argptr, void *);
+    icmd = (WORD) va_arg (argptr, INT);
+    pvalue = va_arg (argptr, float *);
+    status = dd_sy4527_set_all ((DDSY4527_INFO *)info, icmd, pvalue);
+    break;
+
   default:
     break;
   }
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include "midas.h"
 #include "mscb.h"
+#include "iseg_hv_mpod.h"
 
 #include "WIENER_SNMP.h"
 
@@ -56,6 +57,7 @@ typedef struct {
    ISEG_HV_MPOD_SETTINGS settings;
    void *crate;
    CHANNEL_VARS *chn_vars;
+   double *bulk_values;
 } ISEG_HV_MPOD_INFO;
 
 INT iseg_hv_mpod_get(ISEG_HV_MPOD_INFO * info, INT channel, float *pvalue);
@@ -75,6 +77,8 @@ INT iseg_hv_mpod_init(HNDLE hkey, void **pinfo, INT channels, INT(*bd) (INT cmd,
    info = (ISEG_HV_MPOD_INFO *) calloc(1, sizeof(ISEG_HV_MPOD_INFO));
    info->chn_vars = (CHANNEL_VARS *) calloc(channels, sizeof(CHANNEL_VARS));
    info->settings.chn_address = (int *) calloc(channels, sizeof(int));
+   info->settings.channels = channels;
+   info->bulk_values = (double *) calloc(channels, sizeof(double));
    for (i=0 ; i<channels ; i++)
       info->settings.chn_address[i] = i+1;
    *pinfo = info;
@@ -159,6 +163,7 @@ INT iseg_hv_mpod_exit(ISEG_HV_MPOD_INFO * info)
       SnmpClose(info->crate);
       SnmpCleanup();
       free(info->settings.chn_address);
+      free(info->bulk_values);
       free(info);
    }
    
@@ -334,6 +339,77 @@ INT iseg_hv_mpod_set_triptime(ISEG_HV_MPOD_INFO * info, int channel, float limit
    return FE_SUCCESS;
 }
 
+/*----------------------------------------------------------------------------*/
+
+/* bulk access for DF_BULK_ACCESS, reads one parameter of many channels
+   with a single SNMP request */
+
+INT iseg_hv_mpod_get_all(ISEG_HV_MPOD_INFO * info, INT cmd, float *values)
+{
+   int i, trip, n = info->settings.channels;
+   double *v = info->bulk_values;
+
+   switch (cmd) {
+   case CMD_GET:
+      getOutputSenseMeasurementList(info->crate, n, info->settings.chn_address, v);
+      for (i=0 ; i<n ; i++) {
+         if (v[i] != -1)
+            values[i] = (float)((int)(v[i]*1e3+0.5)/1E3);
+         else
+            iseg_hv_mpod_get(info, i, &values[i]); // retry single channel
+      }
+      break;
+
+   case CMD_GET_CURRENT:
+      getCurrentMeasurementList(info->crate, n, info->settings.chn_address, v);
+      for (i=0 ; i<n ; i++) {
+         if (v[i] != -1)
+            values[i] = (float)((int)(v[i]*1E6*1e3+0.5)/1E3); // uA
+         else
+            iseg_hv_mpod_get_current(info, i, &values[i]);
+      }
+      break;
+
+   case CMD_GET_DEMAND:
+      getOutputVoltageList(info->crate, n, info->settings.chn_address, v);
+      for (i=0 ; i<n ; i++)
+         values[i] = (float)v[i];
+      break;
+
+   case CMD_GET_TRIP:
+   case CMD_GET_STATUS:
+      // same as iseg_hv_mpod_get_trip: INT trip flag stored in the float value
+      getChannelStatusList(info->crate, n, info->settings.chn_address, v);
+      for (i=0 ; i<n ; i++) {
+         if (v[i] != -1) {
+            trip = ((int)v[i] & 1<<10) ? 1 : 0;
+            memcpy(&values[i], &trip, sizeof(trip));
+         } else
+            iseg_hv_mpod_get_trip(info, i, (INT *)&values[i]);
+      }
+      break;
+
+   default:
+      break;
+   }
+
+   return FE_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------*/
+
+INT iseg_hv_mpod_set_all(ISEG_HV_MPOD_INFO * info, INT cmd, float *values)
+{
+   int i;
+
+   // settings are written channel by channel, NaN means unchanged
+   for (i=0 ; i<info->settings.channels ; i++)
+      if (!ss_isnan(values[i]))
+         iseg_hv_mpod(cmd, info, i, (double)values[i]);
+
+   return FE_SUCCESS;
+}
+
 /*---- device driver entry point -----------------------------------*/
 
 INT iseg_hv_mpod(INT cmd, ...)
@@ -509,6 +585,20 @@ INT iseg_hv_mpod(INT cmd, ...)
       status = iseg_hv_mpod_get_trip(info, channel, pivalue);
       break;
 
+   case CMD_GET_ALL:
+      info = va_arg(argptr, ISEG_HV_MPOD_INFO *);
+      channel = va_arg(argptr, INT);   // CMD_GET_xxx
+      pvalue = va_arg(argptr, float *);
+      status = iseg_hv_mpod_get_all(info, channel, pvalue);
+      break;
+
+   case CMD_SET_ALL:
+      info = va_arg(argptr, ISEG_HV_MPOD_INFO *);
+      channel = va_arg(argptr, INT);   // CMD_SET_xxx
+      pvalue = va_arg(argptr, float *);
+      status = iseg_hv_mpod_set_all(info, channel, pvalue);
+      break;
+
    default:
       cm_msg(MERROR, "iseg_hv_mpod device driver", "Received unknown command %d", cmd);
       status = FE_ERR_DRIVER;
@@ -156,6 +156,61 @@ INT nulldev_get(NULLDEV_INFO * info, INT channel, float *pvalue)
    return FE_SUCCESS;
 }
 
+/*----------------------------------------------------------------------------*/
+
+/* Optional bulk access, used by the multithreaded sc_thread if the device
+   is flagged with DF_BULK_ACCESS. A real driver would transfer all channels
+   in one bus transaction here instead of one transaction per channel. A
+   driver using DF_BULK_ACCESS has to handle all CMD_GET_xxx and CMD_SET_xxx
+   commands, values it does not support are left at NaN. */
+
+INT nulldev_get_all(NULLDEV_INFO * info, INT cmd, float *values)
+{
+   char str[80];
+   int i;
+
+   if (cmd != CMD_GET)
+      return FE_SUCCESS;
+
+   /* read all channels at once, something like ... */
+   BD_PUTS("GET ALL");
+   BD_GETS(str, sizeof(str), ">", DEFAULT_TIMEOUT);
+
+   /* simulate reading by generating some sine wave data */
+   time_t t = time(NULL);
+   for (i = 0; i < info->num_channels; i++)
+      values[i] = 5 + 5 * sin(M_PI * t / 60) + 10 * i;
+
+   return FE_SUCCESS;
+}
+
+/*----------------------------------------------------------------------------*/
+
+INT nulldev_set_all(NULLDEV_INFO * info, INT cmd, float *values)
+{
+   char str[80];
+   int i;
+
+   if (cmd != CMD_SET)
+      return FE_SUCCESS;
+
+   /* write all changed channels, NaN means unchanged */
+   for (i = 0; i < info->num_channels; i++)
+      if (!ss_isnan(values[i])) {
+         sprintf(str, "SET %d %lf", i, values[i]);
+         BD_PUTS(str);
+      }
+   BD_GETS(str, sizeof(str), ">", DEFAULT_TIMEOUT);
+
+   /* simulate writing by storing value in local array, has to be removed
+      in a real driver */
+   for (i = 0; i < info->num_channels; i++)
+      if (!ss_isnan(values[i]))
+         info->array[i] = values[i];
+
+   return FE_SUCCESS;
+}
+
 /*---- device driver entry point -----------------------------------*/
 
 INT nulldev(INT cmd, ...)
@@ -198,6 +253,20 @@ INT nulldev(INT cmd, ...)
       status = nulldev_get(info, channel, pvalue);
       break;
 
+   case CMD_GET_ALL:
+      info = va_arg(argptr, NULLDEV_INFO *);
+      channel = va_arg(argptr, INT);   // CMD_GET_xxx to execute for all channels
+      pvalue = va_arg(argptr, float *);
+      status = nulldev_get_all(info, channel, pvalue);
+      break;
+
+   case CMD_SET_ALL:
+      info = va_arg(argptr, NULLDEV_INFO *);
+      channel = va_arg(argptr, INT);   // CMD_SET_xxx to execute for all channels
+      pvalue = va_arg(argptr, float *);
+      status = nulldev_set_all(info, channel, pvalue);
+      break;
+
    default:
       break;
    }
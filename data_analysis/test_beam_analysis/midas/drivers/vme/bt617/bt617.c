@@ -388,6 +388,31 @@ int mvme_get_blt(MVME_INTERFACE *vme, int *mode)
 
 /*------------------------------------------------------------------*/
 
+int mvme_read_async(MVME_INTERFACE *vme, MVME_REQUEST *req)
+{
+   /* bt_read() is synchronous, read right away */
+   if (!req || !req->dst)
+      return MVME_INVALID_PARAM;
+
+   req->am = vme->am;
+   req->dmode = vme->dmode;
+   req->blt_mode = vme->blt_mode;
+
+   req->n_done = mvme_read(vme, req->dst, req->vme_addr, req->n_bytes);
+   req->status = (req->n_done == req->n_bytes) ? MVME_SUCCESS : MVME_ACCESS_ERROR;
+
+   return MVME_SUCCESS;
+}
+
+/*------------------------------------------------------------------*/
+
+int mvme_read_wait(MVME_INTERFACE *vme, MVME_REQUEST *req)
+{
+   return req->status;
+}
+
+/*------------------------------------------------------------------*/
+
 /* Small test program, comment back for testing...
 
 main()
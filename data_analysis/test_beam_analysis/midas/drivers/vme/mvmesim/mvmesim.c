@@ -0,0 +1,914 @@
+/*********************************************************************
+
+  Name:         mvmesim.c
+
+  Contents:     Software VME interface simulating a crate of
+                CAEN V1720 and V1740 digitizers, see mvmesim.h.
+
+                All accesses go through one simulated bus: each
+                transfer occupies the bus for its setup latency plus
+                its size divided by the bandwidth of the transfer mode,
+                and the caller returns when the transfer is done.
+                Asynchronous reads are done by a thread, so the caller
+                can work while the bus is busy, as with real DMA.
+
+*********************************************************************/
+
+#define  _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "mvmesim.h"
+#include "v1720.h" // the V1740 has the same register map
+
+#define MVMESIM_MAX_BOARDS   21
+#define MVMESIM_BOARD_SPACE  0x10000     // A32 space of one board
+#define MVMESIM_FIFO_SPACE   0x1000      // event readout buffer at the board base
+#define MVMESIM_MAX_EVENTS   1024        // events stored on a board
+#define MVMESIM_FILLER       0xFFFFFFFF  // read from an empty readout buffer
+#define MVMESIM_PULSE_LENGTH 64          // samples
+
+typedef struct {
+  int          type;
+  mvme_addr_t  base;
+  uint32_t     reg[MVMESIM_BOARD_SPACE/4];
+  double       trig_time[MVMESIM_MAX_EVENTS]; // triggers waiting for readout, ring buffer
+  int          trig_first;
+  int          trig_count;
+  double       run_start;
+  double       ntrig;                    // triggers generated by the trigger rate
+  uint32_t     event_counter;
+  uint32_t     *data;                    // event being read out
+  int          data_size;
+  int          data_pos;
+  int          data_alloc;
+  uint32_t     seed;
+} MVMESIM_BOARD;
+
+typedef struct {
+  pthread_mutex_t mutex;                 // protects everything below
+  MVMESIM_BOARD   *board[MVMESIM_MAX_BOARDS];
+  int             nboards;
+  double          latency_us;
+  double          bandwidth_mbs;
+  double          pio_us;
+  double          trigger_hz;
+  double          bus_free;              // time when the bus becomes free
+  double          bus_bytes;
+  double          bus_busy;
+  pthread_t       thread;                // asynchronous reads
+  int             thread_running;
+  pthread_cond_t  cond;
+  MVME_REQUEST    *head;
+  MVME_REQUEST    *tail;
+  int             exit;
+} MVMESIM;
+
+static int pulse_shape[MVMESIM_PULSE_LENGTH]; // in units of 1/1024
+
+/********************************************************************/
+static double sim_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static void sim_wait_until(double t)
+{
+  while (1) {
+    double dt = t - sim_time();
+    if (dt <= 0)
+      return;
+    if (dt > 200e-6) {
+      /* sleep, spin for the last part to be accurate */
+      struct timespec ts;
+      dt -= 100e-6;
+      ts.tv_sec = (time_t)dt;
+      ts.tv_nsec = (long)((dt - ts.tv_sec)*1e9);
+      nanosleep(&ts, NULL);
+    }
+  }
+}
+
+static uint32_t sim_random(MVMESIM_BOARD *b)
+{
+  /* xorshift32 */
+  uint32_t x = b->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  b->seed = x;
+  return x;
+}
+
+/********************************************************************/
+static int sim_is_dma(int blt_mode)
+{
+  return blt_mode != 0 && blt_mode != MVME_BLT_NONE;
+}
+
+static double sim_bandwidth(MVMESIM *sim, int blt_mode)
+{
+  if (sim->bandwidth_mbs > 0)
+    return sim->bandwidth_mbs;
+
+  /* typical values in MB/s */
+  switch (blt_mode) {
+  case MVME_BLT_BLT32:
+  case MVME_BLT_BLT32FIFO:
+    return 40;
+  case MVME_BLT_2EVME:
+  case MVME_BLT_2EVMEFIFO:
+    return 160;
+  case MVME_BLT_2ESST:
+    return 200;
+  default:
+    return 80;
+  }
+}
+
+/* occupy the bus for a transfer, returns the time the transfer is done */
+static double sim_bus_reserve(MVMESIM *sim, double cost, mvme_size_t n_bytes)
+{
+  double start = sim_time();
+  if (sim->bus_free > start)
+    start = sim->bus_free;
+  sim->bus_free = start + cost;
+  sim->bus_bytes += n_bytes;
+  sim->bus_busy += cost;
+  return sim->bus_free;
+}
+
+/********************************************************************/
+static MVMESIM_BOARD* sim_find_board(MVMESIM *sim, mvme_addr_t addr)
+{
+  int i;
+  for (i=0; i<sim->nboards; i++)
+    if (addr - sim->board[i]->base < MVMESIM_BOARD_SPACE)
+      return sim->board[i];
+  return NULL;
+}
+
+static int sim_running(MVMESIM_BOARD *b)
+{
+  return (b->reg[V1720_ACQUISITION_CONTROL/4] & 0x4) != 0;
+}
+
+static int sim_max_events(MVMESIM_BOARD *b)
+{
+  int n = 1 << (b->reg[V1720_BUFFER_ORGANIZATION/4] & 0xF);
+  return n < MVMESIM_MAX_EVENTS ? n : MVMESIM_MAX_EVENTS;
+}
+
+static int sim_nsamples(MVMESIM_BOARD *b)
+{
+  int org = b->reg[V1720_BUFFER_ORGANIZATION/4] & 0xF;
+  if (b->type == MVMESIM_V1740)
+    return ((192*1024) >> org) & ~7;  // 192 kS per channel
+  return ((1024*1024) >> org) & ~1;   // 1 MS per channel
+}
+
+static int sim_event_size(MVMESIM_BOARD *b)
+{
+  uint32_t mask = b->reg[V1720_CHANNEL_EN_MASK/4] & 0xFF;
+  int n = 0;
+  int i;
+  for (i=0; i<8; i++)
+    if (mask & (1<<i))
+      n++;
+  if (b->type == MVMESIM_V1740)
+    return 4 + n*sim_nsamples(b)*3;  // 8 channels of 12 bits per group
+  return 4 + n*sim_nsamples(b)/2;
+}
+
+static void sim_board_clear(MVMESIM_BOARD *b)
+{
+  b->trig_first = 0;
+  b->trig_count = 0;
+  b->event_counter = 0;
+  b->data_size = 0;
+  b->data_pos = 0;
+}
+
+static void sim_board_reset(MVMESIM_BOARD *b, int slot)
+{
+  memset(b->reg, 0, sizeof(b->reg));
+  /* defaults give a small event, not the power-up values of the board */
+  b->reg[V1720_BUFFER_ORGANIZATION/4] = 0x0A;
+  b->reg[V1720_CHANNEL_EN_MASK/4]     = 0xFF;
+  b->reg[V1720_TRIG_SRCE_EN_MASK/4]   = V1720_SOFT_TRIGGER | V1720_EXTERNAL_TRIGGER;
+  b->reg[V1720_BLT_EVENT_NB/4]        = 1;
+  b->reg[V1720_BOARD_ID/4]            = slot;
+  sim_board_clear(b);
+}
+
+/********************************************************************/
+static void sim_trigger(MVMESIM_BOARD *b, double t)
+{
+  /* board is busy if all buffers are full */
+  if (b->trig_count >= sim_max_events(b))
+    return;
+  b->trig_time[(b->trig_first + b->trig_count) % MVMESIM_MAX_EVENTS] = t;
+  b->trig_count++;
+}
+
+static void sim_update_triggers(MVMESIM *sim, MVMESIM_BOARD *b, double t)
+{
+  double n;
+
+  if (!sim_running(b) || sim->trigger_hz <= 0)
+    return;
+  if (!(b->reg[V1720_TRIG_SRCE_EN_MASK/4] & V1720_EXTERNAL_TRIGGER))
+    return;
+
+  n = floor((t - b->run_start)*sim->trigger_hz);
+
+  /* triggers beyond the buffer space are lost anyway */
+  if (n - b->ntrig > MVMESIM_MAX_EVENTS)
+    b->ntrig = n - MVMESIM_MAX_EVENTS;
+
+  while (b->ntrig < n) {
+    b->ntrig += 1;
+    sim_trigger(b, b->run_start + b->ntrig/sim->trigger_hz);
+  }
+}
+
+static int sim_sample(MVMESIM_BOARD *b, int baseline, int pos, int amp, int i)
+{
+  int v = baseline + (int)(sim_random(b) & 3) - 2;
+  if (i >= pos && i < pos + MVMESIM_PULSE_LENGTH)
+    v -= (amp*pulse_shape[i - pos]) >> 10;
+  if (v < 0)
+    v = 0;
+  return v & 0xFFF;
+}
+
+/* move the oldest trigger into the readout buffer */
+static void sim_make_event(MVMESIM_BOARD *b)
+{
+  uint32_t mask = b->reg[V1720_CHANNEL_EN_MASK/4] & 0xFF;
+  int nsamples = sim_nsamples(b);
+  int size = sim_event_size(b);
+  double t = b->trig_time[b->trig_first];
+  uint32_t *p;
+  int i, j, k, ch;
+
+  assert(b->trig_count > 0);
+  b->trig_first = (b->trig_first + 1) % MVMESIM_MAX_EVENTS;
+  b->trig_count--;
+
+  if (size > b->data_alloc) {
+    b->data = (uint32_t*) realloc(b->data, size*sizeof(uint32_t));
+    assert(b->data);
+    b->data_alloc = size;
+  }
+
+  p = b->data;
+  *p++ = 0xA0000000 | size;
+  *p++ = ((b->reg[V1720_BOARD_ID/4] & 0x1F) << 27) | mask;
+  *p++ = b->event_counter++ & 0xFFFFFF;
+  *p++ = (uint32_t)((t - b->run_start)*125e6) & 0x7FFFFFFF; // 8 ns ticks
+
+  if (b->type == MVMESIM_V1720) {
+    for (ch=0; ch<8; ch++) {
+      int pos, amp;
+      if (!(mask & (1<<ch)))
+        continue;
+      pos = sim_random(b) % nsamples;
+      amp = 200 + sim_random(b) % 1500;
+      for (i=0; i<nsamples; i+=2) {
+        uint32_t s0 = sim_sample(b, 3600 + 10*ch, pos, amp, i);
+        uint32_t s1 = sim_sample(b, 3600 + 10*ch, pos, amp, i+1);
+        *p++ = s0 | (s1 << 16);
+      }
+    }
+  } else {
+    for (k=0; k<8; k++) {
+      int pos[8], amp[8];
+      if (!(mask & (1<<k)))
+        continue;
+      for (ch=0; ch<8; ch++) {
+        pos[ch] = sim_random(b) % nsamples;
+        amp[ch] = 200 + sim_random(b) % 1500;
+      }
+      /* blocks of 8 samples of each channel in 3 words */
+      for (i=0; i<nsamples; i+=8) {
+        for (ch=0; ch<8; ch++) {
+          p[0] = p[1] = p[2] = 0;
+          for (j=0; j<8; j++) {
+            uint32_t s = sim_sample(b, 3600 + 10*(8*k+ch), pos[ch], amp[ch], i+j);
+            int bit = 12*j;
+            p[bit/32] |= s << (bit%32);
+            if (bit%32 > 20) // sample continues in the next word
+              p[bit/32 + 1] |= s >> (32 - bit%32);
+          }
+          p += 3;
+        }
+      }
+    }
+  }
+
+  assert(p == b->data + size);
+
+  b->data_size = size;
+  b->data_pos = 0;
+}
+
+/********************************************************************/
+static uint32_t sim_fifo_read(MVMESIM *sim, MVMESIM_BOARD *b, double t)
+{
+  if (b->data_pos >= b->data_size) {
+    sim_update_triggers(sim, b, t);
+    if (b->trig_count == 0)
+      return MVMESIM_FILLER;
+    sim_make_event(b);
+  }
+  return b->data[b->data_pos++];
+}
+
+static uint32_t sim_reg_read(MVMESIM *sim, MVMESIM_BOARD *b, uint32_t offset, double t)
+{
+  uint32_t v;
+
+  if (offset < MVMESIM_FIFO_SPACE)
+    return sim_fifo_read(sim, b, t);
+
+  sim_update_triggers(sim, b, t);
+
+  switch (offset & ~3) {
+  case V1720_ACQUISITION_STATUS:
+    v = 0x100; // board ready
+    if (sim_running(b))
+      v |= 0x4;
+    if (b->trig_count > 0 || b->data_pos < b->data_size)
+      v |= 0x8;
+    if (b->trig_count >= sim_max_events(b))
+      v |= 0x10;
+    return v;
+  case V1720_EVENT_STORED:
+    return b->trig_count + (b->data_pos < b->data_size ? 1 : 0);
+  case V1720_EVENT_SIZE:
+    if (b->data_pos < b->data_size)
+      return b->data_size - b->data_pos;
+    if (b->trig_count > 0)
+      return sim_event_size(b);
+    return 0;
+  default:
+    return b->reg[offset/4];
+  }
+}
+
+static void sim_reg_write(MVMESIM *sim, MVMESIM_BOARD *b, uint32_t offset, uint32_t value, double t)
+{
+  int slot;
+
+  switch (offset & ~3) {
+  case V1720_ACQUISITION_CONTROL:
+    if ((value & 0x4) && !sim_running(b)) {
+      b->run_start = t;
+      b->ntrig = 0;
+    }
+    b->reg[offset/4] = value;
+    break;
+  case V1720_SW_TRIGGER:
+    if (sim_running(b) && (b->reg[V1720_TRIG_SRCE_EN_MASK/4] & V1720_SOFT_TRIGGER))
+      sim_trigger(b, t);
+    break;
+  case V1720_SW_RESET:
+    slot = b->reg[V1720_BOARD_ID/4];
+    sim_board_reset(b, slot);
+    break;
+  case V1720_SW_CLEAR:
+    sim_board_clear(b);
+    break;
+  case V1720_CHANNEL_CFG_BIT_SET:
+    b->reg[V1720_CHANNEL_CONFIG/4] |= value;
+    break;
+  case V1720_CHANNEL_CFG_BIT_CLR:
+    b->reg[V1720_CHANNEL_CONFIG/4] &= ~value;
+    break;
+  case V1720_ACQUISITION_STATUS:
+  case V1720_EVENT_STORED:
+  case V1720_EVENT_SIZE:
+    break; // read only
+  default:
+    if (offset >= MVMESIM_FIFO_SPACE)
+      b->reg[offset/4] = value;
+    break;
+  }
+}
+
+/********************************************************************/
+/*
+Move data for a read, with the mutex locked. Returns the time at
+which the transfer is complete on the simulated bus.
+*/
+static int sim_read_locked(MVMESIM *sim, int blt_mode, int dmode, void *dst, mvme_addr_t vme_addr, mvme_size_t n_bytes, mvme_size_t *n_done, double *t_done)
+{
+  MVMESIM_BOARD *b = sim_find_board(sim, vme_addr);
+  uint32_t offset;
+  double t = sim_time();
+  mvme_size_t i;
+
+  *n_done = 0;
+
+  if (!b) {
+    /* nobody answers, bus error after the VME timeout */
+    *t_done = sim_bus_reserve(sim, 1e-6*sim->latency_us, 0);
+    return MVME_ACCESS_ERROR;
+  }
+
+  offset = vme_addr - b->base;
+
+  if (sim_is_dma(blt_mode)) {
+    uint32_t *p = (uint32_t*)dst;
+    mvme_size_t nw = n_bytes/4;
+
+    if (offset < MVMESIM_FIFO_SPACE) {
+      /* block transfer ends with a bus error after BLT_EVENT_NB events */
+      uint32_t max_events = b->reg[V1720_BLT_EVENT_NB/4] ? b->reg[V1720_BLT_EVENT_NB/4] : 1;
+      uint32_t nevents = (b->data_pos < b->data_size) ? 1 : 0;
+      for (i=0; i<nw; i++) {
+        if (b->data_pos >= b->data_size) {
+          sim_update_triggers(sim, b, t);
+          if (nevents >= max_events || b->trig_count == 0)
+            break;
+          sim_make_event(b);
+          nevents++;
+        }
+        p[i] = b->data[b->data_pos++];
+      }
+      *n_done = i*4;
+      for (; i<nw; i++)
+        p[i] = MVMESIM_FILLER;
+    } else {
+      for (i=0; i<nw; i++)
+        p[i] = sim_reg_read(sim, b, offset + 4*i, t);
+      *n_done = nw*4;
+    }
+
+    *t_done = sim_bus_reserve(sim, 1e-6*sim->latency_us + *n_done/(1e6*sim_bandwidth(sim, blt_mode)), *n_done);
+  } else {
+    int width = (dmode == MVME_DMODE_D8) ? 1 : (dmode == MVME_DMODE_D16) ? 2 : 4;
+    int fifo = offset < MVMESIM_FIFO_SPACE;
+
+    for (i=0; i+width<=n_bytes; i+=width) {
+      uint32_t v = sim_reg_read(sim, b, fifo ? offset : offset + i, t);
+      if (width == 1)
+        ((uint8_t*)dst)[i] = v;
+      else if (width == 2)
+        *(uint16_t*)((char*)dst + i) = v;
+      else
+        *(uint32_t*)((char*)dst + i) = v;
+    }
+    *n_done = i;
+
+    *t_done = sim_bus_reserve(sim, 1e-6*sim->pio_us*(i/width), i);
+  }
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+static void* sim_async_thread(void *arg)
+{
+  MVMESIM *sim = (MVMESIM*)arg;
+  MVME_REQUEST *req;
+  mvme_size_t n_done;
+  double t_done;
+  int status;
+
+  pthread_mutex_lock(&sim->mutex);
+
+  while (1) {
+    while (!sim->head && !sim->exit)
+      pthread_cond_wait(&sim->cond, &sim->mutex);
+
+    if (!sim->head)
+      break;
+
+    req = sim->head;
+    status = sim_read_locked(sim, req->blt_mode, req->dmode, req->dst, req->vme_addr, req->n_bytes, &n_done, &t_done);
+
+    /* the bus is busy, the CPU is not */
+    pthread_mutex_unlock(&sim->mutex);
+    sim_wait_until(t_done);
+    pthread_mutex_lock(&sim->mutex);
+
+    sim->head = (MVME_REQUEST*)req->next;
+    if (!sim->head)
+      sim->tail = NULL;
+    req->next = NULL;
+    req->n_done = n_done;
+    req->status = status;
+
+    pthread_cond_broadcast(&sim->cond);
+  }
+
+  pthread_mutex_unlock(&sim->mutex);
+
+  return NULL;
+}
+
+/********************************************************************/
+int mvmesim_add_board(MVME_INTERFACE *mvme, int type, mvme_addr_t base)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  MVMESIM_BOARD *b;
+
+  if (type != MVMESIM_V1720 && type != MVMESIM_V1740)
+    return MVME_INVALID_PARAM;
+
+  if (base % MVMESIM_BOARD_SPACE != 0)
+    return MVME_INVALID_PARAM;
+
+  pthread_mutex_lock(&sim->mutex);
+
+  if (sim->nboards >= MVMESIM_MAX_BOARDS || sim_find_board(sim, base)) {
+    pthread_mutex_unlock(&sim->mutex);
+    return MVME_INVALID_PARAM;
+  }
+
+  b = (MVMESIM_BOARD*) calloc(1, sizeof(MVMESIM_BOARD));
+  if (!b) {
+    pthread_mutex_unlock(&sim->mutex);
+    return MVME_NO_MEM;
+  }
+
+  b->type = type;
+  b->base = base;
+  b->seed = 0x12345678 + base;
+  sim_board_reset(b, sim->nboards);
+
+  sim->board[sim->nboards++] = b;
+
+  pthread_mutex_unlock(&sim->mutex);
+
+  return MVME_SUCCESS;
+}
+
+void mvmesim_set_timing(MVME_INTERFACE *mvme, double latency_us, double bandwidth_mbs, double pio_us)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  pthread_mutex_lock(&sim->mutex);
+  sim->latency_us = latency_us;
+  sim->bandwidth_mbs = bandwidth_mbs;
+  sim->pio_us = pio_us;
+  pthread_mutex_unlock(&sim->mutex);
+}
+
+void mvmesim_set_trigger_rate(MVME_INTERFACE *mvme, double rate_hz)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  pthread_mutex_lock(&sim->mutex);
+  sim->trigger_hz = rate_hz;
+  pthread_mutex_unlock(&sim->mutex);
+}
+
+void mvmesim_get_bus_stat(MVME_INTERFACE *mvme, double *bytes, double *busy_sec)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  pthread_mutex_lock(&sim->mutex);
+  *bytes = sim->bus_bytes;
+  *busy_sec = sim->bus_busy;
+  pthread_mutex_unlock(&sim->mutex);
+}
+
+static void sim_configure(MVME_INTERFACE *mvme)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  const char *s;
+
+  if ((s = getenv("MVMESIM_LATENCY_US")))
+    sim->latency_us = atof(s);
+  if ((s = getenv("MVMESIM_BANDWIDTH_MBS")))
+    sim->bandwidth_mbs = atof(s);
+  if ((s = getenv("MVMESIM_PIO_US")))
+    sim->pio_us = atof(s);
+  if ((s = getenv("MVMESIM_TRIGGER_HZ")))
+    sim->trigger_hz = atof(s);
+
+  if ((s = getenv("MVMESIM_BOARDS"))) {
+    /* comma separated list of type:base */
+    while (*s) {
+      char type[16];
+      unsigned base;
+      int n = 0;
+      if (sscanf(s, "%15[^:]:%i%n", type, (int*)&base, &n) != 2) {
+        fprintf(stderr, "mvme_open: Invalid MVMESIM_BOARDS entry \"%s\"\n", s);
+        break;
+      }
+      if (strcmp(type, "v1720") == 0 || strcmp(type, "V1720") == 0)
+        mvmesim_add_board(mvme, MVMESIM_V1720, base);
+      else if (strcmp(type, "v1740") == 0 || strcmp(type, "V1740") == 0)
+        mvmesim_add_board(mvme, MVMESIM_V1740, base);
+      else
+        fprintf(stderr, "mvme_open: Unknown MVMESIM_BOARDS board type \"%s\"\n", type);
+      s += n;
+      if (*s == ',')
+        s++;
+    }
+  }
+}
+
+/********************************************************************/
+int mvme_open(MVME_INTERFACE **mvme, int idx)
+{
+  MVMESIM *sim;
+  int i;
+
+  if (pulse_shape[1] == 0) {
+    /* fast rise, exponential tail */
+    for (i=0; i<MVMESIM_PULSE_LENGTH; i++)
+      pulse_shape[i] = (int)(1024*(1 - exp(-i/1.5))*exp(-i/12.0)/0.75);
+  }
+
+  *mvme = (MVME_INTERFACE *) calloc(1, sizeof(MVME_INTERFACE));
+  if (!*mvme)
+    return MVME_NO_MEM;
+
+  sim = (MVMESIM*) calloc(1, sizeof(MVMESIM));
+  if (!sim) {
+    free(*mvme);
+    *mvme = NULL;
+    return MVME_NO_MEM;
+  }
+
+  pthread_mutex_init(&sim->mutex, NULL);
+  pthread_cond_init(&sim->cond, NULL);
+  sim->latency_us = 28;
+  sim->pio_us = 1;
+
+  (*mvme)->initialized = 1;
+  (*mvme)->index = idx;
+  (*mvme)->info = sim;
+  (*mvme)->am = MVME_AM_DEFAULT;
+  (*mvme)->dmode = MVME_DMODE_D32;
+  (*mvme)->blt_mode = 0;
+
+  sim_configure(*mvme);
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_close(MVME_INTERFACE *mvme)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  int i;
+
+  /* queued reads are completed before the thread exits */
+  if (sim->thread_running) {
+    pthread_mutex_lock(&sim->mutex);
+    sim->exit = 1;
+    pthread_cond_broadcast(&sim->cond);
+    pthread_mutex_unlock(&sim->mutex);
+    pthread_join(sim->thread, NULL);
+  }
+
+  for (i=0; i<sim->nboards; i++) {
+    free(sim->board[i]->data);
+    free(sim->board[i]);
+  }
+
+  pthread_cond_destroy(&sim->cond);
+  pthread_mutex_destroy(&sim->mutex);
+  free(sim);
+  free(mvme);
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_sysreset(MVME_INTERFACE *mvme)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  int i;
+
+  pthread_mutex_lock(&sim->mutex);
+  for (i=0; i<sim->nboards; i++)
+    sim_board_reset(sim->board[i], i);
+  pthread_mutex_unlock(&sim->mutex);
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_read(MVME_INTERFACE *mvme, void *dst, mvme_addr_t vme_addr, mvme_size_t n_bytes)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  mvme_size_t n_done;
+  double t_done;
+  int status;
+
+  pthread_mutex_lock(&sim->mutex);
+  status = sim_read_locked(sim, mvme->blt_mode, mvme->dmode, dst, vme_addr, n_bytes, &n_done, &t_done);
+  pthread_mutex_unlock(&sim->mutex);
+
+  sim_wait_until(t_done);
+
+  return status;
+}
+
+/********************************************************************/
+DWORD mvme_read_value(MVME_INTERFACE *mvme, mvme_addr_t vme_addr)
+{
+  DWORD value = 0;
+  int blt_mode = mvme->blt_mode;
+
+  /* single cycle access */
+  mvme->blt_mode = MVME_BLT_NONE;
+  if (mvme_read(mvme, &value, vme_addr, (mvme->dmode == MVME_DMODE_D8) ? 1 : (mvme->dmode == MVME_DMODE_D16) ? 2 : 4) != MVME_SUCCESS)
+    value = 0xFFFFFFFF;
+  mvme->blt_mode = blt_mode;
+
+  if (mvme->dmode == MVME_DMODE_D8)
+    value &= 0xFF;
+  else if (mvme->dmode == MVME_DMODE_D16)
+    value &= 0xFFFF;
+
+  return value;
+}
+
+/********************************************************************/
+int mvme_write(MVME_INTERFACE *mvme, mvme_addr_t vme_addr, void *src, mvme_size_t n_bytes)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  MVMESIM_BOARD *b;
+  int width = (mvme->dmode == MVME_DMODE_D8) ? 1 : (mvme->dmode == MVME_DMODE_D16) ? 2 : 4;
+  double t_done;
+  mvme_size_t i;
+  int status = MVME_SUCCESS;
+
+  pthread_mutex_lock(&sim->mutex);
+
+  b = sim_find_board(sim, vme_addr);
+  if (b) {
+    double t = sim_time();
+    for (i=0; i+width<=n_bytes; i+=width) {
+      uint32_t v;
+      if (width == 1)
+        v = ((uint8_t*)src)[i];
+      else if (width == 2)
+        v = *(uint16_t*)((char*)src + i);
+      else
+        v = *(uint32_t*)((char*)src + i);
+      sim_reg_write(sim, b, vme_addr - b->base + i, v, t);
+    }
+    t_done = sim_bus_reserve(sim, 1e-6*sim->pio_us*(n_bytes/width), n_bytes);
+  } else {
+    t_done = sim_bus_reserve(sim, 1e-6*sim->latency_us, 0);
+    status = MVME_ACCESS_ERROR;
+  }
+
+  pthread_mutex_unlock(&sim->mutex);
+
+  sim_wait_until(t_done);
+
+  return status;
+}
+
+/********************************************************************/
+int mvme_write_value(MVME_INTERFACE *mvme, mvme_addr_t vme_addr, DWORD value)
+{
+  if (mvme->dmode == MVME_DMODE_D8) {
+    uint8_t v = value;
+    return mvme_write(mvme, vme_addr, &v, 1);
+  } else if (mvme->dmode == MVME_DMODE_D16) {
+    uint16_t v = value;
+    return mvme_write(mvme, vme_addr, &v, 2);
+  }
+  return mvme_write(mvme, vme_addr, &value, 4);
+}
+
+/********************************************************************/
+int mvme_set_am(MVME_INTERFACE *mvme, int am)
+{
+  mvme->am = am;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_get_am(MVME_INTERFACE *mvme, int *am)
+{
+  *am = mvme->am;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_set_dmode(MVME_INTERFACE *mvme, int dmode)
+{
+  mvme->dmode = dmode;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_get_dmode(MVME_INTERFACE *mvme, int *dmode)
+{
+  *dmode = mvme->dmode;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_set_blt(MVME_INTERFACE *mvme, int mode)
+{
+  mvme->blt_mode = mode;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_get_blt(MVME_INTERFACE *mvme, int *mode)
+{
+  *mode = mvme->blt_mode;
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_read_async(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+
+  if (!req || !req->dst || req->n_bytes == 0)
+    return MVME_INVALID_PARAM;
+
+  req->am       = mvme->am;
+  req->dmode    = mvme->dmode;
+  req->blt_mode = mvme->blt_mode;
+  req->n_done   = 0;
+  req->status   = MVME_PENDING;
+  req->next     = NULL;
+
+  pthread_mutex_lock(&sim->mutex);
+
+  if (!sim->thread_running) {
+    int status = pthread_create(&sim->thread, NULL, sim_async_thread, sim);
+    if (status != 0) {
+      pthread_mutex_unlock(&sim->mutex);
+      fprintf(stderr, "mvme_read_async: Cannot create DMA thread, error %d (%s)\n", status, strerror(status));
+      return MVME_NO_MEM;
+    }
+    sim->thread_running = 1;
+  }
+
+  if (sim->tail)
+    sim->tail->next = req;
+  else
+    sim->head = req;
+  sim->tail = req;
+  pthread_cond_broadcast(&sim->cond);
+
+  pthread_mutex_unlock(&sim->mutex);
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_read_wait(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  MVMESIM *sim = (MVMESIM*)mvme->info;
+  int status;
+
+  pthread_mutex_lock(&sim->mutex);
+  while (req->status == MVME_PENDING)
+    pthread_cond_wait(&sim->cond, &sim->mutex);
+  status = req->status;
+  pthread_mutex_unlock(&sim->mutex);
+
+  return status;
+}
+
+/********************************************************************/
+int mvme_interrupt_generate(MVME_INTERFACE *mvme, int level, int vector, void *info)
+{
+  return MVME_UNSUPPORTED;
+}
+
+int mvme_interrupt_attach(MVME_INTERFACE *mvme, int level, int vector, void (*isr)(int, void*, void *), void *info)
+{
+  return MVME_UNSUPPORTED;
+}
+
+int mvme_interrupt_detach(MVME_INTERFACE *mvme, int level, int vector, void *info)
+{
+  return MVME_UNSUPPORTED;
+}
+
+int mvme_interrupt_enable(MVME_INTERFACE *mvme, int level, int vector, void *info)
+{
+  return MVME_UNSUPPORTED;
+}
+
+int mvme_interrupt_disable(MVME_INTERFACE *mvme, int level, int vector, void *info)
+{
+  return MVME_UNSUPPORTED;
+}
+
+/* end */
@@ -0,0 +1,64 @@
+/*********************************************************************
+
+  Name:         mvmesim.h
+
+  Contents:     Software VME interface simulating a crate of
+                CAEN V1720 and V1740 digitizers. Link mvmesim.o
+                instead of the hardware interface (gefvme.o, ...)
+                to run a frontend without a VME crate.
+
+                The crate can be set up with the functions below or,
+                without changing the frontend, with environment
+                variables read by mvme_open():
+
+                MVMESIM_BOARDS        "v1720:0x32100000,v1740:0x32200000"
+                MVMESIM_TRIGGER_HZ    external trigger rate per board (0)
+                MVMESIM_LATENCY_US    setup time of each DMA (28)
+                MVMESIM_BANDWIDTH_MBS DMA bandwidth, 0: depends on BLT mode
+                MVMESIM_PIO_US        time of a single cycle access (1)
+
+                Board data follow the CAEN event format: a 4 word
+                header (0xA0000000 | size, board id/pattern/mask,
+                event counter, trigger time tag), then for each
+                enabled channel (V1720) or group (V1740) its samples:
+
+                V1720: 2 samples per word, sample n in bits 0..11,
+                       sample n+1 in bits 16..27.
+                V1740: 12-bit samples packed LSB first, 8 samples of a
+                       channel in 3 words, in blocks of 8 samples:
+                       ch0 s0..7, ch1 s0..7, ..., ch7 s0..7, ch0 s8..15, ...
+
+                The number of samples per channel follows the buffer
+                organization register as on the real board.
+
+*********************************************************************/
+
+#ifndef MVMESIM_H
+#define MVMESIM_H
+
+#include "mvmestd.h"
+
+#define MVMESIM_V1720 1
+#define MVMESIM_V1740 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// add a board of type MVMESIM_V1720 or MVMESIM_V1740 at A32 base address, returns MVME_SUCCESS, MVME_INVALID_PARAM, MVME_NO_MEM
+int  mvmesim_add_board(MVME_INTERFACE *mvme, int type, mvme_addr_t base);
+
+/// set bus timing: DMA setup latency, DMA bandwidth (0: typical value of the BLT mode) and single cycle access time
+void mvmesim_set_timing(MVME_INTERFACE *mvme, double latency_us, double bandwidth_mbs, double pio_us);
+
+/// set external trigger rate of all boards, used when the external trigger is enabled
+void mvmesim_set_trigger_rate(MVME_INTERFACE *mvme, double rate_hz);
+
+/// number of bytes moved over the simulated bus and time the bus was busy, for throughput measurements
+void mvmesim_get_bus_stat(MVME_INTERFACE *mvme, double *bytes, double *busy_sec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MVMESIM_H
@@ -270,12 +270,13 @@ uint32_t v1720_DataRead(MVME_INTERFACE *mvme, uint32_t base, uint32_t *pdata, ui
         Presently the block mode seem to fail on the last bytes, work around
         is to read the last bytes through normal PIO. Caen has been
         contacted about this problem.
+    Returns MVME_SUCCESS or the status of the failed DMA, the rest of
+    the event is not read then.
  */
-void v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32)
+int v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32)
 {
   int i, to_read32, status;
   uint32_t w;
-  printf("--------------------- DataBlockRead() nwords32:%d\n", nwords32);
   if (nwords32 < 50) { // PIO
     for (i=0; i<nwords32; i++) {
       w = regRead(mvme, base, 0);
@@ -299,9 +300,9 @@ void v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32,
       to_read32 &= ~0x3;
       if (to_read32 <= 0)
         break;
-      printf("going to read: read %d, total %d\n", to_read32*4, nwords32*4);                
       status=mvme_read(mvme, pbuf32, base, to_read32*4);
-      printf("read %d, status %d, total %d\n", to_read32*4, status, nwords32*4);            
+      if (status != MVME_SUCCESS)
+        return status;
       nwords32 -= to_read32;
       pbuf32 += to_read32;
     }
@@ -312,6 +313,94 @@ void v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32,
       nwords32--;
     }
   }
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+/** v1720_DataBlockReadStart
+Queue the DMA of an event, split as in v1720_DataBlockRead(), and
+return without waiting for it. The readout of other boards can be
+started or the previous event processed before calling
+v1720_DataBlockReadWait(). pbuf32 and rd must stay valid until then.
+@param mvme vme structure
+@param base  base address
+@param pbuf32 Destination pointer
+@param nwords32 number of 32 bit words to read
+@param rd state of the read, owned by the caller
+@return MVME_SUCCESS
+*/
+int v1720_DataBlockReadStart(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32, V1720_BLOCK_READ* rd)
+{
+  int status, to_read32;
+
+  rd->nreq = 0;
+  rd->base = base;
+
+  if (nwords32 >= 50) {
+    mvme_set_dmode(mvme, MVME_DMODE_D32);
+    mvme_set_blt(mvme, MVME_BLT_2ESST);
+
+    while (nwords32>0 && rd->nreq < V1720_MAX_DMA_REQUEST) {
+      to_read32 = nwords32;
+      to_read32 &= ~0x3;
+      if (to_read32*4 >= 0xFF0)
+        to_read32 = 0xFF0/4;
+      else
+        to_read32 = nwords32 - 8;
+      to_read32 &= ~0x3;
+      if (to_read32 <= 0)
+        break;
+      rd->req[rd->nreq].dst      = pbuf32;
+      rd->req[rd->nreq].vme_addr = base;
+      rd->req[rd->nreq].n_bytes  = to_read32*4;
+      status = mvme_read_async(mvme, &rd->req[rd->nreq]);
+      if (status != MVME_SUCCESS)
+        break; // read by DataBlockReadWait()
+      rd->nreq++;
+      nwords32 -= to_read32;
+      pbuf32 += to_read32;
+    }
+  }
+
+  rd->pbuf32 = pbuf32;
+  rd->nwords32 = nwords32;
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+/** v1720_DataBlockReadWait
+Wait for the DMA queued by v1720_DataBlockReadStart() and read the
+rest of the event.
+@param mvme vme structure
+@param rd state of the read
+@return MVME_SUCCESS or the status of the first failed DMA
+*/
+int v1720_DataBlockReadWait(MVME_INTERFACE* mvme, V1720_BLOCK_READ* rd)
+{
+  int i, status, ret = MVME_SUCCESS;
+
+  for (i=0; i<rd->nreq; i++) {
+    status = mvme_read_wait(mvme, &rd->req[i]);
+    if (status != MVME_SUCCESS && ret == MVME_SUCCESS)
+      ret = status;
+  }
+  rd->nreq = 0;
+
+  /* words beyond the queued requests and the PIO tail */
+  if (rd->nwords32 >= 50) {
+    status = v1720_DataBlockRead(mvme, rd->base, rd->pbuf32, rd->nwords32);
+    if (status != MVME_SUCCESS && ret == MVME_SUCCESS)
+      ret = status;
+  } else
+    while (rd->nwords32) {
+      *rd->pbuf32 = regRead(mvme, rd->base, 0);
+      rd->pbuf32++;
+      rd->nwords32--;
+    }
+  rd->nwords32 = 0;
+
+  return ret;
 }
 
 #if 0
@@ -18,6 +18,17 @@
 
 #include "v1720.h"
 
+#define V1720_MAX_DMA_REQUEST 64
+
+/// state of a block read started by v1720_DataBlockReadStart()
+typedef struct {
+  MVME_REQUEST req[V1720_MAX_DMA_REQUEST];
+  int       nreq;
+  uint32_t  base;
+  uint32_t* pbuf32;   // words not covered by the queued DMA
+  int       nwords32;
+} V1720_BLOCK_READ;
+
 uint32_t v1720_RegisterRead(MVME_INTERFACE *mvme, uint32_t a32base, int offset);
 uint32_t v1720_BufferFreeRead(MVME_INTERFACE *mvme, uint32_t a32base);
 uint32_t v1720_BufferOccupancy(MVME_INTERFACE *mvme, uint32_t a32base, uint32_t channel);
@@ -34,7 +45,9 @@ void     v1720_Status(MVME_INTERFACE *mvme, uint32_t a32base);
 int      v1720_Setup(MVME_INTERFACE *mvme, uint32_t a32base, int mode);
 void     v1720_info(MVME_INTERFACE *mvme, uint32_t a32base, int *nch, uint32_t *n32w);
 uint32_t v1720_DataRead(MVME_INTERFACE *mvme,uint32_t a32base, uint32_t *pdata, uint32_t n32w);
-void     v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base     , uint32_t* pbuf32, int nwords32);
+int      v1720_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base     , uint32_t* pbuf32, int nwords32);
+int      v1720_DataBlockReadStart(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32, V1720_BLOCK_READ* rd);
+int      v1720_DataBlockReadWait(MVME_INTERFACE* mvme, V1720_BLOCK_READ* rd);
 //uint32_t v1720_DataBlockRead(MVME_INTERFACE *mvme, uint32_t a32base, uint32_t *pdest, uint32_t *nentry);
 void     v1720_ChannelThresholdSet(MVME_INTERFACE *mvme, uint32_t base, uint32_t channel, uint32_t threshold);
 void     v1720_ChannelOUThresholdSet(MVME_INTERFACE *mvme, uint32_t base, uint32_t channel, uint32_t threshold);
@@ -274,6 +274,91 @@ void v1740_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base     , uint32_t* pbu
   }
 }
 
+/********************************************************************/
+/** v1740_DataBlockReadStart
+Queue the DMA of an event, split as in v1740_DataBlockRead(), and
+return without waiting for it. The readout of other boards can be
+started or the previous event processed before calling
+v1740_DataBlockReadWait(). pbuf32 and rd must stay valid until then.
+@param mvme vme structure
+@param base  base address
+@param pbuf32 Destination pointer
+@param nwords32 number of 32 bit words to read
+@param rd state of the read, owned by the caller
+@return MVME_SUCCESS
+*/
+int v1740_DataBlockReadStart(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32, V1740_BLOCK_READ* rd)
+{
+  int status, to_read32;
+
+  rd->nreq = 0;
+  rd->base = base;
+
+  if (nwords32 >= 100) {
+    mvme_set_dmode(mvme, MVME_DMODE_D32);
+    mvme_set_blt(mvme, MVME_BLT_2ESST);
+
+    while (nwords32>0 && rd->nreq < V1740_MAX_DMA_REQUEST) {
+      to_read32 = nwords32;
+      to_read32 &= ~0x3;
+      if (to_read32*4 >= 0xFF0)
+        to_read32 = 0xFF0/4;
+      else
+        to_read32 = nwords32 - 8;
+      to_read32 &= ~0x3;
+      if (to_read32 <= 0)
+        break;
+      rd->req[rd->nreq].dst      = pbuf32;
+      rd->req[rd->nreq].vme_addr = base;
+      rd->req[rd->nreq].n_bytes  = to_read32*4;
+      status = mvme_read_async(mvme, &rd->req[rd->nreq]);
+      if (status != MVME_SUCCESS)
+        break; // read by DataBlockReadWait()
+      rd->nreq++;
+      nwords32 -= to_read32;
+      pbuf32 += to_read32;
+    }
+  }
+
+  rd->pbuf32 = pbuf32;
+  rd->nwords32 = nwords32;
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+/** v1740_DataBlockReadWait
+Wait for the DMA queued by v1740_DataBlockReadStart() and read the
+rest of the event.
+@param mvme vme structure
+@param rd state of the read
+@return MVME_SUCCESS or the status of the first failed DMA
+*/
+int v1740_DataBlockReadWait(MVME_INTERFACE* mvme, V1740_BLOCK_READ* rd)
+{
+  int i, status, ret = MVME_SUCCESS;
+
+  for (i=0; i<rd->nreq; i++) {
+    status = mvme_read_wait(mvme, &rd->req[i]);
+    if (status != MVME_SUCCESS && ret == MVME_SUCCESS)
+      ret = status;
+  }
+  rd->nreq = 0;
+
+  /* words beyond the queued requests and the PIO tail */
+  if (rd->nwords32 >= 100)
+    v1740_DataBlockRead(mvme, rd->base, rd->pbuf32, rd->nwords32);
+  else
+    while (rd->nwords32) {
+      *rd->pbuf32 = regRead(mvme, rd->base, 0);
+      rd->pbuf32++;
+      rd->nwords32--;
+    }
+  rd->nwords32 = 0;
+
+  return ret;
+}
+
 #if 0
 /********************************************************************/
 /** v1740_DataBlockRead
@@ -18,6 +18,17 @@
 
 #include "v1740.h"
 
+#define V1740_MAX_DMA_REQUEST 64
+
+/// state of a block read started by v1740_DataBlockReadStart()
+typedef struct {
+  MVME_REQUEST req[V1740_MAX_DMA_REQUEST];
+  int       nreq;
+  uint32_t  base;
+  uint32_t* pbuf32;   // words not covered by the queued DMA
+  int       nwords32;
+} V1740_BLOCK_READ;
+
 uint32_t v1740_RegisterRead(MVME_INTERFACE *mvme, uint32_t a32base, int offset);
 uint32_t v1740_BufferFreeRead(MVME_INTERFACE *mvme, uint32_t a32base);
 uint32_t v1740_BufferOccupancy(MVME_INTERFACE *mvme, uint32_t a32base, uint32_t channel);
@@ -36,6 +47,8 @@ void     v1740_info(MVME_INTERFACE *mvme, uint32_t a32base, int *nch, uint32_t *
 uint32_t v1740_DataRead(MVME_INTERFACE *mvme,uint32_t a32base, uint32_t *pdata, uint32_t n32w);
 //PAA- replaced with KO from V1742 example
 void     v1740_DataBlockRead(MVME_INTERFACE* mvme, uint32_t base     , uint32_t* pbuf32, int nwords32);
+int      v1740_DataBlockReadStart(MVME_INTERFACE* mvme, uint32_t base, uint32_t* pbuf32, int nwords32, V1740_BLOCK_READ* rd);
+int      v1740_DataBlockReadWait(MVME_INTERFACE* mvme, V1740_BLOCK_READ* rd);
 void     v1740_GroupThresholdSet(MVME_INTERFACE *mvme, uint32_t base, uint32_t channel, uint32_t threshold);
 void     v1740_GroupDACSet(MVME_INTERFACE *mvme, uint32_t base, uint32_t channel, uint32_t dac);
 int      v1740_GroupDACGet(MVME_INTERFACE *mvme, uint32_t base, uint32_t channel, uint32_t *dac);
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include "gefvme.h"
 
@@ -41,6 +42,8 @@ typedef struct {
   int           valid;
 } VME_TABLE;
 
+static void gefvme_async_stop(MVME_INTERFACE *mvme);
+
 /********************************************************************/
 /**
 VME Memory map, uses the driver MVME_INTERFACE for storing the map information.
@@ -401,16 +404,23 @@ static int makeDmaPacket(vmeDmaPacket_t *pkt, int blt_mode, int am, uint32_t vme
   return MVME_SUCCESS;
 }
 
+/* the asynchronous DMA thread and synchronous mvme_read() use the same DMA channel */
+static pthread_mutex_t gefvme_dma_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int runDma(int channel, vmeDmaPacket_t *pkt)
 {
   char devnode[256];
   int status, fd, xerrno;
 
+  pthread_mutex_lock(&gefvme_dma_mutex);
+
   sprintf(devnode, "/dev/vme_dma%d", channel);
   fd = open(devnode, 0);
   if (fd < 0) {
-    fprintf(stderr,"gefvme::runDma: Cannot open VME device \'%s\', errno %d (%s)\n", devnode, errno, strerror(errno));
-    return -errno;
+    xerrno = errno;
+    pthread_mutex_unlock(&gefvme_dma_mutex);
+    fprintf(stderr,"gefvme::runDma: Cannot open VME device \'%s\', errno %d (%s)\n", devnode, xerrno, strerror(xerrno));
+    return -xerrno;
   }
 
   errno  = 0;
@@ -419,6 +429,8 @@ static int runDma(int channel, vmeDmaPacket_t *pkt)
 
   close(fd);
 
+  pthread_mutex_unlock(&gefvme_dma_mutex);
+
   if (status < 0)
     return -xerrno;
 
@@ -438,7 +450,7 @@ void  gefvme_set_dma_channel(int channel)
   gefvme_dma_channel = channel;
 }
 
-int gefvme_read_dma_multiple(MVME_INTERFACE *mvme, int nseg, void* dstaddr[], const mvme_addr_t vmeaddr[], int nbytes[])
+static int gefvme_read_dma_multiple_am(int blt_mode, int am, int nseg, void* dstaddr[], const mvme_addr_t vmeaddr[], int nbytes[])
 {
   int i;
   int xerrno;
@@ -446,8 +458,8 @@ int gefvme_read_dma_multiple(MVME_INTERFACE *mvme, int nseg, void* dstaddr[], co
   for (i=0; i<nseg; i++)
     {
       if (gefvme_dma_debug)
-         printf("packet %p+%d, blt %d, am 0x%x, vmeaddr 0x%x, dstaddr %p, nbytes %d\n",  pkt+i, (int)sizeof(vmeDmaPacket_t), mvme->blt_mode, mvme->am, vmeaddr[i], dstaddr[i], nbytes[i]);
-      makeDmaPacket(pkt+i, mvme->blt_mode, mvme->am, vmeaddr[i], dstaddr[i], nbytes[i]);
+         printf("packet %p+%d, blt %d, am 0x%x, vmeaddr 0x%x, dstaddr %p, nbytes %d\n",  pkt+i, (int)sizeof(vmeDmaPacket_t), blt_mode, am, vmeaddr[i], dstaddr[i], nbytes[i]);
+      makeDmaPacket(pkt+i, blt_mode, am, vmeaddr[i], dstaddr[i], nbytes[i]);
       pkt[i].pNextPacket = pkt+i+1;
     }
   pkt[nseg-1].pNextPacket = NULL;
@@ -467,6 +479,11 @@ int gefvme_read_dma_multiple(MVME_INTERFACE *mvme, int nseg, void* dstaddr[], co
   return MVME_SUCCESS;
 }
 
+int gefvme_read_dma_multiple(MVME_INTERFACE *mvme, int nseg, void* dstaddr[], const mvme_addr_t vmeaddr[], int nbytes[])
+{
+  return gefvme_read_dma_multiple_am(mvme->blt_mode, mvme->am, nseg, dstaddr, vmeaddr, nbytes);
+}
+
 /********************************************************************/
 /**
 Open a VME channel
@@ -584,6 +601,9 @@ int mvme_close(MVME_INTERFACE *mvme)
   //DMA_INFO  *info;
   
   table = ((VME_TABLE *)mvme->table);
+
+  /* finish queued DMA */
+  gefvme_async_stop(mvme);
   
   /*------------------------------------------------------------*/
   /* Close all the window handles */
@@ -616,15 +636,28 @@ int mvme_sysreset(MVME_INTERFACE *mvme)
   return MVME_SUCCESS;
 }
 
-int gefvme_read_dma(MVME_INTERFACE *mvme, void *dst, mvme_addr_t vme_addr, int n_bytes)
+static void gefvme_swap32(void *dst, int n_bytes)
 {
   int i;
+  char* ptr = (char*)dst;
+  for (i=0; i<n_bytes; i+=4) {
+    char tmp;
+    tmp = ptr[i+0];
+    ptr[i+0] = ptr[i+3];
+    ptr[i+3] = tmp;
+    tmp = ptr[i+1];
+    ptr[i+1] = ptr[i+2];
+    ptr[i+2] = tmp;
+  }
+}
+
+static int gefvme_read_dma_am(int blt_mode, int am, void *dst, mvme_addr_t vme_addr, int n_bytes)
+{
   vmeDmaPacket_t vmeDma;
-  char* ptr;
   int xerrno;
   int bytesRead;
 
-  makeDmaPacket(&vmeDma, mvme->blt_mode, mvme->am, vme_addr, dst, n_bytes);
+  makeDmaPacket(&vmeDma, blt_mode, am, vme_addr, dst, n_bytes);
   xerrno = runDma(gefvme_dma_channel, &vmeDma);
 
   if (0)
@@ -684,21 +717,17 @@ int gefvme_read_dma(MVME_INTERFACE *mvme, void *dst, mvme_addr_t vme_addr, int n
     }
   
   if (1) {
-     ptr = (char*)dst;
-     for (i=0; i<n_bytes; i+=4) {
-        char tmp;
-        tmp = ptr[i+0];
-        ptr[i+0] = ptr[i+3];
-        ptr[i+3] = tmp;
-        tmp = ptr[i+1];
-        ptr[i+1] = ptr[i+2];
-        ptr[i+2] = tmp;
-     }
+     gefvme_swap32(dst, n_bytes);
   }
     
   return MVME_SUCCESS;
 }
 
+int gefvme_read_dma(MVME_INTERFACE *mvme, void *dst, mvme_addr_t vme_addr, int n_bytes)
+{
+  return gefvme_read_dma_am(mvme->blt_mode, mvme->am, dst, vme_addr, n_bytes);
+}
+
 /********************************************************************/
 /**
 Read from VME bus. Uses MVME_BLT_BLT32 for enabling the DMA
@@ -1063,6 +1092,179 @@ int mvme_get_blt(MVME_INTERFACE *mvme, int *mode)
   return MVME_SUCCESS;
 }
 
+/********************************************************************/
+/*
+Asynchronous DMA: requests are queued to a thread which runs them
+as chained DMA, up to GEFVME_MAX_CHAIN consecutive requests with the
+same transfer mode in one VME_IOCTL_START_DMA.
+*/
+
+#define GEFVME_MAX_CHAIN 16
+
+typedef struct {
+  pthread_t       thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;  // new request queued, request completed or exit
+  MVME_REQUEST   *head;  // oldest queued request, still queued while its DMA runs
+  MVME_REQUEST   *tail;
+  int             exit;
+} GEFVME_ASYNC;
+
+static int gefvme_read_dma_chain(MVME_REQUEST *req[], int nreq)
+{
+  int i, status;
+  void*       dst[GEFVME_MAX_CHAIN];
+  mvme_addr_t vme_addr[GEFVME_MAX_CHAIN];
+  int         n_bytes[GEFVME_MAX_CHAIN];
+
+  for (i=0; i<nreq; i++) {
+    dst[i]      = req[i]->dst;
+    vme_addr[i] = req[i]->vme_addr;
+    n_bytes[i]  = req[i]->n_bytes;
+  }
+
+  status = gefvme_read_dma_multiple_am(req[0]->blt_mode, req[0]->am, nreq, dst, vme_addr, n_bytes);
+  if (status != MVME_SUCCESS)
+    return status;
+
+  for (i=0; i<nreq; i++)
+    gefvme_swap32(req[i]->dst, req[i]->n_bytes);
+
+  return MVME_SUCCESS;
+}
+
+static void* gefvme_async_thread(void *arg)
+{
+  GEFVME_ASYNC *async = (GEFVME_ASYNC*)arg;
+  MVME_REQUEST *chain[GEFVME_MAX_CHAIN];
+  MVME_REQUEST *req;
+  int i, nreq, status;
+
+  pthread_mutex_lock(&async->mutex);
+
+  while (1) {
+    while (!async->head && !async->exit)
+      pthread_cond_wait(&async->cond, &async->mutex);
+
+    if (!async->head)
+      break;
+
+    /* collect consecutive requests with the same transfer mode */
+    nreq = 0;
+    for (req = async->head; req && nreq < GEFVME_MAX_CHAIN; req = (MVME_REQUEST*)req->next) {
+      if (nreq > 0 && (req->am != chain[0]->am || req->blt_mode != chain[0]->blt_mode))
+        break;
+      chain[nreq++] = req;
+    }
+
+    pthread_mutex_unlock(&async->mutex);
+
+    if (nreq == 1)
+      status = gefvme_read_dma_am(chain[0]->blt_mode, chain[0]->am, chain[0]->dst, chain[0]->vme_addr, chain[0]->n_bytes);
+    else
+      status = gefvme_read_dma_chain(chain, nreq);
+
+    pthread_mutex_lock(&async->mutex);
+
+    for (i=0; i<nreq; i++) {
+      async->head = (MVME_REQUEST*)chain[i]->next;
+      chain[i]->next = NULL;
+      chain[i]->n_done = (status == MVME_SUCCESS) ? chain[i]->n_bytes : 0;
+      chain[i]->status = status;
+    }
+    if (!async->head)
+      async->tail = NULL;
+
+    pthread_cond_broadcast(&async->cond);
+  }
+
+  pthread_mutex_unlock(&async->mutex);
+
+  return NULL;
+}
+
+/********************************************************************/
+int mvme_read_async(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  GEFVME_ASYNC *async = (GEFVME_ASYNC*)mvme->info;
+
+  if (!req || !req->dst || req->n_bytes == 0)
+    return MVME_INVALID_PARAM;
+
+  if (!async) {
+    async = (GEFVME_ASYNC*) calloc(1, sizeof(GEFVME_ASYNC));
+    if (!async)
+      return MVME_NO_MEM;
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->cond, NULL);
+    int status = pthread_create(&async->thread, NULL, gefvme_async_thread, async);
+    if (status != 0) {
+      fprintf(stderr,"mvme_read_async: Cannot create DMA thread, error %d (%s)\n", status, strerror(status));
+      free(async);
+      return MVME_NO_MEM;
+    }
+    mvme->info = async;
+  }
+
+  req->am       = mvme->am;
+  req->dmode    = mvme->dmode;
+  req->blt_mode = mvme->blt_mode;
+  if (req->blt_mode == 0)
+    req->blt_mode = MVME_BLT_NONE; // single cycle DMA
+  req->n_done   = 0;
+  req->status   = MVME_PENDING;
+  req->next     = NULL;
+
+  pthread_mutex_lock(&async->mutex);
+  if (async->tail)
+    async->tail->next = req;
+  else
+    async->head = req;
+  async->tail = req;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->mutex);
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_read_wait(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  GEFVME_ASYNC *async = (GEFVME_ASYNC*)mvme->info;
+  int status;
+
+  if (!async)
+    return req->status;
+
+  pthread_mutex_lock(&async->mutex);
+  while (req->status == MVME_PENDING)
+    pthread_cond_wait(&async->cond, &async->mutex);
+  status = req->status;
+  pthread_mutex_unlock(&async->mutex);
+
+  return status;
+}
+
+static void gefvme_async_stop(MVME_INTERFACE *mvme)
+{
+  GEFVME_ASYNC *async = (GEFVME_ASYNC*)mvme->info;
+
+  if (!async)
+    return;
+
+  /* queued requests are completed before the thread exits */
+  pthread_mutex_lock(&async->mutex);
+  async->exit = 1;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->mutex);
+
+  pthread_join(async->thread, NULL);
+  pthread_cond_destroy(&async->cond);
+  pthread_mutex_destroy(&async->mutex);
+  free(async);
+  mvme->info = NULL;
+}
+
 /********************************************************************/
 int mvme_interrupt_generate(MVME_INTERFACE *mvme, int level, int vector, void *info)
 {
@@ -492,6 +492,37 @@ int mvme_get_blt(MVME_INTERFACE *mvme, int *mode)
   return MVME_SUCCESS;
 }
 
+/********************************************************************/
+/**
+Queue a block read. The universe DMA buffer is shared, so the
+read is done right away and the request is complete on return.
+@param *mvme VME structure
+@param *req  request
+@return MVME_SUCCESS, MVME_INVALID_PARAM
+*/
+int mvme_read_async(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  if (!req || !req->dst)
+    return MVME_INVALID_PARAM;
+
+  req->am       = mvme->am;
+  req->dmode    = mvme->dmode;
+  req->blt_mode = mvme->blt_mode;
+
+  req->status = mvme_read(mvme, req->dst, req->vme_addr, req->n_bytes);
+  if (req->status != MVME_SUCCESS)
+    req->status = MVME_ACCESS_ERROR;
+  req->n_done = (req->status == MVME_SUCCESS) ? req->n_bytes : 0;
+
+  return MVME_SUCCESS;
+}
+
+/********************************************************************/
+int mvme_read_wait(MVME_INTERFACE *mvme, MVME_REQUEST *req)
+{
+  return req->status;
+}
+
 /********************************************************************/
 /*
 static void myisr(int sig, siginfo_t * siginfo, void *extra)
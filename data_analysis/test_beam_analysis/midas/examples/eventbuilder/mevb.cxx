@@ -87,6 +87,7 @@ extern INT md_event_swap(INT fmt, void * pevt);
 Events sent = DOUBLE : 0\n\
 Events per sec. = DOUBLE : 0\n\
 kBytes per sec. = DOUBLE : 0\n\
+Readback time = DOUBLE : 0\n\
 "
 static int waiting_for_stop = FALSE;
 
@@ -181,6 +182,7 @@ INT register_equipment(void)
       eq_stats->events_sent = 0;
       eq_stats->events_per_sec = 0;
       eq_stats->kbytes_per_sec = 0;
+      eq_stats->readback_time = 0;
 
       /* open hot link to statistics tree */
       status = db_open_record(hDB, hKey, eq_stats, sizeof(EQUIPMENT_STATS), MODE_WRITE, NULL, NULL);
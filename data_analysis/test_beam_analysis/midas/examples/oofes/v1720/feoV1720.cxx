@@ -47,6 +47,21 @@ off portions of code which make use of the driver to the actual hardware.
 Where data acquisition should be performed, we generate random data instead
 (see v1720CONET2::ReadEvent()). See usage below to use real hardware.
 
+## Processing
+
+Events are read by a readout thread. With "Worker threads" > 0 in
+/Equipment/<name>/Settings/Processing, each raw event is passed to one
+of the worker threads (round robin), which extracts the waveform
+features of each channel and writes compact FTxx/ZSxx banks, with or
+without the raw W2xx banks (see v1720Features.hxx). Each worker has its
+own event ring buffer, mfe sends the events in serial number order.
+Processing statistics are reported at the end of each run.
+
+By default there are no worker threads and the raw data is written
+unchanged. Dropping the raw banks ("Keep raw" = n) must be requested
+explicitly. v1720_bench measures data volume and CPU time per event of
+the processing settings on recorded run files.
+
 The simulation code assumes the following setup:
 - 1 frontend only
 - Arbitrary number of v1720 modules
@@ -98,13 +113,17 @@ $Id: feov1720.cxx 128 2011-05-12 06:26:34Z alex $
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sched.h>
 #include <sys/resource.h>
 
 #include <vector>
+#include <atomic>
 using std::vector;
 
 #include "midas.h"
+#include "msystem.h"
+#include "mfe.h"
 
 extern "C" {
 #include "CAENComm.h"
@@ -112,6 +131,7 @@ extern "C" {
 }
 
 #include "v1720CONET2.hxx"
+#include "v1720Features.hxx"
 
 // __________________________________________________________________
 // --- General feov1720 parameters
@@ -135,6 +155,8 @@ extern "C" {
 
 #define UNUSED(x) ((void)(x)) //!< Suppress compiler warnings
 
+#define MAX_WORKERS 16        //!< Maximum number of processing threads
+
 // __________________________________________________________________
 // --- MIDAS global variables
 extern HNDLE hDB;   //!< main ODB handle
@@ -143,17 +165,12 @@ extern BOOL debug;  //!< debug printouts
 BOOL debugpolling = false;  //!< debug msgs polling loop
 BOOL debugtrigger = false;  //!< debug msgs read trigger event
 
-/* make frontend functions callable from the C framework */
-#ifdef __cplusplus
-extern "C" {
-#endif
-
 /*-- Globals -------------------------------------------------------*/
 
 //! The frontend name (client name) as seen by other MIDAS clients
-char *frontend_name = (char*)FE_NAME;
+const char *frontend_name = FE_NAME;
 //! The frontend file name, don't change it
-char *frontend_file_name = (char*)__FILE__;
+const char *frontend_file_name = __FILE__;
 //! frontend_loop is called periodically if this variable is TRUE
 BOOL frontend_call_loop = FALSE;
 //! a frontend status page is displayed with this frequency in ms
@@ -164,8 +181,10 @@ INT max_event_size = 32 * 34000;
 INT max_event_size_frag = 5 * 1024 * 1024;
 //! buffer size to hold events
 INT event_buffer_size = 200 * max_event_size + 10000;
+//! overwrite equipment common settings in ODB
+BOOL equipment_common_overwrite = FALSE;
 
-bool runInProgress = false; //!< run is in progress
+std::atomic<bool> runInProgress(false); //!< run is in progress, see readout_thread() for end_of_run()
 bool runOver = false; //!< run is over
 bool runStopRequested = false; //!< stop run requested
 
@@ -183,11 +202,13 @@ extern void interrupt_routine(void);  //!< Interrupt Service Routine
 
 INT read_trigger_event(char *pevent, INT off);
 INT read_scaler_event(char *pevent, INT off); //!< Placeholder
+INT readout_thread(void *param);
+INT worker_thread(void *param);
+bool workers_idle();
 
 // __________________________________________________________________
 /*-- Equipment list ------------------------------------------------*/
-#undef USE_INT
-//! Main structure for midas equipment
+//! Main structure for midas equipment, events come from the readout thread
 EQUIPMENT equipment[] =
 {
   {
@@ -196,11 +217,7 @@ EQUIPMENT equipment[] =
     {
       EQ_EVID, EQ_TRGMSK,     /* event ID, trigger mask */
       "SYSTEM",               /* event buffer */
-# ifdef USE_INT
-      EQ_INTERRUPT,           /* equipment type */
-# else
-      EQ_POLLED,              /* equipment type */
-# endif //USE_INT
+      EQ_USER,                /* equipment type */
 
 #else
     "FEv1720I%0d",            /* equipment name */
@@ -210,12 +227,7 @@ EQUIPMENT equipment[] =
       //      //to different buffers
       //      "BUF%0d",               /* event buffer */
       "SYSTEM",               /* event buffer */
-
-# ifdef USE_INT
-      EQ_INTERRUPT,           /* equipment type */
-# else
-      EQ_POLLED | EQ_EB,      /* equipment type */
-# endif //USE_INT
+      EQ_USER | EQ_EB,        /* equipment type */
 
 #endif //SIMULATION
 
@@ -229,18 +241,26 @@ EQUIPMENT equipment[] =
       0,                      /* don't log history */
       "", "", ""
     },
-    read_trigger_event,       /* readout routine */
+    NULL,                     /* readout routine, see readout_thread() */
   },
   {""}
 };
 
-#ifdef __cplusplus
-}
-#endif
-
 vector<v1720CONET2> ov1720; //!< objects for the v1720 modules controlled by this frontend
 vector<v1720CONET2>::iterator itv1720;  //!< iterator
 
+V1720_PROCESSING_SETTINGS processing;   //!< processing settings
+HNDLE hProcessing = 0;                  //!< ODB key of the processing settings
+int nWorkers = 0;                       //!< number of worker threads
+int workerRbh[MAX_WORKERS];             //!< ring buffers of raw events for the workers
+std::atomic<int> readoutBusy(0);        //!< readout thread is reading an event
+
+//! Processing statistics of a worker, reset at begin of run
+//! Written by the worker only
+struct WORKER_STATS {
+  std::atomic<double> events, bytes_in, bytes_out, cpu_sec;
+} workerStats[MAX_WORKERS];
+
 
 /********************************************************************/
 /********************************************************************/
@@ -284,6 +304,36 @@ INT frontend_init(){
   // --- Suppress watchdog for PICe for now
   cm_set_watchdog_params(FALSE, 0);
 
+  // --- Processing settings, the number of workers is used at startup only
+  char str[256];
+  sprintf(str, "/Equipment/%s/Settings/Processing", equipment[0].name);
+  db_create_record(hDB, 0, str, strcomb1(v1720_processing_str).c_str());
+  db_find_key(hDB, 0, str, &hProcessing);
+  int size = sizeof(processing);
+  if (db_get_record(hDB, hProcessing, &processing, &size, 0) != DB_SUCCESS) {
+    cm_msg(MERROR, "feov1720", "Cannot read %s, processing disabled", str);
+    processing.nworkers = 0;
+  }
+  nWorkers = processing.nworkers;
+  if (nWorkers < 0)
+    nWorkers = 0;
+  if (nWorkers > MAX_WORKERS)
+    nWorkers = MAX_WORKERS;
+
+  // --- Readout thread and worker threads. Without workers the readout
+  // thread writes into the event ring buffer directly. Threads are started
+  // before the main thread is locked to one core below.
+  if (nWorkers == 0) {
+    create_event_rb(0);
+  } else {
+    for (int i=0; i < nWorkers; i++) {
+      create_event_rb(i);
+      rb_create(20 * max_event_size, max_event_size, &workerRbh[i]);
+      ss_thread_create(worker_thread, (void*)(POINTER_T)i);
+    }
+  }
+  ss_thread_create(readout_thread, NULL);
+
 #if SIMULATION
   for (int iBoard=0; iBoard < Nv1720; iBoard++)
   {
@@ -475,6 +525,17 @@ INT begin_of_run(INT run_number, char *error){
   printf("<<< Begin of begin_of_run\n");
 
   CAENComm_ErrorCode sCAEN = CAENComm_Success;
+
+  // Processing settings may change from run to run, except the number of workers
+  int size = sizeof(processing);
+  db_get_record(hDB, hProcessing, &processing, &size, 0);
+  for (int i=0; i < MAX_WORKERS; i++) {
+    workerStats[i].events = 0;
+    workerStats[i].bytes_in = 0;
+    workerStats[i].bytes_out = 0;
+    workerStats[i].cpu_sec = 0;
+  }
+
   //we've decided to only initialize at start of frontend
   //if odb stuff is changed, will need to restart fe to take effect.
 
@@ -513,6 +574,18 @@ INT end_of_run(INT run_number, char *error){
   set_equipment_status(equipment[0].name, "Ending run...", "#FFFF00");
 
   printf("<<< Beging of end_of_run \n");
+
+  // Stop the readout thread first and wait until it has finished the event
+  // it is reading, the boards must not be accessed from both threads
+  runOver = false;
+  runStopRequested = false;
+  runInProgress = false;
+  DWORD start = ss_millitime();
+  while (readoutBusy && ss_millitime() - start < 10000)
+    ss_sleep(1);
+  if (readoutBusy)
+    cm_msg(MERROR, "feov1720:EOR", "Timeout waiting for the readout thread");
+
   // Stop run
   CAENComm_ErrorCode sCAEN = CAENComm_Success;
 
@@ -522,9 +595,25 @@ INT end_of_run(INT run_number, char *error){
     }
   }
 
-  runOver = false;
-  runStopRequested = false;
-  runInProgress = false;
+  // Let the workers finish the events read so far, mfe sends them after end_of_run
+  start = ss_millitime();
+  while (!workers_idle() && ss_millitime() - start < 10000)
+    ss_sleep(1);
+  if (!workers_idle())
+    cm_msg(MERROR, "feov1720:EOR", "Timeout waiting for the processing threads");
+
+  if (nWorkers > 0) {
+    double events = 0, bytes_in = 0, bytes_out = 0, cpu_sec = 0;
+    for (int i=0; i < nWorkers; i++) {
+      events += workerStats[i].events;
+      bytes_in += workerStats[i].bytes_in;
+      bytes_out += workerStats[i].bytes_out;
+      cpu_sec += workerStats[i].cpu_sec;
+    }
+    if (events > 0)
+      cm_msg(MINFO, "feov1720:EOR", "Processed %.0f events: %.1f MB raw, %.1f MB sent (%.1f%%), %.1f us CPU per event",
+             events, bytes_in/1e6, bytes_out/1e6, bytes_in > 0 ? 100*bytes_out/bytes_in : 0, 1e6*cpu_sec/events);
+  }
 
 #if SIMULATION
   sCAEN = ov1720[0].Poll(&buffLvl);
@@ -588,7 +677,7 @@ INT frontend_loop()
 
   if (runStopRequested && !runOver) {
     db_set_value(hDB,0,"/logger/channels/0/Settings/Event limit", &evlimit, sizeof(evlimit), 1, TID_DWORD);
-    if (cm_transition(TR_STOP, 0, str, sizeof(str), ASYNC, FALSE) != CM_SUCCESS) {
+    if (cm_transition(TR_STOP, 0, str, sizeof(str), TR_ASYNC, FALSE) != CM_SUCCESS) {
       cm_msg(MERROR, "feov1720", "cannot stop run: %s", str);
     }
     runInProgress = false;
@@ -616,7 +705,7 @@ int Ncount; //!< Loop count for event polling timeout
  * \return  1 if event is available, 0 if done polling (no event).
  * If test equals TRUE, don't return.
  */
-extern "C" INT poll_event(INT source, INT count, BOOL test)
+INT poll_event(INT source, INT count, BOOL test)
 {
   register int i;  // , mod=-1;
   register DWORD lam;
@@ -660,7 +749,7 @@ extern "C" INT poll_event(INT source, INT count, BOOL test)
  *
  * \return  Midas status code
  */
-extern "C" INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
+INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
 {
   switch (cmd) {
   case CMD_INTERRUPT_ENABLE:
@@ -734,11 +823,13 @@ INT read_trigger_event(char *pevent, INT off) {
     else{
       sprintf(bankName, "W2%02d", module);
     }
-    bk_create(pevent, bankName, TID_DWORD, &pdata);
+    bk_create(pevent, bankName, TID_DWORD, (void **)&pdata);
 
     //read event into bank
     int dwords_read = 0;
     sCAEN = itv1720->ReadEvent(pdata, &dwords_read);
+    DWORD evCounter = dwords_read >= 4 ? pdata[2] & 0xFFFFFF : 0;
+    DWORD triggerTime = dwords_read >= 4 ? pdata[3] : 0;
 
     // >>> close data bank
     bk_close(pevent, pdata + dwords_read);
@@ -752,7 +843,7 @@ INT read_trigger_event(char *pevent, INT off) {
 
     // >>> Statistical bank for data throughput analysis
     sprintf(statBankName, "ST%02d", module);
-    bk_create(pevent, statBankName, TID_DWORD, &pdata);
+    bk_create(pevent, statBankName, TID_DWORD, (void **)&pdata);
     *pdata++ = module;
     *pdata++ = eStored;
     *pdata++ = eSizeTot;
@@ -760,6 +851,8 @@ INT read_trigger_event(char *pevent, INT off) {
     gettimeofday(&tv,0);
     *pdata++ = usStart;
     *pdata++ = tv.tv_usec;
+    *pdata++ = evCounter;    // kept here for events without the raw bank
+    *pdata++ = triggerTime;
     bk_close(pevent, pdata);
 
   }
@@ -769,3 +862,146 @@ INT read_trigger_event(char *pevent, INT off) {
 
   return bk_size(pevent);
 }
+
+/**
+ * \brief   Get buffer space in a ring buffer
+ *
+ * Wait for space, return false if the frontend is shutting down.
+ */
+static bool get_write_pointer(int rbh, EVENT_HEADER **pevent)
+{
+  while (1) {
+    int status = rb_get_wp(rbh, (void **)pevent, 0);
+    if (status == DB_SUCCESS)
+      return true;
+    if (status != DB_TIMEOUT || !is_readout_thread_enabled())
+      return false;
+    ss_sleep(1);
+  }
+}
+
+/**
+ * \brief   Readout thread
+ *
+ * Polls the modules and reads each event with read_trigger_event(), into
+ * the event ring buffer if there are no workers, otherwise into the raw
+ * ring buffer of worker (serial number % number of workers).
+ *
+ * \param   [in]  param unused
+ * \return  0
+ */
+INT readout_thread(void *param)
+{
+  UNUSED(param);
+  signal_readout_thread_active(0, TRUE);
+  ss_thread_set_name(std::string(equipment[0].name) + "RO");
+
+  while (is_readout_thread_enabled()) {
+
+    // busy before the run state is checked: end_of_run() clears
+    // runInProgress, then waits until readoutBusy is 0, so once it
+    // stops the boards this thread does not access them any more
+    readoutBusy = 1;
+    if (!readout_enabled() || !runInProgress) {
+      readoutBusy = 0;
+      ss_sleep(10);
+      continue;
+    }
+
+    if (!poll_event(0, 100, FALSE)) {
+      readoutBusy = 0;
+      continue;
+    }
+
+    DWORD serial = equipment[0].serial_number;
+    int rbh = nWorkers ? workerRbh[serial % nWorkers] : get_event_rbh(0);
+
+    EVENT_HEADER *pevent;
+    if (!get_write_pointer(rbh, &pevent)) {
+      readoutBusy = 0;
+      break;
+    }
+
+    bm_compose_event_threadsafe(pevent, EQ_EVID, EQ_TRGMSK, 0, &equipment[0].serial_number);
+    pevent->data_size = read_trigger_event((char *)(pevent + 1), 0);
+
+    if (pevent->data_size > 0) {
+      rb_increment_wp(rbh, sizeof(EVENT_HEADER) + pevent->data_size);
+      if (nWorkers == 0)
+        mfe_wakeup();
+    } else
+      equipment[0].serial_number--;
+    readoutBusy = 0;
+  }
+
+  signal_readout_thread_active(0, FALSE);
+  return 0;
+}
+
+/**
+ * \brief   Processing thread
+ *
+ * Takes raw events from its ring buffer, extracts the waveform features
+ * (see v1720ProcessEvent()) and puts the processed event into its event
+ * ring buffer for mfe to send.
+ *
+ * \param   [in]  param worker index
+ * \return  0
+ */
+INT worker_thread(void *param)
+{
+  int index = (int)(POINTER_T)param;
+  int rbhIn = workerRbh[index];
+  int rbhOut = get_event_rbh(index);
+  std::vector<int16_t> scratch;
+  WORKER_STATS &stats = workerStats[index];
+
+  signal_readout_thread_active(index + 1, TRUE);
+  ss_thread_set_name(std::string(equipment[0].name) + "W" + std::to_string(index));
+
+  while (is_readout_thread_enabled()) {
+    EVENT_HEADER *pin, *pout;
+
+    if (rb_get_rp(rbhIn, (void **)&pin, 10) != DB_SUCCESS)
+      continue;
+
+    if (!get_write_pointer(rbhOut, &pout))
+      break;
+
+    timespec t0, t1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    v1720ProcessEvent(processing, pin, pout, scratch);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+    stats.events = stats.events + 1;
+    stats.bytes_in = stats.bytes_in + sizeof(EVENT_HEADER) + pin->data_size;
+    stats.bytes_out = stats.bytes_out + sizeof(EVENT_HEADER) + pout->data_size;
+    stats.cpu_sec = stats.cpu_sec + (t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec);
+
+    rb_increment_wp(rbhOut, sizeof(EVENT_HEADER) + pout->data_size);
+    rb_increment_rp(rbhIn, sizeof(EVENT_HEADER) + pin->data_size);
+    mfe_wakeup();
+  }
+
+  signal_readout_thread_active(index + 1, FALSE);
+  return 0;
+}
+
+/**
+ * \brief   Check for events in the processing pipeline
+ *
+ * \return  true if the readout thread is not reading and all raw events
+ * have been processed
+ */
+bool workers_idle()
+{
+  if (readoutBusy)
+    return false;
+  for (int i=0; i < nWorkers; i++) {
+    int n = 0;
+    rb_get_buffer_level(workerRbh[i], &n);
+    if (n > 0)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,215 @@
+/*****************************************************************************/
+/**
+\file v1720Features.cxx
+
+## Contents
+
+Feature extraction and zero suppression of v1720 waveforms, run by the
+worker threads of feoV1720 between readout and sending of the event.
+See v1720Features.hxx for the bank formats.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "v1720Features.hxx"
+#include "caen_unpack.h"
+
+//! ODB record of V1720_PROCESSING_SETTINGS
+const char *v1720_processing_str[] = {\
+    "Worker threads = INT : 0",\
+    "Features = BOOL : y",\
+    "Zero suppression = BOOL : y",\
+    "Keep raw = BOOL : y",\
+    "Polarity = INT : -1",\
+    "Baseline samples = INT : 16",\
+    "Threshold = FLOAT : 20",\
+    "Pre samples = INT : 16",\
+    "Post samples = INT : 48",\
+    NULL
+};
+
+/**
+ * \brief   Extract the features of one channel
+ *
+ * \param   [in]  settings  processing settings
+ * \param   [in]  samples   waveform
+ * \param   [in]  nsamples  number of samples
+ * \param   [out] f         features
+ */
+void v1720ExtractFeatures(const V1720_PROCESSING_SETTINGS &settings,
+                          const int16_t *samples, int nsamples, V1720_FEATURES *f)
+{
+  memset(f, 0, sizeof(*f));
+  if (nsamples <= 0)
+    return;
+
+  // >>> baseline and pedestal RMS from the start of the waveform
+  int nbase = settings.baseline_samples;
+  if (nbase < 1)
+    nbase = 1;
+  if (nbase > nsamples)
+    nbase = nsamples;
+  int64_t sum = 0, sum2 = 0;
+  for (int i=0; i<nbase; i++) {
+    sum += samples[i];
+    sum2 += samples[i]*samples[i];
+  }
+  double baseline = (double)sum/nbase;
+  double var = (double)sum2/nbase - baseline*baseline;
+  f->baseline = baseline;
+  f->rms = var > 0 ? sqrt(var) : 0;
+
+  // >>> peak and total charge in one pass, integer arithmetic
+  int polarity = settings.polarity < 0 ? -1 : 1;
+  int64_t total = 0;
+  int peak = 0;
+  int extreme = samples[0];
+  if (polarity < 0) {
+    for (int i=0; i<nsamples; i++) {
+      total += samples[i];
+      if (samples[i] < extreme) {
+        extreme = samples[i];
+        peak = i;
+      }
+    }
+  } else {
+    for (int i=0; i<nsamples; i++) {
+      total += samples[i];
+      if (samples[i] > extreme) {
+        extreme = samples[i];
+        peak = i;
+      }
+    }
+  }
+  f->peak_time = peak;
+  f->peak_height = polarity*(extreme - baseline);
+  f->charge = polarity*(total - nsamples*baseline);
+
+  // >>> window around the peak
+  int first = peak - settings.pre_samples;
+  int last = peak + settings.post_samples;
+  if (first < 0)
+    first = 0;
+  if (last > nsamples - 1)
+    last = nsamples - 1;
+  int64_t wsum = 0;
+  for (int i=first; i<=last; i++)
+    wsum += samples[i];
+  f->window_first = first;
+  f->window_size = last - first + 1;
+  f->charge_window = polarity*(wsum - f->window_size*baseline);
+}
+
+/**
+ * \brief   Copy a bank into the output event
+ */
+static void copyBank(EVENT_HEADER *pout, const BANK32 *pbk)
+{
+  char name[5];
+  memcpy(name, pbk->name, 4);
+  name[4] = 0;
+  char *pdata;
+  bk_create(pout + 1, name, pbk->type, (void **)&pdata);
+  memcpy(pdata, pbk + 1, pbk->data_size);
+  bk_close(pout + 1, pdata + pbk->data_size);
+}
+
+/**
+ * \brief   Process one event
+ *
+ * Decode the W2xx banks of the input event and write the feature and
+ * zero-suppressed banks of each module into the output event. Raw banks
+ * which cannot be decoded (e.g. ZLE data) are copied unchanged.
+ *
+ * \param   [in]  settings  processing settings
+ * \param   [in]  pin       raw event from the readout thread
+ * \param   [out] pout      processed event, header copied from pin
+ * \param   [in]  scratch   decoding buffer, kept by the caller between events
+ * \return  data size of the output event
+ */
+int v1720ProcessEvent(const V1720_PROCESSING_SETTINGS &settings,
+                      const EVENT_HEADER *pin, EVENT_HEADER *pout,
+                      std::vector<int16_t> &scratch)
+{
+  *pout = *pin;
+  bk_init32(pout + 1);
+
+  BANK32 *pbk = NULL;
+  DWORD *pdata;
+  while (bk_iterate32(pin + 1, &pbk, &pdata), pbk != NULL) {
+
+    if (strncmp(pbk->name, "W2", 2) != 0) {
+      copyBank(pout, pbk);
+      continue;
+    }
+
+    // >>> decode the board data
+    CAEN_EVENT ev;
+    size_t nwords = pbk->data_size/4;
+    int status = caen_unpack_header(CAEN_V1720, pdata, nwords, &ev);
+    if (status == CAEN_SUCCESS) {
+      size_t n = (size_t)ev.nchannels*ev.nsamples;
+      if (scratch.size() < n)
+        scratch.resize(n);
+      status = caen_unpack(CAEN_V1720, pdata, nwords, &ev, scratch.data(), scratch.size());
+    }
+    if (status != CAEN_SUCCESS) {
+      copyBank(pout, pbk);
+      continue;
+    }
+
+    if (settings.keep_raw)
+      copyBank(pout, pbk);
+
+    V1720_FEATURES f[CAEN_MAX_CHANNELS];
+    bool zs[CAEN_MAX_CHANNELS];
+    for (int i=0; i<ev.nchannels; i++) {
+      v1720ExtractFeatures(settings, scratch.data() + i*ev.nsamples, ev.nsamples, &f[i]);
+      zs[i] = settings.zero_suppression && f[i].peak_height > settings.threshold;
+    }
+
+    char name[5];
+    if (settings.features) {
+      float *pf;
+      snprintf(name, sizeof(name), "FT%.2s", pbk->name + 2);
+      bk_create(pout + 1, name, TID_FLOAT, (void **)&pf);
+      for (int i=0; i<ev.nchannels; i++) {
+        *pf++ = ev.channel[i];
+        *pf++ = f[i].baseline;
+        *pf++ = f[i].rms;
+        *pf++ = f[i].peak_time;
+        *pf++ = f[i].peak_height;
+        *pf++ = f[i].charge;
+        *pf++ = f[i].charge_window;
+        *pf++ = zs[i] ? f[i].window_size : 0;
+      }
+      bk_close(pout + 1, pf);
+    }
+
+    if (settings.zero_suppression) {
+      DWORD *pz;
+      snprintf(name, sizeof(name), "ZS%.2s", pbk->name + 2);
+      bk_create(pout + 1, name, TID_DWORD, (void **)&pz);
+      for (int i=0; i<ev.nchannels; i++) {
+        if (!zs[i])
+          continue;
+        const int16_t *s = scratch.data() + i*ev.nsamples + f[i].window_first;
+        int n = f[i].window_size;
+        *pz++ = ev.channel[i];
+        *pz++ = f[i].window_first;
+        *pz++ = n;
+        // packed as in the raw data, 2 samples per word
+        for (int j=0; j+1<n; j+=2)
+          *pz++ = (uint16_t)s[j] | ((uint32_t)(uint16_t)s[j+1] << 16);
+        if (n & 1)
+          *pz++ = (uint16_t)s[n-1];
+      }
+      bk_close(pout + 1, pz);
+    }
+  }
+
+  pout->data_size = bk_size(pout + 1);
+  return pout->data_size;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************************/
+/**
+\file v1720Features.hxx
+
+## Contents
+
+Frontend-side processing of v1720 waveforms: baseline, pedestal RMS,
+peak time and height, charge integrals and an optional zero-suppressed
+window around the peak for each channel.
+
+### Banks written for each module (xx: module number)
+
+- FTxx (TID_FLOAT): V1720_FEATURE_WORDS values per enabled channel:
+  channel, baseline, pedestal RMS, peak time (samples), peak height,
+  charge (whole waveform), charge in the window, samples in ZSxx.
+  Peak height and charges are baseline subtracted, in ADC counts
+  (times samples for the charges), positive for pulses of the
+  configured polarity.
+- ZSxx (TID_DWORD): for each channel with a peak above threshold:
+  channel, first sample, number of samples n, then the n samples of
+  the window, 2 per word as in the raw data (sample in bits 0..11,
+  next sample in bits 16..27).
+- W2xx, the raw board data, is kept or dropped depending on the
+  settings. All other banks are copied unchanged.
+
+The window is [peak time - pre samples, peak time + post samples].
+ *****************************************************************************/
+
+#ifndef V1720FEATURES_HXX_INCLUDE
+#define V1720FEATURES_HXX_INCLUDE
+
+#include <stdint.h>
+#include <vector>
+
+#include "midas.h"
+
+#define V1720_FEATURE_WORDS 8 //!< floats per channel in the FTxx bank
+
+//! Processing settings, in /Equipment/<name>/Settings/Processing
+struct V1720_PROCESSING_SETTINGS {
+  INT       nworkers;           //!< worker threads, 0: no processing (read at frontend start)
+  BOOL      features;           //!< write FTxx banks
+  BOOL      zero_suppression;   //!< write ZSxx banks
+  BOOL      keep_raw;           //!< keep the W2xx banks
+  INT       polarity;           //!< -1: negative pulses, 1: positive pulses
+  INT       baseline_samples;   //!< samples at the start of the waveform used for the baseline
+  float     threshold;          //!< minimum peak height for a ZSxx window
+  INT       pre_samples;        //!< window start before the peak
+  INT       post_samples;       //!< window end after the peak
+};
+
+extern const char *v1720_processing_str[];
+
+//! Features of one channel
+struct V1720_FEATURES {
+  float     baseline;
+  float     rms;
+  int       peak_time;
+  float     peak_height;
+  float     charge;
+  float     charge_window;
+  int       window_first;       //!< first sample of the window
+  int       window_size;        //!< samples in the window
+};
+
+void v1720ExtractFeatures(const V1720_PROCESSING_SETTINGS &settings,
+                          const int16_t *samples, int nsamples, V1720_FEATURES *f);
+
+int v1720ProcessEvent(const V1720_PROCESSING_SETTINGS &settings,
+                      const EVENT_HEADER *pin, EVENT_HEADER *pout,
+                      std::vector<int16_t> &scratch);
+
+#endif // V1720FEATURES_HXX_INCLUDE
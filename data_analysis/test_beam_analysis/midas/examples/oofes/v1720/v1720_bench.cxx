@@ -0,0 +1,178 @@
+/*****************************************************************************/
+/**
+\file v1720_bench.cxx
+
+## Contents
+
+Offline benchmark of the feoV1720 processing: runs v1720ProcessEvent()
+over the events of recorded run files and reports, for several
+processing settings, the data volume written and the CPU time per
+event.
+
+## Usage
+
+    ./v1720_bench.exe [-n max events] [-t threshold] [-p polarity] run00123.mid[.gz] ...
+
+The events are read into memory first, so file reading is not part of
+the measurement. Files can be uncompressed or gzip compressed. Events
+without W2xx banks (e.g. begin/end of run ODB dumps) are skipped.
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include <vector>
+#include <string>
+
+#include "midas.h"
+#include "v1720Features.hxx"
+
+//! Events of one file with W2xx banks, in the order of the file
+static int readEvents(const char *filename, size_t maxEvents, std::vector<std::vector<char> > &events)
+{
+  gzFile f = gzopen(filename, "rb");
+  if (!f) {
+    printf("Cannot open %s\n", filename);
+    return -1;
+  }
+
+  int n = 0;
+  while (events.size() < maxEvents) {
+    EVENT_HEADER header;
+    if (gzread(f, &header, sizeof(header)) != (int)sizeof(header))
+      break;
+    if (header.data_size > 100*1024*1024) {
+      printf("%s: bad event size %u, stopping\n", filename, header.data_size);
+      break;
+    }
+
+    std::vector<char> event(sizeof(header) + header.data_size);
+    memcpy(event.data(), &header, sizeof(header));
+    if (gzread(f, event.data() + sizeof(header), header.data_size) != (int)header.data_size)
+      break;
+
+    // skip ODB dumps and other events without 32 bit banks
+    if ((header.event_id & 0xFFFF) >= 0x8000)
+      continue;
+    EVENT_HEADER *pevent = (EVENT_HEADER *)event.data();
+    if (!bk_is32(pevent + 1))
+      continue;
+
+    bool raw = false;
+    BANK32 *pbk = NULL;
+    DWORD *pdata;
+    while (bk_iterate32(pevent + 1, &pbk, &pdata), pbk != NULL)
+      if (strncmp(pbk->name, "W2", 2) == 0)
+        raw = true;
+    if (!raw)
+      continue;
+
+    events.push_back(event);
+    n++;
+  }
+
+  gzclose(f);
+  return n;
+}
+
+static double cpuTime()
+{
+  timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  V1720_PROCESSING_SETTINGS base;
+  memset(&base, 0, sizeof(base));
+  base.polarity = -1;
+  base.baseline_samples = 16;
+  base.threshold = 20;
+  base.pre_samples = 16;
+  base.post_samples = 48;
+
+  size_t maxEvents = 100000;
+  std::vector<const char *> files;
+
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      maxEvents = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      base.threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+      base.polarity = atoi(argv[++i]);
+    else if (argv[i][0] == '-') {
+      printf("Usage: v1720_bench.exe [-n max events] [-t threshold] [-p polarity] file.mid[.gz] ...\n");
+      return 1;
+    } else
+      files.push_back(argv[i]);
+  }
+
+  if (files.empty()) {
+    printf("Usage: v1720_bench.exe [-n max events] [-t threshold] [-p polarity] file.mid[.gz] ...\n");
+    return 1;
+  }
+
+  std::vector<std::vector<char> > events;
+  for (size_t i=0; i<files.size(); i++)
+    if (readEvents(files[i], maxEvents, events) < 0)
+      return 1;
+
+  if (events.empty()) {
+    printf("No events with W2xx banks found\n");
+    return 1;
+  }
+
+  double bytesIn = 0;
+  size_t maxSize = 0;
+  for (size_t i=0; i<events.size(); i++) {
+    bytesIn += events[i].size();
+    if (events[i].size() > maxSize)
+      maxSize = events[i].size();
+  }
+
+  printf("%d events, %.1f MB raw, threshold %.1f, polarity %d\n",
+         (int)events.size(), bytesIn/1e6, base.threshold, base.polarity);
+
+  // >>> settings as selectable in /Equipment/<name>/Settings/Processing
+  struct Config {
+    const char *name;
+    BOOL features, zero_suppression, keep_raw;
+  } configs[] = {
+    { "raw only",             FALSE, FALSE, TRUE  },
+    { "features + raw",       TRUE,  FALSE, TRUE  },
+    { "features + ZS + raw",  TRUE,  TRUE,  TRUE  },
+    { "features",             TRUE,  FALSE, FALSE },
+    { "features + ZS",        TRUE,  TRUE,  FALSE },
+  };
+
+  // output can be larger than the input when raw data is kept
+  std::vector<char> out(2*maxSize + 1024*1024);
+  std::vector<int16_t> scratch;
+
+  printf("%-22s %10s %10s %12s %12s\n", "settings", "MB out", "out/raw", "us/event", "MB/s raw");
+  for (size_t c=0; c<sizeof(configs)/sizeof(configs[0]); c++) {
+    V1720_PROCESSING_SETTINGS settings = base;
+    settings.features = configs[c].features;
+    settings.zero_suppression = configs[c].zero_suppression;
+    settings.keep_raw = configs[c].keep_raw;
+
+    double bytesOut = 0;
+    double t0 = cpuTime();
+    for (size_t i=0; i<events.size(); i++) {
+      EVENT_HEADER *pout = (EVENT_HEADER *)out.data();
+      v1720ProcessEvent(settings, (const EVENT_HEADER *)events[i].data(), pout, scratch);
+      bytesOut += sizeof(EVENT_HEADER) + pout->data_size;
+    }
+    double cpu = cpuTime() - t0;
+
+    printf("%-22s %10.1f %9.1f%% %12.2f %12.1f\n", configs[c].name, bytesOut/1e6,
+           100*bytesOut/bytesIn, 1e6*cpu/events.size(), cpu > 0 ? bytesIn/1e6/cpu : 0);
+  }
+
+  return 0;
+}
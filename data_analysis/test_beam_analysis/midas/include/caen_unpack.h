@@ -0,0 +1,98 @@
+/********************************************************************\
+
+  Name:         caen_unpack.h
+
+  Contents:     Decoding of CAEN digitizer event data, as stored in
+                the TID_DWORD banks written by the V1720/V1740
+                frontends, into channel-major int16 sample arrays.
+
+                Supported formats, after the 4 word event header:
+
+                CAEN_V1720: per enabled channel, 2 samples per word,
+                            sample n in bits 0..11, n+1 in bits 16..27
+                            (also V1724, V1730 with 14 bit samples)
+                CAEN_V1740: per enabled group, blocks of 8 samples
+                            of one channel packed LSB first in 3 words,
+                            ch0 s0..7, ch1 s0..7, ..., ch7 s0..7,
+                            ch0 s8..15, ...
+                CAEN_V1751: per enabled channel, 3 samples per word,
+                            sample n in bits 0..9, n+1 in bits 10..19,
+                            n+2 in bits 20..29
+
+                Zero-length-encoded (ZLE) events are not supported.
+
+\********************************************************************/
+
+#ifndef CAEN_UNPACK_H
+#define CAEN_UNPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAEN_V1720 1
+#define CAEN_V1740 2
+#define CAEN_V1751 3
+
+#define CAEN_MAX_CHANNELS 64
+
+/* return values of caen_unpack() */
+#define CAEN_SUCCESS       1
+#define CAEN_BAD_HEADER    2 // not a CAEN event header
+#define CAEN_BAD_SIZE      3 // event size does not match the bank or the channel mask
+#define CAEN_NO_SPACE      4 // output array too small
+#define CAEN_UNSUPPORTED   5 // unknown board type or ZLE event
+
+/* implementations for caen_unpack_select() */
+#define CAEN_UNPACK_AUTO   0
+#define CAEN_UNPACK_SCALAR 1
+#define CAEN_UNPACK_SSE    2 // SSSE3/SSE4.1
+#define CAEN_UNPACK_AVX2   3
+
+typedef struct {
+   uint32_t event_size;                   // words, including the header
+   uint32_t board_id;
+   uint32_t pattern;
+   uint32_t channel_mask;                 // enabled channels (V1720, V1751) or groups (V1740)
+   uint32_t event_counter;
+   uint32_t trigger_time_tag;
+   int      nchannels;                    // channels in the output
+   int      nsamples;                     // samples per channel
+   int      channel[CAEN_MAX_CHANNELS];   // board channel of each output row
+} CAEN_EVENT;
+
+/**
+Decode one event of a board. Samples of output row i (board channel
+event->channel[i]) are at samples[i*event->nsamples ...].
+@param board_type CAEN_V1720, CAEN_V1740 or CAEN_V1751
+@param data event data, starting with the event header
+@param nwords words in data, at least the event size
+@param event decoded header and channel list
+@param samples output array
+@param max_samples size of the output array
+@return CAEN_SUCCESS, CAEN_BAD_HEADER, CAEN_BAD_SIZE, CAEN_NO_SPACE, CAEN_UNSUPPORTED
+*/
+int caen_unpack(int board_type, const uint32_t* data, size_t nwords, CAEN_EVENT* event, int16_t* samples, size_t max_samples);
+
+/**
+Decode the header of an event to find the size of the output array
+(event->nchannels*event->nsamples) before calling caen_unpack().
+*/
+int caen_unpack_header(int board_type, const uint32_t* data, size_t nwords, CAEN_EVENT* event);
+
+/**
+Select the implementation used by caen_unpack(). CAEN_UNPACK_AUTO
+(the default) uses the fastest one supported by the CPU, others fall
+back to the next slower one if not supported.
+@return implementation in use
+*/
+int caen_unpack_select(int impl);
+
+#endif // CAEN_UNPACK_H
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
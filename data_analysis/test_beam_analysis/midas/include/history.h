@@ -100,6 +100,48 @@ class MidasHistoryBinnedBuffer: public MidasHistoryBufferInterface
    void Finish();
 };
 
+// Decimation of history data for plotting: for each of num_bins time bins
+// (i.e. pixels of the plot) keep only the first, last, minimum and maximum
+// data points (M4 aggregation). A line plot drawn through these points
+// is the same as one drawn through all the data.
+
+class MidasHistoryDecimatedBuffer: public MidasHistoryBufferInterface
+{
+ public:
+   int fNumBins = 0; // number of time bins, 0 means keep all data
+   time_t fFirstTime = 0;
+   time_t fLastTime  = 0;
+
+   int fNumEntries = 0; // number of data points seen
+
+ public: // decimated data, filled by Finish()
+   std::vector<time_t> fTime;
+   std::vector<double> fValue;
+
+ protected:
+   struct Bin {
+      int    count = 0;
+      time_t first_time = 0;
+      double first_value = 0;
+      time_t last_time = 0;
+      double last_value = 0;
+      time_t min_time = 0;
+      double min_value = 0;
+      time_t max_time = 0;
+      double max_value = 0;
+   };
+
+   std::vector<Bin> fBins;
+
+ public:
+   MidasHistoryDecimatedBuffer(time_t first_time, time_t last_time, int num_bins); // ctor
+   ~MidasHistoryDecimatedBuffer(); // dtor
+
+ public:
+   void Add(time_t t, double v);
+   void Finish();
+};
+
 // MIDAS history interface class
 
 class MidasHistoryInterface
@@ -127,6 +127,76 @@ Display format */
   INT EXPRT md_log_write(INT handle, INT data_fmt, INT type, void *prec, DWORD nbytes);
   INT EXPRT md_event_swap(INT data_fmt, void *pevent);
 //INT EXPRT md_event_get(INT data_fmt, void **pevent, DWORD * psize);
+
+/*---- event index -------------------------------------------------*/
+
+/*
+Optional sidecar file "<data file>.idx" written by mlogger next to a raw
+or LZ4 compressed data file ("Write index" channel setting):
+
+  MD_INDEX_HEADER
+  MD_INDEX_ENTRY[num_entries]      one per event, in file order
+  uint64_t block_offset[num_blocks] LZ4 files: file offset of each block
+  MD_INDEX_TRAILER                 written when the data file is closed
+
+LZ4 files with an index are written with independent blocks of block_size
+uncompressed bytes, so the event at uncompressed offset x can be read by
+decompressing block x/block_size and the ones following it.
+*/
+
+#include <vector>
+#include <map>
+#include <string>
+
+#define MD_INDEX_MAGIC       "MIDASIDX"
+#define MD_INDEX_END_MAGIC   "MIDASEND"
+#define MD_INDEX_VERSION     1
+#define MD_INDEX_RAW         0     /**< index of an uncompressed data file */
+#define MD_INDEX_LZ4         1     /**< index of an LZ4 data file */
+
+typedef struct {
+   char     magic[8];              /**< MD_INDEX_MAGIC */
+   DWORD    version;               /**< MD_INDEX_VERSION */
+   DWORD    entry_size;            /**< sizeof(MD_INDEX_ENTRY) */
+} MD_INDEX_HEADER;
+
+typedef struct {
+   DWORD    serial_number;
+   DWORD    time_stamp;
+   WORD     event_id;
+   WORD     trigger_mask;
+   DWORD    data_size;             /**< event size w/o header */
+   uint64_t offset;                /**< offset of the event header in the uncompressed data */
+} MD_INDEX_ENTRY;
+
+typedef struct {
+   uint64_t num_entries;
+   uint64_t num_blocks;
+   DWORD    compression;           /**< MD_INDEX_RAW or MD_INDEX_LZ4 */
+   DWORD    block_size;            /**< uncompressed size of the LZ4 blocks */
+   char     magic[8];              /**< MD_INDEX_END_MAGIC */
+} MD_INDEX_TRAILER;
+
+struct MD_INDEX {
+   std::vector<MD_INDEX_ENTRY> entries;
+   std::vector<uint64_t> blocks;   /**< file offset of each LZ4 block */
+   DWORD compression = MD_INDEX_RAW;
+   DWORD block_size = 0;
+   bool complete = false;          /**< trailer present, data file was closed */
+   std::map<WORD, std::vector<size_t> > by_event_id; /**< entries of each event ID */
+};
+
+struct MD_INDEX_FILE;
+
+  std::string EXPRT md_index_file_name(const char *data_file);
+  INT EXPRT md_index_load(const char *index_file, MD_INDEX *index);
+  size_t EXPRT md_index_find_time(const MD_INDEX *index, DWORD time_stamp);
+  size_t EXPRT md_index_find_serial(const MD_INDEX *index, WORD event_id, DWORD serial_number);
+  std::vector<size_t> EXPRT md_index_split(const MD_INDEX *index, int nparts);
+  INT EXPRT md_index_open(const char *data_file, const MD_INDEX *index, MD_INDEX_FILE **pfile);
+  INT EXPRT md_index_seek(MD_INDEX_FILE *file, size_t entry);
+  int EXPRT md_index_read(MD_INDEX_FILE *file, void *buf, int count);
+  void EXPRT md_index_close(MD_INDEX_FILE *file);
   
 /*------------ END --------------------------------------------------------------*/
 /**dox***************************************************************/
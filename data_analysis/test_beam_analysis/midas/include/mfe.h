@@ -68,6 +68,7 @@ extern DWORD auto_restart;           /* restart run after event limit reached st
 extern INT manual_trigger_event_id;  /* set from the manual_trigger callback */
 extern INT verbosity_level;          /* can be used by user code for debugging output */
 extern BOOL lockout_readout_thread;  /* manual triggers, periodic events and 1Hz flush cache lockout the readout thread */
+extern INT poll_backoff_max;         /* max. sleep in ms between polls of an idle EQ_POLLED equipment, 0 (default) for calibrated busy polling, set in frontend_init() */
 
 extern HNDLE hDB;
 extern HNDLE hClient;
@@ -106,6 +107,9 @@ int is_readout_thread_enabled(void);
 int is_readout_thread_active(void);
 void signal_readout_thread_active(int index, int flag);
 INT set_odb_equipment_common(EQUIPMENT eq[], const char *name);
+void mfe_wakeup(void);              /* wake up the scheduler, e.g. from an interrupt callback or user thread */
+INT mfe_add_poll_fd(int fd);        /* wake up the scheduler when fd becomes readable (Linux epoll) */
+INT mfe_remove_poll_fd(int fd);
 
 #endif
 
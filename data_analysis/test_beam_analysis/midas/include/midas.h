@@ -31,7 +31,8 @@ The main include file
  */
 
 /* has to be changed whenever binary ODB format changes */
-#define DATABASE_VERSION 3
+/* version 4: ODB lock is a reader/writer lock, see ss_rwlock_create() */
+#define DATABASE_VERSION 4
 
 /* MIDAS version number which will be incremented for every release */
 #define MIDAS_VERSION "2.1"
@@ -809,6 +810,11 @@ Slow control device driver commands */
 #define CMD_GET_DEMAND_DIRECT        CMD_GET_DIRECT+8
 #define CMD_GET_DIRECT_LAST          CMD_GET_DIRECT+8 /* update this if you add new commands ! */
 
+#define CMD_BULK_FIRST               CMD_GET_DIRECT_LAST+1 /* optional bulk commands, see DF_BULK_ACCESS */
+#define CMD_GET_ALL                  CMD_BULK_FIRST   // dd(CMD_GET_ALL, info, CMD_GET_xxx, float value[channels])
+#define CMD_SET_ALL                  CMD_BULK_FIRST+1 // dd(CMD_SET_ALL, info, CMD_SET_xxx, float value[channels]), NaN = unchanged
+#define CMD_BULK_LAST                CMD_BULK_FIRST+1 /* update this if you add new commands ! */
+
 #define CMD_ENABLE_COMMAND       (1<<14)  /* these two commands can be used to enable/disable */
 #define CMD_DISABLE_COMMAND      (1<<15)  /* one of the other commands                        */
 
@@ -947,7 +953,7 @@ typedef struct {
    INT max_request_index;             /**< index of last request      */
    INT num_received_events;           /**< no of received events      */
    INT num_sent_events;               /**< no of sent events          */
-   INT unused1;                       /**< was num_waiting_events     */
+   DWORD wakeup_time;                 /**< ss_microtime() of last wake-up message, was num_waiting_events */
    float unused2;                     /**< was data_rate              */
    BOOL read_wait;                    /**< wait for read - flag       */
    INT write_wait;                    /**< wait for write # bytes     */
@@ -974,6 +980,23 @@ typedef struct {
 
 } BUFFER_HEADER;
 
+/* Buffer manager latency histograms, see bm_enable_histograms() */
+
+#define BM_HISTOGRAM_BINS   32       /**< bin 0: value 0, bin i: 2^(i-1) <= value < 2^i, last bin includes overflow */
+
+#define BM_HISTO_LOCK_WAIT  0        /**< time to acquire the buffer lock, usec */
+#define BM_HISTO_SPACE_WAIT 1        /**< time a writer waited for free space, usec */
+#define BM_HISTO_WAKEUP     2        /**< wake-up message sent to waiting client running again, usec */
+#define BM_HISTO_COPY_BYTES 3        /**< bytes copied to or from the shared memory per buffer lock */
+#define BM_HISTO_MAX        4
+
+typedef struct {
+   DWORD bins[BM_HISTOGRAM_BINS];     /**< entries per bin            */
+   DWORD entries;                     /**< total number of entries    */
+   double sum;                        /**< sum of all values          */
+   DWORD max;                         /**< largest value              */
+} BM_HISTOGRAM;
+
 /* Per-process buffer access structure (descriptor) */
 
 /*
@@ -1027,6 +1050,8 @@ struct BUFFER
    double bytes_read = 0;             /**< count how many bytes we read */
    int client_count_write_wait[MAX_CLIENTS]; /**< per-client count_write_wait */
    DWORD client_time_write_wait[MAX_CLIENTS]; /**< per-client time_write_wait */
+   DWORD wait_start_usec = 0;         /**< ss_microtime() when we started the wait */
+   BM_HISTOGRAM histo[BM_HISTO_MAX];  /**< latency histograms, filled if enabled by bm_enable_histograms() */
 };
 
 typedef struct {
@@ -1067,6 +1092,7 @@ typedef struct {
 #define DF_QUICKSTART         (1<<11) //*< do not read channels initially during init to speed up startup */
 #define DF_POLL_DEMAND        (1<<12) //*< continously read demand value from device */
 #define DF_PRIORITY_READ      (1<<13) //*< read channel with priority after setting */
+#define DF_BULK_ACCESS        (1<<14) //*< driver implements CMD_GET_ALL/CMD_SET_ALL, read all channels at once */
 
 /** @addtogroup msectionh
  *  @{  */
@@ -1088,6 +1114,7 @@ typedef struct {
    midas_thread_t thread_id;          /**< Thread ID                         */
    INT status;                        /**< Status passed from device thread  */
    DD_MT_CHANNEL *channel;            /**< One data set for each channel     */
+   double readback_time;              /**< Time for last readout of all channels in ms */
 
 } DD_MT_BUFFER;
 
@@ -1144,6 +1171,7 @@ typedef struct {
    double events_sent;
    double events_per_sec;
    double kbytes_per_sec;
+   double readback_time;
 } EQUIPMENT_STATS;
 
 /** @} */
@@ -1152,6 +1180,7 @@ typedef struct {
 Events sent = DOUBLE : 0\n\
 Events per sec. = DOUBLE : 0\n\
 kBytes per sec. = DOUBLE : 0\n\
+Readback time = DOUBLE : 0\n\
 "
 
 typedef struct eqpmnt *PEQUIPMENT;
@@ -1272,6 +1301,7 @@ typedef struct {
    const char **init_str;             /**< Parameter init string             */
    BOOL enabled;                      /**< Enabled flag                      */
    void *histo_folder;
+   BOOL multithread;                  /**< Module may run in worker threads  */
 } ANA_MODULE;
 
 typedef struct {
@@ -1874,6 +1904,8 @@ flags for db_json_save() */
    INT EXPRT bm_empty_buffers(void);
    INT EXPRT bm_check_buffers(void);
    INT EXPRT bm_write_statistics_to_odb(void);
+   INT EXPRT bm_enable_histograms(BOOL enable);
+   INT EXPRT bm_get_histograms(INT buffer_handle, BM_HISTOGRAM histo[BM_HISTO_MAX]);
 
    /** @addtogroup odbfunctionc */
    /** @{ */
@@ -2058,6 +2090,8 @@ flags for db_json_save() */
 
    INT EXPRT rpc_send_event(INT buffer_handle, const EVENT_HEADER *event, int unused, INT async_flag, INT mode);
    INT EXPRT rpc_flush_event(void);
+   INT EXPRT rpc_set_event_compression(BOOL enable);
+   INT EXPRT rpc_set_event_streams(int n_streams, BOOL ordered);
 
    INT EXPRT rpc_send_event1(INT buffer_handle, const EVENT_HEADER *event);
    INT EXPRT rpc_send_event_sg(INT buffer_handle, int sg_n, const char* const sg_ptr[], const size_t sg_len[]);
@@ -2075,6 +2109,7 @@ flags for db_json_save() */
    DWORD EXPRT ss_millitime(void);
    DWORD EXPRT ss_time(void);
    double EXPRT ss_time_sec(void);
+   DWORD EXPRT ss_microtime(void);
    DWORD EXPRT ss_settime(DWORD seconds);
    void  EXPRT ss_tzset();
    time_t EXPRT ss_mktime(struct tm* tms);
@@ -2174,6 +2209,8 @@ flags for db_json_save() */
    void EXPRT test_register(ANA_TEST * t);
    void EXPRT add_data_dir(char *result, char *file);
    void EXPRT lock_histo(INT id);
+   INT EXPRT mana_thread_index(void);
+   INT EXPRT mana_thread_count(void);
 
    void EXPRT open_subfolder(const char *name);
    void EXPRT close_subfolder(void);
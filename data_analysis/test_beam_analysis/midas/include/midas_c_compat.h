@@ -19,6 +19,18 @@ python/midas/__init__.py.
 
  */
 
+/*
+One entry of the bank index filled by c_bk_index_banks(), see
+python/midas/fast_reader.py.
+ */
+typedef struct {
+   INT event;              // index of the event in the event list
+   char name[4];
+   DWORD type;             // TID_xxx
+   DWORD data_size;        // bytes
+   uint64_t offset;        // offset of the bank data in the buffer
+} C_BANK_INDEX;
+
 extern "C" {
    void c_free(void* mem);
    void c_free_list(void** mem_list, int arr_len);
@@ -30,6 +42,8 @@ extern "C" {
    INT c_al_trigger_alarm(const char *alarm_name, const char *alarm_message, const char *default_class, const char *cond_str, INT type);
    INT c_al_reset_alarm(const char *alarm_name);
    INT c_al_define_odb_alarm(const char *name, const char *condition, const char *aclass, const char *message);
+   INT c_bk_index_banks(const char* buf, uint64_t buf_size, const uint64_t* event_offsets, INT num_events, const char* bank_name, C_BANK_INDEX* banks, INT max_banks, INT* num_banks);
+   INT c_bk_index_events(const char* buf, uint64_t buf_size, EVENT_HEADER* headers, uint64_t* offsets, INT max_events, INT* num_events);
    INT c_bm_flush_cache(INT buffer_handle, INT async_flag);
    INT c_bm_open_buffer(const char *buffer_name, INT buffer_size, INT * buffer_handle);
    INT c_bm_receive_event(INT buffer_handle, void *destination, INT * buf_size, INT async_flag);
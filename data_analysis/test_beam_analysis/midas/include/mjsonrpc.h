@@ -17,11 +17,66 @@
 
 typedef MJsonNode* (mjsonrpc_handler_t)(const MJsonNode* params);
 
+///
+/// Streaming JSON writer for RPC replies with large data (ODB dumps, history arrays).
+///
+/// The JSON text is written into one growable buffer, in the same format
+/// as used by db_copy_json_xxx(), so ODB data can be appended to it
+/// directly and the buffer can be sent to the network as is,
+/// without building an MJsonNode tree.
+///
+/// To append ODB data:
+///
+///   int pos = w->Value();
+///   status = db_copy_json_save(hDB, hKey, &w->fBuf, &w->fSize, &w->fEnd);
+///   if (status != DB_SUCCESS) { w->Rewind(pos); w->Raw("null"); }
+///
+
+class MJsonStreamWriter
+{
+public:
+   char* fBuf = NULL; // NUL-terminated JSON text
+   int   fSize = 0;   // allocated size of fBuf
+   int   fEnd = 0;    // length of JSON text in fBuf
+
+public:
+   MJsonStreamWriter() {}; // ctor
+   ~MJsonStreamWriter(); // dtor
+   MJsonStreamWriter(const MJsonStreamWriter&) = delete; // not copyable
+   MJsonStreamWriter& operator=(const MJsonStreamWriter&) = delete;
+
+   void BeginObject();
+   void EndObject();
+   void BeginArray();
+   void EndArray();
+   void Key(const char* name); // name of next object member
+   void String(const char* s);
+   void Int(long long v);
+   void Number(double v);
+   void Bool(bool v);
+   void Null();
+   void JSON(const char* json); // already encoded JSON text
+   void Node(const MJsonNode* node);
+   int  Value(); // write separator before next value, return position after it
+   void Raw(const char* s); // write text without separator
+   void Rewind(int pos); // discard text after position pos
+   void Reset(); // discard everything
+
+protected:
+   std::vector<bool> fFirst; // for each open array or object: no element written yet
+   bool fAfterKey = false;
+};
+
+/// Streaming RPC handler: writes the "result" value into the stream and returns NULL,
+/// or returns a complete reply (error, documentation, etc) like mjsonrpc_handler_t
+typedef MJsonNode* (mjsonrpc_stream_handler_t)(const MJsonNode* params, MJsonStreamWriter* result);
+
 extern int mjsonrpc_debug;
 
 void mjsonrpc_init();
 void mjsonrpc_user_init();
 void mjsonrpc_add_handler(const char* method, mjsonrpc_handler_t *handler, bool needs_locking = false);
+void mjsonrpc_add_stream_handler(const char* method, mjsonrpc_stream_handler_t *handler, bool needs_locking = false);
 void mjsonrpc_exit();
 
 void mjsonrpc_set_std_mutex(void* mutex);
@@ -35,6 +90,8 @@ MJsonNode* mjsonrpc_make_result(const char* name, MJsonNode* value, const char*
 const MJsonNode* mjsonrpc_get_param(const MJsonNode* params, const char* name, MJsonNode** error);
 
 MJsonNode* mjsonrpc_decode_post_data(const char* post_data);
+// same, but replies of streaming handlers are written into "reply" and NULL is returned
+MJsonNode* mjsonrpc_decode_post_data(const char* post_data, MJsonStreamWriter* reply);
 
 ///
 /// MIDAS JSON Schema Objects for documenting RPC calls.
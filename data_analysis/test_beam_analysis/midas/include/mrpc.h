@@ -48,6 +48,7 @@ routine IDs for RPC calls
 #define RPC_BM_MARK_READ_WAITING        11112 /**< - */
 #define RPC_BM_EMPTY_BUFFERS            11113 /**< - */
 #define RPC_BM_SKIP_EVENT               11114 /**< - */
+#define RPC_BM_EVENT_STREAMS            11115 /**< - */
 
 #define RPC_DB_OPEN_DATABASE            11200 /**< - */
 #define RPC_DB_CLOSE_DATABASE           11201 /**< - */
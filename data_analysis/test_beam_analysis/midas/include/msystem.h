@@ -31,6 +31,7 @@ The Midas System include file
 #include "midasinc.h"
 #include <string> // std::string
 #include <mutex>  // std::mutex
+#include <vector> // std::vector
 
 /**dox***************************************************************/
 #endif                          /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -339,6 +340,8 @@ typedef struct rpc_server_connection_struct {
    std::mutex event_sock_mutex; /*  protect event socket against multithreaded access */
    INT remote_hw_type;          /*  remote hardware type    */
    INT rpc_timeout;             /*  in milliseconds         */
+   BOOL event_lz4;              /*  server accepts LZ4 event frames */
+   BOOL event_streams;          /*  server accepts event streams */
 
    void clear() {
       host_name = "";
@@ -349,6 +352,8 @@ typedef struct rpc_server_connection_struct {
       event_sock = 0;
       remote_hw_type = 0;
       rpc_timeout = 0;
+      event_lz4 = FALSE;
+      event_streams = FALSE;
    }
 } RPC_SERVER_CONNECTION;
 
@@ -368,6 +373,11 @@ typedef struct rpc_server_acception_struct {
    INT write_ptr=0, read_ptr=0, misalign=0;   /* pointers for cache */
    HNDLE odb_handle = 0;            /*  handle to online datab. */
    HNDLE client_handle = 0;         /*  client key handle .     */
+   void *lz4_dctx = NULL;           /*  LZ4 event frame decompression context */
+   char *lz4_buffer = NULL;         /*  decompressed events     */
+   size_t lz4_buffer_size = 0;
+   size_t lz4_wp = 0, lz4_rp = 0;   /*  pointers for decompressed events */
+   struct RPC_EVENT_STREAMS *event_streams = NULL; /*  event stream receivers */
 
    void clear() {
       prog_name = "";
@@ -387,6 +397,12 @@ typedef struct rpc_server_acception_struct {
       misalign = 0;
       odb_handle = 0;
       client_handle = 0;
+      lz4_dctx = NULL;
+      lz4_buffer = NULL;
+      lz4_buffer_size = 0;
+      lz4_wp = 0;
+      lz4_rp = 0;
+      event_streams = NULL;
    }
 
    void close();
@@ -445,8 +461,9 @@ typedef struct {
    INT client_index;            /* index to CLIENT str. in buf. */
    DATABASE_HEADER *database_header;    /* pointer to database header   */
    void *database_data;         /* pointer to database data     */
-   HNDLE semaphore;             /* semaphore handle             */
+   HNDLE semaphore;             /* reader/writer lock handle    */
    INT lock_cnt;                /* flag to avoid multiple locks */
+   BOOL lock_shared;            /* lock is held for reading only */
    void* shm_adr;               /* address of shared memory     */
    HNDLE shm_size;              /* size of shared memory        */
    HNDLE shm_handle;            /* handle (id) to shared memory */
@@ -456,6 +473,10 @@ typedef struct {
    MUTEX_T *mutex;              /* mutex for multi-thread access */
    INT timeout;                 /* timeout for mutex and semaphore */
    BOOL inside_lock_unlock;     /* protection against recursive call to db_lock/unlock */
+   unsigned char *dirty_pages;  /* pages written since last flush, NULL if none */
+   INT dirty_npages;            /* number of entries in dirty_pages */
+   BOOL dirty;                  /* any page is dirty            */
+   DWORD last_flush;            /* time of last flush by this process */
 
 } DATABASE;
 
@@ -528,6 +549,7 @@ typedef struct {
 
    /*---- online database ----*/
    INT EXPRT db_lock_database(HNDLE database_handle);
+   INT EXPRT db_lock_database_shared(HNDLE database_handle);
    INT EXPRT db_unlock_database(HNDLE database_handle);
    //INT EXPRT db_get_lock_cnt(HNDLE database_handle);
    INT EXPRT db_set_lock_timeout(HNDLE database_handle, int timeout_millisec);
@@ -574,7 +596,9 @@ typedef struct {
    /*---- system services ----*/
    INT ss_shm_open(const char *name, INT size, void **shm_adr, size_t *shm_size, HNDLE *handle, BOOL get_size);
    INT ss_shm_close(const char *name, void *shm_adr, size_t shm_size, HNDLE handle, INT destroy_flag);
-   INT ss_shm_flush(const char *name, const void *shm_adr, size_t shm_size, HNDLE handle, bool wait_for_thread);
+   INT ss_shm_flush(const char *name, const void *shm_adr, size_t shm_size, HNDLE handle, const unsigned char *dirty_pages, size_t page_size);
+   INT ss_shm_copy_dirty(const void *shm_adr, size_t shm_size, const unsigned char *dirty_pages, size_t page_size, std::vector<char> *copy);
+   INT ss_shm_flush_copy(const char *name, const void *shm_adr, size_t shm_size, const unsigned char *dirty_pages, size_t page_size, const std::vector<char> &copy);
    INT EXPRT ss_shm_delete(const char *name);
    INT ss_shm_protect(HNDLE handle, void *shm_adr, size_t shm_size);
    INT ss_shm_unprotect(HNDLE handle, void **shm_adr, size_t shm_size, BOOL read, BOOL write, const char* caller_name);
@@ -593,6 +617,12 @@ typedef struct {
    INT EXPRT ss_semaphore_wait_for(HNDLE semaphore_handle, INT timeout);
    INT EXPRT ss_semaphore_release(HNDLE semaphore_handle);
    INT EXPRT ss_semaphore_delete(HNDLE semaphore_handle, INT destroy_flag);
+   INT EXPRT ss_rwlock_create(const char *name, HNDLE * rwlock_handle);
+   INT EXPRT ss_rwlock_read_lock(HNDLE rwlock_handle, INT timeout);
+   INT EXPRT ss_rwlock_read_unlock(HNDLE rwlock_handle);
+   INT EXPRT ss_rwlock_write_lock(HNDLE rwlock_handle, INT timeout);
+   INT EXPRT ss_rwlock_write_unlock(HNDLE rwlock_handle);
+   INT EXPRT ss_rwlock_delete(HNDLE rwlock_handle, INT destroy_flag);
    INT EXPRT ss_mutex_create(MUTEX_T **mutex, BOOL recursive);
    INT EXPRT ss_mutex_wait_for(MUTEX_T *mutex, INT timeout);
    INT EXPRT ss_mutex_release(MUTEX_T *mutex);
@@ -643,6 +673,7 @@ typedef struct {
    /*---- mserver event socket ----*/
    bool ss_event_socket_has_data();
    int  rpc_flush_event_socket(int timeout_msec);
+   INT  rpc_server_event_streams(INT port, INT n_streams, BOOL ordered);
 
    /** @} */
 
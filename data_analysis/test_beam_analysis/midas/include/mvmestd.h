@@ -65,6 +65,7 @@ typedef unsigned int DWORD;
 #define MVME_INVALID_PARAM            5
 #define MVME_NO_MEM                   6
 #define MVME_ACCESS_ERROR             7
+#define MVME_PENDING                  8
 
 /*---- types -------------------------------------------------------*/
 
@@ -143,6 +144,19 @@ typedef struct {
    void *table;              /**< Optional table for some drivers */
 } MVME_INTERFACE;
 
+/*---- asynchronous block transfer request -------------------------*/
+typedef struct {
+   void         *dst;        /**< destination buffer, set by caller */
+   mvme_addr_t  vme_addr;    /**< source address (VME location), set by caller */
+   mvme_size_t  n_bytes;     /**< requested transfer size, set by caller */
+   mvme_size_t  n_done;      /**< bytes transferred, valid after completion */
+   int          status;      /**< MVME_PENDING until completed, then MVME_xxx */
+   int          am;          /**< address modifier, captured when queued */
+   int          dmode;       /**< data mode, captured when queued */
+   int          blt_mode;    /**< block transfer mode, captured when queued */
+   void         *next;       /**< internal use of the driver */
+} MVME_REQUEST;
+
 /*---- function declarations ---------------------------------------*/
 
 /* make functions callable from a C++ program */
@@ -328,6 +342,42 @@ Get current Data mode.
 @return MVME_SUCCESS
 */
   int EXPRT mvme_get_blt(MVME_INTERFACE *vme, int *mode);
+
+/********************************************************************/
+/**
+Queue a block read from VME bus.
+The transfer uses the address modifier, data mode and block transfer
+mode which are current at the time of the call, and completes in
+the order it was queued. Several reads can be queued before waiting
+for the first one, so the CPU can process data while the bus is busy.
+The request structure and the destination buffer are owned by the
+caller and have to stay valid until mvme_read_wait() returns.
+Interfaces without asynchronous DMA perform the read immediately.
+\code
+  MVME_REQUEST req[2];
+  req[0].dst = buf0; req[0].vme_addr = base0; req[0].n_bytes = n0;
+  req[1].dst = buf1; req[1].vme_addr = base1; req[1].n_bytes = n1;
+  mvme_set_blt(myvme, MVME_BLT_MBLT64);
+  mvme_read_async(myvme, &req[0]);
+  mvme_read_async(myvme, &req[1]);
+  ... // pack the previous event
+  status = mvme_read_wait(myvme, &req[1]); // req[0] is also complete
+\endcode
+@param *vme VME structure
+@param *req request with dst, vme_addr and n_bytes filled in
+@return MVME_SUCCESS, MVME_INVALID_PARAM, MVME_NO_MEM
+*/
+  int EXPRT mvme_read_async(MVME_INTERFACE *vme, MVME_REQUEST *req);
+
+/********************************************************************/
+/**
+Wait for completion of a block read queued by mvme_read_async().
+@param *vme VME structure
+@param *req request to wait for
+@return status of the transfer, MVME_SUCCESS, MVME_ACCESS_ERROR
+*/
+  int EXPRT mvme_read_wait(MVME_INTERFACE *vme, MVME_REQUEST *req);
+
   int EXPRT mvme_interrupt_generate(MVME_INTERFACE *mvme, int level, int vector, void *info);
   int EXPRT mvme_interrupt_attach(MVME_INTERFACE *mvme, int level, int vector,
                                   void (*isr)(int, void*, void *), void *info);
@@ -13,6 +13,7 @@
 #include <TObjArray.h>
 #include <TFolder.h>
 #include <TCutG.h>
+#include <TH1.h>
 
 /* root functions really are C++ functions */ extern TFolder *gManaHistosFolder;
 extern TObjArray *gHistoFolderStack;
@@ -167,4 +168,7 @@ TH2X EXPRT * h2_book(const char *name, const char *title,
 
 TCutG *cut_book(const char *name);
 
+/* per-thread instance of a histogram for modules running in worker threads */
+TH1 *mana_thread_histo(TH1 *h);
+
 #endif
@@ -0,0 +1,176 @@
+//
+// bm_latency_test: send events through an event buffer from one process
+// to another and print the buffer manager latency histograms of both
+// (see bm_enable_histograms()).
+//
+// Usage: bm_latency_test [-n events] [-s event size] [-c cache size] [-b buffer]
+//
+// A small buffer makes the writer wait for free space, a large write
+// cache makes it copy many events per buffer lock.
+//
+
+#undef NDEBUG // midas required assert() to be always enabled
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+
+#include "midas.h"
+#include "msystem.h"
+
+static void PrintHistograms(const char* who, HNDLE hbuf)
+{
+   static const char* const names[BM_HISTO_MAX] = { "lock wait, usec", "space wait, usec", "wakeup, usec", "copy, bytes" };
+   BM_HISTOGRAM histo[BM_HISTO_MAX];
+
+   int status = bm_get_histograms(hbuf, histo);
+   if (status != BM_SUCCESS) {
+      printf("%s: bm_get_histograms() status %d\n", who, status);
+      return;
+   }
+
+   for (int i=0; i<BM_HISTO_MAX; i++) {
+      const BM_HISTOGRAM* h = &histo[i];
+      printf("%s: %s: %u entries, mean %.1f, max %u\n", who, names[i], h->entries, h->entries ? h->sum/h->entries : 0.0, h->max);
+      for (int j=0; j<BM_HISTOGRAM_BINS; j++) {
+         if (h->bins[j] == 0)
+            continue;
+         double lo = j ? (double)(1u << (j - 1)) : 0;
+         double hi = j ? 2*lo : 1;
+         printf("   %10.0f..%-10.0f %10u\n", lo, hi, h->bins[j]);
+      }
+   }
+}
+
+static int Connect(const char* client_name, const char* buffer_name, int cache_size, HNDLE* phbuf)
+{
+   char host_name[256];
+   char expt_name[256];
+
+   cm_get_environment(host_name, sizeof(host_name), expt_name, sizeof(expt_name));
+
+   int status = cm_connect_experiment1(host_name, expt_name, client_name, 0, DEFAULT_ODB_SIZE, 0);
+   if (status != CM_SUCCESS)
+      return status;
+
+   cm_set_watchdog_params(0, 0);
+   bm_enable_histograms(TRUE);
+
+   status = bm_open_buffer(buffer_name, DEFAULT_BUFFER_SIZE, phbuf);
+   if (status != BM_SUCCESS && status != BM_CREATED)
+      return status;
+
+   bm_set_cache_size(*phbuf, 0, cache_size);
+
+   return BM_SUCCESS;
+}
+
+static int Reader(const char* buffer_name)
+{
+   HNDLE hbuf;
+   int status = Connect("bm_latency_test_r", buffer_name, 0, &hbuf);
+   if (status != BM_SUCCESS) {
+      printf("reader: cannot connect, status %d\n", status);
+      return 1;
+   }
+
+   int request_id;
+   bm_request_event(hbuf, EVENTID_ALL, TRIGGER_ALL, GET_ALL, &request_id, NULL);
+
+   std::vector<char> event;
+   int count = 0;
+
+   while (1) {
+      status = bm_receive_event_vec(hbuf, &event, 10000);
+      if (status != BM_SUCCESS) {
+         printf("reader: bm_receive_event_vec() status %d after %d events\n", status, count);
+         break;
+      }
+      const EVENT_HEADER* pevent = (const EVENT_HEADER*)event.data();
+      if (pevent->event_id == 2)
+         break;
+      count++;
+   }
+
+   printf("reader: received %d events\n", count);
+   PrintHistograms("reader", hbuf);
+
+   cm_disconnect_experiment();
+   return status == BM_SUCCESS ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+   setbuf(stdout, NULL);
+   setbuf(stderr, NULL);
+
+   int nevents = 100000;
+   int event_size = 1000;
+   int cache_size = 0;
+   const char* buffer_name = "BMTEST";
+
+   for (int i=1; i<argc; i++) {
+      if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+         nevents = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+         event_size = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+         cache_size = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-b") == 0 && i+1 < argc)
+         buffer_name = argv[++i];
+      else {
+         printf("Usage: bm_latency_test [-n events] [-s event size] [-c cache size] [-b buffer]\n");
+         return 1;
+      }
+   }
+
+   pid_t pid = fork();
+   if (pid == 0)
+      return Reader(buffer_name);
+
+   HNDLE hbuf;
+   int status = Connect("bm_latency_test_w", buffer_name, cache_size, &hbuf);
+   if (status != BM_SUCCESS) {
+      printf("writer: cannot connect, status %d\n", status);
+      return 1;
+   }
+
+   // give the reader time to request events
+   ss_sleep(1000);
+
+   std::vector<char> event(sizeof(EVENT_HEADER) + event_size);
+   EVENT_HEADER* pevent = (EVENT_HEADER*)event.data();
+
+   double t0 = ss_time_sec();
+
+   for (int i=0; i<=nevents; i++) {
+      bm_compose_event(pevent, i < nevents ? 1 : 2, 0, event_size, i);
+      status = bm_send_event_vec(hbuf, event, BM_WAIT);
+      assert(status == BM_SUCCESS);
+   }
+
+   bm_flush_cache(hbuf, BM_WAIT);
+
+   double t1 = ss_time_sec();
+   printf("writer: sent %d events of %d bytes in %.3f s, %.1f MB/s\n", nevents, event_size, t1 - t0, nevents*(double)event_size/1e6/(t1 - t0));
+   PrintHistograms("writer", hbuf);
+
+   int child_status = 0;
+   waitpid(pid, &child_status, 0);
+
+   cm_disconnect_experiment();
+
+   return child_status ? 1 : 0;
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,262 @@
+//
+// caen_unpack_test: check caen_unpack() against a reference encoder
+// on synthetic V1720, V1740 and V1751 events, with each implementation
+// supported by the CPU, then measure the decoding speed.
+//
+// Usage: caen_unpack_test [-q]   (-q: correctness only)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "caen_unpack.h"
+
+static uint32_t xseed = 2463534242u;
+
+static uint32_t xrand()
+{
+   xseed ^= xseed << 13;
+   xseed ^= xseed >> 17;
+   xseed ^= xseed << 5;
+   return xseed;
+}
+
+static double GetTimeSec()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + 0.000001*tv.tv_usec;
+}
+
+static const char* ImplName(int impl)
+{
+   switch (impl) {
+   case CAEN_UNPACK_SCALAR: return "scalar";
+   case CAEN_UNPACK_SSE: return "ssse3";
+   case CAEN_UNPACK_AVX2: return "avx2";
+   }
+   return "unknown";
+}
+
+static const char* BoardName(int type)
+{
+   switch (type) {
+   case CAEN_V1720: return "V1720";
+   case CAEN_V1740: return "V1740";
+   case CAEN_V1751: return "V1751";
+   }
+   return "unknown";
+}
+
+// reference encoder: random samples for each enabled channel, returns
+// the event data and the expected channel-major samples
+static void MakeEvent(int type, uint32_t mask, int nsamples, std::vector<uint32_t>* data, std::vector<int16_t>* samples)
+{
+   int bits = (type == CAEN_V1720) ? 14 : (type == CAEN_V1740) ? 12 : 10;
+   int ngroups = 0;
+   for (int i=0; i<8; i++)
+      if (mask & (1<<i))
+         ngroups++;
+   int nchannels = (type == CAEN_V1740) ? 8*ngroups : ngroups;
+
+   samples->resize(nchannels*nsamples);
+   for (size_t i=0; i<samples->size(); i++)
+      (*samples)[i] = xrand() & ((1<<bits)-1);
+
+   data->clear();
+   data->push_back(0);
+   data->push_back((5u<<27) | (0x1234<<8) | mask);
+   data->push_back(4711);
+   data->push_back(0x12345678);
+
+   const int16_t* s = samples->data();
+
+   if (type == CAEN_V1720) {
+      for (int ch=0; ch<nchannels; ch++, s+=nsamples)
+         for (int i=0; i<nsamples; i+=2)
+            data->push_back((uint16_t)s[i] | ((uint32_t)(uint16_t)s[i+1] << 16));
+   } else if (type == CAEN_V1751) {
+      for (int ch=0; ch<nchannels; ch++, s+=nsamples)
+         for (int i=0; i<nsamples; i+=3)
+            data->push_back(s[i] | (s[i+1] << 10) | (s[i+2] << 20));
+   } else {
+      for (int g=0; g<ngroups; g++, s+=8*nsamples)
+         for (int i=0; i<nsamples; i+=8)
+            for (int ch=0; ch<8; ch++) {
+               uint32_t w[3] = { 0, 0, 0 };
+               for (int j=0; j<8; j++) {
+                  uint32_t v = s[ch*nsamples + i + j];
+                  int bit = 12*j;
+                  w[bit/32] |= v << (bit%32);
+                  if (bit%32 > 20)
+                     w[bit/32 + 1] |= v >> (32 - bit%32);
+               }
+               data->push_back(w[0]);
+               data->push_back(w[1]);
+               data->push_back(w[2]);
+            }
+   }
+
+   (*data)[0] = 0xA0000000 | data->size();
+}
+
+static int CheckEvent(int type, uint32_t mask, int nsamples)
+{
+   std::vector<uint32_t> data;
+   std::vector<int16_t> expected;
+   MakeEvent(type, mask, nsamples, &data, &expected);
+
+   std::vector<int16_t> out(expected.size() + 16, -1);
+   CAEN_EVENT ev;
+
+   int status = caen_unpack(type, data.data(), data.size(), &ev, out.data(), out.size());
+   if (status != CAEN_SUCCESS) {
+      printf("%s mask 0x%02x nsamples %d: caen_unpack() status %d\n", BoardName(type), mask, nsamples, status);
+      return 1;
+   }
+
+   if (mask == 0)
+      nsamples = 0; // no channels, no samples
+
+   if ((size_t)ev.nchannels*ev.nsamples != expected.size() || ev.nsamples != nsamples || ev.channel_mask != mask ||
+       ev.board_id != 5 || ev.pattern != 0x1234 || ev.event_counter != 4711 || ev.trigger_time_tag != 0x12345678) {
+      printf("%s mask 0x%02x nsamples %d: bad header, nchannels %d, nsamples %d\n", BoardName(type), mask, nsamples, ev.nchannels, ev.nsamples);
+      return 1;
+   }
+
+   for (size_t i=0; i<expected.size(); i++)
+      if (out[i] != expected[i]) {
+         printf("%s mask 0x%02x nsamples %d: row %d sample %d is %d instead of %d\n", BoardName(type), mask, nsamples,
+                (int)(i/nsamples), (int)(i%nsamples), out[i], expected[i]);
+         return 1;
+      }
+
+   for (size_t i=expected.size(); i<out.size(); i++)
+      if (out[i] != -1) {
+         printf("%s mask 0x%02x nsamples %d: write past the end of the samples\n", BoardName(type), mask, nsamples);
+         return 1;
+      }
+
+   return 0;
+}
+
+static int CheckErrors()
+{
+   std::vector<uint32_t> data;
+   std::vector<int16_t> expected;
+   MakeEvent(CAEN_V1720, 0x3, 16, &data, &expected);
+
+   std::vector<int16_t> out(expected.size());
+   CAEN_EVENT ev;
+   int errors = 0;
+
+   if (caen_unpack(CAEN_V1720, data.data(), data.size() - 1, &ev, out.data(), out.size()) != CAEN_BAD_SIZE) {
+      printf("truncated bank not detected\n");
+      errors++;
+   }
+
+   if (caen_unpack(CAEN_V1720, data.data(), data.size(), &ev, out.data(), out.size() - 1) != CAEN_NO_SPACE) {
+      printf("short output array not detected\n");
+      errors++;
+   }
+
+   if (caen_unpack(CAEN_V1740, data.data(), data.size(), &ev, out.data(), out.size()) != CAEN_BAD_SIZE) {
+      printf("V1720 event decoded as V1740 not detected\n");
+      errors++;
+   }
+
+   data[1] |= (1<<24);
+   if (caen_unpack(CAEN_V1720, data.data(), data.size(), &ev, out.data(), out.size()) != CAEN_UNSUPPORTED) {
+      printf("ZLE event not detected\n");
+      errors++;
+   }
+
+   data[0] = 0x12345678;
+   if (caen_unpack(CAEN_V1720, data.data(), data.size(), &ev, out.data(), out.size()) != CAEN_BAD_HEADER) {
+      printf("bad header not detected\n");
+      errors++;
+   }
+
+   return errors;
+}
+
+static void Speed(int type, uint32_t mask, int nsamples)
+{
+   std::vector<uint32_t> data;
+   std::vector<int16_t> expected;
+   MakeEvent(type, mask, nsamples, &data, &expected);
+   std::vector<int16_t> out(expected.size());
+   CAEN_EVENT ev;
+
+   int n = 0;
+   double t0 = GetTimeSec();
+   double t1 = t0;
+   while (t1 - t0 < 0.5) {
+      for (int i=0; i<10; i++)
+         caen_unpack(type, data.data(), data.size(), &ev, out.data(), out.size());
+      n += 10;
+      t1 = GetTimeSec();
+   }
+
+   double mb = 4.0*data.size()*n/1e6;
+   printf("  %s %2d channels x %6d samples: %8.1f MB/s in, %8.1f Msamples/s\n", BoardName(type), ev.nchannels, nsamples,
+          mb/(t1 - t0), 1e-6*expected.size()*n/(t1 - t0));
+}
+
+int main(int argc, char* argv[])
+{
+   bool quiet = (argc > 1 && strcmp(argv[1], "-q") == 0);
+   int errors = 0;
+   int last = -1;
+
+   for (int impl=CAEN_UNPACK_SCALAR; impl<=CAEN_UNPACK_AVX2; impl++) {
+      int sel = caen_unpack_select(impl);
+      if (sel == last)
+         continue; // not supported by this CPU
+      last = sel;
+
+      int e = 0;
+      const uint32_t masks[] = { 0x00, 0x01, 0x80, 0x55, 0xFF };
+      for (uint32_t mask : masks) {
+         for (int nsamples = 0; nsamples <= 96; nsamples += 24) {
+            e += CheckEvent(CAEN_V1720, mask, nsamples);
+            e += CheckEvent(CAEN_V1740, mask, nsamples);
+            e += CheckEvent(CAEN_V1751, mask, nsamples);
+         }
+         // odd lengths for the loop tails
+         e += CheckEvent(CAEN_V1720, mask, 2*37);
+         e += CheckEvent(CAEN_V1751, mask, 3*37);
+         e += CheckEvent(CAEN_V1740, mask, 8*37);
+      }
+      for (int i=0; i<200; i++)
+         e += CheckEvent(1 + xrand()%3, xrand() & 0xFF, 24*(1 + xrand()%50));
+      e += CheckErrors();
+
+      printf("%s: %s\n", ImplName(sel), e ? "FAILED" : "ok");
+      errors += e;
+
+      if (!quiet) {
+         Speed(CAEN_V1720, 0xFF, 1024);
+         Speed(CAEN_V1720, 0xFF, 64*1024);
+         Speed(CAEN_V1740, 0xFF, 192);
+         Speed(CAEN_V1740, 0xFF, 12*1024);
+         Speed(CAEN_V1751, 0xFF, 3*1024);
+      }
+   }
+
+   caen_unpack_select(CAEN_UNPACK_AUTO);
+
+   return errors ? 1 : 0;
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
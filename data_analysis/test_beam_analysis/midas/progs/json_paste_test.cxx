@@ -0,0 +1,256 @@
+//
+// json_paste_test: check db_paste_json() and measure the ODB load time
+// of a large JSON document in "ODB save" format. The data is written
+// to /json_paste_test, which is deleted at the end.
+//
+// Usage: json_paste_test [-s MB]   (-s: size of the JSON document, default 5 MB)
+//
+// The ODB of the experiment must be large enough for the data, about
+// twice the size of the JSON document.
+//
+
+#undef NDEBUG // midas required assert() to be always enabled
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <string>
+
+#include "midas.h"
+#include "msystem.h"
+#include "mjson.h"
+
+static double GetTimeSec()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + 0.000001*tv.tv_usec;
+}
+
+// one directory of "ODB save" JSON: double, string and int arrays, scalars
+static void MakeDir(std::string* s, int dir, int nvalues)
+{
+   *s += msprintf("  \"Dir%05d\" : {\n", dir);
+   for (int v=0; v<4; v++) {
+      *s += msprintf("    \"Double%d/key\" : { \"type\" : 10, \"num_values\" : %d, \"access_mode\" : 7, \"last_written\" : 1700000000 },\n", v, nvalues);
+      *s += msprintf("    \"Double%d\" : [", v);
+      for (int i=0; i<nvalues; i++)
+         *s += msprintf("%s%.6f", i ? ", " : "", dir + v + i/1000.0);
+      *s += "],\n";
+      *s += msprintf("    \"Names%d/key\" : { \"type\" : 12, \"num_values\" : 16, \"item_size\" : 32 },\n", v);
+      *s += msprintf("    \"Names%d\" : [", v);
+      for (int i=0; i<16; i++)
+         *s += msprintf("%s\"name %d/%d\"", i ? ", " : "", dir, i);
+      *s += "],\n";
+      *s += msprintf("    \"Mask%d/key\" : { \"type\" : 6, \"num_values\" : %d },\n", v, nvalues/4);
+      *s += msprintf("    \"Mask%d\" : [", v);
+      for (int i=0; i<nvalues/4; i++)
+         *s += msprintf("%s\"0x%08x\"", i ? ", " : "", dir*1000 + i);
+      *s += "],\n";
+      *s += msprintf("    \"Enabled%d\" : %s,\n", v, (dir + v) % 2 ? "true" : "false");
+      *s += msprintf("    \"Count%d/key\" : { \"type\" : 7 },\n", v);
+      *s += msprintf("    \"Count%d\" : %d,\n", v, dir*10 + v);
+   }
+   *s += "    \"Comment\" : \"directory \\\"";
+   *s += msprintf("%d", dir);
+   *s += "\\\"\"\n  }";
+}
+
+static int Check(HNDLE hDB, HNDLE hKey, int ndirs, int nvalues)
+{
+   int errors = 0;
+
+   for (int dir=0; dir<ndirs; dir += ndirs/7 + 1) {
+      double d[3];
+      int size = sizeof(d);
+      std::string path = msprintf("Dir%05d/Double2", dir);
+      int status = db_get_value(hDB, hKey, path.c_str(), d, &size, TID_DOUBLE, FALSE);
+      if (status != DB_SUCCESS && status != DB_TRUNCATED) {
+         printf("%s: db_get_value() status %d\n", path.c_str(), status);
+         errors++;
+         continue;
+      }
+      KEY key;
+      HNDLE hSubkey;
+      db_find_key(hDB, hKey, path.c_str(), &hSubkey);
+      db_get_key(hDB, hSubkey, &key);
+      if (key.num_values != nvalues || d[0] != dir + 2 || d[1] != dir + 2 + 0.001) {
+         printf("%s: %d values %f %f\n", path.c_str(), key.num_values, d[0], d[1]);
+         errors++;
+      }
+
+      char name[32];
+      size = sizeof(name);
+      path = msprintf("Dir%05d/Names1[3]", dir);
+      db_get_value(hDB, hKey, path.c_str(), name, &size, TID_STRING, FALSE);
+      if (std::string(name) != msprintf("name %d/3", dir)) {
+         printf("%s: \"%s\"\n", path.c_str(), name);
+         errors++;
+      }
+
+      DWORD mask = 0;
+      size = sizeof(mask);
+      path = msprintf("Dir%05d/Mask3", dir);
+      db_get_value(hDB, hKey, path.c_str(), &mask, &size, TID_DWORD, FALSE);
+      if (mask != (DWORD)dir*1000) {
+         printf("%s: 0x%08x\n", path.c_str(), mask);
+         errors++;
+      }
+
+      BOOL enabled = 0;
+      size = sizeof(enabled);
+      path = msprintf("Dir%05d/Enabled1", dir);
+      db_get_value(hDB, hKey, path.c_str(), &enabled, &size, TID_BOOL, FALSE);
+      if (enabled != (BOOL)((dir + 1) % 2)) {
+         printf("%s: %d\n", path.c_str(), enabled);
+         errors++;
+      }
+
+      char comment[64];
+      size = sizeof(comment);
+      path = msprintf("Dir%05d/Comment", dir);
+      db_get_value(hDB, hKey, path.c_str(), comment, &size, TID_STRING, FALSE);
+      if (std::string(comment) != msprintf("directory \"%d\"", dir)) {
+         printf("%s: \"%s\"\n", path.c_str(), comment);
+         errors++;
+      }
+   }
+
+   return errors;
+}
+
+int main(int argc, char *argv[])
+{
+   setbuf(stdout, NULL);
+   setbuf(stderr, NULL);
+   int status = 0;
+   char host_name[256];
+   char expt_name[256];
+   host_name[0] = 0;
+   expt_name[0] = 0;
+   double mbytes = 5;
+
+   for (int i=1; i<argc; i++) {
+      if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+         mbytes = atof(argv[++i]);
+      else {
+         printf("Usage: json_paste_test [-s MB]\n");
+         return 1;
+      }
+   }
+
+   cm_get_environment(host_name, sizeof(host_name), expt_name, sizeof(expt_name));
+
+   status = cm_connect_experiment1(host_name, expt_name, "json_paste_test", 0, DEFAULT_ODB_SIZE, 0);
+   assert(status == CM_SUCCESS);
+
+   HNDLE hDB;
+   status = cm_get_experiment_database(&hDB, NULL);
+   assert(status == CM_SUCCESS);
+
+   cm_set_watchdog_params(0, 0);
+
+   // >>> make the JSON document, one directory is about 12 kB
+   const int nvalues = 200;
+   int ndirs = mbytes*1e6/12e3 + 1;
+   std::string json = "{\n";
+   for (int dir=0; dir<ndirs; dir++) {
+      if (dir > 0)
+         json += ",\n";
+      MakeDir(&json, dir, nvalues);
+   }
+   json += "\n}\n";
+   printf("JSON document: %d directories, %.1f MB\n", ndirs, json.size()/1e6);
+
+   int errors = 0;
+
+   // >>> leftovers of an interrupted test
+   HNDLE hKey;
+   if (db_find_key(hDB, 0, "/json_paste_test", &hKey) == DB_SUCCESS)
+      db_delete_key(hDB, hKey, FALSE);
+
+   // >>> paste into an empty tree, then again over the existing keys
+   for (int pass=0; pass<2; pass++) {
+      db_create_key(hDB, 0, "/json_paste_test", TID_KEY);
+      status = db_find_key(hDB, 0, "/json_paste_test", &hKey);
+      assert(status == DB_SUCCESS);
+
+      double t0 = GetTimeSec();
+      status = db_paste_json(hDB, hKey, json.c_str());
+      double t1 = GetTimeSec();
+
+      if (status != DB_SUCCESS) {
+         printf("db_paste_json() status %d, is the ODB large enough?\n", status);
+         errors++;
+         break;
+      }
+
+      errors += Check(hDB, hKey, ndirs, nvalues);
+      printf("db_paste_json() %s: %.3f s, %.1f MB/s\n", pass ? "existing keys" : "new keys", t1 - t0, json.size()/1e6/(t1 - t0));
+   }
+
+   // >>> same document from a file
+   std::string filename = msprintf("/tmp/json_paste_test_%d.json", ss_getpid());
+   FILE* fp = fopen(filename.c_str(), "w");
+   if (fp) {
+      fwrite(json.data(), 1, json.size(), fp);
+      fclose(fp);
+
+      status = db_find_key(hDB, 0, "/json_paste_test", &hKey);
+      if (status == DB_SUCCESS)
+         db_delete_key(hDB, hKey, FALSE);
+      db_create_key(hDB, 0, "/json_paste_test", TID_KEY);
+      db_find_key(hDB, 0, "/json_paste_test", &hKey);
+
+      double t0 = GetTimeSec();
+      status = db_load_json(hDB, hKey, filename.c_str());
+      double t1 = GetTimeSec();
+      if (status != DB_SUCCESS) {
+         printf("db_load_json() status %d\n", status);
+         errors++;
+      } else {
+         errors += Check(hDB, hKey, ndirs, nvalues);
+         printf("db_load_json(): %.3f s, %.1f MB/s\n", t1 - t0, json.size()/1e6/(t1 - t0));
+      }
+      unlink(filename.c_str());
+   }
+
+   // >>> for comparison: parsing alone into an MJsonNode tree, as done before db_paste_json() was streaming
+   double t0 = GetTimeSec();
+   MJsonNode* node = MJsonNode::Parse(json.c_str());
+   double t1 = GetTimeSec();
+   delete node;
+   double t2 = GetTimeSec();
+   printf("MJsonNode::Parse() for comparison: %.3f s, delete %.3f s\n", t1 - t0, t2 - t1);
+
+   // >>> bad JSON must not change the ODB
+   db_find_key(hDB, 0, "/json_paste_test", &hKey);
+   status = db_paste_json(hDB, hKey, "{ \"Bad\" : 1, \"Dir00000\" : { \"Count0\" : 5, } }");
+   int size = sizeof(int);
+   int count = -1;
+   db_get_value(hDB, hKey, "Dir00000/Count0", &count, &size, TID_INT, FALSE);
+   HNDLE hBad;
+   if (status != DB_FILE_ERROR || count != 0 || db_find_key(hDB, hKey, "Bad", &hBad) == DB_SUCCESS) {
+      printf("bad JSON: status %d, Count0 %d\n", status, count);
+      errors++;
+   }
+
+   db_delete_key(hDB, hKey, FALSE);
+
+   printf("json_paste_test: %s\n", errors ? "FAILED" : "ok");
+
+   status = cm_disconnect_experiment();
+   assert(status == CM_SUCCESS);
+
+   return errors ? 1 : 0;
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -30,6 +30,7 @@ char bank_name[4], sbank_name[4];
 INT hBufEvent;
 INT save_dsp = 1, evt_display = 0;
 INT speed = 0, dsp_time = 0, dsp_fmt = 0, dsp_mode = 0, bl = -1;
+DWORD start_time_stamp = 0;
 INT consistency = 0, disp_bank_list = 0, openzip = 0;
 BOOL via_callback;
 INT i, data_fmt;
@@ -108,12 +109,64 @@ void md_all_info_display(int seqno, int runno, TMEvent* e)
    printf("%5del/x%x %5dserial\n", int(e->data.size()), int(e->data.size()), e->serial_number);
 }
 
+/*----- Reader using the event index written by mlogger ---------*/
+class IndexReader : public TMReaderInterface {
+public:
+   IndexReader(MD_INDEX_FILE* file) : fFile(file) {}
+   ~IndexReader() { Close(); }
+
+   int Read(void* buf, int count) {
+      if (!fFile)
+         return -1;
+      return md_index_read(fFile, buf, count);
+   }
+
+   int Close() {
+      md_index_close(fFile);
+      fFile = NULL;
+      return 0;
+   }
+
+private:
+   MD_INDEX_FILE* fFile;
+};
+
 /*----- Replog function ----------------------------------------*/
 int replog(int data_fmt, char *rep_file, int bl, int action, int max_event_size) {
    static char bars[] = "|/-\\";
    static int i_bar;
 
-   TMReaderInterface* r = TMNewReader(rep_file);
+   int seqno = 0;
+   int runno = 0;
+
+   /* with an event index, seek directly to the first event to display */
+   TMReaderInterface* r = NULL;
+   MD_INDEX index;
+   if (bl > 0 || start_time_stamp > 0) {
+      MD_INDEX_FILE* file = NULL;
+      int status = md_index_load(md_index_file_name(rep_file).c_str(), &index);
+      if (status == MD_SUCCESS)
+         status = md_index_open(rep_file, &index, &file);
+      if (status == MD_SUCCESS) {
+         size_t entry = (start_time_stamp > 0) ? md_index_find_time(&index, start_time_stamp) : bl;
+         if (md_index_seek(file, entry) != MD_SUCCESS) {
+            printf("No event to display, %d events in %s\n", int(index.entries.size()), rep_file);
+            md_index_close(file);
+            return -1;
+         }
+         if (index.entries.size() > 0 && index.entries[0].event_id == uint16_t(EVENTID_BOR))
+            runno = index.entries[0].serial_number;
+         seqno = entry;
+         bl = 0;
+         r = new IndexReader(file);
+      } else if (start_time_stamp > 0) {
+         fprintf(stderr, "Cannot use event index %s to seek to time %u\n", md_index_file_name(rep_file).c_str(), start_time_stamp);
+         return -1;
+      }
+   }
+
+   if (!r)
+      r = TMNewReader(rep_file);
 
    /* open data file */
    if (r->fError) {
@@ -123,9 +176,6 @@ int replog(int data_fmt, char *rep_file, int bl, int action, int max_event_size)
       return (-1);
    }
 
-   int seqno = 0;
-   int runno = 0;
-
    //printf("skip %d\n", bl);
 
    while (bl > 0) {
@@ -477,6 +527,8 @@ int main(int argc, char **argv) {
                   dsp_fmt = DSP_ASC;
             } else if (strncmp(argv[i], "-r", 2) == 0)
                bl = atoi(argv[++i]);
+            else if (strncmp(argv[i], "-T", 2) == 0)
+               start_time_stamp = strtoul(argv[++i], NULL, 0);
             else if (strncmp(argv[i], "-x", 2) == 0) {
                if (i + 1 == argc)
                   goto repusage;
@@ -497,6 +549,8 @@ int main(int argc, char **argv) {
                printf(">>> Header & Record are not supported for MIDAS as no physical record structure exists\n");
                printf("                  -f format (auto): data representation ([x]/[d]/[a]scii) def:bank header content\n");
                printf("                  -r #            : skip event(MIDAS) to #\n");
+               printf("                  -T time         : start at the first event at or after time (seconds since 1970)\n");
+               printf(">>> -r and -T seek directly if the event index file.idx written by mlogger exists, -T requires it\n");
                printf("                  -a bytes        : max event size to support (defaults to %d bytes)\n",
                       DEFAULT_MAX_EVENT_SIZE);
                return 0;
@@ -10,27 +10,42 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "midas.h"
 #include "history.h"
 
 #include <map>
-
-std::map<int,const char*> gEventName;
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 bool print_empty = false;
 bool print_dupe = false;
 bool print_string = false;
 
-bool had_empty = false;
-bool had_dupe = false;
-bool had_string = false;
+std::atomic<bool> had_empty(false);
+std::atomic<bool> had_dupe(false);
+std::atomic<bool> had_string(false);
 
 bool report_empty = true;
 bool report_dupe = true;
 bool report_string = true;
 
-int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
+// with several workers, each event is converted by exactly one of them
+
+static bool isMyEvent(const std::string& event_name, int worker, int nworkers)
+{
+   if (nworkers <= 1)
+      return true;
+   return (int)(std::hash<std::string>()(event_name) % nworkers) == worker;
+}
+
+int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh, std::map<int,std::string>& event_names, int worker = 0, int nworkers = 1)
 {
    assert(f!=NULL);
 
@@ -88,6 +103,18 @@ int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
 
                   //  printf("Event %d, \"%s\", size %d, %d tags.\n", rec.event_id, event_name, size, ntags);
 
+                  event_names[rec.event_id] = event_name;
+
+                  if (!isMyEvent(event_name, worker, nworkers)) {
+                     if (fseek(f, size, SEEK_CUR) != 0) {
+                        fprintf(stderr, "Error: %s: Error skipping RT_DEF record, errno %d (%s)\n", filename, errno, strerror(errno));
+                        if (buf)
+                           free(buf);
+                        return -1;
+                     }
+                     break;
+                  }
+
                   if (!((size > 0) &&
                         (size < 1*1024*1024) &&
                         (size == ntags*(int)sizeof(TAG)))) {
@@ -142,8 +169,6 @@ int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
 
                   mh->hs_define_event(event_name, rec.time, ntags, tags);
 
-                  gEventName[rec.event_id] = strdup(event_name);
-
                   delete[] tags;
                   break;
                }
@@ -164,6 +189,18 @@ int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
                      return -1;
                      break;
                   }
+
+                  const std::string& event_name = event_names[rec.event_id];
+
+                  if (!isMyEvent(event_name, worker, nworkers)) {
+                     if (fseek(f, size, SEEK_CUR) != 0) {
+                        fprintf(stderr, "Error: %s: Error skipping RT_DATA record, errno %d (%s)\n", filename, errno, strerror(errno));
+                        if (buf)
+                           free(buf);
+                        return -1;
+                     }
+                     break;
+                  }
 	    
                   if (size > bufSize)
                      {
@@ -193,7 +230,7 @@ int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
 
                   time_t t = (time_t)rec.time;
 
-                  mh->hs_write_event(gEventName[rec.event_id], t, size, buf);
+                  mh->hs_write_event(event_name.c_str(), t, size, buf);
           
                   break;
                }
@@ -208,6 +245,26 @@ int copyHstFile(const char* filename, FILE*f, MidasHistoryInterface *mh)
    return 0;
 }
 
+std::map<int,std::string> gEventName;
+
+void reportRepaired()
+{
+   if (had_empty && report_empty) {
+      report_empty = false;
+      fprintf(stderr, "Notice: Automatically repaired some empty tag names\n");
+   }
+
+   if (had_dupe && report_dupe) {
+      report_dupe = false;
+      fprintf(stderr, "Notice: Automatically repaired some duplicate tag names\n");
+   }
+
+   if (had_string && report_string) {
+      report_string = false;
+      fprintf(stderr, "Notice: Automatically truncated events that contain tags of forbidden type TID_STRING\n");
+   }
+}
+
 int copyHst(const char* name, MidasHistoryInterface* mh)
 {
    FILE* f = fopen(name,"r");
@@ -218,26 +275,150 @@ int copyHst(const char* name, MidasHistoryInterface* mh)
       }
 
    fprintf(stderr, "Reading %s\n", name);
-   copyHstFile(name, f, mh);
+   copyHstFile(name, f, mh, gEventName);
    fclose(f);
    mh->hs_flush_buffers();
 
-   if (had_empty && report_empty) {
-      report_empty = false;
-      fprintf(stderr, "Notice: Automatically repaired some empty tag names\n");
+   reportRepaired();
+
+   return 0;
+}
+
+//
+// Parallel conversion into FILE history: each worker thread reads all
+// the .hst files but only converts the events it owns, writing them
+// through its own FileHistory into a private staging directory. When all
+// workers are done, the new mhf_*.dat files are moved into the output
+// directory. Workers own disjoint events, so the file names cannot clash.
+//
+
+static std::string workerPath(const std::string& path, int worker)
+{
+   std::string p = path;
+   if (p.length() > 0 && p[p.length()-1] != DIR_SEPARATOR)
+      p += DIR_SEPARATOR_STR;
+   p += msprintf(".mh2sql_worker_%d", worker);
+   return p;
+}
+
+static void copyWorker(int worker, int nworkers, const std::vector<std::string>* files, const std::string* path, int hs_debug_flag, int* result)
+{
+   std::string wpath = workerPath(*path, worker);
+
+   MidasHistoryInterface* mh = MakeMidasHistoryFile();
+   assert(mh);
+   mh->hs_set_debug(hs_debug_flag);
+   int status = mh->hs_connect(wpath.c_str());
+   if (status != HS_SUCCESS) {
+      *result = -1;
+      delete mh;
+      return;
    }
 
-   if (had_dupe && report_dupe) {
-      report_dupe = false;
-      fprintf(stderr, "Notice: Automatically repaired some duplicate tag names\n");
+   std::map<int,std::string> event_names;
+
+   *result = 0;
+
+   for (unsigned i=0; i<files->size(); i++) {
+      const char* name = (*files)[i].c_str();
+
+      FILE* f = fopen(name,"r");
+      if (!f) {
+         fprintf(stderr, "Error: Cannot open \'%s\', errno %d (%s)\n", name, errno, strerror(errno));
+         *result = -1;
+         continue;
+      }
+
+      if (worker == 0)
+         fprintf(stderr, "Reading %s\n", name);
+
+      if (copyHstFile(name, f, mh, event_names, worker, nworkers) != 0)
+         *result = -1;
+      fclose(f);
+      mh->hs_flush_buffers();
    }
 
-   if (had_string && report_string) {
-      report_string = false;
-      fprintf(stderr, "Notice: Automatically truncated events that contain tags of forbidden type TID_STRING\n");
+   mh->hs_disconnect();
+   delete mh;
+}
+
+static int moveWorkerFiles(const std::string& path, int worker)
+{
+   std::string wpath = workerPath(path, worker);
+   std::string opath = path;
+   if (opath.length() > 0 && opath[opath.length()-1] != DIR_SEPARATOR)
+      opath += DIR_SEPARATOR_STR;
+
+   DIR* dir = opendir(wpath.c_str());
+   if (!dir) {
+      fprintf(stderr, "Error: Cannot open directory \'%s\', errno %d (%s)\n", wpath.c_str(), errno, strerror(errno));
+      return -1;
    }
 
-   return 0;
+   int result = 0;
+
+   while (1) {
+      struct dirent* de = readdir(dir);
+      if (!de)
+         break;
+      if (de->d_name[0] == '.')
+         continue;
+
+      std::string src = wpath + DIR_SEPARATOR_STR + de->d_name;
+      std::string dst = opath + de->d_name;
+
+      struct stat st;
+      if (stat(dst.c_str(), &st) == 0) {
+         fprintf(stderr, "Error: Cannot move \'%s\': \'%s\' already exists\n", src.c_str(), dst.c_str());
+         result = -1;
+         continue;
+      }
+
+      if (rename(src.c_str(), dst.c_str()) != 0) {
+         fprintf(stderr, "Error: Cannot rename \'%s\' to \'%s\', errno %d (%s)\n", src.c_str(), dst.c_str(), errno, strerror(errno));
+         result = -1;
+      }
+   }
+
+   closedir(dir);
+
+   if (result == 0)
+      rmdir(wpath.c_str());
+
+   return result;
+}
+
+int copyHstParallel(const std::vector<std::string>& files, const std::string& path, int nworkers, int hs_debug_flag)
+{
+   for (int i=0; i<nworkers; i++) {
+      std::string wpath = workerPath(path, i);
+      if (mkdir(wpath.c_str(), 0777) != 0 && errno != EEXIST) {
+         fprintf(stderr, "Error: Cannot create directory \'%s\', errno %d (%s)\n", wpath.c_str(), errno, strerror(errno));
+         return -1;
+      }
+   }
+
+   std::vector<int> results(nworkers, 0);
+   std::vector<std::thread> threads;
+
+   for (int i=0; i<nworkers; i++)
+      threads.push_back(std::thread(copyWorker, i, nworkers, &files, &path, hs_debug_flag, &results[i]));
+
+   for (int i=0; i<nworkers; i++)
+      threads[i].join();
+
+   int result = 0;
+
+   for (int i=0; i<nworkers; i++) {
+      if (results[i] != 0)
+         result = -1;
+      if (moveWorkerFiles(path, i) != 0)
+         result = -1;
+   }
+
+   reportRepaired();
+
+   return result;
 }
 
 void help()
@@ -253,9 +434,11 @@ void help()
    fprintf(stderr,"  --mysql mysql_writer.txt --- write to MYSQL database\n");
    fprintf(stderr,"  --pgsql pgsql_writer.txt --- write to PGSQL database\n");
    fprintf(stderr,"  --file <path> --- write to FILE database at the given path\n");
+   fprintf(stderr,"  -j <n> --- with --file: convert using <n> parallel threads, one FileHistory writer per thread\n");
    fprintf(stderr,"\n");
    fprintf(stderr,"Examples:\n");
    fprintf(stderr,"  mh2sql --hs-debug 1 --sqlite . 130813.hst\n");
+   fprintf(stderr,"  mh2sql -j 8 --file /path/to/history *.hst\n");
    exit(1);
 }
 
@@ -265,6 +448,8 @@ int main(int argc,char*argv[])
    int hs_debug_flag = 0;
    HNDLE hDB;
    MidasHistoryInterface *mh = NULL;
+   int nworkers = 1;
+   std::string file_path;
 
    if (argc <= 2)
       help(); // DOES NOT RETURN
@@ -293,6 +478,11 @@ int main(int argc,char*argv[])
       } else if (strcmp(arg, "--hs-debug") == 0) {
          hs_debug_flag = atoi(argv[iarg+1]);
          iarg++;
+      } else if (strcmp(arg, "-j") == 0) {
+         nworkers = atoi(argv[iarg+1]);
+         if (nworkers < 1)
+            nworkers = 1;
+         iarg++;
       } else if (strcmp(arg, "--odbc") == 0) {
          mh = MakeMidasHistoryODBC();
          assert(mh);
@@ -326,6 +516,7 @@ int main(int argc,char*argv[])
             exit(1);
          iarg++;
       } else if (strcmp(arg, "--file") == 0) {
+         file_path = argv[iarg+1];
          mh = MakeMidasHistoryFile();
          assert(mh);
          mh->hs_set_debug(hs_debug_flag);
@@ -336,6 +527,31 @@ int main(int argc,char*argv[])
       }
    }
 
+   if (nworkers > 1) {
+      if (file_path.empty()) {
+         fprintf(stderr, "Error: -j requires --file\n");
+         cm_disconnect_experiment();
+         exit(1);
+      }
+
+      if (mh) {
+         mh->hs_disconnect();
+         delete mh;
+      }
+
+      std::vector<std::string> files;
+      for (int iarg=1; iarg<argc; iarg++) {
+         if (strstr(argv[iarg], ".hst") != NULL)
+            files.push_back(argv[iarg]);
+      }
+
+      status = copyHstParallel(files, file_path, nworkers, hs_debug_flag);
+
+      cm_disconnect_experiment();
+
+      return (status == 0) ? 0 : 1;
+   }
+
    if (!mh) {
       status = hs_get_history(hDB, 0, HS_GET_DEFAULT|HS_GET_WRITER|HS_GET_INACTIVE, hs_debug_flag, &mh);
       assert(status == HS_SUCCESS);
@@ -8346,7 +8346,49 @@ struct HistPlot
 
 static void LoadHistPlotFromOdb(MVOdb* odb, HistPlot* hp, const char* group, const char* panel);
 
-int read_history(const HistPlot& hp, /*HNDLE hDB, const char *group, const char *panel,*/ int index, int flags, time_t tstart, time_t tend, time_t scale, HistoryData *data)
+// read history data decimated to "width" time bins (pixels), see MidasHistoryDecimatedBuffer.
+// Run markers (odb_index < 0) are not decimated.
+static int read_history_decimated(MidasHistoryInterface* mh, time_t tstart, time_t tend, int width, HistoryData *data)
+{
+   std::vector<MidasHistoryDecimatedBuffer*> dbuf(data->nvars);
+   std::vector<MidasHistoryBufferInterface*> buf(data->nvars);
+
+   for (int i=0; i<data->nvars; i++) {
+      dbuf[i] = new MidasHistoryDecimatedBuffer(tstart, tend, (data->odb_index[i] < 0) ? 0 : width);
+      buf[i] = dbuf[i];
+      data->status[i] = 0;
+   }
+
+   int status = mh->hs_read_buffer(tstart, tend,
+                                   data->nvars,
+                                   data->event_names,
+                                   data->var_names,
+                                   data->var_index,
+                                   buf.data(),
+                                   data->status);
+
+   for (int i=0; i<data->nvars; i++) {
+      dbuf[i]->Finish();
+
+      int n = dbuf[i]->fTime.size();
+
+      data->num_entries[i] = n;
+      data->t[i] = ALLOC(time_t, n);
+      data->v[i] = ALLOC(double, n);
+
+      for (int j=0; j<n; j++) {
+         data->t[i][j] = dbuf[i]->fTime[j];
+         data->v[i][j] = dbuf[i]->fValue[j];
+      }
+
+      delete dbuf[i];
+      dbuf[i] = NULL;
+   }
+
+   return status;
+}
+
+int read_history(const HistPlot& hp, /*HNDLE hDB, const char *group, const char *panel,*/ int index, int flags, time_t tstart, time_t tend, time_t scale, HistoryData *data, int width = 0)
 {
    //HNDLE hkeypanel, hkeydvar, hkey;
    //KEY key;
@@ -8459,15 +8501,19 @@ int read_history(const HistPlot& hp, /*HNDLE hDB, const char *group, const char
    bool get_last_written = false;
 
    if (flags & READ_HISTORY_DATA) {
-      status = mh->hs_read(tstart, tend, scale,
-                           data->nvars,
-                           data->event_names,
-                           data->var_names,
-                           data->var_index,
-                           data->num_entries,
-                           data->t,
-                           data->v,
-                           data->status);
+      if (width > 0) {
+         status = read_history_decimated(mh, tstart, tend, width, data);
+      } else {
+         status = mh->hs_read(tstart, tend, scale,
+                              data->nvars,
+                              data->event_names,
+                              data->var_names,
+                              data->var_index,
+                              data->num_entries,
+                              data->t,
+                              data->v,
+                              data->status);
+      }
 
       if (debug) {
          printf("read_history: nvars %d, hs_read() status %d\n", data->nvars, status);
@@ -9104,7 +9150,7 @@ void generate_hist_graph(MVOdb* odb, Return* rr, const char *hgroup, const char
    if (hp.show_run_markers)
       flags |= READ_HISTORY_RUNMARKER;
 
-   status = read_history(hp, /*hDB, hgroup, hpanel,*/ index, flags, starttime, endtime, scale/1000+1, hsdata);
+   status = read_history(hp, /*hDB, hgroup, hpanel,*/ index, flags, starttime, endtime, scale/1000+1, hsdata, width);
 
    if (status != HS_SUCCESS) {
       sprintf(str, "Complete history failure, read_history() status %d, see messages", status);
@@ -14644,13 +14690,39 @@ static int thread_mjsonrpc(mg_connection *nc, MongooseWorkObject *w)
    //gMutex.lock();
    //w->t->fTimeLocked = GetTimeSec();
 
-   MJsonNode* reply = mjsonrpc_decode_post_data(w->post_body.c_str());
+   MJsonStreamWriter stream;
+
+   MJsonNode* reply = mjsonrpc_decode_post_data(w->post_body.c_str(), &stream);
 
    //w->t->fTimeUnlocked = GetTimeSec();
    //gMutex.unlock();
    
    //ss_mutex_release(request_mutex);
 
+   if (reply == NULL) {
+      // reply was written into the stream, send it as is
+
+      std::string headers;
+      headers += "HTTP/1.1 200 OK\n";
+      if (w->origin.length() > 0)
+         headers += "Access-Control-Allow-Origin: " + w->origin + "\n";
+      else
+         headers += "Access-Control-Allow-Origin: *\n";
+      headers += "Access-Control-Allow-Credentials: true\n";
+      headers += "Content-Length: " + toString(stream.fEnd) + "\n";
+      headers += "Content-Type: application/json\n";
+
+      std::string send = headers + "\n";
+
+      w->t->fTimeProcessed = GetTimeSec();
+
+      mongoose_send(nc, w, send.c_str(), send.length(), stream.fBuf, stream.fEnd);
+
+      w->t->fTimeSent = GetTimeSec();
+
+      return RESPONSE_SENT;
+   }
+
    if (reply->GetType() == MJSON_ARRAYBUFFER) {
       const char* ptr;
       size_t size;
@@ -14930,7 +15002,9 @@ static int handle_http_post(struct mg_connection *nc, const http_message* msg, c
 
       //t->fTimeLocked = GetTimeSec();
 
-      MJsonNode* reply = mjsonrpc_decode_post_data(post_data.c_str());
+      MJsonStreamWriter stream;
+
+      MJsonNode* reply = mjsonrpc_decode_post_data(post_data.c_str(), &stream);
 
       //t->fTimeUnlocked = GetTimeSec();
       
@@ -14938,6 +15012,31 @@ static int handle_http_post(struct mg_connection *nc, const http_message* msg, c
       ss_mutex_release(request_mutex);
 #endif
 
+      if (reply == NULL) {
+         // reply was written into the stream, send it as is
+
+         std::string headers;
+         headers += "HTTP/1.1 200 OK\n";
+         if (origin_header.length() > 0)
+            headers += "Access-Control-Allow-Origin: " + std::string(origin_header) + "\n";
+         else
+            headers += "Access-Control-Allow-Origin: *\n";
+         headers += "Access-Control-Allow-Credentials: true\n";
+         headers += "Content-Length: " + toString(stream.fEnd) + "\n";
+         headers += "Content-Type: application/json\n";
+
+         std::string send = headers + "\n";
+
+         t->fTimeProcessed = GetTimeSec();
+
+         mg_send(nc, send.c_str(), send.length());
+         mg_send(nc, stream.fBuf, stream.fEnd);
+
+         t->fTimeSent = GetTimeSec();
+
+         return RESPONSE_SENT;
+      }
+
       if (reply->GetType() == MJSON_ARRAYBUFFER) {
          const char* ptr;
          size_t size;
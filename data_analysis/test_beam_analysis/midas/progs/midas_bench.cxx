@@ -0,0 +1,1983 @@
+//
+// midas_bench: benchmarks of the midas core, run in a private test
+// experiment. Results are written as JSON to compare midas versions.
+//
+// Usage: midas_bench [-q] [-o results.json] [-s scenario,...] [-k] [-l]
+//
+//   -q  quick run with small sizes and short times
+//   -o  JSON output file, default midas_bench.json
+//   -s  comma-separated list of scenarios to run, default all (-l lists them)
+//   -k  keep the test experiment directory
+//
+// The test experiment lives in a new temporary directory (MIDAS_DIR),
+// a running experiment is not touched. Event producers and consumers,
+// ODB readers, the hotlink peer and the JSON-RPC requests are this
+// program started again with "--child", the logger scenario starts
+// mlogger, the sequencer scenario msequencer, the mfe scenario the
+// test frontend midas_bench_fe, the mserver scenario starts an mserver
+// on a free port and connects producers through it.
+//
+
+#undef NDEBUG // midas required assert() to be always enabled
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include "midas.h"
+#include "msystem.h"
+#include "mjson.h"
+#include "mjsonrpc.h"
+#include "history.h"
+#include "crc32c.h"
+#include "sha256.h"
+#include "sha512.h"
+#include "xxhash.h"
+#include "mlz4frame.h"
+#include "caen_unpack.h"
+#include "mvmesim.h"
+extern "C" {
+#include "v1720drv.h"
+}
+
+static bool gQuick = false;
+static std::string gExe;         // this program, to start child processes
+static std::string gDir;         // directory of the test experiment
+static MJsonNode* gResults = NULL;
+
+/*------------------------------------------------------------------*/
+
+static uint32_t xseed = 2463534242u;
+
+static uint32_t xrand()
+{
+   xseed ^= xseed << 13;
+   xseed ^= xseed >> 17;
+   xseed ^= xseed << 5;
+   return xseed;
+}
+
+// detector-like data: slowly varying 12-bit samples with noise, compresses like real waveforms
+static void FillWaveform(char* buf, size_t size)
+{
+   uint16_t* s = (uint16_t*)buf;
+   int v = 2000;
+   for (size_t i=0; i<size/2; i++) {
+      v += (int)(xrand() % 9) - 4;
+      if (i % 512 == 100)
+         v += 1000;
+      if (v > 4000)
+         v = 2000;
+      s[i] = v;
+   }
+}
+
+static double Percentile(std::vector<double> v, double p)
+{
+   if (v.empty())
+      return 0;
+   std::sort(v.begin(), v.end());
+   size_t i = p*(v.size() - 1);
+   return v[i];
+}
+
+// call f() repeatedly for at least "seconds", returns calls per second
+template<class F>
+static double Rate(double seconds, F f)
+{
+   double t0 = ss_time_sec();
+   double t1 = t0;
+   long count = 0;
+   while (t1 - t0 < seconds) {
+      for (int i=0; i<64; i++)
+         f();
+      count += 64;
+      t1 = ss_time_sec();
+   }
+   return count/(t1 - t0);
+}
+
+// best of "repeat" runs of f(), in seconds
+template<class F>
+static double BestTime(int repeat, F f)
+{
+   double best = 0;
+   for (int i=0; i<repeat; i++) {
+      double t0 = ss_time_sec();
+      f();
+      double t = ss_time_sec() - t0;
+      if (i == 0 || t < best)
+         best = t;
+   }
+   return best;
+}
+
+static void Result(const char* scenario, MJsonNode* params, MJsonNode* metrics)
+{
+   printf("%-9s %s %s\n", scenario, params->Stringify().c_str(), metrics->Stringify().c_str());
+
+   MJsonNode* r = MJsonNode::MakeObject();
+   r->AddToObject("scenario", MJsonNode::MakeString(scenario));
+   r->AddToObject("params", params);
+   r->AddToObject("metrics", metrics);
+   gResults->AddToArray(r);
+}
+
+static void Skipped(const char* scenario, const char* reason)
+{
+   printf("%-9s skipped: %s\n", scenario, reason);
+
+   MJsonNode* r = MJsonNode::MakeObject();
+   r->AddToObject("scenario", MJsonNode::MakeString(scenario));
+   r->AddToObject("skipped", MJsonNode::MakeString(reason));
+   gResults->AddToArray(r);
+}
+
+static void RemoveDir(const std::string& path)
+{
+   DIR* dir = opendir(path.c_str());
+   if (dir) {
+      struct dirent* de;
+      while ((de = readdir(dir)) != NULL) {
+         if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+         std::string name = path + "/" + de->d_name;
+         struct stat st;
+         if (lstat(name.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            RemoveDir(name);
+         else
+            unlink(name.c_str());
+      }
+      closedir(dir);
+   }
+   rmdir(path.c_str());
+}
+
+/*------------------------------------------------------------------*/
+
+// Child processes: started with "--child mode go_fd result_fd args...".
+// They connect to the experiment, report "R" on the result pipe when
+// ready, wait until the parent closes the go pipe and report their
+// results as one line on the result pipe.
+
+class Children
+{
+public:
+   std::vector<pid_t> fPids;
+   size_t fReady = 0;
+   std::string fHost; // "host:port" of an mserver to connect through, empty for a local connection
+   int fGo[2];
+   int fResult[2];
+   std::string fBuf;
+
+   Children()
+   {
+      int status = pipe(fGo);
+      assert(status == 0);
+      status = pipe(fResult);
+      assert(status == 0);
+   }
+
+   ~Children()
+   {
+      if (fGo[1] >= 0)
+         close(fGo[1]);
+      if (fResult[0] >= 0)
+         close(fResult[0]);
+      if (fResult[1] >= 0)
+         close(fResult[1]);
+      close(fGo[0]);
+      for (pid_t pid : fPids)
+         waitpid(pid, NULL, 0);
+   }
+
+   void Start(const char* mode, const std::vector<std::string>& args)
+   {
+      std::vector<std::string> sargv;
+      sargv.push_back(gExe);
+      sargv.push_back("--child");
+      sargv.push_back(mode);
+      sargv.push_back(msprintf("%d", fGo[0]));
+      sargv.push_back(msprintf("%d", fResult[1]));
+      sargv.insert(sargv.end(), args.begin(), args.end());
+
+      std::vector<char*> argv;
+      for (auto& s : sargv)
+         argv.push_back((char*)s.c_str());
+      argv.push_back(NULL);
+
+      pid_t pid = fork();
+      if (pid == 0) {
+         close(fGo[1]);
+         close(fResult[0]);
+         if (!fHost.empty())
+            setenv("MIDAS_SERVER_HOST", fHost.c_str(), 1);
+         execv(gExe.c_str(), argv.data());
+         _exit(127);
+      }
+      assert(pid > 0);
+      fPids.push_back(pid);
+   }
+
+   bool ReadLine(std::string* line)
+   {
+      while (1) {
+         size_t nl = fBuf.find('\n');
+         if (nl != std::string::npos) {
+            *line = fBuf.substr(0, nl);
+            fBuf.erase(0, nl + 1);
+            return true;
+         }
+         char buf[1024];
+         ssize_t rd = read(fResult[0], buf, sizeof(buf));
+         if (rd < 0 && errno == EINTR)
+            continue;
+         if (rd <= 0)
+            return false;
+         fBuf.append(buf, rd);
+      }
+   }
+
+   // wait until the children started so far are ready
+   bool WaitReady()
+   {
+      while (fReady < fPids.size()) {
+         std::string line;
+         if (!ReadLine(&line) || line != "R")
+            return false;
+         fReady++;
+      }
+      return true;
+   }
+
+   // wait until all children are ready, then let them run
+   bool Go()
+   {
+      close(fResult[1]);
+      fResult[1] = -1;
+
+      if (!WaitReady())
+         return false;
+
+      close(fGo[1]);
+      fGo[1] = -1;
+      return true;
+   }
+
+   // result lines of all children
+   std::vector<std::string> Results()
+   {
+      if (fResult[1] >= 0) {
+         close(fResult[1]);
+         fResult[1] = -1;
+      }
+      if (fGo[1] >= 0) {
+         close(fGo[1]);
+         fGo[1] = -1;
+      }
+
+      std::vector<std::string> v;
+      std::string line;
+      while (ReadLine(&line))
+         v.push_back(line);
+      for (pid_t pid : fPids)
+         waitpid(pid, NULL, 0);
+      fPids.clear();
+      return v;
+   }
+};
+
+static void ChildReady(int go_fd, int result_fd)
+{
+   if (write(result_fd, "R\n", 2) != 2)
+      exit(1);
+   char c;
+   while (read(go_fd, &c, 1) > 0) {
+   }
+}
+
+static void ChildResult(int result_fd, const std::string& s)
+{
+   std::string line = s + "\n";
+   if (write(result_fd, line.c_str(), line.length()) != (ssize_t)line.length())
+      exit(1);
+}
+
+// tell the parent that we will not get ready
+static int ChildFailed(int result_fd)
+{
+   ChildResult(result_fd, "E");
+   return 1;
+}
+
+static int gPing = 0;
+
+static void ping_callback(INT hDB, INT hKey, INT index, void* info)
+{
+   int size = sizeof(gPing);
+   db_get_data(hDB, hKey, &gPing, &size, TID_INT);
+   if (gPing > 0)
+      db_set_value(hDB, 0, "/bench/hotlink/pong", &gPing, sizeof(gPing), 1, TID_INT);
+}
+
+static int ChildMain(int argc, char* argv[])
+{
+   if (argc < 5)
+      return 1;
+
+   std::string mode = argv[2];
+   int go_fd = atoi(argv[3]);
+   int result_fd = atoi(argv[4]);
+   std::vector<std::string> args(argv + 5, argv + argc);
+
+   char host_name[256];
+   char expt_name[256];
+   cm_get_environment(host_name, sizeof(host_name), expt_name, sizeof(expt_name));
+
+   std::string client_name = msprintf("bench_%s_%d", mode.c_str(), ss_getpid());
+   int status = cm_connect_experiment1(host_name, expt_name, client_name.c_str(), NULL, DEFAULT_ODB_SIZE, 0);
+   if (status != CM_SUCCESS)
+      return ChildFailed(result_fd);
+
+   cm_set_watchdog_params(0, 0);
+
+   HNDLE hDB;
+   cm_get_experiment_database(&hDB, NULL);
+
+   if (mode == "producer" || mode == "consumer") {
+      // args: buffer, events or producers, cache size, histograms
+      const char* buffer_name = args.at(0).c_str();
+      int n = atoi(args.at(1).c_str());
+      int cache_size = atoi(args.at(2).c_str());
+      bm_enable_histograms(atoi(args.at(3).c_str()));
+
+      HNDLE hbuf;
+      status = bm_open_buffer(buffer_name, DEFAULT_BUFFER_SIZE, &hbuf);
+      if (status != BM_SUCCESS && status != BM_CREATED)
+         return ChildFailed(result_fd);
+
+      if (mode == "producer") {
+         // args: ..., event size, event streams to the mserver
+         int event_size = atoi(args.at(4).c_str());
+         int streams = atoi(args.at(5).c_str());
+         bm_set_cache_size(hbuf, 0, cache_size);
+
+         if (streams > 0) {
+            status = rpc_set_event_streams(streams, TRUE);
+            if (status != RPC_SUCCESS)
+               return ChildFailed(result_fd);
+         }
+
+         std::vector<char> event(sizeof(EVENT_HEADER) + event_size);
+         EVENT_HEADER* pevent = (EVENT_HEADER*)event.data();
+         FillWaveform(event.data() + sizeof(EVENT_HEADER), event_size);
+
+         ChildReady(go_fd, result_fd);
+
+         double t0 = ss_time_sec();
+         for (int i=0; i<=n; i++) {
+            bm_compose_event(pevent, i < n ? 1 : 2, 0, event_size, i);
+            status = bm_send_event_vec(hbuf, event, BM_WAIT);
+            if (status != BM_SUCCESS)
+               break;
+         }
+         bm_flush_cache(hbuf, BM_WAIT);
+         double t1 = ss_time_sec();
+
+         ChildResult(result_fd, msprintf("P %d %.0f %.6f %.6f", n, (double)n*event_size, t0, t1));
+      } else {
+         int request_id;
+         bm_set_cache_size(hbuf, cache_size, 0);
+         bm_request_event(hbuf, EVENTID_ALL, TRIGGER_ALL, GET_ALL, &request_id, NULL);
+
+         ChildReady(go_fd, result_fd);
+
+         std::vector<char> event;
+         int count = 0;
+         int done = 0;
+         double bytes = 0;
+         double t0 = 0;
+         while (done < n) {
+            status = bm_receive_event_vec(hbuf, &event, 30000);
+            if (status != BM_SUCCESS)
+               break;
+            const EVENT_HEADER* pevent = (const EVENT_HEADER*)event.data();
+            if (t0 == 0)
+               t0 = ss_time_sec();
+            if (pevent->event_id == 2) {
+               done++;
+            } else {
+               count++;
+               bytes += pevent->data_size;
+            }
+         }
+         double t1 = ss_time_sec();
+
+         ChildResult(result_fd, msprintf("C %d %.0f %.6f %.6f", count, bytes, t0, t1));
+      }
+   } else if (mode == "odb_reader" || mode == "odb_writer") {
+      // args: seconds
+      double seconds = atof(args.at(0).c_str());
+      double value = 1;
+      int size = sizeof(value);
+
+      ChildReady(go_fd, result_fd);
+
+      double rate;
+      if (mode == "odb_reader")
+         rate = Rate(seconds, [&]() { db_get_value(hDB, 0, "/bench/odb/double", &value, &size, TID_DOUBLE, FALSE); });
+      else
+         rate = Rate(seconds, [&]() { db_set_value(hDB, 0, "/bench/odb/double", &value, size, 1, TID_DOUBLE); value += 1; });
+
+      ChildResult(result_fd, msprintf("%s %.1f", mode == "odb_reader" ? "R" : "W", rate));
+   } else if (mode == "hotlink_echo") {
+      HNDLE hKey;
+      db_find_key(hDB, 0, "/bench/hotlink/ping", &hKey);
+      db_watch(hDB, hKey, ping_callback, NULL);
+
+      ChildReady(go_fd, result_fd);
+
+      while (gPing >= 0) {
+         status = cm_yield(100);
+         if (status == SS_ABORT || status == RPC_SHUTDOWN)
+            break;
+      }
+
+      ChildResult(result_fd, "H");
+   } else if (mode == "jsonrpc") {
+      // args: ODB path, "stream" or "tree" reply, repeats
+      std::string request = msprintf("{\"jsonrpc\":\"2.0\",\"method\":\"db_copy\",\"params\":{\"paths\":[\"%s\"]},\"id\":1}", args.at(0).c_str());
+      bool stream = (args.at(1) == "stream");
+      int repeat = atoi(args.at(2).c_str());
+
+      mjsonrpc_init();
+
+      struct rusage ru;
+      getrusage(RUSAGE_SELF, &ru);
+      long maxrss0 = ru.ru_maxrss;
+
+      ChildReady(go_fd, result_fd);
+
+      // like mhttpd: a streamed reply is sent from the writer buffer,
+      // an MJsonNode reply is sent as its Stringify() text
+      size_t bytes = 0;
+      double t = BestTime(repeat, [&]() {
+         MJsonStreamWriter w;
+         MJsonNode* reply = mjsonrpc_decode_post_data(request.c_str(), stream ? &w : NULL);
+         if (reply) {
+            bytes = reply->Stringify().length();
+            delete reply;
+         } else {
+            bytes = w.fEnd;
+         }
+      });
+
+      getrusage(RUSAGE_SELF, &ru);
+      ChildResult(result_fd, msprintf("J %.6f %.0f %ld %ld", t, (double)bytes, maxrss0, ru.ru_maxrss));
+
+      mjsonrpc_exit();
+   }
+
+   cm_disconnect_experiment();
+   return 0;
+}
+
+/*------------------------------------------------------------------*/
+
+// event buffer throughput: producers and GET_ALL consumers in separate
+// processes, with "host" the producers connect through that mserver
+// and send over "streams" event streams (0: the event socket)
+static void RunBm(const char* scenario, int nproducers, int nconsumers, int event_size, bool histograms, const std::string& host = "", int streams = 0)
+{
+   double bytes_per_producer = gQuick ? 20e6 : 200e6;
+   int nevents = bytes_per_producer/event_size;
+   nevents = std::max(1000, std::min(nevents, gQuick ? 100000 : 1000000));
+   int write_cache = (event_size < 100000 && host.empty()) ? 1000000 : 0;
+   int read_cache = 1000000;
+
+   Children c;
+
+   for (int i=0; i<nconsumers; i++)
+      c.Start("consumer", { "BMBENCH", msprintf("%d", nproducers), msprintf("%d", read_cache), histograms ? "1" : "0" });
+
+   // consumers must have requested events before the producers start
+   bool ok = c.WaitReady();
+
+   c.fHost = host;
+
+   if (ok)
+      for (int i=0; i<nproducers; i++)
+         c.Start("producer", { "BMBENCH", msprintf("%d", nevents), msprintf("%d", write_cache), histograms ? "1" : "0", msprintf("%d", event_size), msprintf("%d", streams) });
+
+   ok = ok && c.Go();
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("producers", MJsonNode::MakeInt(nproducers));
+   params->AddToObject("consumers", MJsonNode::MakeInt(nconsumers));
+   params->AddToObject("event_size", MJsonNode::MakeInt(event_size));
+   params->AddToObject("events_per_producer", MJsonNode::MakeInt(nevents));
+   params->AddToObject("write_cache", MJsonNode::MakeInt(write_cache));
+   params->AddToObject("histograms", MJsonNode::MakeBool(histograms));
+   if (!host.empty())
+      params->AddToObject("streams", MJsonNode::MakeInt(streams));
+
+   if (!ok) {
+      delete params;
+      Skipped(scenario, "child processes did not start");
+      c.Results();
+      return;
+   }
+
+   double t_start = 0;
+   double t_end = 0;
+   double sent = 0;
+   double received = 0;
+   int lost = 0;
+
+   for (auto& line : c.Results()) {
+      char type = 0;
+      int count = 0;
+      double bytes = 0, t0 = 0, t1 = 0;
+      if (sscanf(line.c_str(), "%c %d %lf %lf %lf", &type, &count, &bytes, &t0, &t1) != 5)
+         continue;
+      if (type == 'P') {
+         sent += count;
+         if (t_start == 0 || t0 < t_start)
+            t_start = t0;
+      } else if (type == 'C') {
+         received += count;
+         if (t1 > t_end)
+            t_end = t1;
+      }
+   }
+
+   lost = sent*nconsumers - received;
+   double elapsed = t_end - t_start;
+
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("elapsed_sec", MJsonNode::MakeNumber(elapsed));
+   metrics->AddToObject("events_per_sec", MJsonNode::MakeNumber(sent/elapsed));
+   metrics->AddToObject("mbytes_per_sec", MJsonNode::MakeNumber(sent*event_size/1e6/elapsed));
+   metrics->AddToObject("received_mbytes_per_sec", MJsonNode::MakeNumber(received*event_size/1e6/elapsed));
+   metrics->AddToObject("lost_events", MJsonNode::MakeInt(lost));
+   Result(scenario, params, metrics);
+}
+
+static void BenchBm()
+{
+   std::vector<int> producers = { 1, 2, 4 };
+   std::vector<int> consumers = { 1, 2 };
+   std::vector<int> sizes = { 64, 1024, 16384, 262144 };
+
+   if (gQuick) {
+      producers = { 1, 2 };
+      consumers = { 1 };
+      sizes = { 1024, 65536 };
+   }
+
+   for (int np : producers)
+      for (int nc : consumers)
+         for (int size : sizes)
+            RunBm("bm", np, nc, size, false);
+
+   // cost of the buffer manager latency histograms
+   RunBm("bm", 1, 1, 1024, true);
+}
+
+/*------------------------------------------------------------------*/
+
+static void BenchOdb(HNDLE hDB)
+{
+   double seconds = gQuick ? 0.2 : 1.0;
+
+   int ivalue = 1;
+   double dvalue = 1;
+   char svalue[32] = "a string value";
+   std::vector<double> array(1000, 1.0);
+
+   db_set_value(hDB, 0, "/bench/odb/int", &ivalue, sizeof(ivalue), 1, TID_INT);
+   db_set_value(hDB, 0, "/bench/odb/double", &dvalue, sizeof(dvalue), 1, TID_DOUBLE);
+   db_set_value(hDB, 0, "/bench/odb/string", svalue, sizeof(svalue), 1, TID_STRING);
+   db_set_value(hDB, 0, "/bench/odb/array", array.data(), array.size()*sizeof(double), array.size(), TID_DOUBLE);
+
+   struct Key {
+      const char* name;
+      void* data;
+      int size;
+      int num;
+      int tid;
+   } keys[] = {
+      { "int",    &ivalue,      sizeof(ivalue), 1,    TID_INT },
+      { "double", &dvalue,      sizeof(dvalue), 1,    TID_DOUBLE },
+      { "string", svalue,       sizeof(svalue), 1,    TID_STRING },
+      { "array",  array.data(), (int)(array.size()*sizeof(double)), (int)array.size(), TID_DOUBLE },
+   };
+
+   for (const Key& k : keys) {
+      std::string path = std::string("/bench/odb/") + k.name;
+      HNDLE hKey;
+      db_find_key(hDB, 0, path.c_str(), &hKey);
+
+      int size = k.size;
+      double get_path = Rate(seconds, [&]() { size = k.size; db_get_value(hDB, 0, path.c_str(), k.data, &size, k.tid, FALSE); });
+      double set_path = Rate(seconds, [&]() { db_set_value(hDB, 0, path.c_str(), k.data, k.size, k.num, k.tid); });
+      double get_handle = Rate(seconds, [&]() { size = k.size; db_get_data(hDB, hKey, k.data, &size, k.tid); });
+      double set_handle = Rate(seconds, [&]() { db_set_data(hDB, hKey, k.data, k.size, k.num, k.tid); });
+
+      MJsonNode* params = MJsonNode::MakeObject();
+      params->AddToObject("key", MJsonNode::MakeString(k.name));
+      params->AddToObject("size", MJsonNode::MakeInt(k.size));
+      MJsonNode* metrics = MJsonNode::MakeObject();
+      metrics->AddToObject("db_get_value_per_sec", MJsonNode::MakeNumber(get_path));
+      metrics->AddToObject("db_set_value_per_sec", MJsonNode::MakeNumber(set_path));
+      metrics->AddToObject("db_get_data_per_sec", MJsonNode::MakeNumber(get_handle));
+      metrics->AddToObject("db_set_data_per_sec", MJsonNode::MakeNumber(set_handle));
+      Result("odb", params, metrics);
+   }
+
+   // concurrent readers in separate processes, with and without a writer
+   std::vector<int> nreaders = { 1, 2, 4, 8 };
+   if (gQuick)
+      nreaders = { 1, 4 };
+
+   for (int writer = 0; writer < 2; writer++) {
+      for (int n : nreaders) {
+         Children c;
+         for (int i=0; i<n; i++)
+            c.Start("odb_reader", { msprintf("%f", seconds) });
+         if (writer)
+            c.Start("odb_writer", { msprintf("%f", seconds) });
+         if (!c.Go()) {
+            Skipped("odb", "child processes did not start");
+            c.Results();
+            continue;
+         }
+
+         double reads = 0;
+         double writes = 0;
+         for (auto& line : c.Results()) {
+            char type = 0;
+            double rate = 0;
+            if (sscanf(line.c_str(), "%c %lf", &type, &rate) != 2)
+               continue;
+            if (type == 'R')
+               reads += rate;
+            else
+               writes += rate;
+         }
+
+         MJsonNode* params = MJsonNode::MakeObject();
+         params->AddToObject("readers", MJsonNode::MakeInt(n));
+         params->AddToObject("writer", MJsonNode::MakeBool(writer));
+         MJsonNode* metrics = MJsonNode::MakeObject();
+         metrics->AddToObject("reads_per_sec", MJsonNode::MakeNumber(reads));
+         metrics->AddToObject("reads_per_sec_per_reader", MJsonNode::MakeNumber(reads/n));
+         if (writer)
+            metrics->AddToObject("writes_per_sec", MJsonNode::MakeNumber(writes));
+         Result("odb", params, metrics);
+      }
+   }
+
+   // flush of the ODB to disk after a few small updates
+   double flush = BestTime(5, [&]() {
+      for (int i=0; i<100; i++) {
+         ivalue++;
+         db_set_value(hDB, 0, "/bench/odb/int", &ivalue, sizeof(ivalue), 1, TID_INT);
+      }
+      db_flush_database(hDB);
+   });
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("updates", MJsonNode::MakeInt(100));
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("db_flush_database_ms", MJsonNode::MakeNumber(flush*1000));
+   Result("odb", params, metrics);
+}
+
+/*------------------------------------------------------------------*/
+
+static int gPong = 0;
+
+static void pong_callback(INT hDB, INT hKey, INT index, void* info)
+{
+   int size = sizeof(gPong);
+   db_get_data(hDB, hKey, &gPong, &size, TID_INT);
+}
+
+// hotlink round trip: we set "ping", the peer process sees it through
+// its hotlink and sets "pong", we see that through our hotlink
+static void BenchHotlink(HNDLE hDB)
+{
+   int nloops = gQuick ? 200 : 2000;
+   int value = 0;
+
+   db_set_value(hDB, 0, "/bench/hotlink/ping", &value, sizeof(value), 1, TID_INT);
+   db_set_value(hDB, 0, "/bench/hotlink/pong", &value, sizeof(value), 1, TID_INT);
+
+   HNDLE hKeyPing, hKeyPong;
+   db_find_key(hDB, 0, "/bench/hotlink/ping", &hKeyPing);
+   db_find_key(hDB, 0, "/bench/hotlink/pong", &hKeyPong);
+   gPong = 0;
+   db_watch(hDB, hKeyPong, pong_callback, NULL);
+
+   Children c;
+   c.Start("hotlink_echo", {});
+   if (!c.Go()) {
+      db_unwatch(hDB, hKeyPong);
+      Skipped("hotlink", "child process did not start");
+      c.Results();
+      return;
+   }
+
+   std::vector<double> rtt;
+   int timeouts = 0;
+
+   for (int i=1; i<=nloops + 10; i++) {
+      double t0 = ss_time_sec();
+      db_set_data(hDB, hKeyPing, &i, sizeof(i), 1, TID_INT);
+      while (gPong != i && ss_time_sec() - t0 < 1.0)
+         cm_yield(10);
+      double t1 = ss_time_sec();
+      if (gPong != i)
+         timeouts++;
+      else if (i > 10) // first loops are warm-up
+         rtt.push_back((t1 - t0)*1e6);
+   }
+
+   value = -1;
+   db_set_data(hDB, hKeyPing, &value, sizeof(value), 1, TID_INT);
+   c.Results();
+   db_unwatch(hDB, hKeyPong);
+
+   double sum = 0;
+   for (double v : rtt)
+      sum += v;
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("loops", MJsonNode::MakeInt(nloops));
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("round_trip_mean_usec", MJsonNode::MakeNumber(rtt.empty() ? 0 : sum/rtt.size()));
+   metrics->AddToObject("round_trip_p50_usec", MJsonNode::MakeNumber(Percentile(rtt, 0.50)));
+   metrics->AddToObject("round_trip_p99_usec", MJsonNode::MakeNumber(Percentile(rtt, 0.99)));
+   metrics->AddToObject("round_trip_max_usec", MJsonNode::MakeNumber(Percentile(rtt, 1.0)));
+   metrics->AddToObject("timeouts", MJsonNode::MakeInt(timeouts));
+   Result("hotlink", params, metrics);
+}
+
+/*------------------------------------------------------------------*/
+
+// midas programs are taken from the directory of midas_bench (build
+// tree or installation), then from $MIDASSYS/bin, then from $PATH
+static std::string FindProgram(const char* name)
+{
+   std::vector<std::string> dirs;
+   dirs.push_back(gExe.substr(0, gExe.rfind('/')));
+   if (getenv("MIDASSYS"))
+      dirs.push_back(std::string(getenv("MIDASSYS")) + "/bin");
+   if (getenv("PATH")) {
+      std::string p = getenv("PATH");
+      size_t start = 0;
+      while (start <= p.length()) {
+         size_t end = p.find(':', start);
+         if (end == std::string::npos)
+            end = p.length();
+         if (end > start)
+            dirs.push_back(p.substr(start, end - start));
+         start = end + 1;
+      }
+   }
+
+   for (auto& d : dirs) {
+      std::string path = d + "/" + name;
+      if (access(path.c_str(), X_OK) == 0)
+         return path;
+   }
+   return "";
+}
+
+// mlogger writer chain: events sent to the SYSTEM buffer are written by
+// a real mlogger with the given compression and checksum, the time is
+// from begin of run to the end of the stop transition (files closed)
+static void BenchLogger(HNDLE hDB)
+{
+   std::string mlogger = FindProgram("mlogger");
+   if (mlogger.empty()) {
+      Skipped("logger", "mlogger not found");
+      return;
+   }
+
+   std::string data_dir = gDir + "/data";
+   mkdir(data_dir.c_str(), 0755);
+
+   char str[256];
+   strlcpy(str, data_dir.c_str(), sizeof(str));
+   db_set_value(hDB, 0, "/Logger/Data dir", str, sizeof(str), 1, TID_STRING);
+   BOOL flag = TRUE;
+   db_set_value(hDB, 0, "/Logger/Write data", &flag, sizeof(flag), 1, TID_BOOL);
+   flag = FALSE;
+   db_set_value(hDB, 0, "/Logger/ODB Dump", &flag, sizeof(flag), 1, TID_BOOL);
+
+   pid_t pid = fork();
+   if (pid == 0) {
+      execl(mlogger.c_str(), "mlogger", (char*)NULL);
+      _exit(127);
+   }
+
+   // wait until mlogger has created its channel settings
+   HNDLE hKeySettings = 0;
+   for (int i=0; i<100; i++) {
+      if (cm_exist("Logger", FALSE) == CM_SUCCESS && db_find_key(hDB, 0, "/Logger/Channels/0/Settings", &hKeySettings) == DB_SUCCESS)
+         break;
+      hKeySettings = 0;
+      ss_sleep(100);
+   }
+
+   if (!hKeySettings) {
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      Skipped("logger", "mlogger did not start");
+      return;
+   }
+
+   flag = FALSE;
+   db_set_value(hDB, hKeySettings, "ODB dump", &flag, sizeof(flag), 1, TID_BOOL);
+
+   HNDLE hbuf;
+   bm_open_buffer(EVENT_BUFFER_NAME, DEFAULT_BUFFER_SIZE, &hbuf);
+   bm_set_cache_size(hbuf, 0, 1000000);
+
+   int event_size = 100000;
+   int nevents = gQuick ? 200 : 5000;
+   std::vector<char> event(sizeof(EVENT_HEADER) + event_size);
+   EVENT_HEADER* pevent = (EVENT_HEADER*)event.data();
+   FillWaveform(event.data() + sizeof(EVENT_HEADER), event_size);
+
+   struct Chain {
+      const char* compress;
+      const char* checksum;
+   } chains[] = {
+      { "none", "NONE" },
+      { "none", "CRC32C" },
+      { "lz4", "NONE" },
+      { "lz4", "CRC32C" },
+      { "gzip", "NONE" },
+   };
+
+   for (const Chain& ch : chains) {
+      if (gQuick && strcmp(ch.compress, "gzip") == 0)
+         continue;
+
+      strlcpy(str, ch.compress, sizeof(str));
+      db_set_value(hDB, hKeySettings, "Compress", str, sizeof(str), 1, TID_STRING);
+      strlcpy(str, ch.checksum, sizeof(str));
+      db_set_value(hDB, hKeySettings, "Data checksum", str, sizeof(str), 1, TID_STRING);
+      strlcpy(str, "NONE", sizeof(str));
+      db_set_value(hDB, hKeySettings, "File checksum", str, sizeof(str), 1, TID_STRING);
+      strlcpy(str, "FILE", sizeof(str));
+      db_set_value(hDB, hKeySettings, "Output", str, sizeof(str), 1, TID_STRING);
+
+      char error[256];
+      double t0 = ss_time_sec();
+      int status = cm_transition(TR_START, 0, error, sizeof(error), TR_SYNC, FALSE);
+      if (status != CM_SUCCESS) {
+         Skipped("logger", msprintf("start transition failed: %s", error).c_str());
+         continue;
+      }
+
+      for (int i=0; i<nevents; i++) {
+         bm_compose_event(pevent, 1, 0, event_size, i);
+         ((uint32_t*)(pevent + 1))[0] = i; // vary the data a little
+         bm_send_event_vec(hbuf, event, BM_WAIT);
+      }
+      bm_flush_cache(hbuf, BM_WAIT);
+
+      status = cm_transition(TR_STOP, 0, error, sizeof(error), TR_SYNC, FALSE);
+      double t1 = ss_time_sec();
+
+      double bytes_written = 0;
+      int size = sizeof(bytes_written);
+      db_get_value(hDB, 0, "/Logger/Channels/0/Statistics/Bytes written", &bytes_written, &size, TID_DOUBLE, FALSE);
+
+      double bytes = (double)nevents*(event_size + sizeof(EVENT_HEADER));
+
+      MJsonNode* params = MJsonNode::MakeObject();
+      params->AddToObject("compress", MJsonNode::MakeString(ch.compress));
+      params->AddToObject("checksum", MJsonNode::MakeString(ch.checksum));
+      params->AddToObject("event_size", MJsonNode::MakeInt(event_size));
+      params->AddToObject("events", MJsonNode::MakeInt(nevents));
+      MJsonNode* metrics = MJsonNode::MakeObject();
+      metrics->AddToObject("mbytes_per_sec", MJsonNode::MakeNumber(bytes/1e6/(t1 - t0)));
+      metrics->AddToObject("compression_ratio", MJsonNode::MakeNumber(bytes_written > 0 ? bytes/bytes_written : 0));
+      metrics->AddToObject("stop_ok", MJsonNode::MakeBool(status == CM_SUCCESS));
+      Result("logger", params, metrics);
+
+      // do not fill the disk
+      RemoveDir(data_dir);
+      mkdir(data_dir.c_str(), 0755);
+   }
+
+   bm_close_buffer(hbuf);
+
+   cm_shutdown("Logger", FALSE);
+   waitpid(pid, NULL, 0);
+}
+
+/*------------------------------------------------------------------*/
+
+// msequencer reaction time: a script waits with WAIT ODBValue until
+// "ping" reaches its loop counter and sets "pong" to it, we see that
+// through a hotlink. The "hotlink" scenario gives the round trip
+// without the sequencer for comparison.
+static void BenchSequencer(HNDLE hDB)
+{
+   std::string msequencer = FindProgram("msequencer");
+   if (msequencer.empty()) {
+      Skipped("sequencer", "msequencer not found");
+      return;
+   }
+
+   int nloops = gQuick ? 100 : 1000;
+   int value = 0;
+
+   db_set_value(hDB, 0, "/bench/sequencer/ping", &value, sizeof(value), 1, TID_INT);
+   db_set_value(hDB, 0, "/bench/sequencer/pong", &value, sizeof(value), 1, TID_INT);
+
+   // MSL scripts are loaded from userfiles/sequencer/ of the experiment directory
+   std::string script_dir = gDir + "/userfiles";
+   mkdir(script_dir.c_str(), 0755);
+   script_dir += "/sequencer";
+   mkdir(script_dir.c_str(), 0755);
+
+   FILE* fp = fopen((script_dir + "/bench.msl").c_str(), "w");
+   if (!fp) {
+      Skipped("sequencer", msprintf("cannot write the script, errno %d (%s)", errno, strerror(errno)).c_str());
+      return;
+   }
+   fprintf(fp, "LOOP i, %d\n", nloops + 10);
+   fprintf(fp, "  WAIT ODBValue, /bench/sequencer/ping, >=, $i\n");
+   fprintf(fp, "  ODBSET /bench/sequencer/pong, $i\n");
+   fprintf(fp, "ENDLOOP\n");
+   fclose(fp);
+
+   std::string log = gDir + "/msequencer.log";
+
+   pid_t pid = fork();
+   if (pid == 0) {
+      int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0) {
+         dup2(fd, 1);
+         dup2(fd, 2);
+         close(fd);
+      }
+      execl(msequencer.c_str(), msequencer.c_str(), (char*)NULL);
+      _exit(127);
+   }
+
+   // load and start the script, the commands are repeated until
+   // msequencer watches them and resets "Load new file"
+   BOOL flag = FALSE;
+   int size = sizeof(flag);
+   bool loaded = false;
+   for (int i=0; i<100 && !loaded; i++) {
+      if (cm_exist("Sequencer", FALSE) == CM_SUCCESS) {
+         char str[256] = "bench.msl";
+         db_set_value(hDB, 0, "/Sequencer/Command/Load filename", str, sizeof(str), 1, TID_STRING);
+         flag = TRUE;
+         db_set_value(hDB, 0, "/Sequencer/Command/Load new file", &flag, sizeof(flag), 1, TID_BOOL);
+         for (int j=0; j<10 && flag; j++) {
+            ss_sleep(10);
+            size = sizeof(flag);
+            db_get_value(hDB, 0, "/Sequencer/Command/Load new file", &flag, &size, TID_BOOL, FALSE);
+         }
+         loaded = !flag;
+      }
+      if (!loaded)
+         ss_sleep(100);
+   }
+
+   bool running = false;
+   if (loaded) {
+      flag = TRUE;
+      db_set_value(hDB, 0, "/Sequencer/Command/Start script", &flag, sizeof(flag), 1, TID_BOOL);
+      for (int i=0; i<100 && !running; i++) {
+         ss_sleep(10);
+         flag = FALSE;
+         size = sizeof(flag);
+         db_get_value(hDB, 0, "/Sequencer/State/Running", &flag, &size, TID_BOOL, FALSE);
+         running = flag;
+      }
+   }
+
+   if (!running) {
+      char error[256] = "";
+      size = sizeof(error);
+      db_get_value(hDB, 0, "/Sequencer/State/Error", error, &size, TID_STRING, FALSE);
+      cm_shutdown("Sequencer", FALSE);
+      waitpid(pid, NULL, 0);
+      Skipped("sequencer", error[0] ? error : "msequencer did not start the script");
+      return;
+   }
+
+   HNDLE hKeyPing, hKeyPong;
+   db_find_key(hDB, 0, "/bench/sequencer/ping", &hKeyPing);
+   db_find_key(hDB, 0, "/bench/sequencer/pong", &hKeyPong);
+   gPong = 0;
+   db_watch(hDB, hKeyPong, pong_callback, NULL);
+
+   std::vector<double> reaction;
+   int timeouts = 0;
+
+   for (int i=1; i<=nloops + 10; i++) {
+      double t0 = ss_time_sec();
+      db_set_data(hDB, hKeyPing, &i, sizeof(i), 1, TID_INT);
+      while (gPong != i && ss_time_sec() - t0 < 1.0)
+         cm_yield(10);
+      double t1 = ss_time_sec();
+      if (gPong != i)
+         timeouts++;
+      else if (i > 10) // first loops are warm-up
+         reaction.push_back((t1 - t0)*1e6);
+   }
+
+   db_unwatch(hDB, hKeyPong);
+
+   flag = TRUE;
+   db_set_value(hDB, 0, "/Sequencer/Command/Stop immediately", &flag, sizeof(flag), 1, TID_BOOL);
+   cm_shutdown("Sequencer", FALSE);
+   waitpid(pid, NULL, 0);
+
+   double sum = 0;
+   for (double v : reaction)
+      sum += v;
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("loops", MJsonNode::MakeInt(nloops));
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("reaction_mean_usec", MJsonNode::MakeNumber(reaction.empty() ? 0 : sum/reaction.size()));
+   metrics->AddToObject("reaction_p50_usec", MJsonNode::MakeNumber(Percentile(reaction, 0.50)));
+   metrics->AddToObject("reaction_p99_usec", MJsonNode::MakeNumber(Percentile(reaction, 0.99)));
+   metrics->AddToObject("reaction_max_usec", MJsonNode::MakeNumber(Percentile(reaction, 1.0)));
+   metrics->AddToObject("timeouts", MJsonNode::MakeInt(timeouts));
+   Result("sequencer", params, metrics);
+}
+
+/*------------------------------------------------------------------*/
+
+// frontend scheduler: midas_bench_fe reads a simulated trigger with
+// calibrated busy polling, with poll back-off, and with back-off plus a
+// pipe watched by mfe_add_poll_fd(); the CPU time of the frontend and
+// the trigger to readout latency are measured for each trigger rate
+static void BenchMfe(HNDLE hDB)
+{
+   std::string fe = FindProgram("midas_bench_fe");
+   if (fe.empty()) {
+      Skipped("mfe", "midas_bench_fe not found");
+      return;
+   }
+
+   struct Mode {
+      const char* name;
+      int poll_backoff_max;
+      BOOL use_fd;
+   } modes[] = {
+      { "busy",            0,  FALSE },
+      { "backoff_1ms",     1,  FALSE },
+      { "backoff_10ms",    10, FALSE },
+      { "backoff_10ms_fd", 10, TRUE  },
+   };
+
+   std::vector<double> rates = { 100, 1000, 10000 };
+   double seconds = 3;
+
+   if (gQuick) {
+      rates = { 1000 };
+      seconds = 1;
+   }
+
+   std::string log = gDir + "/midas_bench_fe.log";
+
+   for (const Mode& m : modes) {
+      BOOL flag = FALSE;
+      db_set_value(hDB, 0, "/bench/mfe/Ready", &flag, sizeof(flag), 1, TID_BOOL);
+      db_set_value(hDB, 0, "/bench/mfe/Poll backoff max", &m.poll_backoff_max, sizeof(m.poll_backoff_max), 1, TID_INT);
+      db_set_value(hDB, 0, "/bench/mfe/Use fd", &m.use_fd, sizeof(m.use_fd), 1, TID_BOOL);
+
+      pid_t pid = fork();
+      if (pid == 0) {
+         int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+         if (fd >= 0) {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+         }
+         // keep the frontend away from our terminal
+         fd = open("/dev/null", O_RDONLY);
+         if (fd >= 0) {
+            dup2(fd, 0);
+            close(fd);
+         }
+         execl(fe.c_str(), fe.c_str(), (char*)NULL);
+         _exit(127);
+      }
+
+      // transitions are registered before frontend_init() sets "Ready"
+      for (int i=0; i<100 && !flag; i++) {
+         ss_sleep(100);
+         int size = sizeof(flag);
+         db_get_value(hDB, 0, "/bench/mfe/Ready", &flag, &size, TID_BOOL, FALSE);
+      }
+
+      if (!flag) {
+         kill(pid, SIGTERM);
+         waitpid(pid, NULL, 0);
+         Skipped("mfe", "midas_bench_fe did not start");
+         return;
+      }
+
+      for (double rate : rates) {
+         db_set_value(hDB, 0, "/bench/mfe/Trigger rate", &rate, sizeof(rate), 1, TID_DOUBLE);
+         HNDLE hKey;
+         if (db_find_key(hDB, 0, "/bench/mfe/Results", &hKey) == DB_SUCCESS)
+            db_delete_key(hDB, hKey, FALSE);
+
+         char error[256];
+         int status = cm_transition(TR_START, 0, error, sizeof(error), TR_SYNC, FALSE);
+         if (status != CM_SUCCESS) {
+            Skipped("mfe", msprintf("start transition failed: %s", error).c_str());
+            continue;
+         }
+         ss_sleep(seconds*1000);
+         status = cm_transition(TR_STOP, 0, error, sizeof(error), TR_SYNC, FALSE);
+         if (status != CM_SUCCESS) {
+            Skipped("mfe", msprintf("stop transition failed: %s", error).c_str());
+            continue;
+         }
+
+         double cpu = 0;
+         double wall = 0;
+         int triggers = 0;
+         int events = 0;
+         int size = sizeof(cpu);
+         db_get_value(hDB, 0, "/bench/mfe/Results/CPU seconds", &cpu, &size, TID_DOUBLE, FALSE);
+         size = sizeof(wall);
+         db_get_value(hDB, 0, "/bench/mfe/Results/Wall seconds", &wall, &size, TID_DOUBLE, FALSE);
+         size = sizeof(triggers);
+         db_get_value(hDB, 0, "/bench/mfe/Results/Triggers", &triggers, &size, TID_INT, FALSE);
+         size = sizeof(events);
+         db_get_value(hDB, 0, "/bench/mfe/Results/Events", &events, &size, TID_INT, FALSE);
+
+         std::vector<double> latency(events);
+         if (events > 0) {
+            size = events*sizeof(double);
+            db_get_value(hDB, 0, "/bench/mfe/Results/Latency", latency.data(), &size, TID_DOUBLE, FALSE);
+            latency.resize(size/sizeof(double));
+         }
+         for (double& v : latency)
+            v *= 1e6;
+
+         MJsonNode* params = MJsonNode::MakeObject();
+         params->AddToObject("mode", MJsonNode::MakeString(m.name));
+         params->AddToObject("trigger_rate", MJsonNode::MakeNumber(rate));
+         MJsonNode* metrics = MJsonNode::MakeObject();
+         metrics->AddToObject("cpu_fraction", MJsonNode::MakeNumber(wall > 0 ? cpu/wall : 0));
+         metrics->AddToObject("events_per_sec", MJsonNode::MakeNumber(wall > 0 ? events/wall : 0));
+         metrics->AddToObject("latency_p50_usec", MJsonNode::MakeNumber(Percentile(latency, 0.50)));
+         metrics->AddToObject("latency_p99_usec", MJsonNode::MakeNumber(Percentile(latency, 0.99)));
+         metrics->AddToObject("latency_max_usec", MJsonNode::MakeNumber(Percentile(latency, 1.0)));
+         metrics->AddToObject("unread_triggers", MJsonNode::MakeInt(triggers - events));
+         Result("mfe", params, metrics);
+      }
+
+      cm_shutdown("midas_bench_fe", FALSE);
+      waitpid(pid, NULL, 0);
+   }
+}
+
+/*------------------------------------------------------------------*/
+
+// remote event producers: an mserver started on a free port of this
+// host, producers connected through it send to the event buffer, a
+// local consumer reads the events
+static void BenchMserver()
+{
+   std::string mserver = FindProgram("mserver");
+   if (mserver.empty()) {
+      Skipped("mserver", "mserver not found");
+      return;
+   }
+
+   int lsock, port;
+   std::string errmsg;
+   if (ss_socket_listen_tcp(true, 0, &lsock, &port, &errmsg) != SS_SUCCESS) {
+      Skipped("mserver", msprintf("no free port: %s", errmsg.c_str()).c_str());
+      return;
+   }
+   ss_socket_close(&lsock);
+
+   std::string log = gDir + "/mserver.log";
+
+   pid_t pid = fork();
+   if (pid == 0) {
+      int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0) {
+         dup2(fd, 1);
+         dup2(fd, 2);
+         close(fd);
+      }
+      execl(mserver.c_str(), mserver.c_str(), "-p", msprintf("%d", port).c_str(), (char*)NULL);
+      _exit(127);
+   }
+
+   // wait until mserver listens
+   bool listening = false;
+   for (int i=0; i<100 && !listening; i++) {
+      int sock;
+      if (ss_socket_connect_tcp("localhost", port, &sock, &errmsg) == SS_SUCCESS) {
+         ss_socket_close(&sock);
+         listening = true;
+      } else {
+         ss_sleep(100);
+      }
+   }
+
+   if (!listening) {
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      Skipped("mserver", "mserver did not start");
+      return;
+   }
+
+   std::string host = msprintf("localhost:%d", port);
+
+   std::vector<int> producers = { 1, 2 };
+   std::vector<int> sizes = { 64, 1024, 16384, 262144 };
+
+   if (gQuick) {
+      producers = { 1 };
+      sizes = { 1024, 65536 };
+   }
+
+   for (int np : producers)
+      for (int size : sizes)
+         RunBm("mserver", np, 1, size, false, host);
+
+   // striped transport, compare with streams 0 of the same event size above
+   std::vector<int> streams = { 1, 2, 4, 8 };
+   int scan_size = 262144;
+
+   if (gQuick) {
+      streams = { 2 };
+      scan_size = 65536;
+   }
+
+   for (int n : streams)
+      RunBm("mserver", 1, 1, scan_size, false, host, n);
+
+   cm_shutdown("mserver", FALSE);
+   waitpid(pid, NULL, 0);
+}
+
+/*------------------------------------------------------------------*/
+
+// history: write one event with "nvars" variables every second for "nrows" seconds, then read it back
+static void BenchHistory()
+{
+   int nvars = 20;
+   int nrows = gQuick ? 10000 : 100000;
+   time_t start = ss_time() - nrows;
+   time_t end = start + nrows;
+
+   std::vector<TAG> tags(nvars);
+   for (int i=0; i<nvars; i++) {
+      snprintf(tags[i].name, sizeof(tags[i].name), "v%d", i);
+      tags[i].type = TID_DOUBLE;
+      tags[i].n_data = 1;
+   }
+
+   struct Type {
+      const char* name;
+      MidasHistoryInterface* (*make)();
+   } types[] = {
+      { "FILE", MakeMidasHistoryFile },
+      { "MIDAS", MakeMidasHistory },
+      { "SQLITE", MakeMidasHistorySqlite },
+   };
+
+   for (const Type& t : types) {
+      MidasHistoryInterface* mh = t.make();
+      if (!mh) {
+         Skipped("history", msprintf("%s history not available", t.name).c_str());
+         continue;
+      }
+
+      std::string dir = gDir + "/history_" + t.name;
+      mkdir(dir.c_str(), 0755);
+
+      int status = mh->hs_connect(dir.c_str());
+      if (status != HS_SUCCESS) {
+         delete mh;
+         Skipped("history", msprintf("%s history: hs_connect() status %d", t.name, status).c_str());
+         continue;
+      }
+
+      std::vector<double> data(nvars);
+      double t0 = ss_time_sec();
+      mh->hs_define_event("bench", start, nvars, tags.data());
+      for (int r=0; r<nrows; r++) {
+         for (int i=0; i<nvars; i++)
+            data[i] = r + i;
+         mh->hs_write_event("bench", start + r, nvars*sizeof(double), (const char*)data.data());
+      }
+      mh->hs_flush_buffers();
+      double t1 = ss_time_sec();
+
+      // read all variables, and one variable
+      for (int n : { nvars, 1 }) {
+         std::vector<const char*> event_name(n, "bench");
+         std::vector<const char*> tag_name(n);
+         std::vector<int> var_index(n, 0);
+         for (int i=0; i<n; i++)
+            tag_name[i] = tags[i].name;
+
+         std::vector<int> num_entries(n);
+         std::vector<time_t*> time_buffer(n);
+         std::vector<double*> data_buffer(n);
+         std::vector<int> hs_status(n);
+
+         mh->hs_clear_cache();
+         double r0 = ss_time_sec();
+         mh->hs_read(start, end, 0, n, event_name.data(), tag_name.data(), var_index.data(), num_entries.data(), time_buffer.data(), data_buffer.data(), hs_status.data());
+         double r1 = ss_time_sec();
+
+         double entries = 0;
+         for (int i=0; i<n; i++) {
+            entries += num_entries[i];
+            free(time_buffer[i]);
+            free(data_buffer[i]);
+         }
+
+         // binned, as used by the history plots
+         int num_bins = 1000;
+         std::vector<int> nentries(n), bstatus(n);
+         std::vector<std::vector<int>> count(n, std::vector<int>(num_bins));
+         std::vector<std::vector<double>> mean(n, std::vector<double>(num_bins)), rms = mean, vmin = mean, vmax = mean, first_value = mean, last_value = mean;
+         std::vector<std::vector<time_t>> first_time(n, std::vector<time_t>(num_bins)), last_time = first_time;
+         std::vector<int*> pcount(n);
+         std::vector<double*> pmean(n), prms(n), pmin(n), pmax(n), pfirst_value(n), plast_value(n);
+         std::vector<time_t*> pfirst_time(n), plast_time(n);
+         std::vector<time_t> xlast_time(n);
+         std::vector<double> xlast_value(n);
+         for (int i=0; i<n; i++) {
+            pcount[i] = count[i].data();
+            pmean[i] = mean[i].data();
+            prms[i] = rms[i].data();
+            pmin[i] = vmin[i].data();
+            pmax[i] = vmax[i].data();
+            pfirst_value[i] = first_value[i].data();
+            plast_value[i] = last_value[i].data();
+            pfirst_time[i] = first_time[i].data();
+            plast_time[i] = last_time[i].data();
+         }
+
+         mh->hs_clear_cache();
+         double b0 = ss_time_sec();
+         mh->hs_read_binned(start, end, num_bins, n, event_name.data(), tag_name.data(), var_index.data(), nentries.data(),
+                            pcount.data(), pmean.data(), prms.data(), pmin.data(), pmax.data(),
+                            pfirst_time.data(), pfirst_value.data(), plast_time.data(), plast_value.data(),
+                            xlast_time.data(), xlast_value.data(), bstatus.data());
+         double b1 = ss_time_sec();
+
+         MJsonNode* params = MJsonNode::MakeObject();
+         params->AddToObject("type", MJsonNode::MakeString(t.name));
+         params->AddToObject("rows", MJsonNode::MakeInt(nrows));
+         params->AddToObject("variables", MJsonNode::MakeInt(nvars));
+         params->AddToObject("read_variables", MJsonNode::MakeInt(n));
+         MJsonNode* metrics = MJsonNode::MakeObject();
+         if (n == nvars)
+            metrics->AddToObject("write_rows_per_sec", MJsonNode::MakeNumber(nrows/(t1 - t0)));
+         metrics->AddToObject("hs_read_sec", MJsonNode::MakeNumber(r1 - r0));
+         metrics->AddToObject("hs_read_entries", MJsonNode::MakeNumber(entries));
+         metrics->AddToObject("hs_read_binned_sec", MJsonNode::MakeNumber(b1 - b0));
+         Result("history", params, metrics);
+      }
+
+      mh->hs_disconnect();
+      delete mh;
+   }
+}
+
+/*------------------------------------------------------------------*/
+
+// synthetic document in "ODB save" format, one directory is about 12 kB
+static std::string MakeOdbJson(double mbytes)
+{
+   int ndirs = mbytes*1e6/12e3 + 1;
+   std::string s = "{\n";
+   for (int dir=0; dir<ndirs; dir++) {
+      s += msprintf("%s  \"Dir%05d\" : {\n", dir ? ",\n" : "", dir);
+      for (int v=0; v<4; v++) {
+         s += msprintf("    \"Double%d/key\" : { \"type\" : 10, \"num_values\" : 200 },\n", v);
+         s += msprintf("    \"Double%d\" : [", v);
+         for (int i=0; i<200; i++)
+            s += msprintf("%s%.6f", i ? ", " : "", dir + v + i/1000.0);
+         s += "],\n";
+         s += msprintf("    \"Names%d/key\" : { \"type\" : 12, \"num_values\" : 16, \"item_size\" : 32 },\n", v);
+         s += msprintf("    \"Names%d\" : [", v);
+         for (int i=0; i<16; i++)
+            s += msprintf("%s\"name %d/%d\"", i ? ", " : "", dir, i);
+         s += "],\n";
+         s += msprintf("    \"Count%d/key\" : { \"type\" : 7 },\n", v);
+         s += msprintf("    \"Count%d\" : %d,\n", v, dir*10 + v);
+      }
+      s += msprintf("    \"Enabled\" : %s\n  }", dir % 2 ? "true" : "false");
+   }
+   s += "\n}\n";
+   return s;
+}
+
+static void BenchJson(HNDLE hDB)
+{
+   double mbytes = gQuick ? 1 : 5;
+   std::string json = MakeOdbJson(mbytes);
+
+   db_create_key(hDB, 0, "/bench/json", TID_KEY);
+   HNDLE hKey;
+   db_find_key(hDB, 0, "/bench/json", &hKey);
+
+   double t0 = ss_time_sec();
+   int status_new = db_paste_json(hDB, hKey, json.c_str());
+   double t1 = ss_time_sec();
+   int status_existing = db_paste_json(hDB, hKey, json.c_str());
+   double t2 = ss_time_sec();
+
+   char* buffer = NULL;
+   int buffer_size = 0;
+   int buffer_end = 0;
+   double save = BestTime(3, [&]() {
+      buffer_end = 0;
+      db_copy_json_save(hDB, hKey, &buffer, &buffer_size, &buffer_end);
+   });
+   free(buffer);
+
+   double parse = BestTime(1, [&]() { delete MJsonNode::Parse(json.c_str()); });
+
+   db_delete_key(hDB, hKey, FALSE);
+
+   double mb = json.size()/1e6;
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("mbytes", MJsonNode::MakeNumber(mb));
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("paste_new_mbytes_per_sec", MJsonNode::MakeNumber(mb/(t1 - t0)));
+   metrics->AddToObject("paste_existing_mbytes_per_sec", MJsonNode::MakeNumber(mb/(t2 - t1)));
+   metrics->AddToObject("paste_ok", MJsonNode::MakeBool(status_new == DB_SUCCESS && status_existing == DB_SUCCESS));
+   metrics->AddToObject("copy_json_save_mbytes_per_sec", MJsonNode::MakeNumber(buffer_end/1e6/save));
+   metrics->AddToObject("mjson_parse_mbytes_per_sec", MJsonNode::MakeNumber(mb/parse));
+   Result("json", params, metrics);
+}
+
+// db_copy JSON-RPC request for a large ODB subtree, reply streamed into
+// one buffer versus built as an MJsonNode tree (the old API). Each
+// request runs in its own process, so the peak RSS is its own.
+static void BenchJsonRpc(HNDLE hDB)
+{
+   double mbytes = gQuick ? 5 : 50;
+   int repeat = gQuick ? 1 : 3;
+   std::string json = MakeOdbJson(mbytes);
+
+   db_create_key(hDB, 0, "/bench/jsonrpc", TID_KEY);
+   HNDLE hKey;
+   db_find_key(hDB, 0, "/bench/jsonrpc", &hKey);
+
+   int status = db_paste_json(hDB, hKey, json.c_str());
+   if (status != DB_SUCCESS) {
+      db_delete_key(hDB, hKey, FALSE);
+      Skipped("jsonrpc", msprintf("cannot load the test document into the ODB, db_paste_json() status %d", status).c_str());
+      return;
+   }
+
+   for (const char* reply : { "stream", "tree" }) {
+      Children c;
+      c.Start("jsonrpc", { "/bench/jsonrpc", reply, msprintf("%d", repeat) });
+      if (!c.Go()) {
+         Skipped("jsonrpc", "child process did not start");
+         c.Results();
+         continue;
+      }
+
+      std::vector<std::string> results = c.Results();
+      double t = 0;
+      double bytes = 0;
+      long maxrss0 = 0;
+      long maxrss = 0;
+      if (results.empty() || sscanf(results[0].c_str(), "J %lf %lf %ld %ld", &t, &bytes, &maxrss0, &maxrss) != 4) {
+         Skipped("jsonrpc", "child process failed");
+         continue;
+      }
+
+      // ru_maxrss is in kB; the ODB pages read by db_copy count in both cases
+      MJsonNode* params = MJsonNode::MakeObject();
+      params->AddToObject("reply", MJsonNode::MakeString(reply));
+      params->AddToObject("odb_mbytes", MJsonNode::MakeNumber(json.size()/1e6));
+      MJsonNode* metrics = MJsonNode::MakeObject();
+      metrics->AddToObject("response_ms", MJsonNode::MakeNumber(t*1000));
+      metrics->AddToObject("reply_mbytes", MJsonNode::MakeNumber(bytes/1e6));
+      metrics->AddToObject("peak_rss_mbytes", MJsonNode::MakeNumber(maxrss/1024.0));
+      metrics->AddToObject("peak_rss_increase_mbytes", MJsonNode::MakeNumber((maxrss - maxrss0)/1024.0));
+      Result("jsonrpc", params, metrics);
+   }
+
+   db_delete_key(hDB, hKey, FALSE);
+}
+
+/*------------------------------------------------------------------*/
+
+static void BenchChecksum()
+{
+   size_t size = gQuick ? 16*1024*1024 : 256*1024*1024;
+   std::vector<char> buf(size);
+   FillWaveform(buf.data(), size);
+   const unsigned char* p = (const unsigned char*)buf.data();
+   int repeat = gQuick ? 1 : 3;
+
+   volatile uint64_t sink = 0;
+   unsigned char digest[64];
+
+   struct Algo {
+      const char* name;
+      std::function<void()> f;
+   };
+
+   std::vector<Algo> algos = {
+      { "crc32c",    [&]() { sink += crc32c(0, p, size); } },
+      { "crc32c_sw", [&]() { sink += crc32c_sw(0, p, size); } },
+      { "zlib_crc32", [&]() { sink += crc32(0, p, size); } },
+      { "sha256",    [&]() { mbedtls_sha256(p, size, digest, 0); sink += digest[0]; } },
+      { "sha512",    [&]() { mbedtls_sha512(p, size, digest, 0); sink += digest[0]; } },
+      { "xxh64",     [&]() { sink += XXH64(p, size, 0); } },
+   };
+
+   for (const Algo& a : algos) {
+      double t = BestTime(repeat, a.f);
+      MJsonNode* params = MJsonNode::MakeObject();
+      params->AddToObject("algorithm", MJsonNode::MakeString(a.name));
+      params->AddToObject("mbytes", MJsonNode::MakeNumber(size/1e6));
+      MJsonNode* metrics = MJsonNode::MakeObject();
+      metrics->AddToObject("mbytes_per_sec", MJsonNode::MakeNumber(size/1e6/t));
+      Result("checksum", params, metrics);
+   }
+}
+
+/*------------------------------------------------------------------*/
+
+static void BenchLz4()
+{
+   size_t size = gQuick ? 16*1024*1024 : 128*1024*1024;
+   std::vector<char> src(size);
+   FillWaveform(src.data(), size);
+   int repeat = gQuick ? 1 : 3;
+
+   MLZ4F_preferences_t prefs;
+   memset(&prefs, 0, sizeof(prefs));
+   prefs.frameInfo.blockSizeID = MLZ4F_max4MB;
+
+   std::vector<char> dst(MLZ4F_compressFrameBound(size, &prefs));
+   size_t csize = 0;
+
+   double tc = BestTime(repeat, [&]() { csize = MLZ4F_compressFrame(dst.data(), dst.size(), src.data(), size, &prefs); });
+
+   if (MLZ4F_isError(csize)) {
+      Skipped("lz4", MLZ4F_getErrorName(csize));
+      return;
+   }
+
+   std::vector<char> out(size);
+   bool ok = true;
+   double td = BestTime(repeat, [&]() {
+      MLZ4F_decompressionContext_t dctx;
+      MLZ4F_createDecompressionContext(&dctx, MLZ4F_VERSION);
+      size_t out_size = out.size();
+      size_t in_size = csize;
+      size_t ret = MLZ4F_decompress(dctx, out.data(), &out_size, dst.data(), &in_size, NULL);
+      ok = !MLZ4F_isError(ret) && out_size == size;
+      MLZ4F_freeDecompressionContext(dctx);
+   });
+
+   ok = ok && memcmp(src.data(), out.data(), size) == 0;
+
+   MJsonNode* params = MJsonNode::MakeObject();
+   params->AddToObject("mbytes", MJsonNode::MakeNumber(size/1e6));
+   params->AddToObject("data", MJsonNode::MakeString("waveform"));
+   MJsonNode* metrics = MJsonNode::MakeObject();
+   metrics->AddToObject("compress_mbytes_per_sec", MJsonNode::MakeNumber(size/1e6/tc));
+   metrics->AddToObject("decompress_mbytes_per_sec", MJsonNode::MakeNumber(size/1e6/td));
+   metrics->AddToObject("compression_ratio", MJsonNode::MakeNumber((double)size/csize));
+   metrics->AddToObject("roundtrip_ok", MJsonNode::MakeBool(ok));
+   Result("lz4", params, metrics);
+}
+
+/*------------------------------------------------------------------*/
+
+// V1720 (8 channels) and V1740 (8 groups) events, as written by the frontends
+static void MakeCaenEvent(int type, int nsamples, std::vector<uint32_t>* data)
+{
+   int nchannels = (type == CAEN_V1740) ? 64 : 8;
+   std::vector<uint16_t> s(nchannels*nsamples);
+   FillWaveform((char*)s.data(), s.size()*2);
+
+   data->clear();
+   data->push_back(0);
+   data->push_back((5u<<27) | 0xFF);
+   data->push_back(1);
+   data->push_back(0);
+
+   if (type == CAEN_V1720) {
+      for (size_t i=0; i<s.size(); i+=2)
+         data->push_back(s[i] | ((uint32_t)s[i+1] << 16));
+   } else {
+      for (int g=0; g<8; g++)
+         for (int i=0; i<nsamples; i+=8)
+            for (int ch=0; ch<8; ch++) {
+               uint32_t w[3] = { 0, 0, 0 };
+               for (int j=0; j<8; j++) {
+                  uint32_t v = s[(g*8 + ch)*nsamples + i + j] & 0xFFF;
+                  int bit = 12*j;
+                  w[bit/32] |= v << (bit%32);
+                  if (bit%32 > 20)
+                     w[bit/32 + 1] |= v >> (32 - bit%32);
+               }
+               data->push_back(w[0]);
+               data->push_back(w[1]);
+               data->push_back(w[2]);
+            }
+   }
+
+   (*data)[0] = 0xA0000000 | data->size();
+}
+
+static void BenchCaen()
+{
+   int nsamples = 1024;
+   int nloops = gQuick ? 2000 : 20000;
+
+   for (int type : { CAEN_V1720, CAEN_V1740 }) {
+      std::vector<uint32_t> data;
+      MakeCaenEvent(type, nsamples, &data);
+      std::vector<int16_t> samples(64*nsamples);
+      CAEN_EVENT event;
+
+      for (int impl : { CAEN_UNPACK_SCALAR, CAEN_UNPACK_AUTO }) {
+         int used = caen_unpack_select(impl);
+         int status = 0;
+         double t = BestTime(3, [&]() {
+            for (int i=0; i<nloops; i++)
+               status = caen_unpack(type, data.data(), data.size(), &event, samples.data(), samples.size());
+         });
+
+         MJsonNode* params = MJsonNode::MakeObject();
+         params->AddToObject("board", MJsonNode::MakeString(type == CAEN_V1720 ? "V1720" : "V1740"));
+         params->AddToObject("impl", MJsonNode::MakeString(used == CAEN_UNPACK_AVX2 ? "avx2" : used == CAEN_UNPACK_SSE ? "sse" : "scalar"));
+         params->AddToObject("samples", MJsonNode::MakeInt(nsamples));
+         MJsonNode* metrics = MJsonNode::MakeObject();
+         metrics->AddToObject("mbytes_per_sec", MJsonNode::MakeNumber(nloops*data.size()*4/1e6/t));
+         metrics->AddToObject("events_per_sec", MJsonNode::MakeNumber(nloops/t));
+         metrics->AddToObject("ok", MJsonNode::MakeBool(status == CAEN_SUCCESS));
+         Result("caen", params, metrics);
+      }
+   }
+
+   caen_unpack_select(CAEN_UNPACK_AUTO);
+}
+
+/*------------------------------------------------------------------*/
+
+// V1720 readout through the mvmesim crate simulator: one event of all
+// boards is read with synchronous DMA, or queued with asynchronous DMA
+// while the previous event is unpacked
+static void BenchVme()
+{
+   const int nboards = 4;
+   const mvme_addr_t base0 = 0x32100000;
+   int nevents = gQuick ? 200 : 2000;
+
+   for (int async : { 0, 1 }) {
+      MVME_INTERFACE* mvme = NULL;
+      int status = mvme_open(&mvme, 0);
+      if (status != MVME_SUCCESS) {
+         Skipped("vme", "cannot open the VME simulator");
+         return;
+      }
+
+      for (int b=0; b<nboards; b++) {
+         uint32_t base = base0 + b*0x10000;
+         mvmesim_add_board(mvme, MVMESIM_V1720, base);
+         v1720_Reset(mvme, base);
+         v1720_RegisterWrite(mvme, base, V1720_BUFFER_ORGANIZATION, 0x0A); // 1024 samples
+         v1720_RegisterWrite(mvme, base, V1720_CHANNEL_EN_MASK, 0xFF);
+         v1720_RegisterWrite(mvme, base, V1720_TRIG_SRCE_EN_MASK, V1720_SOFT_TRIGGER);
+         v1720_AcqCtl(mvme, base, V1720_RUN_START);
+      }
+
+      // two sets of event buffers, one being read while the other is unpacked
+      std::vector<uint32_t> data[2][nboards];
+      int nwords[2][nboards];
+      V1720_BLOCK_READ* rd = new V1720_BLOCK_READ[nboards];
+      std::vector<int16_t> samples(8*1024);
+      CAEN_EVENT event;
+      int errors = 0;
+      double bytes = 0;
+
+      auto unpack = [&](int set) {
+         for (int b=0; b<nboards; b++)
+            if (caen_unpack(CAEN_V1720, data[set][b].data(), nwords[set][b], &event, samples.data(), samples.size()) != CAEN_SUCCESS)
+               errors++;
+      };
+
+      double bus_bytes0, bus_busy0;
+      mvmesim_get_bus_stat(mvme, &bus_bytes0, &bus_busy0);
+
+      double t0 = ss_time_sec();
+
+      for (int i=0; i<nevents; i++) {
+         int set = i%2;
+
+         for (int b=0; b<nboards; b++)
+            v1720_RegisterWrite(mvme, base0 + b*0x10000, V1720_SW_TRIGGER, 1);
+
+         for (int b=0; b<nboards; b++) {
+            uint32_t base = base0 + b*0x10000;
+            while (v1720_RegisterRead(mvme, base, V1720_EVENT_STORED) == 0) {}
+            nwords[set][b] = v1720_RegisterRead(mvme, base, V1720_EVENT_SIZE);
+            data[set][b].resize(nwords[set][b]);
+            bytes += 4*nwords[set][b];
+            if (async)
+               v1720_DataBlockReadStart(mvme, base, data[set][b].data(), nwords[set][b], &rd[b]);
+            else if (v1720_DataBlockRead(mvme, base, data[set][b].data(), nwords[set][b]) != MVME_SUCCESS)
+               errors++;
+         }
+
+         if (async) {
+            if (i > 0)
+               unpack(1 - set);
+            for (int b=0; b<nboards; b++)
+               if (v1720_DataBlockReadWait(mvme, &rd[b]) != MVME_SUCCESS)
+                  errors++;
+         } else {
+            unpack(set);
+         }
+      }
+
+      if (async)
+         unpack((nevents - 1)%2);
+
+      double t = ss_time_sec() - t0;
+
+      double bus_bytes, bus_busy;
+      mvmesim_get_bus_stat(mvme, &bus_bytes, &bus_busy);
+
+      delete[] rd;
+      mvme_close(mvme);
+
+      MJsonNode* params = MJsonNode::MakeObject();
+      params->AddToObject("mode", MJsonNode::MakeString(async ? "async" : "sync"));
+      params->AddToObject("boards", MJsonNode::MakeInt(nboards));
+      params->AddToObject("event_kbytes", MJsonNode::MakeNumber(bytes/nevents/1e3));
+      MJsonNode* metrics = MJsonNode::MakeObject();
+      metrics->AddToObject("events_per_sec", MJsonNode::MakeNumber(nevents/t));
+      metrics->AddToObject("mbytes_per_sec", MJsonNode::MakeNumber(bytes/1e6/t));
+      metrics->AddToObject("bus_busy_fraction", MJsonNode::MakeNumber((bus_busy - bus_busy0)/t));
+      metrics->AddToObject("ok", MJsonNode::MakeBool(errors == 0));
+      Result("vme", params, metrics);
+   }
+}
+
+/*------------------------------------------------------------------*/
+
+static const char* const gScenarios[] = { "bm", "odb", "hotlink", "sequencer", "mfe", "logger", "mserver", "history", "json", "jsonrpc", "checksum", "lz4", "caen", "vme", NULL };
+
+static void Usage()
+{
+   printf("Usage: midas_bench [-q] [-o results.json] [-s scenario,...] [-k] [-l]\n");
+   printf("  -q  quick run with small sizes and short times\n");
+   printf("  -o  JSON output file, default midas_bench.json\n");
+   printf("  -s  comma-separated list of scenarios to run, default all\n");
+   printf("  -k  keep the test experiment directory\n");
+   printf("  -l  list the scenarios\n");
+}
+
+int main(int argc, char *argv[])
+{
+   setbuf(stdout, NULL);
+   setbuf(stderr, NULL);
+
+   char exe[1024];
+   ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+   if (len > 0) {
+      exe[len] = 0;
+      gExe = exe;
+   } else {
+      gExe = argv[0];
+   }
+
+   if (argc > 1 && strcmp(argv[1], "--child") == 0)
+      return ChildMain(argc, argv);
+
+   std::string output = "midas_bench.json";
+   std::string selected;
+   bool keep = false;
+
+   for (int i=1; i<argc; i++) {
+      if (strcmp(argv[i], "-q") == 0)
+         gQuick = true;
+      else if (strcmp(argv[i], "-k") == 0)
+         keep = true;
+      else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+         output = argv[++i];
+      else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+         selected = std::string(",") + argv[++i] + ",";
+      else if (strcmp(argv[i], "-l") == 0) {
+         for (int j=0; gScenarios[j]; j++)
+            printf("%s\n", gScenarios[j]);
+         return 0;
+      } else {
+         Usage();
+         return 1;
+      }
+   }
+
+   // >>> private test experiment
+
+   char dir[] = "/tmp/midas_bench_XXXXXX";
+   if (!mkdtemp(dir)) {
+      printf("Cannot create the test experiment directory, mkdtemp() errno %d (%s)\n", errno, strerror(errno));
+      return 1;
+   }
+   gDir = dir;
+
+   setenv("MIDAS_DIR", dir, 1);
+   setenv("MIDAS_EXPT_NAME", "midas_bench", 1);
+   unsetenv("MIDAS_SERVER_HOST");
+
+   // room for the 50 MB document of the "jsonrpc" scenario
+   int status = cm_connect_experiment1("", "midas_bench", "midas_bench", NULL, 128*1024*1024, 0);
+   if (status != CM_SUCCESS) {
+      printf("Cannot create the test experiment in %s, cm_connect_experiment() status %d\n", dir, status);
+      return 1;
+   }
+
+   cm_set_watchdog_params(0, 0);
+
+   HNDLE hDB;
+   cm_get_experiment_database(&hDB, NULL);
+
+   // the event buffer of the "bm" scenario
+   int buffer_size = 64*1024*1024;
+   db_set_value(hDB, 0, "/Experiment/Buffer sizes/BMBENCH", &buffer_size, sizeof(buffer_size), 1, TID_UINT32);
+
+   gResults = MJsonNode::MakeArray();
+
+   time_t now = time(NULL);
+   struct tm tms;
+   ss_tzset(); // required for localtime_r()
+   localtime_r(&now, &tms);
+   char date[64];
+   strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", &tms);
+   char hostname[256];
+   gethostname(hostname, sizeof(hostname));
+
+   printf("midas_bench: version %s, revision %s, test experiment in %s\n", cm_get_version(), cm_get_revision(), dir);
+
+   for (int i=0; gScenarios[i]; i++) {
+      const char* s = gScenarios[i];
+      if (!selected.empty() && selected.find(std::string(",") + s + ",") == std::string::npos)
+         continue;
+
+      if (strcmp(s, "bm") == 0)
+         BenchBm();
+      else if (strcmp(s, "odb") == 0)
+         BenchOdb(hDB);
+      else if (strcmp(s, "hotlink") == 0)
+         BenchHotlink(hDB);
+      else if (strcmp(s, "sequencer") == 0)
+         BenchSequencer(hDB);
+      else if (strcmp(s, "mfe") == 0)
+         BenchMfe(hDB);
+      else if (strcmp(s, "logger") == 0)
+         BenchLogger(hDB);
+      else if (strcmp(s, "mserver") == 0)
+         BenchMserver();
+      else if (strcmp(s, "history") == 0)
+         BenchHistory();
+      else if (strcmp(s, "json") == 0)
+         BenchJson(hDB);
+      else if (strcmp(s, "jsonrpc") == 0)
+         BenchJsonRpc(hDB);
+      else if (strcmp(s, "checksum") == 0)
+         BenchChecksum();
+      else if (strcmp(s, "lz4") == 0)
+         BenchLz4();
+      else if (strcmp(s, "caen") == 0)
+         BenchCaen();
+      else if (strcmp(s, "vme") == 0)
+         BenchVme();
+   }
+
+   MJsonNode* doc = MJsonNode::MakeObject();
+   doc->AddToObject("midas_bench", MJsonNode::MakeInt(1)); // format version
+   doc->AddToObject("midas_version", MJsonNode::MakeString(cm_get_version()));
+   doc->AddToObject("midas_revision", MJsonNode::MakeString(cm_get_revision()));
+   doc->AddToObject("date", MJsonNode::MakeString(date));
+   doc->AddToObject("host", MJsonNode::MakeString(hostname));
+   doc->AddToObject("cpus", MJsonNode::MakeInt(std::thread::hardware_concurrency()));
+   doc->AddToObject("quick", MJsonNode::MakeBool(gQuick));
+   doc->AddToObject("results", gResults);
+
+   std::string json = doc->Stringify() + "\n";
+   delete doc;
+
+   int errors = 0;
+   FILE* fp = fopen(output.c_str(), "w");
+   if (fp) {
+      fputs(json.c_str(), fp);
+      fclose(fp);
+      printf("midas_bench: results written to %s\n", output.c_str());
+   } else {
+      printf("midas_bench: cannot write %s, errno %d (%s)\n", output.c_str(), errno, strerror(errno));
+      errors++;
+   }
+
+   cm_disconnect_experiment();
+
+   if (!keep) {
+      ss_shm_delete("ODB");
+      ss_shm_delete("SYSTEM");
+      ss_shm_delete("SYSMSG");
+      ss_shm_delete("BMBENCH");
+      RemoveDir(gDir);
+   }
+
+   return errors ? 1 : 0;
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,258 @@
+//
+// midas_bench_fe: frontend for the "mfe" scenario of midas_bench.
+//
+// A thread simulates a trigger source with a fixed rate, the polled
+// equipment reads one event per trigger. At the end of the run the
+// trigger to readout latency of each event and the CPU time used by
+// the frontend are written to /bench/mfe/Results.
+//
+// Settings in /bench/mfe, read at startup and begin of run:
+//
+//   Poll backoff max  poll_backoff_max of the scheduler, 0 for busy polling
+//   Use fd            the trigger also writes to a pipe, watched with mfe_add_poll_fd()
+//   Trigger rate      triggers per second
+//
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "midas.h"
+#include "mfe.h"
+
+const char *frontend_name = "midas_bench_fe";
+const char *frontend_file_name = __FILE__;
+
+BOOL frontend_call_loop = FALSE;
+int display_period = 0;
+int max_event_size = 1024;
+int max_event_size_frag = 5*1024;
+int event_buffer_size = 1024*1024;
+
+static std::thread* gTriggerThread = NULL;
+static std::atomic<bool> gStop(false);
+static std::mutex gMutex;
+static std::deque<double> gTriggers; // times of triggers not yet read
+static std::atomic<int> gPending(0);
+static std::vector<double> gLatency; // seconds from trigger to readout
+static int gNtriggers = 0;
+static int gPipe[2] = { -1, -1 };
+static BOOL gUseFd = FALSE;
+static double gCpu0 = 0;
+static double gTime0 = 0;
+
+INT read_trigger_event(char *pevent, INT off);
+
+BOOL equipment_common_overwrite = TRUE;
+
+EQUIPMENT equipment[] = {
+
+   {"Bench",                 /* equipment name */
+      {1, 0,                 /* event ID, trigger mask */
+         "SYSTEM",           /* event buffer */
+         EQ_POLLED,          /* equipment type */
+         0,                  /* event source */
+         "MIDAS",            /* format */
+         TRUE,               /* enabled */
+         RO_RUNNING,         /* read only when running */
+         100,                /* poll for 100ms */
+         0,                  /* stop run after this event limit */
+         0,                  /* number of sub events */
+         0,                  /* don't log history */
+         "", "", "", "", "", 0, 0},
+      read_trigger_event,    /* readout routine */
+   },
+
+   {""}
+};
+
+/*-- Simulated trigger ---------------------------------------------*/
+
+static void trigger_thread(double rate)
+{
+   auto next = std::chrono::steady_clock::now();
+   auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0/rate));
+
+   while (!gStop) {
+      next += period;
+      std::this_thread::sleep_until(next);
+
+      {
+         std::lock_guard<std::mutex> lock(gMutex);
+         gTriggers.push_back(ss_time_sec());
+         gNtriggers++;
+      }
+      gPending++;
+
+      if (gUseFd) {
+         if (write(gPipe[1], "T", 1) != 1) {
+            // pipe full, the readout is behind and polls anyway
+         }
+      }
+   }
+}
+
+static double cpu_time()
+{
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + 1e-6*(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+/*-- Frontend callbacks --------------------------------------------*/
+
+INT frontend_init()
+{
+   int backoff = poll_backoff_max;
+   int size = sizeof(backoff);
+   db_get_value(hDB, 0, "/bench/mfe/Poll backoff max", &backoff, &size, TID_INT, TRUE);
+   poll_backoff_max = backoff;
+
+   size = sizeof(gUseFd);
+   db_get_value(hDB, 0, "/bench/mfe/Use fd", &gUseFd, &size, TID_BOOL, TRUE);
+
+   if (gUseFd) {
+      if (pipe(gPipe) != 0)
+         return FE_ERR_HW;
+      fcntl(gPipe[0], F_SETFL, O_NONBLOCK);
+      fcntl(gPipe[1], F_SETFL, O_NONBLOCK);
+      if (mfe_add_poll_fd(gPipe[0]) != FE_SUCCESS)
+         return FE_ERR_HW;
+   }
+
+   BOOL ready = TRUE;
+   db_set_value(hDB, 0, "/bench/mfe/Ready", &ready, sizeof(ready), 1, TID_BOOL);
+
+   return SUCCESS;
+}
+
+INT frontend_exit()
+{
+   if (gUseFd) {
+      mfe_remove_poll_fd(gPipe[0]);
+      close(gPipe[0]);
+      close(gPipe[1]);
+   }
+   return SUCCESS;
+}
+
+INT begin_of_run(INT run_number, char *error)
+{
+   double rate = 1000;
+   int size = sizeof(rate);
+   db_get_value(hDB, 0, "/bench/mfe/Trigger rate", &rate, &size, TID_DOUBLE, TRUE);
+
+   gTriggers.clear();
+   gPending = 0;
+   gLatency.clear();
+   gNtriggers = 0;
+
+   gCpu0 = cpu_time();
+   gTime0 = ss_time_sec();
+
+   gStop = false;
+   gTriggerThread = new std::thread(trigger_thread, rate);
+
+   return SUCCESS;
+}
+
+INT end_of_run(INT run_number, char *error)
+{
+   gStop = true;
+   if (gTriggerThread) {
+      gTriggerThread->join();
+      delete gTriggerThread;
+      gTriggerThread = NULL;
+   }
+
+   double cpu = cpu_time() - gCpu0;
+   double wall = ss_time_sec() - gTime0;
+   int nevents = gLatency.size();
+
+   db_set_value(hDB, 0, "/bench/mfe/Results/CPU seconds", &cpu, sizeof(cpu), 1, TID_DOUBLE);
+   db_set_value(hDB, 0, "/bench/mfe/Results/Wall seconds", &wall, sizeof(wall), 1, TID_DOUBLE);
+   db_set_value(hDB, 0, "/bench/mfe/Results/Triggers", &gNtriggers, sizeof(gNtriggers), 1, TID_INT);
+   db_set_value(hDB, 0, "/bench/mfe/Results/Events", &nevents, sizeof(nevents), 1, TID_INT);
+   if (nevents > 0)
+      db_set_value(hDB, 0, "/bench/mfe/Results/Latency", gLatency.data(), nevents*sizeof(double), nevents, TID_DOUBLE);
+
+   return SUCCESS;
+}
+
+INT pause_run(INT run_number, char *error)
+{
+   return SUCCESS;
+}
+
+INT resume_run(INT run_number, char *error)
+{
+   return SUCCESS;
+}
+
+INT frontend_loop()
+{
+   return SUCCESS;
+}
+
+INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
+{
+   return SUCCESS;
+}
+
+/*-- Readout -------------------------------------------------------*/
+
+INT poll_event(INT source, INT count, BOOL test)
+{
+   if (gUseFd && !test) {
+      char buf[256];
+      while (read(gPipe[0], buf, sizeof(buf)) > 0) {
+      }
+   }
+
+   for (int i = 0; i < count; i++) {
+      if (gPending > 0 && !test)
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+INT read_trigger_event(char *pevent, INT off)
+{
+   double t;
+   {
+      std::lock_guard<std::mutex> lock(gMutex);
+      if (gTriggers.empty())
+         return 0;
+      t = gTriggers.front();
+      gTriggers.pop_front();
+   }
+   gPending--;
+
+   gLatency.push_back(ss_time_sec() - t);
+
+   bk_init32(pevent);
+
+   UINT32 *pdata;
+   bk_create(pevent, "BNCH", TID_UINT32, (void **)&pdata);
+   *pdata++ = gLatency.size();
+   bk_close(pevent, pdata);
+
+   return bk_size(pevent);
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
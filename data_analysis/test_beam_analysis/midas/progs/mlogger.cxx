@@ -17,6 +17,13 @@
 #include <errno.h>              /* for mkdir() */
 #include <assert.h>
 #include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #ifndef HAVE_STRLCPY
 #include "strlcpy.h"
@@ -28,6 +35,7 @@
 #ifdef HAVE_ROOT
 #undef GetCurrentTime
 #include "TApplication.h"
+#include "TROOT.h"
 #include "TFile.h"
 #include "TNtuple.h"
 #include "TLeaf.h"
@@ -157,6 +165,7 @@ static std::string TimeToString(time_t t)
 "Pbzip2 num cpu = UINT32 : 0",\
 "Pbzip2 compression = UINT32 : 0",\
 "Pbzip2 options = STRING : [256]",\
+"Write index = BOOL : n",\
 "",\
 "[Statistics]",\
 "Events written = DOUBLE : 0",\
@@ -166,6 +175,8 @@ static std::string TimeToString(time_t t)
 "Bytes written subrun = DOUBLE : 0",\
 "Files written = DOUBLE : 0",\
 "Disk level = DOUBLE : 0",\
+"Queue level = DOUBLE : 0",\
+"Queue wait time = DOUBLE : 0",\
 "",\
 NULL}
 
@@ -201,6 +212,7 @@ typedef struct {
    uint32_t pbzip2_num_cpu;
    uint32_t pbzip2_compression;
    char pbzip2_options[256];
+   BOOL write_index;
 } CHN_SETTINGS;
 
 // NOTE: CHN_SETTINGS here MUST be exactly same as [Settings] in CHN_TREE_STR above.
@@ -232,6 +244,7 @@ typedef struct {
 "Pbzip2 num cpu = UINT32 : 0",\
 "Pbzip2 compression = UINT32 : 0",\
 "Pbzip2 options = STRING : [256]",\
+"Write index = BOOL : n",\
 "",\
 NULL}
 
@@ -243,6 +256,8 @@ struct CHN_STATISTICS {
    double bytes_written_subrun = 0; /* count bytes written out (compressed), reset in tr_start() and on subrun increment */
    double files_written = 0;  /* incremented in log_close(), reset in log_callback(RPC_LOG_REWIND) */
    double disk_level = 0;
+   double queue_level = 0;    /* bytes waiting in the channel writer queue */
+   double queue_wait_time = 0; /* seconds receive_event() was blocked by a full writer queue, reset in tr_start() */
 };
 
 #define CHN_STATISTICS_STR(_name) const char *_name[] = {\
@@ -253,6 +268,8 @@ struct CHN_STATISTICS {
 "Bytes written subrun = DOUBLE : 0",\
 "Files written = DOUBLE : 0",\
 "Disk level = DOUBLE : 0",\
+"Queue level = DOUBLE : 0",\
+"Queue wait time = DOUBLE : 0",\
 "",\
 NULL}
 
@@ -282,7 +299,8 @@ struct LOG_CHN {
    HNDLE stats_hkey = 0;
    HNDLE settings_hkey = 0;
    CHN_SETTINGS settings;
-   CHN_STATISTICS statistics;
+   CHN_STATISTICS statistics;     /* owned by the writer thread while it runs */
+   CHN_STATISTICS odb_statistics; /* hot-linked to ODB, updated by log_update_statistics() */
    MIDAS_INFO *midas_info = NULL;
 #ifdef HAVE_ROOT
    TREE_STRUCT *root_tree_struct = NULL;
@@ -301,6 +319,27 @@ struct LOG_CHN {
    int compression_module = 0;   // COMPRESS_xxx
    int post_checksum_module = 0; // CHECKSUM_xxx
    int output_module = 0;        // OUTPUT_xxx
+
+   /* writer thread and its event queue, see log_writer_thread() */
+   std::thread* writer_thread = NULL;
+   std::mutex queue_mutex;
+   std::condition_variable queue_cv;       // new event or exit request
+   std::condition_variable queue_drain_cv; // event written
+   std::deque<std::shared_ptr<EVENT_HEADER>> queue;
+   size_t queue_bytes = 0;
+   bool queue_exit = false;
+   double queue_wait_time = 0;
+   CHN_STATISTICS published_statistics; // copy of statistics made by the writer thread
+
+   /* event index, see log_index_open() */
+   FILE* index_file = NULL;
+   uint64_t index_offset = 0;            // uncompressed offset of the next event
+   uint64_t index_entries = 0;
+   std::vector<uint64_t> index_blocks;   // file offsets of the LZ4 blocks, filled by WriterLZ4
+   DWORD index_block_size = 0;
+
+   bool subrun_switch = false; // log_write() is closing/opening a subrun file
+   bool stop_pending = false;  // log_write() has asked the main thread to stop the run
 };
 
 LOG_CHN* new_LOG_CHN(const char* name)
@@ -315,16 +354,23 @@ LOG_CHN* new_LOG_CHN(const char* name)
 
 #define DISK_CHECK_INTERVAL_MILLISEC 10000
 
+/* maximum number of bytes queued for one channel writer thread */
+#define CHN_QUEUE_SIZE (64*1024*1024)
+
 INT  local_state;
-BOOL in_stop_transition = FALSE;
+std::atomic<BOOL> in_stop_transition(FALSE);
 BOOL tape_message = TRUE;
 BOOL verbose = FALSE;
-BOOL stop_requested = FALSE;
+std::atomic<BOOL> stop_requested(FALSE);
 BOOL start_requested = FALSE;
 DWORD auto_restart = 0;
-DWORD run_start_time, subrun_start_time;
+DWORD run_start_time;
+std::atomic<DWORD> subrun_start_time(0);
 double stop_try_later = 0;
 
+/* run stop requested by a channel writer thread: 0 - none, 1 - stop, 2 - stop and auto restart */
+static std::atomic<int> writer_stop_request(0);
+
 std::vector<LOG_CHN*> log_channels;
 
 struct hist_log_s {
@@ -1421,6 +1467,124 @@ private:
    mbedtls_sha512_context fCtx;
 };
 
+/*---- XXH64 computation -------------------------------------------*/
+
+#include "xxhash.h"
+
+class WriterXXH64 : public WriterInterface
+{
+public:
+   WriterXXH64(LOG_CHN* log_chn, int level, WriterInterface* wr) // ctor
+   {
+      if (fTrace)
+         printf("WriterXXH64: path [%s], level %d\n", log_chn->path.c_str(), level);
+
+      assert(wr != NULL);
+
+      fLevel = level;
+      fWr = wr;
+      XXH64_reset(&fState, 0);
+   }
+
+   ~WriterXXH64() // dtor
+   {
+      if (fTrace)
+         printf("WriterXXH64: destructor\n");
+      DELETE(fWr);
+   }
+
+   int wr_open(LOG_CHN* log_chn, int run_number)
+   {
+      int status;
+
+      if (fTrace)
+         printf("WriterXXH64: open path [%s], level %d\n", log_chn->path.c_str(), fLevel);
+
+      status = fWr->wr_open(log_chn, run_number);
+
+      fBytesIn += 0;
+      fBytesOut = fWr->fBytesOut;
+
+      if (status != SUCCESS) {
+         return status;
+      }
+
+      log_chn->handle = 9999;
+
+      XXH64_reset(&fState, 0);
+
+      return SUCCESS;
+   }
+
+   int wr_write(LOG_CHN* log_chn, const void* data, const int size)
+   {
+      if (fTrace)
+         printf("WriterXXH64: write path [%s], size %d\n", log_chn->path.c_str(), size);
+
+      XXH64_update(&fState, data, size);
+
+      int status = fWr->wr_write(log_chn, data, size);
+
+      fBytesIn += size;
+      fBytesOut = fWr->fBytesOut;
+
+      if (status != SUCCESS) {
+         return status;
+      }
+
+      return SUCCESS;
+   }
+
+   int wr_close(LOG_CHN* log_chn, int run_number)
+   {
+      std::string x = xpathname(log_chn->path.c_str(), fLevel);
+      std::string f = x + ".xxh64";
+
+      if (fTrace)
+         printf("WriterXXH64: close path [%s], level %d, file [%s]\n", log_chn->path.c_str(), fLevel, f.c_str());
+
+      log_chn->handle = 0;
+
+      unsigned long long xxh64 = XXH64_digest(&fState);
+
+      cm_msg(MLOG, "XXH64", "File \'%s\' XXH64 checksum: 0x%016llx, %.0f bytes", x.c_str(), xxh64, fBytesIn);
+
+      FILE *fp = fopen_wx(f.c_str());
+      if (!fp) {
+         cm_msg(MERROR, "WriterXXH64::wr_close", "Cannot write XXH64 to file \'%s\', fopen() errno %d (%s)", f.c_str(), errno, strerror(errno));
+      } else {
+         fprintf(fp, "%016llx %.0f %s\n", xxh64, fBytesIn, x.c_str());
+         fclose(fp);
+      }
+
+      /* close downstream writer */
+
+      int status = fWr->wr_close(log_chn, run_number);
+
+      fBytesIn += 0;
+      fBytesOut = fWr->fBytesOut;
+
+      if (status != SUCCESS) {
+         return status;
+      }
+
+      return SUCCESS;
+   }
+
+   std::string wr_get_file_ext() {
+      return fWr->wr_get_file_ext();
+   }
+
+   std::string wr_get_chain() {
+      return "XXH64 | " + fWr->wr_get_chain();
+   }
+
+private:
+   int fLevel;
+   WriterInterface *fWr;
+   XXH64_state_t fState;
+};
+
 /*---- LZ4 compressed writer  --------------------------------------*/
 
 #include "mlz4frame.h"
@@ -1439,6 +1603,7 @@ public:
       fWr = wr;
       fBufferSize = 0;
       fBlockSize = 0;
+      fOffset = 0;
    }
 
    ~WriterLZ4() // dtor
@@ -1486,6 +1651,14 @@ public:
       fPrefs.frameInfo.contentChecksumFlag = MLZ4F_contentChecksumEnabled;
       fPrefs.frameInfo.blockSizeID = blockSizeId;
 
+      /* the event index needs blocks which can be decompressed on their own */
+      if (log_chn->settings.write_index)
+         fPrefs.frameInfo.blockMode = MLZ4F_blockIndependent;
+
+      fOffset = 0;
+      log_chn->index_blocks.clear();
+      log_chn->index_block_size = fBlockSize;
+
       size_t headerSize = MLZ4F_compressBegin(fContext, fBuffer, fBufferSize, &fPrefs);
       
       if (MLZ4F_isError(headerSize)) {
@@ -1496,6 +1669,7 @@ public:
 
       status = fWr->wr_write(log_chn, fBuffer, headerSize);
 
+      fOffset += headerSize;
       fBytesIn += 0;
       fBytesOut = fWr->fBytesOut;
 
@@ -1531,6 +1705,8 @@ public:
          }
 
          if (outSize > 0) {
+            add_blocks(log_chn, outSize);
+
             int status = fWr->wr_write(log_chn, fBuffer, outSize);
  
             fBytesIn += wsize;
@@ -1567,6 +1743,8 @@ public:
          return SS_FILE_ERROR;
       }
 
+      add_blocks(log_chn, headerSize);
+
       int status = fWr->wr_write(log_chn, fBuffer, headerSize);
 
       fBytesIn += 0;
@@ -1611,12 +1789,30 @@ public:
    }
 
 private:
+   /* record the file offsets of the blocks in fBuffer for the event index.
+      Each block is a 4-byte size (bit 31: stored uncompressed) and the data,
+      a size of zero is the end mark. The frame has no block checksums. */
+   void add_blocks(LOG_CHN* log_chn, size_t size)
+   {
+      size_t pos = 0;
+      while (log_chn->settings.write_index && pos + 4 <= size) {
+         DWORD bsize;
+         memcpy(&bsize, fBuffer + pos, 4);
+         if (bsize == 0)
+            break;
+         log_chn->index_blocks.push_back(fOffset + pos);
+         pos += 4 + (bsize & 0x7FFFFFFF);
+      }
+      fOffset += size;
+   }
+
    WriterInterface *fWr;
    MLZ4F_compressionContext_t fContext;
    MLZ4F_preferences_t fPrefs;
    char* fBuffer;
    int   fBufferSize;
    int   fBlockSize;
+   uint64_t fOffset; // bytes written to fWr
 };
 
 /*---- Logging initialization --------------------------------------*/
@@ -3958,6 +4154,7 @@ WriterInterface* NewWriterPbzip2(LOG_CHN* log_chn)
 #define CHECKSUM_CRC32C 2
 #define CHECKSUM_SHA256 3
 #define CHECKSUM_SHA512 4
+#define CHECKSUM_XXH64  5
 
 WriterInterface* NewChecksum(LOG_CHN* log_chn, int code, int level, WriterInterface* chained)
 {
@@ -3971,6 +4168,8 @@ WriterInterface* NewChecksum(LOG_CHN* log_chn, int code, int level, WriterInterf
       return new WriterSHA256(log_chn, level, chained);
    } else if (code == CHECKSUM_SHA512) {
       return new WriterSHA512(log_chn, level, chained);
+   } else if (code == CHECKSUM_XXH64) {
+      return new WriterXXH64(log_chn, level, chained);
    } else {
       cm_msg(MERROR, "log_create_writer", "channel %s unknown checksum code %d", log_chn->path.c_str(), code);
       return chained;
@@ -4044,6 +4243,7 @@ int select_checksum_module(HNDLE hDB, HNDLE hSet, const char* name)
    s = check_add(s, CHECKSUM_CRC32C, val, "CRC32C", true,  &def, &sel);
    s = check_add(s, CHECKSUM_SHA256, val, "SHA256", false, &def, &sel);
    s = check_add(s, CHECKSUM_SHA512, val, "SHA512", false, &def, &sel);
+   s = check_add(s, CHECKSUM_XXH64,  val, "XXH64",  false, &def, &sel);
    s = check_add(s, CHECKSUM_ZLIB,   val, "ZLIB",   false, &def, &sel);
    if (sel == "")
       sel = "NONE";
@@ -4239,6 +4439,91 @@ int log_create_writer(LOG_CHN *log_chn)
    return SS_SUCCESS;
 }
 
+/*---- event index -------------------------------------------------*/
+
+/* The event index <file>.idx lists serial number, time stamp, event ID,
+   size and uncompressed offset of each event in the data file, see
+   mdsupport.h for the format and the functions to read it. */
+
+static void log_index_open(LOG_CHN * log_chn)
+{
+   log_chn->index_file = NULL;
+   log_chn->index_offset = 0;
+   log_chn->index_entries = 0;
+
+   if (!log_chn->settings.write_index)
+      return;
+
+   if (log_chn->output_module != OUTPUT_FILE ||
+       (log_chn->compression_module != COMPRESS_NONE && log_chn->compression_module != COMPRESS_LZ4)) {
+      cm_msg(MERROR, "log_index_open", "Channel \"%s\": event index is only supported for output \"FILE\" with compression \"none\" or \"lz4\", no index written", log_chn->name.c_str());
+      return;
+   }
+
+   std::string path = md_index_file_name(log_chn->path.c_str());
+   FILE* f = fopen(path.c_str(), "wb");
+   if (f == NULL) {
+      cm_msg(MERROR, "log_index_open", "Cannot create event index file \"%s\", errno %d (%s)", path.c_str(), errno, strerror(errno));
+      return;
+   }
+
+   MD_INDEX_HEADER header;
+   memcpy(header.magic, MD_INDEX_MAGIC, 8);
+   header.version = MD_INDEX_VERSION;
+   header.entry_size = sizeof(MD_INDEX_ENTRY);
+   fwrite(&header, sizeof(header), 1, f);
+
+   log_chn->index_file = f;
+}
+
+static void log_index_write(LOG_CHN * log_chn, const EVENT_HEADER * pevent)
+{
+   MD_INDEX_ENTRY entry;
+   entry.serial_number = pevent->serial_number;
+   entry.time_stamp = pevent->time_stamp;
+   entry.event_id = pevent->event_id;
+   entry.trigger_mask = pevent->trigger_mask;
+   entry.data_size = pevent->data_size;
+   entry.offset = log_chn->index_offset;
+
+   if (fwrite(&entry, sizeof(entry), 1, log_chn->index_file) != 1) {
+      cm_msg(MERROR, "log_index_write", "Cannot write event index of \"%s\", errno %d (%s), index disabled for this file", log_chn->path.c_str(), errno, strerror(errno));
+      fclose(log_chn->index_file);
+      log_chn->index_file = NULL;
+      return;
+   }
+
+   log_chn->index_offset += sizeof(EVENT_HEADER) + pevent->data_size;
+   log_chn->index_entries++;
+}
+
+static void log_index_close(LOG_CHN * log_chn)
+{
+   if (log_chn->index_file == NULL)
+      return;
+
+   MD_INDEX_TRAILER trailer;
+   trailer.num_entries = log_chn->index_entries;
+   if (log_chn->compression_module == COMPRESS_LZ4) {
+      trailer.num_blocks = log_chn->index_blocks.size();
+      trailer.compression = MD_INDEX_LZ4;
+      trailer.block_size = log_chn->index_block_size;
+      fwrite(log_chn->index_blocks.data(), sizeof(uint64_t), log_chn->index_blocks.size(), log_chn->index_file);
+   } else {
+      trailer.num_blocks = 0;
+      trailer.compression = MD_INDEX_RAW;
+      trailer.block_size = 0;
+   }
+   memcpy(trailer.magic, MD_INDEX_END_MAGIC, 8);
+   fwrite(&trailer, sizeof(trailer), 1, log_chn->index_file);
+
+   if (fclose(log_chn->index_file) != 0)
+      cm_msg(MERROR, "log_index_close", "Cannot write event index of \"%s\", errno %d (%s)", log_chn->path.c_str(), errno, strerror(errno));
+
+   log_chn->index_file = NULL;
+   log_chn->index_blocks.clear();
+}
+
 /*---- log_open ----------------------------------------------------*/
 
 INT log_open(LOG_CHN * log_chn, INT run_number)
@@ -4255,6 +4540,8 @@ INT log_open(LOG_CHN * log_chn, INT run_number)
       if (status != SUCCESS)
          return status;
 
+      log_index_open(log_chn);
+
       /* write ODB dump */
       if (log_chn->settings.odb_dump)
          log_odb_dump(log_chn, EVENTID_BOR, run_number);
@@ -4302,6 +4589,9 @@ INT log_close(LOG_CHN * log_chn, INT run_number)
 
       wr->wr_close(log_chn, run_number);
 
+      /* after wr_close(), the LZ4 writer has flushed its last block */
+      log_index_close(log_chn);
+
       /* update statistics */
 
       double incr = wr->fBytesOut - log_chn->statistics.bytes_written_subrun;
@@ -4334,6 +4624,8 @@ INT log_close(LOG_CHN * log_chn, INT run_number)
    if (*p == '.') {
       strlcpy(p, p+1, sizeof(str));
       rename(log_chn->path.c_str(), str); // FIXME: must check return status. K.O.
+      if (log_chn->settings.write_index)
+         rename(md_index_file_name(log_chn->path.c_str()).c_str(), md_index_file_name(str).c_str());
    }
    
    log_chn->statistics.files_written += 1;
@@ -4398,6 +4690,10 @@ int maybe_check_disk_level()
       if (!chn->do_disk_level)
          continue;
 
+      /* the writer thread checks the disk level in log_write() */
+      if (chn->writer_thread)
+         continue;
+
       log_disk_level(chn, NULL, NULL);
    }
 
@@ -4478,6 +4774,23 @@ int stop_the_run(int restart)
    return status;
 }
 
+/* true in the channel writer threads, see log_writer_thread() */
+static thread_local bool in_writer_thread = false;
+
+static int log_stop_the_run(LOG_CHN * log_chn, int restart)
+{
+   log_chn->stop_pending = true;
+
+   /* run transitions are started from the main thread only */
+   if (in_writer_thread) {
+      int none = 0;
+      writer_stop_request.compare_exchange_strong(none, restart ? 2 : 1);
+      return SUCCESS;
+   }
+
+   return stop_the_run(restart);
+}
+
 int start_the_run()
 {
    int status, size, state, run_number, flag;
@@ -4554,6 +4867,9 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       WriterInterface* wr = log_chn->writer;
       status = wr->wr_write(log_chn, pevent, evt_size);
 
+      if (status == SUCCESS && log_chn->index_file)
+         log_index_write(log_chn, pevent);
+
       if (status == SUCCESS) {
          /* update statistics */
          log_chn->statistics.events_written++;
@@ -4602,24 +4918,25 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
    if (actual_time - start_time > 3000)
       cm_msg(MINFO, "log_write", "Write operation on \'%s\' took %d ms", log_chn->path.c_str(), actual_time - start_time);
 
-   if (status != SS_SUCCESS && !stop_requested) {
+   /* no limit checks while switching subruns or once a run stop is on its way */
+   BOOL stopping = stop_requested || log_chn->stop_pending || log_chn->subrun_switch;
+
+   if (status != SS_SUCCESS && !stopping) {
       cm_msg(MTALK, "log_write", "Error writing output file, stopping run");
       cm_msg(MERROR, "log_write", "Cannot write \'%s\', error %d, stopping run", log_chn->path.c_str(), status);
-      stop_the_run(0);
+      log_stop_the_run(log_chn, 0);
 
       return status;
    }
 
    /* check if event limit is reached to stop run */
-   if (!stop_requested && !in_stop_transition &&
+   if (!stopping && !in_stop_transition &&
        log_chn->settings.event_limit > 0 &&
        log_chn->statistics.events_written >= log_chn->settings.event_limit) {
-      stop_requested = TRUE;
-
       cm_msg(MTALK, "log_write", "stopping run after having received %1.0lf events",
              log_chn->settings.event_limit);
 
-      status = stop_the_run(1);
+      status = log_stop_the_run(log_chn, 1);
       return status;
    }
 
@@ -4627,7 +4944,7 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
    duration = 0;
    size = sizeof(duration);
    db_get_value(hDB, 0, "/Logger/Subrun duration", &duration, &size, TID_UINT32, TRUE);
-   if (!stop_requested && duration > 0 && ss_time() >= subrun_start_time + duration) {
+   if (!stopping && duration > 0 && ss_time() >= subrun_start_time + duration) {
       int run_number;
 
       // cm_msg(MTALK, "main", "stopping subrun after %d seconds", duration);
@@ -4636,7 +4953,7 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       status = db_get_value(hDB, 0, "Runinfo/Run number", &run_number, &size, TID_INT32, TRUE);
       assert(status == SUCCESS);
 
-      stop_requested = TRUE; // avoid recursive call thourgh log_odb_dump
+      log_chn->subrun_switch = true; // avoid recursive call thourgh log_odb_dump
       log_close(log_chn, run_number);
       log_chn->subrun_number++;
       log_chn->statistics.bytes_written_subrun = 0;
@@ -4644,11 +4961,11 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       log_generate_file_name(log_chn);
       log_open(log_chn, run_number);
       subrun_start_time = ss_time();
-      stop_requested = FALSE;
+      log_chn->subrun_switch = false;
    }
 
    /* check if byte limit is reached for subrun */
-   if (!stop_requested && log_chn->settings.subrun_byte_limit > 0 &&
+   if (!stopping && log_chn->settings.subrun_byte_limit > 0 &&
        log_chn->statistics.bytes_written_subrun >= log_chn->settings.subrun_byte_limit) {
       int run_number;
 
@@ -4658,7 +4975,7 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       status = db_get_value(hDB, 0, "Runinfo/Run number", &run_number, &size, TID_INT32, TRUE);
       assert(status == SUCCESS);
 
-      stop_requested = TRUE; // avoid recursive call thourgh log_odb_dump
+      log_chn->subrun_switch = true; // avoid recursive call thourgh log_odb_dump
       log_close(log_chn, run_number);
       log_chn->subrun_number++;
       log_chn->statistics.bytes_written_subrun = 0;
@@ -4666,14 +4983,14 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       log_generate_file_name(log_chn);
       log_open(log_chn, run_number);
       subrun_start_time = ss_time();
-      stop_requested = FALSE;
+      log_chn->subrun_switch = false;
    }
 
    /* check if new subrun is requested manually */
    next_subrun = FALSE;
    size = sizeof(next_subrun);
    db_get_value(hDB, 0, "/Logger/Next subrun", &next_subrun, &size, TID_BOOL, true);
-   if (!stop_requested && next_subrun) {
+   if (!stopping && next_subrun) {
       int run_number;
 
       // cm_msg(MTALK, "main", "stopping subrun by user request");
@@ -4682,7 +4999,7 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       status = db_get_value(hDB, 0, "Runinfo/Run number", &run_number, &size, TID_INT32, TRUE);
       assert(status == SUCCESS);
 
-      stop_requested = TRUE; // avoid recursive call thourgh log_odb_dump
+      log_chn->subrun_switch = true; // avoid recursive call thourgh log_odb_dump
       log_close(log_chn, run_number);
       log_chn->subrun_number++;
       log_chn->statistics.bytes_written_subrun = 0;
@@ -4690,22 +5007,20 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
       log_generate_file_name(log_chn);
       log_open(log_chn, run_number);
       subrun_start_time = ss_time();
-      stop_requested = FALSE;
+      log_chn->subrun_switch = false;
 
       next_subrun = FALSE;
       db_set_value(hDB, 0, "/Logger/Next subrun", &next_subrun, sizeof(next_subrun), 1, TID_BOOL);
    }
 
    /* check if byte limit is reached to stop run */
-   if (!stop_requested && !in_stop_transition &&
+   if (!stopping && !in_stop_transition &&
        log_chn->settings.byte_limit > 0 &&
        log_chn->statistics.bytes_written >= log_chn->settings.byte_limit) {
-      stop_requested = TRUE;
-
       cm_msg(MTALK, "log_write", "stopping run after having received %1.0lf mega bytes",
              log_chn->statistics.bytes_written / 1E6);
 
-      status = stop_the_run(1);
+      status = log_stop_the_run(log_chn, 1);
 
       return status;
    }
@@ -4729,18 +5044,129 @@ INT log_write(LOG_CHN * log_chn, EVENT_HEADER * pevent)
          limit = 100E6;
       }
 
-      if (disk_free < limit) {
-         stop_requested = TRUE;
+      if (disk_free < limit && !stopping) {
          cm_msg(MTALK, "log_write", "disk nearly full, stopping the run");
          cm_msg(MERROR, "log_write", "Disk \'%s\' is almost full: %1.0lf MiBytes free out of %1.0f MiBytes, stopping the run", log_chn->path.c_str(), disk_free/MiB, disk_size/MiB);
          
-         status = stop_the_run(0);
+         status = log_stop_the_run(log_chn, 0);
       }
    }
 
    return status;
 }
 
+/*---- channel writer threads --------------------------------------*/
+
+/*
+  Each active channel gets its own writer thread, so that a slow channel
+  (i.e. ROOT output) does not hold up the others. receive_event() puts
+  events into the channel queue, the writer thread takes them out and
+  calls log_write(). If a queue holds more than CHN_QUEUE_SIZE bytes,
+  receive_event() waits for the writer; the time spent waiting shows up
+  as "Queue wait time" in the channel statistics.
+*/
+
+static void log_writer_thread(LOG_CHN* log_chn)
+{
+   in_writer_thread = true;
+   ss_thread_set_name(std::string("mlogger:") + log_chn->name);
+
+   std::unique_lock<std::mutex> lock(log_chn->queue_mutex);
+
+   while (1) {
+      log_chn->queue_cv.wait(lock, [log_chn] { return log_chn->queue_exit || !log_chn->queue.empty(); });
+
+      /* write all pending events before exiting */
+      if (log_chn->queue.empty())
+         break;
+
+      std::shared_ptr<EVENT_HEADER> pevent = log_chn->queue.front();
+      log_chn->queue.pop_front();
+      lock.unlock();
+
+      /* channel may have been closed by a failed subrun switch */
+      int size = pevent->data_size + sizeof(EVENT_HEADER);
+      if (log_chn->handle || log_chn->ftp_con)
+         log_write(log_chn, pevent.get());
+      pevent.reset();
+
+      lock.lock();
+      log_chn->queue_bytes -= size;
+      log_chn->published_statistics = log_chn->statistics;
+      log_chn->queue_drain_cv.notify_all();
+   }
+
+   log_chn->published_statistics = log_chn->statistics;
+}
+
+static void log_start_writer(LOG_CHN* log_chn)
+{
+   assert(log_chn->writer_thread == NULL);
+
+   log_chn->queue_exit = false;
+   log_chn->published_statistics = log_chn->statistics;
+   log_chn->writer_thread = new std::thread(log_writer_thread, log_chn);
+}
+
+static void log_stop_writer(LOG_CHN* log_chn)
+{
+   if (!log_chn->writer_thread)
+      return;
+
+   {
+      std::lock_guard<std::mutex> lock(log_chn->queue_mutex);
+      log_chn->queue_exit = true;
+   }
+   log_chn->queue_cv.notify_one();
+
+   log_chn->writer_thread->join();
+   delete log_chn->writer_thread;
+   log_chn->writer_thread = NULL;
+
+   assert(log_chn->queue.empty());
+   log_chn->queue_bytes = 0;
+}
+
+static void log_queue_event(LOG_CHN* log_chn, const std::shared_ptr<EVENT_HEADER>& pevent)
+{
+   if (!log_chn->writer_thread) {
+      if (log_chn->handle || log_chn->ftp_con)
+         log_write(log_chn, pevent.get());
+      return;
+   }
+
+   size_t size = pevent->data_size + sizeof(EVENT_HEADER);
+
+   std::unique_lock<std::mutex> lock(log_chn->queue_mutex);
+
+   /* back-pressure: wait for the writer if the queue is full */
+   if (log_chn->queue_bytes > 0 && log_chn->queue_bytes + size > CHN_QUEUE_SIZE) {
+      double start_time = ss_time_sec();
+      log_chn->queue_drain_cv.wait(lock, [log_chn, size] { return log_chn->queue_bytes == 0 || log_chn->queue_bytes + size <= CHN_QUEUE_SIZE; });
+      log_chn->queue_wait_time += ss_time_sec() - start_time;
+   }
+
+   log_chn->queue.push_back(pevent);
+   log_chn->queue_bytes += size;
+   lock.unlock();
+
+   log_chn->queue_cv.notify_one();
+}
+
+/* copy the writer thread statistics into the ODB record, main thread only */
+static void log_update_statistics(LOG_CHN* log_chn)
+{
+   std::lock_guard<std::mutex> lock(log_chn->queue_mutex);
+
+   if (log_chn->writer_thread)
+      log_chn->odb_statistics = log_chn->published_statistics;
+   else
+      log_chn->odb_statistics = log_chn->statistics;
+
+   log_chn->odb_statistics.queue_level = log_chn->queue_bytes;
+   log_chn->odb_statistics.queue_wait_time = log_chn->queue_wait_time;
+}
+
 /*---- open_history ------------------------------------------------*/
 
 void log_history(HNDLE hDB, HNDLE hKey, void *info);
@@ -5827,6 +6253,70 @@ int log_generate_file_name(LOG_CHN *log_chn)
 
 \********************************************************************/
 
+/*---- event routing -----------------------------------------------*/
+
+/*
+  Channels reading the same buffer share one event request. The request
+  selects the union of the channel event ids and trigger masks, and
+  receive_event() fans each event out to the matching channels listed
+  in the routing table for its request id.
+*/
+
+struct LOG_ROUTE {
+   short event_id;
+   short trigger_mask;
+   LOG_CHN* chn;
+};
+
+static std::map<int, std::vector<LOG_ROUTE>> log_routes; // key is request id
+
+static int log_place_requests(char* error)
+{
+   std::map<int, std::vector<LOG_ROUTE>> buffer_routes; // key is buffer handle
+
+   for (unsigned i = 0; i < log_channels.size(); i++) {
+      LOG_CHN* chn = log_channels[i];
+
+      if (chn->buffer_handle)
+         buffer_routes[chn->buffer_handle].push_back({(short) chn->settings.event_id, (short) chn->settings.trigger_mask, chn});
+
+      if (chn->msg_buffer_handle)
+         buffer_routes[chn->msg_buffer_handle].push_back({(short) EVENTID_MESSAGE, (short) chn->settings.log_messages, chn});
+   }
+
+   for (auto& b : buffer_routes) {
+      std::vector<LOG_ROUTE>& routes = b.second;
+
+      short event_id = routes[0].event_id;
+      short trigger_mask = 0;
+      for (unsigned i = 0; i < routes.size(); i++) {
+         if (routes[i].event_id != event_id)
+            event_id = EVENTID_ALL;
+         trigger_mask |= routes[i].trigger_mask;
+      }
+
+      int request_id = 0;
+      int status = bm_request_event(b.first, event_id, trigger_mask, GET_ALL, &request_id, receive_event);
+
+      if (status != BM_SUCCESS) {
+         sprintf(error, "Cannot place event request");
+         cm_msg(MERROR, "tr_start", "%s", error);
+         return status;
+      }
+
+      for (unsigned i = 0; i < routes.size(); i++) {
+         if (routes[i].chn->buffer_handle == b.first)
+            routes[i].chn->request_id = request_id;
+         if (routes[i].chn->msg_buffer_handle == b.first)
+            routes[i].chn->msg_request_id = request_id;
+      }
+
+      log_routes[request_id] = routes;
+   }
+
+   return BM_SUCCESS;
+}
+
 /*------------------------------------------------------------------*/
 
 int close_channels(int run_number, BOOL* p_tape_flag)
@@ -5856,11 +6346,15 @@ int close_channels(int run_number, BOOL* p_tape_flag)
          }
 #endif                          /* FAL_MAIN */
 
+         /* write queued events and stop the writer thread */
+         log_stop_writer(chn);
+
          /* close logging channel */
          log_close(chn, run_number);
 
          /* close statistics record */
-         db_set_record(hDB, chn->stats_hkey, &chn->statistics, sizeof(CHN_STATISTICS), 0);
+         log_update_statistics(chn);
+         db_set_record(hDB, chn->stats_hkey, &chn->odb_statistics, sizeof(CHN_STATISTICS), 0);
          db_close_record(hDB, chn->stats_hkey);
          db_unwatch(hDB, chn->settings_hkey);
          chn->stats_hkey = 0;
@@ -5876,9 +6370,19 @@ int close_channels(int run_number, BOOL* p_tape_flag)
 
 int close_buffers()
 {
+#ifndef FAL_MAIN
+   /* remove event requests */
+   for (auto& r : log_routes)
+      bm_delete_request(r.first);
+   log_routes.clear();
+#endif
+
    /* close buffers */
    for (unsigned i = 0; i < log_channels.size(); i++) {
       LOG_CHN* chn = log_channels[i];
+
+      log_stop_writer(chn);
+
 #ifndef FAL_MAIN
       if (chn->buffer_handle) {
          bm_close_buffer(chn->buffer_handle);
@@ -5886,9 +6390,6 @@ int close_buffers()
             if (log_channels[j]->buffer_handle == chn->buffer_handle)
                log_channels[j]->buffer_handle = 0;
       }
-
-      if (chn->msg_request_id)
-         bm_delete_request(chn->msg_request_id);
 #endif
 
       delete chn;
@@ -6059,6 +6560,8 @@ INT tr_start(INT run_number, char *error)
          chn->statistics.bytes_written = 0;
          chn->statistics.bytes_written_uncompressed = 0;
          chn->statistics.bytes_written_subrun = 0;
+         chn->statistics.queue_level = 0;
+         chn->statistics.queue_wait_time = 0;
 
          db_set_record(hDB, chn->stats_hkey, &chn->statistics, size, 0);
 
@@ -6143,7 +6646,8 @@ INT tr_start(INT run_number, char *error)
             db_close_record(hDB, chn->settings_hkey);
 
          /* open hot link to statistics tree */
-         status = db_open_record1(hDB, chn->stats_hkey, &chn->statistics, sizeof(CHN_STATISTICS), MODE_WRITE, NULL, NULL, strcomb1(chn_statistics_str).c_str());
+         log_update_statistics(chn);
+         status = db_open_record1(hDB, chn->stats_hkey, &chn->odb_statistics, sizeof(CHN_STATISTICS), MODE_WRITE, NULL, NULL, strcomb1(chn_statistics_str).c_str());
          if (status == DB_NO_ACCESS) {
             /* record is probably still in exclusive access by dead logger, so reset it */
             status = db_set_mode(hDB, chn->stats_hkey, MODE_READ | MODE_WRITE | MODE_DELETE, TRUE);
@@ -6151,7 +6655,7 @@ INT tr_start(INT run_number, char *error)
                cm_msg(MERROR, "tr_start", "Cannot change access mode for statistics record, error %d", status);
             else
                cm_msg(MINFO, "tr_start", "Recovered access mode for statistics record of channel \"%s\"", chn->name.c_str());
-            status = db_open_record1(hDB, chn->stats_hkey, &chn->statistics, sizeof(CHN_STATISTICS), MODE_WRITE, NULL, NULL, strcomb1(chn_statistics_str).c_str());
+            status = db_open_record1(hDB, chn->stats_hkey, &chn->odb_statistics, sizeof(CHN_STATISTICS), MODE_WRITE, NULL, NULL, strcomb1(chn_statistics_str).c_str());
          }
 
          if (status != DB_SUCCESS)
@@ -6172,15 +6676,6 @@ INT tr_start(INT run_number, char *error)
          }
          bm_set_cache_size(chn->buffer_handle, 100000, 0);
 
-         /* place event request */
-         status = bm_request_event(chn->buffer_handle, (short) chn_settings->event_id, (short) chn_settings->trigger_mask, GET_ALL, &chn->request_id, receive_event);
-
-         if (status != BM_SUCCESS) {
-            sprintf(error, "Cannot place event request");
-            cm_msg(MERROR, "tr_start", "%s", error);
-            return 0;
-         }
-
          /* open message buffer if requested */
          if (chn_settings->log_messages) {
             status = bm_open_buffer((char*)MESSAGE_BUFFER_NAME, MESSAGE_BUFFER_SIZE, &chn->msg_buffer_handle);
@@ -6189,20 +6684,21 @@ INT tr_start(INT run_number, char *error)
                cm_msg(MERROR, "tr_start", "%s", error);
                return 0;
             }
-
-            /* place event request */
-            status = bm_request_event(chn->msg_buffer_handle, (short) EVENTID_MESSAGE, (short) chn_settings->log_messages, GET_ALL, &chn->msg_request_id, receive_event);
-
-            if (status != BM_SUCCESS) {
-               sprintf(error, "Cannot place event request");
-               cm_msg(MERROR, "tr_start", "%s", error);
-               return 0;
-            }
          }
 #endif
+
+         /* start writer thread */
+         log_start_writer(chn);
       }
    }
 
+#ifndef FAL_MAIN
+   /* place event requests, one per buffer */
+   status = log_place_requests(error);
+   if (status != BM_SUCCESS)
+      return 0;
+#endif
+
    DWORD t3 = ss_millitime();
 
    if (tape_flag && tape_message)
@@ -6423,23 +6919,28 @@ void receive_event(HNDLE hBuf, HNDLE request_id, EVENT_HEADER * pheader, void *p
    if (verbose)
       printf("write data event: req %d, evid %d, timestamp %d, size %d\n", request_id, pheader->event_id, pheader->time_stamp, pheader->data_size);
 
-   /* find logging channel for this request id */
-   for (unsigned i = 0; i < log_channels.size(); i++) {
-      LOG_CHN* chn = log_channels[i];
-      if (chn->handle == 0 && chn->ftp_con == NULL)
+   /* find logging channels for this request id */
+   auto it = log_routes.find(request_id);
+   if (it == log_routes.end())
+      return;
+
+   /* the event is copied once and shared by all channel queues */
+   std::shared_ptr<EVENT_HEADER> pcopy;
+
+   for (const LOG_ROUTE& r : it->second) {
+      LOG_CHN* chn = r.chn;
+
+      if (!bm_match_event(r.event_id, r.trigger_mask, pheader))
          continue;
 
-      /* write normal events */
-      if (chn->request_id == request_id) {
-         log_write(chn, pheader);
-         break;
+      if (!pcopy) {
+         int size = pheader->data_size + sizeof(EVENT_HEADER);
+         pcopy.reset((EVENT_HEADER*) malloc(size), free);
+         assert(pcopy);
+         memcpy(pcopy.get(), pheader, size);
       }
 
-      /* write messages */
-      if (chn->msg_request_id == request_id) {
-         log_write(chn, pheader);
-         break;
-      }
+      log_queue_event(chn, pcopy);
    }
 }
 
@@ -6476,6 +6977,10 @@ int main(int argc, char *argv[])
    free(rargv);
    rargv = NULL;
 
+   /* ROOT output files are written from the channel writer threads */
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+   ROOT::EnableThreadSafety();
+#endif
 #endif
 
 #ifdef SIGPIPE
@@ -6636,9 +7141,17 @@ int main(int argc, char *argv[])
                 log_chn->statistics.bytes_written,
                 log_chn->statistics.bytes_written_total);
          */
+         for (unsigned i = 0; i < log_channels.size(); i++)
+            log_update_statistics(log_channels[i]);
          db_send_changed_records();
       }
 
+      /* stop the run if a channel writer thread asked for it */
+      int stop_request = writer_stop_request.exchange(0);
+      if (stop_request && !stop_requested && !in_stop_transition && local_state != STATE_STOPPED) {
+         status = stop_the_run(stop_request == 2);
+      }
+
       /* check for auto restart */
       if (auto_restart && ss_time() > auto_restart) {
          status = start_the_run();
@@ -21,6 +21,7 @@
 #include <sstream>
 #include <string.h>
 #include <vector>
+#include <map>
 
 #define XNAME_LENGTH 256
 
@@ -56,6 +57,16 @@ public:
    std::string seq_name;
    std::string prg_name;
    std::string odb_path;
+
+   // script compiled on load: XML node at each line, subroutines and MSL line targets
+   std::vector<PMXML_NODE> line_node;
+   PMXML_NODE prun = NULL;
+   std::map<std::string, PMXML_NODE> subroutine;
+   std::map<int, int> sline;
+
+   // ODB keys resolved by WAIT statements, and the key currently watched by one
+   std::map<std::string, HNDLE> wait_keys;
+   HNDLE hKeyWait = 0;
 };
 
 /*------------------------------------------------------------------*/
@@ -1159,6 +1170,64 @@ static void seq_step_over(SEQUENCER& seq, SeqCon* c) {
 
 /*------------------------------------------------------------------*/
 
+static void seq_compile_node(SeqCon* c, PMXML_NODE pn) {
+   int line = mxml_get_line_number_start(pn);
+   if (line >= 0 && line < (int) c->line_node.size() && c->line_node[line] == NULL)
+      c->line_node[line] = pn;
+
+   for (int i = 0; i < mxml_get_number_of_children(pn); i++)
+      seq_compile_node(c, mxml_subnode(pn, i));
+}
+
+// resolve everything the interpreter used to search the XML tree for on each step
+static void seq_compile(SeqCon* c) {
+   c->line_node.clear();
+   c->prun = NULL;
+   c->subroutine.clear();
+   c->sline.clear();
+   c->wait_keys.clear();
+
+   if (!c->pnseq)
+      return;
+
+   c->prun = mxml_find_node(c->pnseq, "RunSequence");
+
+   int last_line = mxml_get_line_number_end(c->pnseq);
+   for (int i = 0; i < mxml_get_number_of_children(c->pnseq); i++)
+      last_line = std::max(last_line, mxml_get_line_number_end(mxml_subnode(c->pnseq, i)));
+
+   c->line_node.resize(last_line + 1, NULL);
+   seq_compile_node(c, c->pnseq);
+
+   if (!c->prun)
+      return;
+
+   int run_end = mxml_get_line_number_end(c->prun);
+   for (int i = 0; i <= run_end && i < (int) c->line_node.size(); i++) {
+      PMXML_NODE pn = c->line_node[i];
+      if (!pn)
+         continue;
+
+      if (i < run_end && equal_ustring(mxml_get_name(pn), "Subroutine") && mxml_get_attribute(pn, "name")) {
+         std::string name = mxml_get_attribute(pn, "name");
+         for (auto& ch : name)
+            ch = tolower(ch);
+         c->subroutine.insert(std::make_pair(name, pn));
+      }
+
+      if (mxml_get_attribute(pn, "l"))
+         c->sline.insert(std::make_pair(atoi(mxml_get_attribute(pn, "l")), i));
+   }
+}
+
+static PMXML_NODE seq_node_at_line(SeqCon* c, int line) {
+   if (line < 0 || line >= (int) c->line_node.size())
+      return NULL;
+   return c->line_node[line];
+}
+
+/*------------------------------------------------------------------*/
+
 static void seq_open_file(const char *str, SEQUENCER &seq, SeqCon* c) {
    seq.new_file = FALSE;
    seq.error[0] = 0;
@@ -1203,6 +1272,8 @@ static void seq_open_file(const char *str, SEQUENCER &seq, SeqCon* c) {
       //printf("Loading XML sequencer file: %s\n", str);
       c->pnseq = mxml_parse_file(str, seq.error, sizeof(seq.error), &seq.error_line);
    }
+
+   seq_compile(c);
 }
 
 /*------------------------------------------------------------------*/
@@ -1436,18 +1507,98 @@ int set_all_matching(HNDLE hDB, HNDLE hBaseKey, char *odbpath, char *value, int
 
 /*------------------------------------------------------------------*/
 
+// A pending WAIT only has to be re-evaluated when the ODB key it waits on
+// changes. The hotlink on that key ends cm_yield() in the main loop early,
+// so the sequencer sleeps in select() instead of polling.
+
+static void seq_wait_hotlink(HNDLE hDB, HNDLE hKey, int index, void *info) {
+   // nothing to do, receiving the notification wakes up the main loop
+}
+
+static void seq_wait_unwatch(SeqCon* c) {
+   if (c->hKeyWait) {
+      db_unwatch(c->hDB, c->hKeyWait);
+      c->hKeyWait = 0;
+   }
+}
+
+static void seq_wait_watch(SeqCon* c, HNDLE hKey) {
+   if (c->hKeyWait == hKey)
+      return;
+
+   seq_wait_unwatch(c);
+
+   int status = db_watch(c->hDB, hKey, seq_wait_hotlink, c);
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "seq_wait_watch", "Cannot watch ODB key for WAIT, db_watch() status %d, will poll instead", status);
+      return;
+   }
+
+   c->hKeyWait = hKey;
+}
+
+static int seq_find_wait_key(SeqCon* c, const char *odbpath, HNDLE *hKey) {
+   auto it = c->wait_keys.find(odbpath);
+   if (it != c->wait_keys.end()) {
+      // make sure the key was not deleted or replaced since it was resolved
+      KEY key;
+      const char *name = strrchr(odbpath, '/');
+      name = name ? name + 1 : odbpath;
+      if (db_get_key(c->hDB, it->second, &key) == DB_SUCCESS && equal_ustring(key.name, name)) {
+         *hKey = it->second;
+         return DB_SUCCESS;
+      }
+      c->wait_keys.erase(it);
+   }
+
+   int status = db_find_key(c->hDB, 0, odbpath, hKey);
+   if (status == DB_SUCCESS)
+      c->wait_keys[odbpath] = *hKey;
+   return status;
+}
+
+/*------------------------------------------------------------------*/
+
+// timeout for cm_yield() in the main loop: statements run back to back,
+// everything else waits for a command, a hotlink or the WAIT deadline
+
+static int seq_yield_timeout(const SEQUENCER& seq, SeqCon* c) {
+   if (!seq.running || seq.paused || seq.message_wait)
+      return 100;
+
+   if (seq.wait_type[0] == 0)
+      return 0;
+
+   if (equal_ustring(seq.wait_type, "Seconds")) {
+      if (seq.start_time == 0)
+         return 0;
+      int remaining = (int) seq.wait_limit - (int) (ss_millitime() - seq.start_time);
+      if (remaining < 0)
+         return 0;
+      return std::min(remaining + 1, 100);
+   }
+
+   // waiting on an ODB value: the hotlink wakes us up, the timeout only
+   // covers writes which do not notify
+   if (c->hKeyWait)
+      return 100;
+
+   return 10;
+}
+
+/*------------------------------------------------------------------*/
+
 void sequencer(SEQUENCER& seq, SeqCon* c) {
    PMXML_NODE pn, pr, pt, pe;
    char odbpath[256], value[256], data[256], str[1024], name[32], op[32];
    char list[100][XNAME_LENGTH];
-   int i, j, l, n, status, size, index1, index2, state, run_number, cont;
+   int i, j, n, status, size, index1, index2, state, run_number, cont;
    HNDLE hKey, hKeySeq;
    KEY key;
    double d;
    BOOL skip_step = FALSE;
 
    if (!seq.running || seq.paused) {
-      ss_sleep(10);
       return;
    }
 
@@ -1455,7 +1606,6 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
       seq_stop(seq, c);
       strlcpy(seq.error, "No script loaded", sizeof(seq.error));
       seq_write(seq, c);
-      ss_sleep(10);
       return;
    }
 
@@ -1468,7 +1618,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
    str[19] = 0;
    strcpy(seq.last_msg, str+11);
 
-   pr = mxml_find_node(c->pnseq, "RunSequence");
+   pr = c->prun;
    if (!pr) {
       seq_error(seq, c, "Cannot find &lt;RunSequence&gt; tag in XML file");
       return;
@@ -1517,7 +1667,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
             seq.loop_n[i] = 0;
             seq.current_line_number++;
          } else {
-            pn = mxml_get_node_at_line(c->pnseq, seq.loop_start_line[i]);
+            pn = seq_node_at_line(c, seq.loop_start_line[i]);
             if (mxml_get_attribute(pn, "var")) {
                strlcpy(name, mxml_get_attribute(pn, "var"), sizeof(name));
                if (mxml_get_attribute(pn, "values")) {
@@ -1566,7 +1716,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
    }
 
    /* find node belonging to current line */
-   pn = mxml_get_node_at_line(c->pnseq, seq.current_line_number);
+   pn = seq_node_at_line(c, seq.current_line_number);
    if (!pn) {
       size = sizeof(seq);
       db_get_record(c->hDB, hKeySeq, &seq, &size, 0);
@@ -1576,7 +1726,6 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
    }
 
    /* set MSL line from current element and put script into ODB if changed (library call) */
-   pn = mxml_get_node_at_line(c->pnseq, seq.current_line_number);
    if (pn) {
       if (seq.follow_libraries) {
          if (mxml_get_attribute(pn, "l"))
@@ -2149,8 +2298,12 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
          n = atoi(eval_var(seq, c, mxml_get_value(pn)).c_str());
          seq.wait_limit = (float) n;
          strcpy(seq.wait_type, "Events");
-         size = sizeof(d);
-         db_get_value(c->hDB, 0, "/Equipment/Trigger/Statistics/Events sent", &d, &size, TID_DOUBLE, FALSE);
+         d = 0;
+         if (seq_find_wait_key(c, "/Equipment/Trigger/Statistics/Events sent", &hKey) == DB_SUCCESS) {
+            size = sizeof(d);
+            db_get_data(c->hDB, hKey, &d, &size, TID_DOUBLE);
+            seq_wait_watch(c, hKey);
+         }
          seq.wait_value = (float) d;
          if (d >= n) {
             seq.current_line_number = mxml_get_line_number_end(pn) + 1;
@@ -2189,7 +2342,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
 
             index1 = index2 = 0;
             seq_array_index(seq, c, odbpath, &index1, &index2);
-            status = db_find_key(c->hDB, 0, odbpath, &hKey);
+            status = seq_find_wait_key(c, odbpath, &hKey);
             if (status != DB_SUCCESS) {
                char errorstr[512];
                sprintf(errorstr, "Cannot find ODB key \"%s\"", odbpath);
@@ -2235,6 +2388,8 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
                   seq.wait_value = 0;
                   seq.wait_type[0] = 0;
                   seq.wait_odb[0] = 0;
+               } else {
+                  seq_wait_watch(c, hKey);
                }
             }
          }
@@ -2245,7 +2400,8 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
             seq.start_time = ss_millitime();
             seq.wait_value = 0;
          } else {
-            seq.wait_value = (float) (ss_millitime() - seq.start_time);
+            // progress in steps of 100 ms, so that waiting does not rewrite /Sequencer/State on every pass
+            seq.wait_value = (float) ((ss_millitime() - seq.start_time) / 100 * 100);
             if (seq.wait_value > seq.wait_limit)
                seq.wait_value = seq.wait_limit;
          }
@@ -2261,9 +2417,6 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
          sprintf(str, "Invalid wait attribute \"%s\"", mxml_get_attribute(pn, "for"));
          seq_error(seq, c, str);
       }
-
-      // sleep to keep the CPU from consuming 100%
-      ss_sleep(1);
    }
 
    /*---- Loop start ----*/
@@ -2357,7 +2510,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
       // search for "else" line
       seq.if_else_line[seq.if_index] = 0;
       for (j = seq.current_line_number + 1; j < mxml_get_line_number_end(pn) + 1; j++) {
-         pe = mxml_get_node_at_line(c->pnseq, j);
+         pe = seq_node_at_line(c, j);
 
          // skip nested if..endif
          if (pe && equal_ustring(mxml_get_name(pe), "If")) {
@@ -2417,16 +2570,9 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
       }
       if (mxml_get_attribute(pn, "sline")) {
          strlcpy(str, eval_var(seq, c, mxml_get_attribute(pn, "sline")).c_str(), sizeof(str));
-         for (i = 0; i < last_line; i++) {
-            pt = mxml_get_node_at_line(c->pnseq, i);
-            if (pt && mxml_get_attribute(pt, "l")) {
-               l = atoi(mxml_get_attribute(pt, "l"));
-               if (atoi(str) == l) {
-                  seq.current_line_number = i;
-                  break;
-               }
-            }
-         }
+         auto it = c->sline.find(atoi(str));
+         if (it != c->sline.end() && it->second < last_line)
+            seq.current_line_number = it->second;
       }
    }
 
@@ -2485,7 +2631,7 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
       // check if variable is used in loop
       for (i = SEQ_NEST_LEVEL_LOOP-1; i >= 0; i--)
          if (seq.loop_start_line[i] > 0) {
-            pr = mxml_get_node_at_line(c->pnseq, seq.loop_start_line[i]);
+            pr = seq_node_at_line(c, seq.loop_start_line[i]);
             if (mxml_get_attribute(pr, "var")) {
                if (equal_ustring(mxml_get_attribute(pr, "var"), name))
                   seq.loop_counter[i] = atoi(value);
@@ -2591,34 +2737,30 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
          seq.ssubroutine_call_line[seq.stack_index] = atoi(mxml_get_attribute(pn, "l"));
          seq.subroutine_return_line[seq.stack_index] = mxml_get_line_number_end(pn) + 1;
 
-         // search subroutine
-         for (i = 1; i < mxml_get_line_number_end(mxml_find_node(c->pnseq, "RunSequence")); i++) {
-            pt = mxml_get_node_at_line(c->pnseq, i);
-            if (pt) {
-               if (equal_ustring(mxml_get_name(pt), "Subroutine")) {
-                  if (equal_ustring(mxml_get_attribute(pt, "name"), mxml_get_attribute(pn, "name"))) {
-                     // put routine end line on end stack
-                     seq.subroutine_end_line[seq.stack_index] = mxml_get_line_number_end(pt);
-                     // go to first line of subroutine
-                     seq.current_line_number = mxml_get_line_number_start(pt) + 1;
-                     // put parameter(s) on stack
-                     if (mxml_get_value(pn)) {
-                        char p[256];
-                        if (strchr(mxml_get_value(pn), '$')) // evaluate message string if $ present
-                           strlcpy(p, eval_var(seq, c, mxml_get_value(pn)).c_str(), sizeof(p));
-                        else
-                           strlcpy(p, mxml_get_value(pn), sizeof(p)); // treat message as string
-
-                        strlcpy(seq.subroutine_param[seq.stack_index], p, 256);
-                     }
-                     // increment stack
-                     seq.stack_index++;
-                     break;
-                  }
-               }
+         // look up subroutine
+         std::string sname = mxml_get_attribute(pn, "name") ? mxml_get_attribute(pn, "name") : "";
+         for (auto& ch : sname)
+            ch = tolower(ch);
+         auto it = c->subroutine.find(sname);
+         if (it != c->subroutine.end()) {
+            pt = it->second;
+            // put routine end line on end stack
+            seq.subroutine_end_line[seq.stack_index] = mxml_get_line_number_end(pt);
+            // go to first line of subroutine
+            seq.current_line_number = mxml_get_line_number_start(pt) + 1;
+            // put parameter(s) on stack
+            if (mxml_get_value(pn)) {
+               char p[256];
+               if (strchr(mxml_get_value(pn), '$')) // evaluate message string if $ present
+                  strlcpy(p, eval_var(seq, c, mxml_get_value(pn)).c_str(), sizeof(p));
+               else
+                  strlcpy(p, mxml_get_value(pn), sizeof(p)); // treat message as string
+
+               strlcpy(seq.subroutine_param[seq.stack_index], p, 256);
             }
-         }
-         if (i == mxml_get_line_number_end(mxml_find_node(c->pnseq, "RunSequence"))) {
+            // increment stack
+            seq.stack_index++;
+         } else {
             sprintf(str, "Subroutine '%s' not found", mxml_get_attribute(pn, "name"));
             seq_error(seq, c, str);
          }
@@ -2646,8 +2788,10 @@ void sequencer(SEQUENCER& seq, SeqCon* c) {
    if (seq.debug && !skip_step)
       seq.paused = TRUE;
 
-   /* update current line number */
-   db_set_record(c->hDB, hKeySeq, &seq, sizeof(seq), 0);
+   /* update current line number, unless nothing changed (pending WAIT): our own
+      hotlink on /Sequencer/State would wake up the main loop right away */
+   if (memcmp(&seq, &seq1, sizeof(seq)) != 0)
+      db_set_record(c->hDB, hKeySeq, &seq, sizeof(seq), 0);
 }
 
 /*------------------------------------------------------------------*/
@@ -2864,7 +3008,11 @@ int main(int argc, const char *argv[]) {
          seq_error(seq, &c, msg);
       }
 
-      status = cm_yield(0);
+      /* drop the hotlink of a WAIT which has finished */
+      if (c.hKeyWait && (!seq.running || seq.wait_type[0] == 0))
+         seq_wait_unwatch(&c);
+
+      status = cm_yield(seq_yield_timeout(seq, &c));
 
       ch = 0;
       while (ss_kbhit()) {
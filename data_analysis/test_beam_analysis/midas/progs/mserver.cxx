@@ -586,6 +586,10 @@ INT rpc_server_dispatch(INT index, void *prpc_param[])
       }
       break;
 
+   case RPC_BM_EVENT_STREAMS:
+      status = rpc_server_event_streams(CINT(0), CINT(1), CBOOL(2));
+      break;
+
    case RPC_BM_MARK_READ_WAITING:
       status = BM_SUCCESS;
       break;
@@ -554,6 +554,9 @@ int main(int argc, char *argv[])
          int cstatus = ss_semaphore_create("ODB", &sem);
          int dstatus = ss_semaphore_delete(sem, TRUE);
          printf("Deleting old ODB semaphore... create status %d, delete status %d\n", cstatus, dstatus);
+         cstatus = ss_rwlock_create("ODB", &sem);
+         dstatus = ss_rwlock_delete(sem, TRUE);
+         printf("Deleting old ODB lock... create status %d, delete status %d\n", cstatus, dstatus);
       }
    }
    
@@ -0,0 +1,446 @@
+"""
+Fast, numpy-based access to the banks in a midas file.
+
+`midas.file_reader` unpacks every event header and bank with `struct.unpack`,
+which is convenient but slow for large files. The tools in this file instead
+index the whole file in one go, and return bank data as numpy arrays that are
+views of the file content (no copying).
+
+* Raw files (.mid) are memory-mapped, so only the pages you access are read.
+* Compressed files (.mid.gz, .mid.bz2, .mid.lz4) are decompressed into memory
+    first, so need enough RAM to hold the uncompressed file.
+* The index is built by the midas C library (`libmidas-c-compat`, so midas must
+    be built using cmake, see the README). If the library can't be found, the
+    same index is built in pure python, which is slower but gives the same results.
+
+This module requires numpy. The `midas.file_reader` module remains available
+if you don't have numpy, or prefer to work with `midas.event.Event` objects.
+
+
+Basic usage:
+
+```
+import midas.fast_reader
+
+mfile = midas.fast_reader.FastMidasFile("040644.mid")
+
+# Headers of all events, as a numpy structured array
+print("File contains %d events, first serial number %d" % (len(mfile), mfile.headers["serial_number"][0]))
+
+# Data of the "ADC0" bank of each event that contains one, as a list of
+# numpy arrays (plus the index of each event in mfile.headers)
+event_idx, adc_data = mfile.get_bank("ADC0")
+
+# If all the "ADC0" banks have the same length, get them as one 2D array
+event_idx, adc_array = mfile.get_bank_array("ADC0")
+print("Mean of each channel: %s" % adc_array.mean(axis=0))
+
+# Or loop over the events
+for event in mfile:
+    if "ADC0" in event.banks:
+        print("Event %d: ADC0 sum %d" % (event.header["serial_number"], event.banks["ADC0"].sum()))
+```
+
+
+Reading a bank from all the files of a run:
+
+```
+import glob
+import midas.fast_reader
+
+headers, adc_data = midas.fast_reader.get_run_bank(sorted(glob.glob("run00123_*.mid.lz4")), "ADC0")
+```
+"""
+import os
+import mmap
+import gzip
+import bz2
+import struct
+import ctypes
+import numpy as np
+import midas
+import midas.event
+import midas.file_reader
+
+try:
+    import lz4.frame
+    have_lz4 = True
+except ImportError:
+    have_lz4 = False
+
+# numpy version of midas' EVENT_HEADER (with field names from `midas.event.EventHeader`)
+event_header_dtype = np.dtype([("event_id", "<u2"),
+                               ("trigger_mask", "<u2"),
+                               ("serial_number", "<u4"),
+                               ("timestamp", "<u4"),
+                               ("event_data_size_bytes", "<u4")])
+
+# numpy version of C_BANK_INDEX in midas_c_compat.h
+bank_index_dtype = np.dtype([("event", "<i4"),
+                             ("name", "S4"),
+                             ("type", "<u4"),
+                             ("size_bytes", "<u4"),
+                             ("offset", "<u8")])
+
+_native_lib = None
+_native_lib_searched = False
+
+def get_native_lib():
+    """
+    Load the midas C library used to index files.
+
+    Returns:
+        `midas.MidasLib`, or None if $MIDASSYS isn't set or the library
+        wasn't found.
+    """
+    global _native_lib, _native_lib_searched
+
+    if _native_lib_searched:
+        return _native_lib
+
+    _native_lib_searched = True
+    midas_sys = os.getenv("MIDASSYS", None)
+
+    if midas_sys is None:
+        return None
+
+    for lib_file in ["libmidas-c-compat.so", "libmidas-c-compat.dylib"]:
+        lib_path = os.path.join(midas_sys, "lib", lib_file)
+
+        if os.path.exists(lib_path):
+            try:
+                lib = midas.MidasLib(lib_path)
+                lib.c_bk_index_events.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+                lib.c_bk_index_banks.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+                _native_lib = lib
+            except (OSError, AttributeError):
+                # Library too old (no c_bk_index_xxx functions) or can't be loaded
+                midas.logger.warning("Can't use %s to index midas files, using the pure-python fallback" % lib_path)
+            break
+
+    return _native_lib
+
+class FastEvent:
+    """
+    An event returned when iterating over a `FastMidasFile`.
+
+    Members:
+
+    * header (numpy record, see `event_header_dtype`)
+    * banks (dict of {str: numpy array}) - Views of the bank data, keyed by
+        bank name. Empty for midas internal events.
+    """
+    def __init__(self, header, banks):
+        self.header = header
+        self.banks = banks
+
+class FastMidasFile:
+    """
+    Indexed access to a midas file - either raw (.mid), gzipped (.mid.gz),
+    bzip2 (.mid.bz2) or lz4 (.mid.lz4).
+
+    Members:
+
+    * path (str)
+    * buffer (mmap or bytes) - The uncompressed file content
+    * native (bool) - Whether the index was built by the midas C library
+    * headers (numpy structured array, see `event_header_dtype`) - Header
+        of each event
+    * offsets (numpy array of uint64) - Position of each event in buffer
+    """
+    def __init__(self, path, use_native=True):
+        """
+        Open and index a midas file.
+
+        Args:
+
+        * path (str) - Path to midas file. Can be raw, gz, bz2 or lz4 compressed.
+        * use_native (bool) - Whether to use the midas C library to build
+            the index (if it can be found).
+        """
+        self.path = path
+        self.buffer = self._read(path)
+        self._raw = np.frombuffer(self.buffer, np.uint8)
+        self._lib = get_native_lib() if use_native else None
+        self.native = self._lib is not None
+        self._bank_index = {}
+
+        if self.native:
+            self.headers, self.offsets = self._index_events_native()
+        else:
+            self.headers, self.offsets = self._index_events_python()
+
+    def __len__(self):
+        return len(self.headers)
+
+    def __iter__(self):
+        """
+        Iterate over all events, as `FastEvent` objects.
+        """
+        index = self.get_bank_index()
+        starts = np.searchsorted(index["event"], np.arange(len(self.headers) + 1))
+
+        for i in range(len(self.headers)):
+            banks = {}
+
+            for entry in index[starts[i]:starts[i+1]]:
+                banks[entry["name"].decode("ascii")] = self.get_bank_data(entry)
+
+            yield FastEvent(self.headers[i], banks)
+
+    def _read(self, path):
+        """
+        Map or decompress the file into memory.
+        """
+        if path.endswith(".lz4"):
+            if not have_lz4:
+                raise ImportError("lz4 package not found - install using 'pip install lz4'")
+            with lz4.frame.open(path, "rb") as f:
+                return f.read()
+        elif path.endswith(".gz"):
+            with gzip.open(path, "rb") as f:
+                return f.read()
+        elif path.endswith(".bz2"):
+            with bz2.open(path, "rb") as f:
+                return f.read()
+
+        with open(path, "rb") as f:
+            if os.fstat(f.fileno()).st_size == 0:
+                return b""
+            return mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    def _index_events_native(self):
+        buf = self._raw.ctypes.data
+        num_events = ctypes.c_int()
+        self._lib.c_bk_index_events(buf, len(self._raw), None, None, 0, ctypes.byref(num_events))
+
+        headers = np.zeros(num_events.value, event_header_dtype)
+        offsets = np.zeros(num_events.value, np.uint64)
+        self._lib.c_bk_index_events(buf, len(self._raw), headers.ctypes.data, offsets.ctypes.data, len(headers), ctypes.byref(num_events))
+
+        return headers, offsets
+
+    def _index_events_python(self):
+        headers = []
+        offsets = []
+        pos = 0
+        size = len(self.buffer)
+
+        while pos + midas.event.event_header_size <= size:
+            header = struct.unpack_from("<HHIII", self.buffer, pos)
+
+            if pos + midas.event.event_header_size + header[4] > size:
+                break
+
+            headers.append(header)
+            offsets.append(pos)
+            pos += midas.event.event_header_size + header[4]
+
+        return np.array(headers, event_header_dtype), np.array(offsets, np.uint64)
+
+    def _index_banks_native(self, bank_name):
+        buf = self._raw.ctypes.data
+        offsets = self.offsets.ctypes.data
+        name = bank_name.encode("ascii") if bank_name else None
+        num_banks = ctypes.c_int()
+        self._lib.c_bk_index_banks(buf, len(self._raw), offsets, len(self.offsets), name, None, 0, ctypes.byref(num_banks))
+
+        index = np.zeros(num_banks.value, bank_index_dtype)
+        self._lib.c_bk_index_banks(buf, len(self._raw), offsets, len(self.offsets), name, index.ctypes.data, len(index), ctypes.byref(num_banks))
+
+        return index
+
+    def _index_banks_python(self, bank_name):
+        index = []
+        name = bank_name.encode("ascii") if bank_name else None
+
+        for i, (header, pos) in enumerate(zip(self.headers, self.offsets)):
+            if header["event_id"] in (0x8000, 0x8001, 0x8002):
+                # BOR/EOR ODB dump or message
+                continue
+
+            pos = int(pos) + midas.event.event_header_size
+            data_size = int(header["event_data_size_bytes"])
+
+            if data_size < midas.event.all_bank_header_size:
+                continue
+
+            all_bank_size, flags = struct.unpack_from("<II", self.buffer, pos)
+
+            if all_bank_size > data_size - midas.event.all_bank_header_size:
+                continue
+
+            pos += midas.event.all_bank_header_size
+            end = pos + all_bank_size
+
+            if flags & (1<<5):
+                fmt = "<4sIII"
+            elif flags & (1<<4):
+                fmt = "<4sII"
+            else:
+                fmt = "<4sHH"
+
+            bank_header_size = struct.calcsize(fmt)
+
+            while pos + bank_header_size <= end:
+                bank_header = struct.unpack_from(fmt, self.buffer, pos)
+                pos += bank_header_size
+
+                if pos + bank_header[2] > end:
+                    break
+
+                if name is None or bank_header[0] == name:
+                    index.append((i, bank_header[0], bank_header[1], bank_header[2], pos))
+
+                    if name is not None:
+                        break
+
+                pos += (bank_header[2] + 7) & ~7
+
+        return np.array(index, bank_index_dtype)
+
+    def get_bank_index(self, bank_name=None):
+        """
+        Find the banks in all events of this file. The result is cached.
+
+        Args:
+
+        * bank_name (str) - Only find banks with this name (the first one in
+            each event). None means all banks.
+
+        Returns:
+            numpy structured array (see `bank_index_dtype`), with the index
+            of the event in self.headers, the bank name, type, size and
+            position in self.buffer.
+        """
+        if bank_name not in self._bank_index:
+            if self.native:
+                self._bank_index[bank_name] = self._index_banks_native(bank_name)
+            else:
+                self._bank_index[bank_name] = self._index_banks_python(bank_name)
+
+        return self._bank_index[bank_name]
+
+    def get_bank_data(self, entry):
+        """
+        Get the data of one bank, as a numpy view of self.buffer.
+
+        Args:
+
+        * entry (numpy record) - An entry of `get_bank_index()`
+
+        Returns:
+            numpy array, of the dtype matching the bank type (uint8 for
+            strings, structs and unknown types).
+        """
+        dtype = midas.tid_np_formats.get(int(entry["type"]) & 0xFF, None)
+
+        if dtype is None:
+            dtype = np.uint8
+
+        dtype = np.dtype(dtype)
+        count = int(entry["size_bytes"]) // dtype.itemsize
+        return np.frombuffer(self.buffer, dtype, count, int(entry["offset"]))
+
+    def get_bank(self, bank_name):
+        """
+        Get the data of a bank in all events of this file.
+
+        Args:
+
+        * bank_name (str)
+
+        Returns:
+            tuple of (numpy array of int, list of numpy arrays) - The index of
+            each event containing the bank in self.headers, and the bank data
+            of each of these events (views of self.buffer).
+        """
+        index = self.get_bank_index(bank_name)
+        return index["event"], [self.get_bank_data(entry) for entry in index]
+
+    def get_bank_array(self, bank_name):
+        """
+        Get the data of a bank that has the same type and size in every event
+        as a 2D array, with one row per event. If the events are all the same
+        size, this is a view of self.buffer; otherwise the data is copied.
+
+        Args:
+
+        * bank_name (str)
+
+        Returns:
+            tuple of (numpy array of int, 2D numpy array) - The index of
+            each event containing the bank in self.headers, and the bank data.
+
+        Raises:
+            ValueError if the banks don't all have the same size and type.
+        """
+        index = self.get_bank_index(bank_name)
+
+        if len(index) == 0:
+            return index["event"], np.zeros((0, 0), np.uint8)
+
+        if np.any(index["size_bytes"] != index["size_bytes"][0]) or np.any(index["type"] != index["type"][0]):
+            raise ValueError("Banks %s have different sizes or types" % bank_name)
+
+        first = self.get_bank_data(index[0])
+        offsets = index["offset"].astype(np.int64)
+
+        if len(index) == 1:
+            return index["event"], first.reshape(1, first.size)
+
+        steps = np.diff(offsets)
+
+        if np.all(steps == steps[0]) and steps[0] > 0 and steps[0] % first.itemsize == 0:
+            # Regularly spaced - zero-copy strided view
+            view = np.ndarray((len(index), first.size), first.dtype, self.buffer, offsets[0], (int(steps[0]), first.itemsize))
+            return index["event"], view
+
+        # Gather the rows (copy)
+        array = np.empty((len(index), first.size), first.dtype)
+
+        for i, entry in enumerate(index):
+            array[i] = self.get_bank_data(entry)
+
+        return index["event"], array
+
+    def get_bor_odb_dump(self):
+        """
+        Return the begin-of-run ODB dump as a `midas.file_reader.Odb` object.
+
+        Raises a RuntimeError if the dump can't be found.
+        """
+        if len(self.headers) == 0 or self.headers["event_id"][0] != 0x8000:
+            raise RuntimeError("Unable to find BOR event")
+
+        start = int(self.offsets[0]) + midas.event.event_header_size
+        return midas.file_reader.Odb(bytes(self._raw[start:start + int(self.headers["event_data_size_bytes"][0])]))
+
+def get_run_bank(paths, bank_name, use_native=True):
+    """
+    Get the data of a bank from several files (e.g. all subrun files of a run).
+
+    Args:
+
+    * paths (list of str) - Files to read, in order
+    * bank_name (str)
+    * use_native (bool) - See `FastMidasFile`
+
+    Returns:
+        tuple of (numpy structured array, list of numpy arrays) - The header
+        of each event containing the bank, and the bank data of each of these
+        events (views of the file content).
+    """
+    headers = []
+    data = []
+
+    for path in paths:
+        mfile = FastMidasFile(path, use_native)
+        event_idx, bank_data = mfile.get_bank(bank_name)
+        headers.append(mfile.headers[event_idx])
+        data.extend(bank_data)
+
+    if len(headers) == 0:
+        return np.zeros(0, event_header_dtype), data
+
+    return np.concatenate(headers), data
@@ -97,10 +97,35 @@ except RuntimeError:
 
 ```
 
+
+
+Random access using the event index written by mlogger (if "Write index" is
+enabled for the logger channel, mlogger writes "<data file>.idx" next to each
+.mid or .mid.lz4 file):
+
+```
+import midas.file_reader
+
+mfile = midas.file_reader.MidasFile("run00123.mid.lz4")
+
+if mfile.index is not None:
+    # Start at the first event written at or after a given time
+    mfile.jump_to_time(1700000000)
+    event = mfile.read_next_event()
+
+    # Split the run into 4 parts of about the same size, e.g. for 4 worker processes
+    bounds = mfile.index.split(4)
+    mfile.jump_to_event(bounds[1])
+    for i in range(bounds[1], bounds[2]):
+        event = mfile.read_next_event()
+```
+
 """
 import gzip
 import bz2
 import struct
+import os
+import bisect
 import midas
 import midas.event
 import datetime
@@ -109,10 +134,222 @@ from xml.etree import ElementTree
 
 try:
     import lz4.frame
+    import lz4.block
     have_lz4 = True
 except ImportError:
     have_lz4 = False
         
+class EventIndex:
+    """
+    The event index written by mlogger next to a data file. See mdsupport.h
+    for the file format.
+
+    Members:
+
+    * serial_number, time_stamp, event_id, trigger_mask, data_size (lists of int) -
+        Header fields of each event in the data file
+    * offset (list of int) - Position of each event in the uncompressed data
+    * blocks (list of int) - File offsets of the LZ4 blocks (lz4 files only)
+    * compression (int) - `EventIndex.RAW` or `EventIndex.LZ4`
+    * block_size (int) - Uncompressed size of the LZ4 blocks
+    * complete (bool) - False if the index has no trailer (mlogger is still
+        writing the file, or stopped before closing it). The block list is
+        only available for a complete index.
+    """
+    MAGIC = b"MIDASIDX"
+    END_MAGIC = b"MIDASEND"
+    VERSION = 1
+    RAW = 0
+    LZ4 = 1
+
+    header_struct = struct.Struct("<8sII")
+    entry_struct = struct.Struct("<IIHHIQ")
+    trailer_struct = struct.Struct("<QQII8s")
+
+    def __init__(self, path):
+        """
+        Load an index file.
+
+        Args:
+
+        * path (str) - Path to the index file, see `EventIndex.file_name()`
+        """
+        with open(path, "rb") as f:
+            data = f.read()
+
+        header_size = self.header_struct.size
+        entry_size = self.entry_struct.size
+
+        if len(data) < header_size:
+            raise ValueError("%s is not a midas event index" % path)
+
+        magic, version, file_entry_size = self.header_struct.unpack_from(data, 0)
+
+        if magic != self.MAGIC or version != self.VERSION or file_entry_size != entry_size:
+            raise ValueError("%s is not a midas event index" % path)
+
+        size = len(data) - header_size
+        num_entries = size // entry_size
+        num_blocks = 0
+        self.compression = self.RAW
+        self.block_size = 0
+        self.complete = False
+
+        if size >= self.trailer_struct.size:
+            n, nb, compression, block_size, end_magic = self.trailer_struct.unpack_from(data, len(data) - self.trailer_struct.size)
+
+            if end_magic == self.END_MAGIC and n * entry_size + nb * 8 + self.trailer_struct.size == size:
+                num_entries = n
+                num_blocks = nb
+                self.compression = compression
+                self.block_size = block_size
+                self.complete = True
+
+        entries = [self.entry_struct.unpack_from(data, header_size + i * entry_size) for i in range(num_entries)]
+
+        self.serial_number = [e[0] for e in entries]
+        self.time_stamp = [e[1] for e in entries]
+        self.event_id = [e[2] for e in entries]
+        self.trigger_mask = [e[3] for e in entries]
+        self.data_size = [e[4] for e in entries]
+        self.offset = [e[5] for e in entries]
+
+        blocks_start = header_size + num_entries * entry_size
+        self.blocks = list(struct.unpack_from("<%dQ" % num_blocks, data, blocks_start))
+
+        self._by_event_id = {}
+
+        for i, event_id in enumerate(self.event_id):
+            self._by_event_id.setdefault(event_id, []).append(i)
+
+    def __len__(self):
+        return len(self.offset)
+
+    @staticmethod
+    def file_name(data_path):
+        """
+        Name of the index file of a data file.
+        """
+        return data_path + ".idx"
+
+    def find_time(self, time_stamp):
+        """
+        Find the first event written at or after a given time.
+
+        Args:
+
+        * time_stamp (int) - Seconds since 1970
+
+        Returns:
+            int, the event number (len(self) if there is no such event)
+        """
+        return bisect.bisect_left(self.time_stamp, time_stamp)
+
+    def find_serial(self, event_id, serial_number):
+        """
+        Find the first event of a given ID with a serial number at or after
+        `serial_number`. Serial numbers are counted separately for each event ID.
+
+        Returns:
+            int, the event number (len(self) if there is no such event)
+        """
+        pos = self._by_event_id.get(event_id, [])
+        serials = [self.serial_number[i] for i in pos]
+        i = bisect.bisect_left(serials, serial_number)
+        return pos[i] if i < len(pos) else len(self)
+
+    def split(self, nparts):
+        """
+        Split the data file into parts of about the same size, for example
+        to process a run with several worker processes.
+
+        Returns:
+            List of nparts+1 event numbers; part i contains the events
+            from result[i] up to (not including) result[i+1].
+        """
+        nparts = max(1, nparts)
+        n = len(self)
+
+        if n == 0:
+            return [0] * (nparts + 1)
+
+        total = self.offset[-1] + midas.event.event_header_size + self.data_size[-1]
+        bounds = [0]
+
+        for p in range(1, nparts):
+            bounds.append(bisect.bisect_left(self.offset, total // nparts * p))
+
+        bounds.append(n)
+        return bounds
+
+class _LZ4BlockFile:
+    """
+    Seekable reader of an lz4 data file written with independent blocks,
+    using the block offsets from the event index. Only the block containing
+    the current position is decompressed.
+    """
+    def __init__(self, path, index):
+        self.file = open(path, "rb")
+        self.index = index
+        self.pos = 0
+        self.block_number = -1
+        self.block = b""
+
+    def close(self):
+        self.file.close()
+
+    def seek(self, offset, whence=0):
+        if whence == 0:
+            self.pos = offset
+        elif whence == 1:
+            self.pos += offset
+        else:
+            raise ValueError("Seeking from the end is not supported")
+
+        return self.pos
+
+    def tell(self):
+        return self.pos
+
+    def _read_block(self, block_number):
+        self.block_number = block_number
+        self.block = b""
+
+        if block_number >= len(self.index.blocks):
+            return
+
+        self.file.seek(self.index.blocks[block_number])
+        size = struct.unpack("<I", self.file.read(4))[0]
+        data = self.file.read(size & 0x7FFFFFFF)
+
+        if size & 0x80000000:
+            self.block = data
+        else:
+            self.block = lz4.block.decompress(data, uncompressed_size=self.index.block_size)
+
+    def read(self, size=-1):
+        chunks = []
+
+        while size != 0:
+            block_number = self.pos // self.index.block_size
+
+            if block_number != self.block_number:
+                self._read_block(block_number)
+
+            start = self.pos - block_number * self.index.block_size
+            chunk = self.block[start:] if size < 0 else self.block[start:start + size]
+
+            if not chunk:
+                break
+
+            chunks.append(chunk)
+            self.pos += len(chunk)
+
+            if size > 0:
+                size -= len(chunk)
+
+        return b"".join(chunks)
+
 class MidasFile:
     """
     Provides access to a midas file - either raw (.mid), gzipped (.mid.gz) or lz4 (.mid.lz4).
@@ -126,8 +363,9 @@ class MidasFile:
         not the full data. This member is where the data of the current event starts.
     * use_numpy (bool) - Whether to use numpy when extracting bank contents (so bank
         data is a numpy array rather than a standard python tuple)
+    * index (`EventIndex`) - The event index of the file, or None
     """
-    def __init__(self, path, use_numpy=False):
+    def __init__(self, path, use_numpy=False, use_index=True):
         """
         Open a midas file.
         
@@ -136,12 +374,17 @@ class MidasFile:
         * path (str) - Path to the file
         * use_numpy (bool) - Whether to use numpy when extracting bank contents (so bank
             data is a numpy array rather than a standard python tuple)
+        * use_index (bool) - Whether to load the event index written by mlogger,
+            if there is one. It is needed for `jump_to_event()` etc., and makes
+            seeking in lz4 files fast.
         """
         self.file = None
         self.event = None
+        self.index = None
         self.next_event_offset = 0
         self.this_event_payload_offset = 0
         self.use_numpy = use_numpy
+        self.use_index = use_index
         self.reset_event()
         self.open(path)
         
@@ -189,8 +432,14 @@ class MidasFile:
         * path (str) - Path to midas file. Can be raw, gz or lz4 compressed.
         """
         self.reset_event()
-        
-        if path.endswith(".lz4"):
+        self.index = None
+
+        if self.use_index and os.path.exists(EventIndex.file_name(path)) and not path.endswith((".gz", ".bz2")):
+            self.index = EventIndex(EventIndex.file_name(path))
+
+        if path.endswith(".lz4") and have_lz4 and self.index is not None and self.index.compression == EventIndex.LZ4 and self.index.complete:
+            self.file = _LZ4BlockFile(path, self.index)
+        elif path.endswith(".lz4"):
             if have_lz4:
                 self.file = lz4.frame.LZ4FrameFile(path, "rb")
             else:
@@ -210,6 +459,59 @@ class MidasFile:
         self.next_event_offset = 0
         self.reset_event()
     
+    def jump_to_event(self, event_number):
+        """
+        Move to an event, so it is the next one returned by read_next_event()
+        and friends. Needs the event index.
+
+        Args:
+
+        * event_number (int) - Position of the event in the file (the BOR
+            ODB dump is event 0)
+
+        Returns:
+            bool, False if there is no such event (then we move to the
+            end of the indexed events)
+        """
+        if self.index is None:
+            raise RuntimeError("No event index for this file")
+
+        self.reset_event()
+
+        if event_number >= len(self.index):
+            if len(self.index):
+                self.next_event_offset = self.index.offset[-1] + midas.event.event_header_size + self.index.data_size[-1]
+            return False
+
+        self.next_event_offset = self.index.offset[event_number]
+        return True
+
+    def jump_to_time(self, time_stamp):
+        """
+        Move to the first event written at or after a given time (seconds
+        since 1970). Needs the event index.
+
+        Returns:
+            bool, False if there is no such event
+        """
+        if self.index is None:
+            raise RuntimeError("No event index for this file")
+
+        return self.jump_to_event(self.index.find_time(time_stamp))
+
+    def jump_to_serial(self, event_id, serial_number):
+        """
+        Move to the first event of a given ID with a serial number at or
+        after `serial_number`. Needs the event index.
+
+        Returns:
+            bool, False if there is no such event
+        """
+        if self.index is None:
+            raise RuntimeError("No event index for this file")
+
+        return self.jump_to_event(self.index.find_serial(event_id, serial_number))
+
     def get_bor_odb_dump(self):
         """
         Return the begin-of-run ODB dump as a `midas.file_reader.Odb` object.
@@ -0,0 +1,166 @@
+import unittest
+import os
+import shutil
+import struct
+import tempfile
+import midas
+import midas.event
+import midas.file_reader
+from midas.file_reader import EventIndex
+
+try:
+    import lz4.frame
+    have_lz4 = True
+except ImportError:
+    have_lz4 = False
+
+def write_index(path, events, compression=EventIndex.RAW, blocks=[], block_size=0, trailer=True):
+    """
+    Write an index file the way mlogger does. `events` is a list of
+    (event_id, serial_number, time_stamp, data_size) tuples.
+    """
+    with open(path, "wb") as f:
+        f.write(EventIndex.header_struct.pack(EventIndex.MAGIC, EventIndex.VERSION, EventIndex.entry_struct.size))
+        offset = 0
+
+        for event_id, serial_number, time_stamp, data_size in events:
+            f.write(EventIndex.entry_struct.pack(serial_number, time_stamp, event_id, 0, data_size, offset))
+            offset += midas.event.event_header_size + data_size
+
+        if trailer:
+            f.write(struct.pack("<%dQ" % len(blocks), *blocks))
+            f.write(EventIndex.trailer_struct.pack(len(events), len(blocks), compression, block_size, EventIndex.END_MAGIC))
+
+def lz4_blocks(data):
+    """
+    File offsets of the blocks of an lz4 frame without block checksums.
+    """
+    flg = data[4]
+    pos = 7 + (8 if flg & 0x08 else 0) + (4 if flg & 0x01 else 0)
+    blocks = []
+
+    while True:
+        size = struct.unpack_from("<I", data, pos)[0]
+
+        if size == 0:
+            return blocks
+
+        blocks.append(pos)
+        pos += 4 + (size & 0x7FFFFFFF)
+
+class TestEventIndex(unittest.TestCase):
+    """
+    Write a file of synthetic events with an event index and check the
+    random access functions of `midas.file_reader.MidasFile`. Unlike most
+    of the other tests, these don't need a midas experiment.
+    """
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.path = os.path.join(cls.tmpdir, "run00001.mid")
+        cls.events = []
+        raw = b""
+
+        for i in range(2000):
+            event = midas.event.Event()
+            event.header.event_id = 1 + i % 2
+            event.header.serial_number = i // 2
+            event.header.timestamp = 1700000000 + i // 100
+            event.create_bank("ADC0", midas.TID_WORD, [i % 1000 + j for j in range(1 + i % 50)])
+            data = bytes(event.pack())
+            raw += data
+            cls.events.append((event.header.event_id, event.header.serial_number, event.header.timestamp, len(data) - midas.event.event_header_size))
+
+        with open(cls.path, "wb") as f:
+            f.write(raw)
+
+        write_index(EventIndex.file_name(cls.path), cls.events)
+
+        if have_lz4:
+            compressed = lz4.frame.compress(raw, block_size=lz4.frame.BLOCKSIZE_MAX64KB, block_linked=False, content_checksum=True)
+
+            with open(cls.path + ".lz4", "wb") as f:
+                f.write(compressed)
+
+            blocks = lz4_blocks(compressed)
+            write_index(EventIndex.file_name(cls.path + ".lz4"), cls.events, EventIndex.LZ4, blocks, 64 * 1024)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.tmpdir)
+
+    def _check(self, path):
+        mfile = midas.file_reader.MidasFile(path)
+        self.assertIsNotNone(mfile.index)
+        self.assertTrue(mfile.index.complete)
+        self.assertEqual(len(mfile.index), len(self.events))
+
+        for n in [1500, 3, 0, 1999, 777]:
+            self.assertTrue(mfile.jump_to_event(n))
+            event = mfile.read_next_event()
+            self.assertEqual(event.header.event_id, self.events[n][0])
+            self.assertEqual(event.header.serial_number, self.events[n][1])
+            self.assertEqual(event.banks["ADC0"].data[0], n % 1000)
+
+            # sequential reading continues after the seek
+            if n + 1 < len(self.events):
+                self.assertEqual(mfile.read_next_event().banks["ADC0"].data[0], (n + 1) % 1000)
+
+        self.assertFalse(mfile.jump_to_event(2000))
+        self.assertIsNone(mfile.read_next_event())
+
+        self.assertTrue(mfile.jump_to_time(1700000012))
+        self.assertEqual(mfile.read_next_event().banks["ADC0"].data[0], 200)
+
+        self.assertTrue(mfile.jump_to_serial(2, 500))
+        event = mfile.read_next_event()
+        self.assertEqual((event.header.event_id, event.header.serial_number), (2, 500))
+
+        self.assertFalse(mfile.jump_to_serial(3, 0))
+        self.assertFalse(mfile.jump_to_time(1800000000))
+
+        bounds = mfile.index.split(3)
+        self.assertEqual(bounds[0], 0)
+        self.assertEqual(bounds[-1], len(self.events))
+        self.assertEqual(len(bounds), 4)
+
+        count = 0
+        for part in range(3):
+            mfile.jump_to_event(bounds[part])
+            for i in range(bounds[part], bounds[part + 1]):
+                self.assertEqual(mfile.read_next_event().banks["ADC0"].data[0], i % 1000)
+                count += 1
+
+        self.assertEqual(count, len(self.events))
+
+    def testRaw(self):
+        self._check(self.path)
+
+    @unittest.skipUnless(have_lz4, "lz4 not installed")
+    def testLZ4(self):
+        self._check(self.path + ".lz4")
+        self.assertGreater(len(midas.file_reader.MidasFile(self.path + ".lz4").index.blocks), 2)
+
+    def testIncomplete(self):
+        path = os.path.join(self.tmpdir, "incomplete.mid")
+        shutil.copyfile(self.path, path)
+        write_index(EventIndex.file_name(path), self.events[:1200], trailer=False)
+
+        # a partly written entry at the end is ignored
+        with open(EventIndex.file_name(path), "ab") as f:
+            f.write(b"\0" * 10)
+
+        mfile = midas.file_reader.MidasFile(path)
+        self.assertFalse(mfile.index.complete)
+        self.assertEqual(len(mfile.index), 1200)
+        self.assertTrue(mfile.jump_to_event(1199))
+        self.assertEqual(mfile.read_next_event().header.serial_number, 599)
+
+    def testNoIndex(self):
+        mfile = midas.file_reader.MidasFile(self.path, use_index=False)
+        self.assertIsNone(mfile.index)
+        self.assertRaises(RuntimeError, mfile.jump_to_event, 0)
+        self.assertEqual(mfile.get_event_count(), len(self.events))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,127 @@
+import unittest
+import os
+import gzip
+import shutil
+import tempfile
+import midas
+import midas.event
+import midas.file_reader
+
+try:
+    import numpy as np
+    import midas.fast_reader
+    have_numpy = True
+except ImportError:
+    have_numpy = False
+
+@unittest.skipUnless(have_numpy, "numpy not installed")
+class TestFastReader(unittest.TestCase):
+    """
+    Write a file of synthetic events and check that `midas.fast_reader`
+    gives the same results as `midas.file_reader`. Unlike the other tests,
+    these don't need a midas experiment; the native index is only tested
+    if libmidas-c-compat can be found.
+    """
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.path = os.path.join(cls.tmpdir, "run00001.mid")
+
+        with open(cls.path, "wb") as f:
+            bor = midas.event.EventHeader()
+            bor.event_id = 0x8000
+            bor.serial_number = 1
+            odb = b'{\n  "Runinfo" : {\n    "Run number" : 1\n  }\n}\n'
+            bor.event_data_size_bytes = len(odb)
+            f.write(bytes(bor.pack()) + odb)
+
+            for i in range(30):
+                # Mix of bank formats and sizes, and a bank missing in some events
+                event = midas.event.Event(bank32=(i % 3 != 0), align64=(i % 3 == 2))
+                event.header.event_id = 1 + i % 2
+                event.header.serial_number = i
+                event.create_bank("ADC0", midas.TID_WORD, [i + j for j in range(16)])
+                event.create_bank("TDC0", midas.TID_INT, list(range(-i, i + 1)))
+                if i % 4 == 0:
+                    event.create_bank("SCLR", midas.TID_DOUBLE, [i * 0.5, -1.25])
+                event.create_bank("TEXT", midas.TID_CHAR, b"event %d" % i)
+                f.write(bytes(event.pack()))
+
+        with open(cls.path, "rb") as f_in, gzip.open(cls.path + ".gz", "wb") as f_out:
+            shutil.copyfileobj(f_in, f_out)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.tmpdir)
+
+    def _readers(self, path):
+        readers = [midas.fast_reader.FastMidasFile(path, use_native=False)]
+
+        if midas.fast_reader.get_native_lib() is not None:
+            readers.append(midas.fast_reader.FastMidasFile(path, use_native=True))
+            self.assertTrue(readers[-1].native)
+
+        return readers
+
+    def _check(self, path):
+        reference = list(midas.file_reader.MidasFile(path, use_numpy=True))
+
+        for mfile in self._readers(path):
+            self.assertEqual(len(mfile), len(reference))
+
+            for event, ref in zip(mfile, reference):
+                self.assertEqual(event.header["event_id"], ref.header.event_id)
+                self.assertEqual(event.header["serial_number"], ref.header.serial_number)
+                self.assertEqual(event.header["event_data_size_bytes"], ref.header.event_data_size_bytes)
+                self.assertEqual(sorted(event.banks.keys()), sorted(ref.banks.keys()))
+
+                for name, bank in ref.banks.items():
+                    if bank.type == midas.TID_CHAR:
+                        self.assertEqual(event.banks[name].tobytes(), bytes(bank.data))
+                    else:
+                        self.assertTrue(np.array_equal(event.banks[name], bank.data))
+
+            event_idx, adc = mfile.get_bank_array("ADC0")
+            self.assertEqual(adc.shape, (30, 16))
+            self.assertTrue(np.array_equal(adc[:, 0], np.arange(30)))
+            self.assertTrue(np.array_equal(mfile.headers["serial_number"][event_idx], np.arange(30)))
+
+            event_idx, sclr = mfile.get_bank("SCLR")
+            self.assertEqual(len(sclr), 8)
+            self.assertTrue(np.array_equal(mfile.headers["serial_number"][event_idx], np.arange(0, 30, 4)))
+            self.assertEqual(sclr[2].tolist(), [4.0, -1.25])
+
+            self.assertRaises(ValueError, mfile.get_bank_array, "TDC0")
+            self.assertEqual(len(mfile.get_bank_index("XXXX")), 0)
+            self.assertEqual(mfile.get_bor_odb_dump().data["Runinfo"]["Run number"], 1)
+
+    def testRaw(self):
+        self._check(self.path)
+
+    def testGzip(self):
+        self._check(self.path + ".gz")
+
+    def testZeroCopy(self):
+        for mfile in self._readers(self.path):
+            event_idx, adc = mfile.get_bank("ADC0")
+            self.assertFalse(adc[0].flags.owndata)
+            self.assertFalse(adc[0].flags.writeable)
+
+    def testTruncated(self):
+        path = os.path.join(self.tmpdir, "truncated.mid")
+
+        with open(self.path, "rb") as f_in, open(path, "wb") as f_out:
+            f_out.write(f_in.read()[:-10])
+
+        for mfile in self._readers(path):
+            self.assertEqual(len(mfile), 30)
+            self.assertEqual(len(mfile.get_bank("ADC0")[1]), 29)
+
+    def testRunBank(self):
+        headers, adc = midas.fast_reader.get_run_bank([self.path, self.path + ".gz"], "ADC0")
+        self.assertEqual(len(headers), 60)
+        self.assertEqual(len(adc), 60)
+        self.assertEqual(adc[45][0], 15)
+
+if __name__ == '__main__':
+    unittest.main()
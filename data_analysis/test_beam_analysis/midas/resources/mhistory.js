@@ -1040,14 +1040,15 @@ MhistoryGraph.prototype.loadFullData = function (t1, t2, scrollFlag) {
       log_hs_read("loadFullData un-binned", t1, t2);
       this.parentDiv.style.cursor = "progress";
       this.pendingUpdates++;
-      mjsonrpc_call("hs_read_arraybuffer",
+      mjsonrpc_call("hs_read_decimated",
          {
             "start_time": Math.floor(this.tMinRequested),
             "end_time": Math.floor(this.tMaxRequested),
+            "width": this.decimationWidth(this.tMinRequested, this.tMaxRequested),
             "events": this.events,
             "tags": this.tags,
             "index": this.index
-         }, "arraybuffer")
+         })
          .then(function (rpc) {
 
             this.tMinReceived = this.tMinRequested;
@@ -1115,14 +1116,15 @@ MhistoryGraph.prototype.loadSideData = function () {
 
          log_hs_read("loadSideData left un-binned", t1, t2);
          this.pendingUpdates++;
-         mjsonrpc_call("hs_read_arraybuffer",
+         mjsonrpc_call("hs_read_decimated",
             {
                "start_time": t1,
                "end_time": t2,
+               "width": this.decimationWidth(t1, t2),
                "events": this.events,
                "tags": this.tags,
                "index": this.index
-            }, "arraybuffer")
+            })
             .then(function (rpc) {
 
                this.tMinReceived = this.tMinRequested;
@@ -1182,14 +1184,15 @@ MhistoryGraph.prototype.loadSideData = function () {
          this.parentDiv.style.cursor = "progress";
          log_hs_read("loadSideData right un-binned", t1, t2);
          this.pendingUpdates++;
-         mjsonrpc_call("hs_read_arraybuffer",
+         mjsonrpc_call("hs_read_decimated",
             {
                "start_time": t1,
                "end_time": t2,
+               "width": this.decimationWidth(t1, t2),
                "events": this.events,
                "tags": this.tags,
                "index": this.index
-            }, "arraybuffer")
+            })
             .then(function (rpc) {
 
                this.tMaxReceived = this.tMaxRequested;
@@ -1209,32 +1212,46 @@ MhistoryGraph.prototype.loadSideData = function () {
    }
 };
 
-MhistoryGraph.prototype.receiveData = function (rpc) {
+// number of time bins (pixels) of hs_read_decimated for the time range t1...t2 at the current zoom
+MhistoryGraph.prototype.decimationWidth = function (t1, t2) {
+   let width = this.x2 - this.x1;
+   if (!(width > 0))
+      width = this.parentDiv.clientWidth;
+   if (!(width > 0))
+      width = 1000;
+   if (this.tMax > this.tMin)
+      width = width * (t2 - t1) / (this.tMax - this.tMin);
+   // hs_read_decimated accepts at most 16384 pixels
+   return Math.min(16384, Math.max(1, Math.ceil(width)));
+};
 
-   // decode binary array
-   let array = new Float64Array(rpc);
-   let nVars = array[1];
-   let nData = array.slice(2 + nVars, 2 + 2 * nVars);
-   let i = 2 + 2 * nVars;
+// apply the formula of variable "index", rawValue holds the values before the formula
+MhistoryGraph.prototype.applyFormula = function (index, time, value) {
+   let formula = this.param["Formula"];
+   if (Array.isArray(formula))
+      formula = formula[index];
 
-   if (i >= array.length) {
-      // RPC did not return any data
+   if (formula === undefined || formula === "")
+      return {time: time, value: value, rawValue: []};
 
-      if (this.data === undefined) {
-         // must initialize the arrays otherwise nothing works
-         this.data = [];
-         for (let index = 0; index < nVars; index++) {
-            this.data.push({time:[], value:[], rawValue:[], bin:[], rawBin:[]});
-         }
-      }
-
-      return false;
+   let v1 = [];
+   let x, v, t;
+   for (let j = 0; j < time.length; j++) {
+      t = time[j];
+      x = value[j];
+      v = eval(formula);
+      v1.push(v);
    }
+   return {time: time, value: v1, rawValue: value};
+};
 
-   // bin size 1 for un-binned data
-   this.binSize = 1;
+MhistoryGraph.prototype.receiveData = function (rpc) {
 
-   // push empty arrays on the first time
+   // decimated data from hs_read_decimated, at most four points per pixel
+   let data = rpc.result.data;
+   let nVars = data.length;
+
+   // push empty arrays on the first time, must initialize the arrays otherwise nothing works
    if (this.data === undefined) {
       this.data = [];
       for (let index = 0; index < nVars; index++) {
@@ -1242,36 +1259,24 @@ MhistoryGraph.prototype.receiveData = function (rpc) {
       }
    }
 
+   if (!data.some(d => d.count > 0)) {
+      // RPC did not return any data
+      return false;
+   }
+
+   // bin size 1 for un-binned data
+   this.binSize = 1;
+
    // append new values to end of arrays
    for (let index = 0; index < nVars; index++) {
-      if (nData[index] === 0)
+      if (data[index].count === 0)
          continue;
 
-      let formula = this.param["Formula"];
-      if (Array.isArray(formula))
-         formula = formula[index];
-
-      let t1 = [];
-      let v1 = [];
-      let v1Raw = [];
-      let x, v, t;
-      if (formula !== undefined && formula !== "") {
-         for (let j = 0; j < nData[index]; j++) {
-            t = array[i++];
-            x = array[i++];
-            v = eval(formula);
-            t1.push(t);
-            v1.push(v);
-            v1Raw.push(x);
-         }
-      } else {
-         for (let j = 0; j < nData[index]; j++) {
-            t = array[i++];
-            v = array[i++];
-            t1.push(t);
-            v1.push(v);
-         }
-      }
+      // "NaN", "Infinity" are strings in JSON
+      let d = this.applyFormula(index, data[index].time, data[index].value.map(Number));
+      let t1 = d.time;
+      let v1 = d.value;
+      let v1Raw = d.rawValue;
 
       if (t1.length > 0) {
 
@@ -1523,14 +1528,15 @@ MhistoryGraph.prototype.loadNewData = function () {
    this.binned = false;
 
    log_hs_read("loadNewData  un-binned", t1, t2);
-   mjsonrpc_call("hs_read_arraybuffer",
+   mjsonrpc_call("hs_read_decimated",
       {
          "start_time": Math.floor(t1),
          "end_time": Math.floor(t2),
+         "width": this.decimationWidth(t1, t2),
          "events": this.events,
          "tags": this.tags,
          "index": this.index
-      }, "arraybuffer")
+      })
       .then(function (rpc) {
 
          if (this.tMinRequested === undefined || t1 < this.tMinRequested) {
@@ -3725,78 +3731,118 @@ MhistoryGraph.prototype.download = function (mode) {
    if (mode === "CSV") {
       filename += ".csv";
 
-      let data = "";
-      this.param["Variables"].forEach(v => {
-         data += "Time,";
-         if (this.binned)
-            data += v + " MIN," + v + " MAX,";
-         else
-            data += v + ",";
-      });
-      data = data.slice(0, -1);
-      data += '\n';
-
-      let maxlen = 0;
-      let nvar = this.param["Variables"].length;
-      for (let index=0 ; index < nvar ; index++)
-         if (this.data[index].time.length > maxlen)
-            maxlen = this.data[index].time.length;
-      let index = [];
-      for (let di=0 ; di < nvar ; di++)
-         for (let i = 0; i < maxlen; i++) {
-            if (i < this.data[di].time.length &&
-               this.data[di].time[i] > this.tMin) {
-               index[di] = i;
-               break;
+      let writeCSV = (hsData) => {
+
+         let data = "";
+         this.param["Variables"].forEach(v => {
+            data += "Time,";
+            if (this.binned)
+               data += v + " MIN," + v + " MAX,";
+            else
+               data += v + ",";
+         });
+         data = data.slice(0, -1);
+         data += '\n';
+
+         let maxlen = 0;
+         let nvar = this.param["Variables"].length;
+         for (let index=0 ; index < nvar ; index++)
+            if (hsData[index].time.length > maxlen)
+               maxlen = hsData[index].time.length;
+         let index = [];
+         for (let di=0 ; di < nvar ; di++)
+            for (let i = 0; i < maxlen; i++) {
+               if (i < hsData[di].time.length &&
+                  hsData[di].time[i] > this.tMin) {
+                  index[di] = i;
+                  break;
+               }
             }
-         }
 
-      for (let i = 0; i < maxlen; i++) {
-         let l = "";
-         for (let di = 0 ; di < nvar ; di++) {
-            if (index[di] < this.data[di].time.length &&
-               this.data[di].time[index[di]] > this.tMin && this.data[di].time[index[di]] < this.tMax) {
-               if (this.binned) {
-                  l += this.data[di].time[index[di]] + ",";
-
-                  if (this.param["Show raw value"] !== undefined &&
-                     this.param["Show raw value"][di]) {
-                     l += this.data[di].binRaw[index[di]].minValue + ",";
-                     l += this.data[di].binRaw[index[di]].maxValue + ",";
-                  } else {
-                     l += this.data[di].bin[index[di]].minValue + ",";
-                     l += this.data[di].bin[index[di]].maxValue + ",";
-                  }
+         for (let i = 0; i < maxlen; i++) {
+            let l = "";
+            for (let di = 0 ; di < nvar ; di++) {
+               if (index[di] < hsData[di].time.length &&
+                  hsData[di].time[index[di]] > this.tMin && hsData[di].time[index[di]] < this.tMax) {
+                  if (this.binned) {
+                     l += hsData[di].time[index[di]] + ",";
+
+                     if (this.param["Show raw value"] !== undefined &&
+                        this.param["Show raw value"][di]) {
+                        l += hsData[di].binRaw[index[di]].minValue + ",";
+                        l += hsData[di].binRaw[index[di]].maxValue + ",";
+                     } else {
+                        l += hsData[di].bin[index[di]].minValue + ",";
+                        l += hsData[di].bin[index[di]].maxValue + ",";
+                     }
 
-               } else {
+                  } else {
 
-                  l += this.data[di].time[index[di]] + ",";
+                     l += hsData[di].time[index[di]] + ",";
 
-                  if (this.param["Show raw value"] !== undefined &&
-                     this.param["Show raw value"][di])
-                     l += this.data[di].rawValue[index[di]] + ",";
-                  else
-                     l += this.data[di].value[index[di]] + ",";
+                     if (this.param["Show raw value"] !== undefined &&
+                        this.param["Show raw value"][di])
+                        l += hsData[di].rawValue[index[di]] + ",";
+                     else
+                        l += hsData[di].value[index[di]] + ",";
+                  }
+               } else {
+                  l += ",,";
                }
-            } else {
-               l += ",,";
+               index[di]++;
+            }
+            if (l.split(',').some(s => s)) { // don't add if only commas
+               l = l.slice(0, -1); // remove last comma
+               data += l + '\n';
             }
-            index[di]++;
-         }
-         if (l.split(',').some(s => s)) { // don't add if only commas
-            l = l.slice(0, -1); // remove last comma
-            data += l + '\n';
          }
-      }
 
-      let blob = new Blob([data], {type: "text/csv"});
-      let url = window.URL.createObjectURL(blob);
+         let blob = new Blob([data], {type: "text/csv"});
+         let url = window.URL.createObjectURL(blob);
 
-      a.href = url;
-      a.download = filename;
-      a.click();
-      window.URL.revokeObjectURL(url);
-      dlgAlert("Data downloaded to '" + filename + "'");
+         a.href = url;
+         a.download = filename;
+         a.click();
+         window.URL.revokeObjectURL(url);
+         dlgAlert("Data downloaded to '" + filename + "'");
+      };
+
+      if (this.binned) {
+         writeCSV(this.data);
+      } else {
+         // the plot holds decimated data, export all data points
+         mjsonrpc_call("hs_read_arraybuffer",
+            {
+               "start_time": Math.floor(this.tMin),
+               "end_time": Math.ceil(this.tMax),
+               "events": this.events,
+               "tags": this.tags,
+               "index": this.index
+            }, "arraybuffer")
+            .then(function (rpc) {
+
+               // decode binary array
+               let array = new Float64Array(rpc);
+               let nVars = array[1];
+               let nData = array.slice(2 + nVars, 2 + 2 * nVars);
+               let i = 2 + 2 * nVars;
+               let hsData = [];
+               for (let index = 0; index < nVars; index++) {
+                  let t = [];
+                  let v = [];
+                  for (let j = 0; j < nData[index]; j++) {
+                     t.push(array[i++]);
+                     v.push(array[i++]);
+                  }
+                  hsData.push(this.applyFormula(index, t, v));
+               }
+               writeCSV(hsData);
+
+            }.bind(this))
+            .catch(function (error) {
+               mjsonrpc_error_alert(error);
+            });
+      }
 
    } else if (mode === "PNG") {
       filename += ".png";
@@ -0,0 +1,353 @@
+/********************************************************************\
+
+  Name:         caen_unpack.cxx
+
+  Contents:     Decoding of CAEN digitizer event data into
+                channel-major int16 sample arrays, see caen_unpack.h.
+
+                The sample loops have scalar, SSSE3 and AVX2 versions,
+                selected at run time from the CPU features.
+
+\********************************************************************/
+
+#include "caen_unpack.h"
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CAEN_X86 1
+#include <immintrin.h>
+#endif
+
+/* sample loops of one implementation */
+typedef struct {
+   int impl;
+   /* 2 samples per word, nwords words of one channel */
+   void (*unpack_2x16)(const uint32_t* in, size_t nwords, int16_t* out);
+   /* 3 samples per word, nwords words of one channel */
+   void (*unpack_3x10)(const uint32_t* in, size_t nwords, int16_t* out);
+   /* one V1740 group, 8 rows of nsamples separated by stride */
+   void (*unpack_v1740)(const uint32_t* in, size_t nsamples, int16_t* out, size_t stride);
+} CAEN_KERNELS;
+
+/********************************************************************/
+
+static void unpack_2x16_c(const uint32_t* in, size_t nwords, int16_t* out)
+{
+   for (size_t i=0; i<nwords; i++) {
+      uint32_t w = in[i];
+      out[2*i]   = w & 0x3FFF;
+      out[2*i+1] = (w >> 16) & 0x3FFF;
+   }
+}
+
+static void unpack_3x10_c(const uint32_t* in, size_t nwords, int16_t* out)
+{
+   for (size_t i=0; i<nwords; i++) {
+      uint32_t w = in[i];
+      out[3*i]   = w & 0x3FF;
+      out[3*i+1] = (w >> 10) & 0x3FF;
+      out[3*i+2] = (w >> 20) & 0x3FF;
+   }
+}
+
+/* 8 samples of one channel from 3 words */
+static inline void unpack_v1740_block_c(const uint32_t* p, int16_t* out)
+{
+   uint32_t w0 = p[0];
+   uint32_t w1 = p[1];
+   uint32_t w2 = p[2];
+   out[0] = w0 & 0xFFF;
+   out[1] = (w0 >> 12) & 0xFFF;
+   out[2] = (w0 >> 24) | ((w1 & 0xF) << 8);
+   out[3] = (w1 >> 4) & 0xFFF;
+   out[4] = (w1 >> 16) & 0xFFF;
+   out[5] = (w1 >> 28) | ((w2 & 0xFF) << 4);
+   out[6] = (w2 >> 8) & 0xFFF;
+   out[7] = w2 >> 20;
+}
+
+static void unpack_v1740_c(const uint32_t* in, size_t nsamples, int16_t* out, size_t stride)
+{
+   for (size_t i=0; i<nsamples; i+=8)
+      for (int ch=0; ch<8; ch++, in+=3)
+         unpack_v1740_block_c(in, out + ch*stride + i);
+}
+
+static const CAEN_KERNELS caen_kernels_c = {
+   CAEN_UNPACK_SCALAR, unpack_2x16_c, unpack_3x10_c, unpack_v1740_c
+};
+
+#ifdef HAVE_CAEN_X86
+
+/********************************************************************/
+
+__attribute__((target("ssse3")))
+static void unpack_2x16_ssse3(const uint32_t* in, size_t nwords, int16_t* out)
+{
+   const __m128i mask = _mm_set1_epi16(0x3FFF);
+   size_t i = 0;
+   for (; i+4<=nwords; i+=4) {
+      __m128i w = _mm_loadu_si128((const __m128i*)(in + i));
+      _mm_storeu_si128((__m128i*)(out + 2*i), _mm_and_si128(w, mask));
+   }
+   unpack_2x16_c(in + i, nwords - i, out + 2*i);
+}
+
+__attribute__((target("ssse3")))
+static void unpack_3x10_ssse3(const uint32_t* in, size_t nwords, int16_t* out)
+{
+   const __m128i mask = _mm_set1_epi32(0x3FF);
+   /* interleave a0..a3 b0..b3 (ab) and c0..c3 (cc) as a0 b0 c0 a1 b1 c1 ... */
+   const __m128i ab_lo = _mm_setr_epi8(0,1, 8,9, -1,-1, 2,3, 10,11, -1,-1, 4,5, 12,13);
+   const __m128i cc_lo = _mm_setr_epi8(-1,-1, -1,-1, 0,1, -1,-1, -1,-1, 2,3, -1,-1, -1,-1);
+   const __m128i ab_hi = _mm_setr_epi8(-1,-1, 6,7, 14,15, -1,-1, -1,-1, -1,-1, -1,-1, -1,-1);
+   const __m128i cc_hi = _mm_setr_epi8(4,5, -1,-1, -1,-1, 6,7, -1,-1, -1,-1, -1,-1, -1,-1);
+   size_t i = 0;
+   for (; i+4<=nwords; i+=4) {
+      __m128i w = _mm_loadu_si128((const __m128i*)(in + i));
+      __m128i a = _mm_and_si128(w, mask);
+      __m128i b = _mm_and_si128(_mm_srli_epi32(w, 10), mask);
+      __m128i c = _mm_and_si128(_mm_srli_epi32(w, 20), mask);
+      __m128i ab = _mm_packs_epi32(a, b);
+      __m128i cc = _mm_packs_epi32(c, c);
+      __m128i lo = _mm_or_si128(_mm_shuffle_epi8(ab, ab_lo), _mm_shuffle_epi8(cc, cc_lo));
+      __m128i hi = _mm_or_si128(_mm_shuffle_epi8(ab, ab_hi), _mm_shuffle_epi8(cc, cc_hi));
+      _mm_storeu_si128((__m128i*)(out + 3*i), lo);
+      _mm_storel_epi64((__m128i*)(out + 3*i + 8), hi);
+   }
+   unpack_3x10_c(in + i, nwords - i, out + 3*i);
+}
+
+/*
+ * V1740 block: sample j starts at bit 12*j, i.e. in byte 3*j/2. Bytes
+ * 3*j/2 and 3*j/2+1 go into 16-bit lane j, even samples are the low
+ * 12 bits of the lane, odd samples the high 12 bits.
+ */
+#define V1740_SHUFFLE 0,1, 1,2, 3,4, 4,5, 6,7, 7,8, 9,10, 10,11
+#define V1740_EVEN    0x0FFF, 0, 0x0FFF, 0, 0x0FFF, 0, 0x0FFF, 0
+#define V1740_ODD     0, 0x0FFF, 0, 0x0FFF, 0, 0x0FFF, 0, 0x0FFF
+
+__attribute__((target("ssse3")))
+static void unpack_v1740_ssse3(const uint32_t* in, size_t nsamples, int16_t* out, size_t stride)
+{
+   const __m128i shuffle = _mm_setr_epi8(V1740_SHUFFLE);
+   const __m128i even = _mm_setr_epi16(V1740_EVEN);
+   const __m128i odd = _mm_setr_epi16(V1740_ODD);
+   for (size_t i=0; i<nsamples; i+=8) {
+      /* the 16 byte load reads one word past the block, do the last one in C */
+      int nch = (i+8 < nsamples) ? 8 : 7;
+      for (int ch=0; ch<nch; ch++, in+=3) {
+         __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), shuffle);
+         v = _mm_or_si128(_mm_and_si128(v, even), _mm_and_si128(_mm_srli_epi16(v, 4), odd));
+         _mm_storeu_si128((__m128i*)(out + ch*stride + i), v);
+      }
+      if (nch == 7) {
+         unpack_v1740_block_c(in, out + 7*stride + i);
+         in += 3;
+      }
+   }
+}
+
+static const CAEN_KERNELS caen_kernels_ssse3 = {
+   CAEN_UNPACK_SSE, unpack_2x16_ssse3, unpack_3x10_ssse3, unpack_v1740_ssse3
+};
+
+/********************************************************************/
+
+__attribute__((target("avx2")))
+static void unpack_2x16_avx2(const uint32_t* in, size_t nwords, int16_t* out)
+{
+   const __m256i mask = _mm256_set1_epi16(0x3FFF);
+   size_t i = 0;
+   for (; i+16<=nwords; i+=16) {
+      __m256i w0 = _mm256_loadu_si256((const __m256i*)(in + i));
+      __m256i w1 = _mm256_loadu_si256((const __m256i*)(in + i + 8));
+      _mm256_storeu_si256((__m256i*)(out + 2*i), _mm256_and_si256(w0, mask));
+      _mm256_storeu_si256((__m256i*)(out + 2*i + 16), _mm256_and_si256(w1, mask));
+   }
+   unpack_2x16_ssse3(in + i, nwords - i, out + 2*i);
+}
+
+/* two channels at a time, the blocks of channels ch and ch+1 follow each other */
+__attribute__((target("avx2")))
+static void unpack_v1740_avx2(const uint32_t* in, size_t nsamples, int16_t* out, size_t stride)
+{
+   const __m256i shuffle = _mm256_setr_epi8(V1740_SHUFFLE, V1740_SHUFFLE);
+   const __m256i even = _mm256_setr_epi16(V1740_EVEN, V1740_EVEN);
+   const __m256i odd = _mm256_setr_epi16(V1740_ODD, V1740_ODD);
+   for (size_t i=0; i<nsamples; i+=8) {
+      int npair = (i+8 < nsamples) ? 4 : 3;
+      for (int ch=0; ch<2*npair; ch+=2, in+=6) {
+         __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+                                             _mm_loadu_si128((const __m128i*)(in + 3)), 1);
+         v = _mm256_shuffle_epi8(v, shuffle);
+         v = _mm256_or_si256(_mm256_and_si256(v, even), _mm256_and_si256(_mm256_srli_epi16(v, 4), odd));
+         _mm_storeu_si128((__m128i*)(out + ch*stride + i), _mm256_castsi256_si128(v));
+         _mm_storeu_si128((__m128i*)(out + (ch+1)*stride + i), _mm256_extracti128_si256(v, 1));
+      }
+      if (npair == 3) {
+         unpack_v1740_block_c(in, out + 6*stride + i);
+         unpack_v1740_block_c(in + 3, out + 7*stride + i);
+         in += 6;
+      }
+   }
+}
+
+/* 3x10 has no gain from 256 bit registers, the interleave works in 128 bit lanes */
+static const CAEN_KERNELS caen_kernels_avx2 = {
+   CAEN_UNPACK_AVX2, unpack_2x16_avx2, unpack_3x10_ssse3, unpack_v1740_avx2
+};
+
+#endif // HAVE_CAEN_X86
+
+/********************************************************************/
+
+static const CAEN_KERNELS* caen_kernels_find(int impl)
+{
+   const CAEN_KERNELS* k = &caen_kernels_c;
+
+#ifdef HAVE_CAEN_X86
+   __builtin_cpu_init();
+   bool avx2 = __builtin_cpu_supports("avx2");
+   bool ssse3 = __builtin_cpu_supports("ssse3");
+
+   if (impl == CAEN_UNPACK_AUTO)
+      impl = CAEN_UNPACK_AVX2;
+   if (impl >= CAEN_UNPACK_AVX2 && avx2)
+      k = &caen_kernels_avx2;
+   else if (impl >= CAEN_UNPACK_SSE && ssse3)
+      k = &caen_kernels_ssse3;
+#endif
+
+   return k;
+}
+
+// set by caen_unpack_select(), NULL for the default
+static std::atomic<const CAEN_KERNELS*> caen_kernels{NULL};
+
+// the default, found once on first use, thread safe
+static const CAEN_KERNELS* caen_kernels_auto()
+{
+   static const CAEN_KERNELS* k = caen_kernels_find(CAEN_UNPACK_AUTO);
+   return k;
+}
+
+int caen_unpack_select(int impl)
+{
+   const CAEN_KERNELS* k = caen_kernels_find(impl);
+   caen_kernels = k;
+   return k->impl;
+}
+
+/********************************************************************/
+
+int caen_unpack_header(int board_type, const uint32_t* data, size_t nwords, CAEN_EVENT* event)
+{
+   memset(event, 0, sizeof(*event));
+
+   if (board_type != CAEN_V1720 && board_type != CAEN_V1740 && board_type != CAEN_V1751)
+      return CAEN_UNSUPPORTED;
+
+   if (nwords < 4 || (data[0] >> 28) != 0xA)
+      return CAEN_BAD_HEADER;
+
+   event->event_size       = data[0] & 0x0FFFFFFF;
+   event->board_id         = data[1] >> 27;
+   event->pattern          = (data[1] >> 8) & 0xFFFF;
+   event->channel_mask     = data[1] & 0xFF;
+   event->event_counter    = data[2] & 0xFFFFFF;
+   event->trigger_time_tag = data[3];
+
+   /* bit 24: zero length encoding */
+   if (data[1] & (1<<24))
+      return CAEN_UNSUPPORTED;
+
+   if (event->event_size < 4 || event->event_size > nwords)
+      return CAEN_BAD_SIZE;
+
+   int nmask = 0;
+   for (int i=0; i<8; i++)
+      if (event->channel_mask & (1<<i)) {
+         if (board_type == CAEN_V1740)
+            for (int j=0; j<8; j++)
+               event->channel[event->nchannels++] = 8*i + j;
+         else
+            event->channel[event->nchannels++] = i;
+         nmask++;
+      }
+
+   size_t payload = event->event_size - 4;
+
+   if (nmask == 0) {
+      event->nchannels = 0;
+      return payload == 0 ? CAEN_SUCCESS : CAEN_BAD_SIZE;
+   }
+
+   if (payload % nmask != 0)
+      return CAEN_BAD_SIZE;
+
+   size_t words = payload / nmask; // per channel or group
+
+   switch (board_type) {
+   case CAEN_V1720:
+      event->nsamples = 2*words;
+      break;
+   case CAEN_V1751:
+      event->nsamples = 3*words;
+      break;
+   case CAEN_V1740:
+      if (words % 24 != 0)
+         return CAEN_BAD_SIZE;
+      event->nsamples = words/3;
+      break;
+   }
+
+   return CAEN_SUCCESS;
+}
+
+/********************************************************************/
+
+int caen_unpack(int board_type, const uint32_t* data, size_t nwords, CAEN_EVENT* event, int16_t* samples, size_t max_samples)
+{
+   int status = caen_unpack_header(board_type, data, nwords, event);
+   if (status != CAEN_SUCCESS)
+      return status;
+
+   size_t nsamples = event->nsamples;
+   if ((size_t)event->nchannels*nsamples > max_samples)
+      return CAEN_NO_SPACE;
+
+   const CAEN_KERNELS* k = caen_kernels;
+   if (!k)
+      k = caen_kernels_auto();
+
+   const uint32_t* p = data + 4;
+
+   switch (board_type) {
+   case CAEN_V1720:
+      for (int i=0; i<event->nchannels; i++, p+=nsamples/2)
+         k->unpack_2x16(p, nsamples/2, samples + i*nsamples);
+      break;
+   case CAEN_V1751:
+      for (int i=0; i<event->nchannels; i++, p+=nsamples/3)
+         k->unpack_3x10(p, nsamples/3, samples + i*nsamples);
+      break;
+   case CAEN_V1740:
+      for (int i=0; i<event->nchannels; i+=8, p+=3*nsamples)
+         k->unpack_v1740(p, nsamples, samples + i*nsamples, nsamples);
+      break;
+   }
+
+   return CAEN_SUCCESS;
+}
+
+/* emacs
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 3
+ * indent-tabs-mode: nil
+ * End:
+ */
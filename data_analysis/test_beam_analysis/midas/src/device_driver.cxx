@@ -22,6 +22,9 @@ static int sc_thread(void *info)
    int *last_update;
    unsigned int current_time;
    DWORD last_time;
+   double cycle_start = 0;
+   float *values = NULL;
+   BOOL bulk = (device_drv->flags & DF_BULK_ACCESS) != 0;
 
    ss_thread_set_name(std::string("SC:")+ *device_drv->pequipment_name);
 
@@ -30,6 +33,10 @@ static int sc_thread(void *info)
       last_update[i] = ss_millitime() - 20000;
    last_time = ss_millitime();
 
+   // buffer for CMD_GET_ALL/CMD_SET_ALL, which transfer all channels in one driver call
+   if (bulk)
+      values = (float*)calloc(device_drv->channels, sizeof(float));
+
    // call CMD_START of device driver
    device_drv->dd(CMD_START, device_drv->dd_info, 0, NULL);
 
@@ -55,7 +62,31 @@ static int sc_thread(void *info)
             }
          }
 
-         if (!skip) {
+         if (!skip && bulk) {
+            /* read all channels with one driver call per command */
+            cycle_start = ss_time_sec();
+            for (cmd = CMD_GET_FIRST; cmd <= CMD_GET_LAST; cmd++) {
+               for (i = 0; i < device_drv->channels; i++)
+                  values[i] = (float) ss_nan();
+               status = device_drv->dd(CMD_GET_ALL, device_drv->dd_info, cmd, values);
+
+               ss_mutex_wait_for(device_drv->mutex, 1000);
+               for (i = 0; i < device_drv->channels; i++)
+                  device_drv->mt_buffer->channel[i].variable[cmd] = values[i];
+               device_drv->mt_buffer->status = status;
+               ss_mutex_release(device_drv->mutex);
+            }
+
+            ss_mutex_wait_for(device_drv->mutex, 1000);
+            for (i = 0; i < device_drv->channels; i++)
+               device_drv->mt_buffer->channel[i].n_read++;
+            device_drv->mt_buffer->readback_time = (ss_time_sec() - cycle_start) * 1000;
+            ss_mutex_release(device_drv->mutex);
+
+         } else if (!skip) {
+            if (current_channel == 0)
+               cycle_start = ss_time_sec();
+
             for (cmd = CMD_GET_FIRST; cmd <= CMD_GET_LAST; cmd++) {
                value = (float) ss_nan();
                status = device_drv->dd(cmd, device_drv->dd_info, current_channel, &value);
@@ -66,13 +97,21 @@ static int sc_thread(void *info)
                ss_mutex_release(device_drv->mutex);
             }
             device_drv->mt_buffer->channel[current_channel].n_read++;
+
+            /* time for one sweep over all channels */
+            if (current_channel == device_drv->channels - 1) {
+               ss_mutex_wait_for(device_drv->mutex, 1000);
+               device_drv->mt_buffer->readback_time = (ss_time_sec() - cycle_start) * 1000;
+               ss_mutex_release(device_drv->mutex);
+            }
          }
 
          /* switch to next channel in next loop */
-         current_channel = (current_channel + 1) % device_drv->channels;
+         if (!bulk)
+            current_channel = (current_channel + 1) % device_drv->channels;
 
-         /* check for priority channel */
-         if (device_drv->flags & DF_PRIORITY_READ) {
+         /* check for priority channel, not needed if all channels are read in every loop */
+         if (!bulk && (device_drv->flags & DF_PRIORITY_READ)) {
             current_time = ss_millitime();
             i = (current_priority_channel + 1) % device_drv->channels;
             while (!(current_time - last_update[i] < 10000)) {
@@ -117,20 +156,40 @@ static int sc_thread(void *info)
             }
          }
 
-         /* check if anything to write to device */
-         for (i = 0; i < device_drv->channels; i++) {
-
+         /* check if anything to write to device, all channels of one command at once */
+         if (bulk) {
             for (cmd = CMD_SET_FIRST; cmd <= CMD_SET_LAST; cmd++) {
-               if (!ss_isnan(device_drv->mt_buffer->channel[i].variable[cmd])) {
-                  ss_mutex_wait_for(device_drv->mutex, 1000);
-                  value = device_drv->mt_buffer->channel[i].variable[cmd];
+               int n_set = 0;
+
+               ss_mutex_wait_for(device_drv->mutex, 1000);
+               for (i = 0; i < device_drv->channels; i++) {
+                  values[i] = device_drv->mt_buffer->channel[i].variable[cmd];
                   device_drv->mt_buffer->channel[i].variable[cmd] = (float) ss_nan();
-                  ss_mutex_release(device_drv->mutex);
+                  if (!ss_isnan(values[i]))
+                     n_set++;
+               }
+               ss_mutex_release(device_drv->mutex);
 
-                  status = device_drv->dd(cmd, device_drv->dd_info, i, value);
+               if (n_set > 0) {
+                  status = device_drv->dd(CMD_SET_ALL, device_drv->dd_info, cmd, values);
                   device_drv->mt_buffer->status = status;
-                  if (cmd == CMD_SET)
-                     last_update[i] = ss_millitime();
+               }
+            }
+         } else {
+            for (i = 0; i < device_drv->channels; i++) {
+
+               for (cmd = CMD_SET_FIRST; cmd <= CMD_SET_LAST; cmd++) {
+                  if (!ss_isnan(device_drv->mt_buffer->channel[i].variable[cmd])) {
+                     ss_mutex_wait_for(device_drv->mutex, 1000);
+                     value = device_drv->mt_buffer->channel[i].variable[cmd];
+                     device_drv->mt_buffer->channel[i].variable[cmd] = (float) ss_nan();
+                     ss_mutex_release(device_drv->mutex);
+
+                     status = device_drv->dd(cmd, device_drv->dd_info, i, value);
+                     device_drv->mt_buffer->status = status;
+                     if (cmd == CMD_SET)
+                        last_update[i] = ss_millitime();
+                  }
                }
             }
          }
@@ -141,6 +200,8 @@ static int sc_thread(void *info)
    } while (device_drv->stop_thread == 0);
 
    free(last_update);
+   if (values)
+      free(values);
 
    /* signal stopped thread */
    device_drv->stop_thread = 2;
@@ -245,6 +306,7 @@ INT device_driver(DEVICE_DRIVER * device_drv, INT cmd, ...)
          ss_mutex_delete(device_drv->mutex);
          free(device_drv->mt_buffer->channel);
          free(device_drv->mt_buffer);
+         device_drv->mt_buffer = NULL;
       }
       break;
 
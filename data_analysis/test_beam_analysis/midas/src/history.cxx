@@ -25,6 +25,7 @@
 #include <assert.h>
 
 #include <map>
+#include <vector>
 
 #include "midas.h"
 #include "msystem.h"
@@ -1460,12 +1461,14 @@ double hs_to_double(int tid, const void* ybuffer)
    /* NOT REACHED */
 }
 
-static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD interval, const char *tag_name, DWORD var_index, DWORD * time_buffer, DWORD * tbsize, void *data_buffer, DWORD * dbsize, DWORD * data_type, DWORD * data_n, MidasHistoryBufferInterface* buffer)
+static INT hs_read_vars(DWORD event_id, DWORD start_time, DWORD end_time, DWORD interval, int num_var, const char *const tag_name[], const int var_index[], MidasHistoryBufferInterface *buffer[], int read_status[])
 /********************************************************************\
 
-  Routine: hs_read
+  Routine: hs_read_vars
 
-  Purpose: Read history for a variable at a certain time interval
+  Purpose: Read history for several variables of the same event at a
+           certain time interval. Each matching data record is read
+           only once and all requested variables are extracted from it.
 
   Input:
     DWORD  event_id         Event ID
@@ -1473,27 +1476,22 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
     DWORD  end_time         End Date/Time
     DWORD  interval         Minimum time in seconds between reported
                             events. Can be used to skip events
-    char   *tag_name        Variable name inside event
-    DWORD  var_index        Index if variable is array
+    int    num_var          Number of variables
+    char   *tag_name[]      Variable names inside event
+    int    var_index[]      Index if variable is array
 
   Output:
-    DWORD  *time_buffer     Buffer containing times for each value
-    DWORD  *tbsize          Size of time buffer
-    void   *data_buffer     Buffer containing variable values
-    DWORD  *dbsize          Data buffer size
-    DWORD  *type            Type of variable (one of TID_xxx)
-    DWORD  *n               Number of time/value pairs found
-                            in specified interval and placed into
-                            time_buffer and data_buffer
-
+    MidasHistoryBufferInterface *buffer[]
+                            Receives the time/value pairs of each
+                            variable found in the specified interval
+    int    read_status[]    Per-variable status, HS_SUCCESS or
+                            HS_WRONG_INDEX if var_index exceeds the
+                            array size of the variable
 
   Function value:
     HS_SUCCESS              Successful completion
     HS_NO_MEMEORY           Out of memory
     HS_FILE_ERROR           Cannot open history file
-    HS_WRONG_INDEX          var_index exceeds array size of variable
-    HS_UNDEFINED_VAR        Variable "tag_name" not found in event
-    HS_TRUNCATED            Buffer too small, data has been truncated
 
 \********************************************************************/
 {
@@ -1511,14 +1509,18 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
    char *cache = NULL;
    time_t ltime;
 
-   int tag_index = -1;
-   int var_type = -1;
-   unsigned var_size = 0;
-   unsigned var_offset = 0;
-         
+   /* per-variable location inside the current event definition */
+   std::vector<int> var_type(num_var, -1);
+   std::vector<unsigned> var_size(num_var, 0);
+   std::vector<unsigned> var_offset(num_var, 0);
+   std::vector<char> data;
+
    int ieof = 0;
 
-   //printf("hs_read event %d, time %d:%d, tagname: \'%s\', varindex: %d\n", event_id, start_time, end_time, tag_name, var_index);
+   //printf("hs_read_vars event %d, time %d:%d, %d variables\n", event_id, start_time, end_time, num_var);
+
+   for (int k = 0; k < num_var; k++)
+      read_status[k] = HS_SUCCESS;
 
    ss_tzset(); // required by localtime_r()
 
@@ -1528,21 +1530,13 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
    if (end_time == 0)
       end_time = (DWORD) time(NULL);
 
-   if (data_n)
-      *data_n = 0;
    prev_time = 0;
    last_irec_time = start_time;
 
    /* search history file for start_time */
    status = hs_search_file(&start_time, 1);
    if (status != HS_SUCCESS) {
-      //cm_msg(MERROR, "hs_read", "cannot find recent history file");
-      if (data_n)
-         *data_n = 0;
-      if (tbsize)
-         *tbsize = 0;
-      if (dbsize)
-         *dbsize = 0;
+      //cm_msg(MERROR, "hs_read_vars", "cannot find recent history file");
       return HS_FILE_ERROR;
    }
 
@@ -1551,13 +1545,7 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
    hs_open_file(start_time, "idf", O_RDONLY, &fnd, &fhd);
    hs_open_file(start_time, "idx", O_RDONLY, &fni, &fhi);
    if (fh < 0 || fhd < 0 || fhi < 0) {
-      cm_msg(MERROR, "hs_read", "cannot open index files");
-      if (tbsize)
-         *tbsize = 0;
-      if (dbsize)
-         *dbsize = 0;
-      if (data_n)
-         *data_n = 0;
+      cm_msg(MERROR, "hs_read_vars", "cannot open index files");
       if (fh > 0)
          close(fh);
       if (fhd > 0)
@@ -1666,8 +1654,9 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
       //printf("time %d -> %d\n", last_irec_time, irec.time);
 
       if (irec.time < last_irec_time) {
-         cm_msg(MERROR, "hs_read", "corrupted history data: time does not increase: %d -> %d", last_irec_time, irec.time);
-         //*tbsize = *dbsize = *n = 0;
+         cm_msg(MERROR, "hs_read_vars", "corrupted history data: time does not increase: %d -> %d", last_irec_time, irec.time);
+         if (cache)
+            M_FREE(cache);
          if (fh > 0)
             close(fh);
          if (fhd > 0)
@@ -1684,8 +1673,9 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
             prev_time = irec.time;
             xseek(fn, fh, irec.offset);
             if (xread(fn, fh, (char *) &rec, sizeof(rec)) < 0) {
-               cm_msg(MERROR, "hs_read", "corrupted history data at time %d", (int) irec.time);
-               //*tbsize = *dbsize = *n = 0;
+               cm_msg(MERROR, "hs_read_vars", "corrupted history data at time %d", (int) irec.time);
+               if (cache)
+                  M_FREE(cache);
                if (fh > 0)
                   close(fh);
                if (fhd > 0)
@@ -1704,12 +1694,6 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
 
                tag = (TAG *) M_MALLOC(drec.data_size);
                if (tag == NULL) {
-                  if (data_n)
-                     *data_n = 0;
-                  if (tbsize)
-                     *tbsize = 0;
-                  if (dbsize)
-                     *dbsize = 0;
                   if (cache)
                      M_FREE(cache);
                   if (fh > 0)
@@ -1722,62 +1706,43 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
                }
                xread(fn, fh, (char *) tag, drec.data_size);
 
-               /* find index of tag_name in new definition */
-               for (DWORD i = 0; i < drec.data_size / sizeof(TAG); i++)
-                  if (equal_ustring(tag[i].name, tag_name)) {
-                     tag_index = i;
-                     break;
-                  }
+               int n_tags = drec.data_size / sizeof(TAG);
 
-               /*
-                  if ((DWORD) i == drec.data_size/sizeof(TAG))
-                  {
-                  *n = *tbsize = *dbsize = 0;
-                  if (cache)
-                  M_FREE(cache);
+               /* offset of each tag inside the data record */
+               std::vector<unsigned> tag_offset(n_tags + 1, 0);
+               for (int i = 0; i < n_tags; i++)
+                  tag_offset[i + 1] = tag_offset[i] + rpc_tid_size(tag[i].type) * tag[i].n_data;
 
-                  return HS_UNDEFINED_VAR;
-                  }
-                */
-
-               if (tag_index >= 0 && var_index >= tag[tag_index].n_data) {
-                  if (data_n)
-                     *data_n = 0;
-                  if (tbsize)
-                     *tbsize = 0;
-                  if (dbsize)
-                     *dbsize = 0;
-                  if (cache)
-                     M_FREE(cache);
-                  M_FREE(tag);
-                  if (fh > 0)
-                     close(fh);
-                  if (fhd > 0)
-                     close(fhd);
-                  if (fhi > 0)
-                     close(fhi);
-                  return HS_WRONG_INDEX;
-               }
+               for (int k = 0; k < num_var; k++) {
+                  var_type[k] = -1;
 
-               /* calculate offset for variable */
-               if (tag_index >= 0) {
-                  var_type = tag[tag_index].type;
+                  if (read_status[k] != HS_SUCCESS)
+                     continue;
 
-                  if (data_type)
-                     *data_type = var_type;
+                  /* find index of tag_name in new definition */
+                  int tag_index = -1;
+                  for (int i = 0; i < n_tags; i++)
+                     if (equal_ustring(tag[i].name, tag_name[k])) {
+                        tag_index = i;
+                        break;
+                     }
 
-                  /* loop over all previous variables */
-                  var_offset = 0;
-                  for (int i=0; i<tag_index; i++)
-                     var_offset += rpc_tid_size(tag[i].type) * tag[i].n_data;
+                  if (tag_index < 0)
+                     continue;
+
+                  if ((DWORD) var_index[k] >= tag[tag_index].n_data) {
+                     read_status[k] = HS_WRONG_INDEX;
+                     continue;
+                  }
 
                   /* strings have size n_data */
                   if (tag[tag_index].type == TID_STRING)
-                     var_size = tag[tag_index].n_data;
+                     var_size[k] = tag[tag_index].n_data;
                   else
-                     var_size = rpc_tid_size(tag[tag_index].type);
+                     var_size[k] = rpc_tid_size(tag[tag_index].type);
 
-                  var_offset += var_size * var_index;
+                  var_type[k] = tag[tag_index].type;
+                  var_offset[k] = tag_offset[tag_index] + var_size[k] * var_index[k];
                }
 
                M_FREE(tag);
@@ -1785,39 +1750,28 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
                xseek(fn, fh, irec.offset + sizeof(rec));
             }
 
-            if (buffer) {
-               /* copy time from header */
-               DWORD t = irec.time;
-               char buf[16]; // biggest data is 8-byte "double"
-               assert(var_size <= sizeof(buf));
-               xseek_cur(fn, fh, var_offset);
-               xread(fn, fh, buf, var_size);
-               buffer->Add(t, hs_to_double(var_type, buf));
-            } else if (tag_index >= 0 && data_n) {
-               /* check if data fits in buffers */
-               if ((*data_n) * sizeof(DWORD) >= *tbsize || (*data_n) * var_size >= *dbsize) {
-                  *dbsize = (*data_n) * var_size;
-                  *tbsize = (*data_n) * sizeof(DWORD);
-                  if (cache)
-                     M_FREE(cache);
-                  if (fh > 0)
-                     close(fh);
-                  if (fhd > 0)
-                     close(fhd);
-                  if (fhi > 0)
-                     close(fhi);
-                  return HS_TRUNCATED;
-               }
-
-               /* copy time from header */
-               time_buffer[*data_n] = irec.time;
-
-               /* copy data from record */
-               xseek_cur(fn, fh, var_offset);
-               xread(fn, fh, (char *) data_buffer + (*data_n) * var_size, var_size);
+            /* read the whole data record once for all variables */
+            data.resize(rec.data_size);
+            if (rec.data_size > 0 && xread(fn, fh, data.data(), rec.data_size) < 0) {
+               cm_msg(MERROR, "hs_read_vars", "corrupted history data at time %d", (int) irec.time);
+               if (cache)
+                  M_FREE(cache);
+               if (fh > 0)
+                  close(fh);
+               if (fhd > 0)
+                  close(fhd);
+               if (fhi > 0)
+                  close(fhi);
+               hs_gen_index(last_irec_time);
+               return HS_SUCCESS;
+            }
 
-               /* increment counter */
-               (*data_n)++;
+            /* copy time from header */
+            DWORD t = irec.time;
+            for (int k = 0; k < num_var; k++) {
+               if (var_type[k] < 0 || var_offset[k] + var_size[k] > rec.data_size)
+                  continue;
+               buffer[k]->Add(t, hs_to_double(var_type[k], data.data() + var_offset[k]));
             }
          }
       }
@@ -1873,6 +1827,11 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
             close(fhi);
          fh = fhd = fhi = 0;
 
+         if (cache) {
+            M_FREE(cache);
+            cache = NULL;
+         }
+
          /* advance one day */
          ltime = (time_t) last_irec_time;
          struct tm tms;
@@ -1895,7 +1854,7 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
          hs_open_file(last_irec_time, "idf", O_RDONLY, &fnd, &fhd);
          hs_open_file(last_irec_time, "idx", O_RDONLY, &fni, &fhi);
          if (fh < 0 || fhd < 0 || fhi < 0) {
-            cm_msg(MERROR, "hs_read", "cannot open index files");
+            cm_msg(MERROR, "hs_read_vars", "cannot open index files");
             break;
          }
 
@@ -1908,7 +1867,7 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
          }
 
          xseek(fni, fhi, 0);
-         cache = (char *) M_MALLOC(cache_size); // FIXME: is this a memory leak?
+         cache = (char *) M_MALLOC(cache_size);
          if (cache) {
             if (xread(fni, fhi, cache, cache_size) < 0) {
                break;
@@ -1932,18 +1891,13 @@ static INT hs_read(DWORD event_id, DWORD start_time, DWORD end_time, DWORD inter
 
    if (cache)
       M_FREE(cache);
-   if (fh)
+   if (fh > 0)
       close(fh);
-   if (fhd)
+   if (fhd > 0)
       close(fhd);
-   if (fhi)
+   if (fhi > 0)
       close(fhi);
 
-   if (dbsize && data_n)
-      *dbsize = *data_n * var_size;
-   if (tbsize && data_n)
-      *tbsize = *data_n * sizeof(DWORD);
-
    return HS_SUCCESS;
 }
 
@@ -2224,6 +2178,23 @@ char* sort_names(char* names)
 
 /*------------------------------------------------------------------*/
 
+/* collects time/value pairs for MidasHistory::hs_read() */
+
+class MidasHistoryArrayBuffer: public MidasHistoryBufferInterface
+{
+public:
+   std::vector<time_t> fTimes;
+   std::vector<double> fValues;
+
+   void Add(time_t t, double v)
+   {
+      fTimes.push_back(t);
+      fValues.push_back(v);
+   }
+};
+
+/*------------------------------------------------------------------*/
+
 class MidasHistory: public MidasHistoryInterface
 {
 public:
@@ -3195,129 +3166,106 @@ public:
    /*------------------------------------------------------------------*/
 
 
-   int hs_read(time_t start_time, time_t end_time, time_t interval,
-               int num_var,
-               const char* const event_name[], const char* const tag_name[], const int var_index[],
-               int num_entries[],
-               time_t* time_buffer[], double* data_buffer[],
-               int read_status[])
+   /* read all variables of the same event in one pass over the history files */
+
+   int ReadVars(time_t start_time, time_t end_time, time_t interval,
+                int num_var, const char* const event_name[], const char* const tag_name[], const int var_index[],
+                MidasHistoryBufferInterface* buffer[],
+                int read_status[])
    {
-      DWORD* tbuffer = NULL;
-      char* ybuffer = NULL;
-      DWORD bsize, tsize;
-      int hbuffer_size = 0;
-      
-      if (hbuffer_size == 0) {
-         hbuffer_size = 1000 * sizeof(DWORD);
-         tbuffer = (DWORD*)malloc(hbuffer_size);
-         ybuffer = (char*)malloc(hbuffer_size);
-      }
+      std::vector<int> event_id(num_var, 0);
+      std::vector<bool> done(num_var, false);
 
       for (int i=0; i<num_var; i++) {
-         DWORD tid = 0;
-         int event_id = 0;
-
          if (event_name[i]==NULL) {
             read_status[i] = HS_UNDEFINED_EVENT;
-            num_entries[i] = 0;
+            done[i] = true;
             continue;
          }
-         
-         int status = GetEventId(end_time, event_name[i], tag_name[i], &event_id);
-         
+
+         int status = GetEventId(end_time, event_name[i], tag_name[i], &event_id[i]);
+
          if (status != HS_SUCCESS) {
             read_status[i] = status;
+            done[i] = true;
+         }
+      }
+
+      for (int i=0; i<num_var; i++) {
+         if (done[i])
             continue;
+
+         std::vector<int> idx;
+         std::vector<const char*> xtag_name;
+         std::vector<int> xvar_index;
+         std::vector<MidasHistoryBufferInterface*> xbuffer;
+
+         for (int j=i; j<num_var; j++) {
+            if (done[j] || event_id[j] != event_id[i])
+               continue;
+            idx.push_back(j);
+            xtag_name.push_back(tag_name[j]);
+            xvar_index.push_back(var_index[j]);
+            xbuffer.push_back(buffer[j]);
+            done[j] = true;
          }
-         
-         DWORD n_point = 0;
-         
-         do {
-            bsize = tsize = hbuffer_size;
-            memset(ybuffer, 0, bsize);
-            status = ::hs_read(event_id, (DWORD)start_time, (DWORD)end_time, (DWORD)interval,
-                               tag_name[i], var_index[i],
-                               tbuffer, &tsize,
-                               ybuffer, &bsize,
-                               &tid, &n_point,
-                               NULL);
-         
+
+         int n = idx.size();
+         std::vector<int> xstatus(n, HS_SUCCESS);
+
+         int status = ::hs_read_vars(event_id[i], (DWORD)start_time, (DWORD)end_time, (DWORD)interval,
+                                     n, xtag_name.data(), xvar_index.data(),
+                                     xbuffer.data(), xstatus.data());
+
+         for (int k=0; k<n; k++) {
+            if (status == HS_SUCCESS)
+               read_status[idx[k]] = xstatus[k];
+            else
+               read_status[idx[k]] = status;
+
             if (fDebug)
-               printf("hs_read %d \'%s\' [%d] returned %d, %d entries\n", event_id, tag_name[i], var_index[i], status, n_point);
-         
-            if (status == HS_TRUNCATED) {
-               hbuffer_size *= 2;
-               tbuffer = (DWORD*)realloc(tbuffer, hbuffer_size);
-               assert(tbuffer);
-               ybuffer = (char*)realloc(ybuffer, hbuffer_size);
-               assert(ybuffer);
-            }
+               printf("hs_read %d \'%s\' [%d] returned %d\n", event_id[i], tag_name[idx[k]], var_index[idx[k]], read_status[idx[k]]);
+         }
+      }
+
+      return HS_SUCCESS;
+   }
 
-         } while (status == HS_TRUNCATED);
-        
-         read_status[i] = status;
+   /*------------------------------------------------------------------*/
+
+   int hs_read(time_t start_time, time_t end_time, time_t interval,
+               int num_var,
+               const char* const event_name[], const char* const tag_name[], const int var_index[],
+               int num_entries[],
+               time_t* time_buffer[], double* data_buffer[],
+               int read_status[])
+   {
+      std::vector<MidasHistoryArrayBuffer> abuffer(num_var);
+      std::vector<MidasHistoryBufferInterface*> xbuffer(num_var);
+
+      for (int i=0; i<num_var; i++)
+         xbuffer[i] = &abuffer[i];
+
+      ReadVars(start_time, end_time, interval, num_var, event_name, tag_name, var_index, xbuffer.data(), read_status);
+
+      for (int i=0; i<num_var; i++) {
+         int n_point = abuffer[i].fTimes.size();
 
          time_t* x = (time_t*)malloc(n_point*sizeof(time_t));
          assert(x);
          double* y = (double*)malloc(n_point*sizeof(double));
          assert(y);
 
-         time_buffer[i] = x;
-         data_buffer[i] = y;
-
-         int n_vp = 0;
-
-         for (unsigned j = 0; j < n_point; j++) {
-            x[n_vp] = tbuffer[j];
-          
-            /* convert data to float */
-            switch (tid) {
-            default:
-               y[n_vp] =  0;
-               break;
-            case TID_BYTE:
-               y[n_vp] =  *(((BYTE *) ybuffer) + j);
-               break;
-            case TID_SBYTE:
-               y[n_vp] =  *(((char *) ybuffer) + j);
-               break;
-            case TID_CHAR:
-               y[n_vp] =  *(((char *) ybuffer) + j);
-               break;
-            case TID_WORD:
-               y[n_vp] =  *(((WORD *) ybuffer) + j);
-               break;
-            case TID_SHORT:
-               y[n_vp] =  *(((short *) ybuffer) + j);
-               break;
-            case TID_DWORD:
-               y[n_vp] =  *(((DWORD *) ybuffer) + j);
-               break;
-            case TID_INT:
-               y[n_vp] =  *(((INT *) ybuffer) + j);
-               break;
-            case TID_BOOL:
-               y[n_vp] =  *(((BOOL *) ybuffer) + j);
-               break;
-            case TID_FLOAT:
-               y[n_vp] =  *(((float *) ybuffer) + j);
-               break;
-            case TID_DOUBLE:
-               y[n_vp] =  *(((double *) ybuffer) + j);
-               break;
-            }
-          
-            n_vp++;
+         for (int j=0; j<n_point; j++) {
+            x[j] = abuffer[i].fTimes[j];
+            y[j] = abuffer[i].fValues[j];
          }
 
-         num_entries[i] = n_vp;
+         time_buffer[i] = x;
+         data_buffer[i] = y;
+         num_entries[i] = n_point;
       }
 
-      if (ybuffer)
-         free(ybuffer);
-      if (tbuffer)
-         free(tbuffer);
-
       return HS_SUCCESS;
    }
 
@@ -3358,36 +3306,7 @@ public:
                       MidasHistoryBufferInterface* buffer[],
                       int read_status[])
    {
-      for (int i=0; i<num_var; i++) {
-         int event_id = 0;
-
-         if (event_name[i]==NULL) {
-            read_status[i] = HS_UNDEFINED_EVENT;
-            continue;
-         }
-         
-         int status = GetEventId(end_time, event_name[i], tag_name[i], &event_id);
-         
-         if (status != HS_SUCCESS) {
-            read_status[i] = status;
-            continue;
-         }
-         
-         status = ::hs_read(event_id, (DWORD)start_time, (DWORD)end_time, 0,
-                            tag_name[i], var_index[i],
-                            NULL, NULL,
-                            NULL, NULL,
-                            NULL, NULL,
-                            buffer[i]);
-         
-         if (fDebug) {
-            printf("hs_read %d \'%s\' [%d] returned %d\n", event_id, tag_name[i], var_index[i], status);
-         }
-        
-         read_status[i] = status;
-      }
-
-      return HS_SUCCESS;
+      return ReadVars(start_time, end_time, 0, num_var, event_name, tag_name, var_index, buffer, read_status);
    }
    
    int hs_read_binned(time_t start_time, time_t end_time, int num_bins,
@@ -457,6 +457,121 @@ int hs_read_event_list(std::vector<std::string> *pevents)
    return HS_SUCCESS;
 }
 
+/*------------------------------------------------------------------*/
+
+MidasHistoryDecimatedBuffer::MidasHistoryDecimatedBuffer(time_t first_time, time_t last_time, int num_bins) // ctor
+{
+   fNumEntries = 0;
+
+   fNumBins = num_bins;
+   fFirstTime = first_time;
+   fLastTime = last_time;
+
+   if (fNumBins > 0)
+      fBins.resize(fNumBins);
+}
+
+MidasHistoryDecimatedBuffer::~MidasHistoryDecimatedBuffer() // dtor
+{
+}
+
+void MidasHistoryDecimatedBuffer::Add(time_t t, double v)
+{
+   if (t < fFirstTime)
+      return;
+   if (t > fLastTime)
+      return;
+
+   fNumEntries++;
+
+   if (fNumBins <= 0) {
+      fTime.push_back(t);
+      fValue.push_back(v);
+      return;
+   }
+
+   int ibin = 0;
+   if (fLastTime > fFirstTime) {
+      double a = (double)(t - fFirstTime);
+      double b = (double)(fLastTime - fFirstTime);
+      ibin = (int)(fNumBins*a/b);
+   }
+
+   if (ibin < 0)
+      ibin = 0;
+   else if (ibin >= fNumBins)
+      ibin = fNumBins-1;
+
+   Bin& bin = fBins[ibin];
+
+   if (bin.count == 0) {
+      bin.first_time = t;
+      bin.first_value = v;
+      bin.min_time = t;
+      bin.min_value = v;
+      bin.max_time = t;
+      bin.max_value = v;
+   }
+
+   bin.count++;
+
+   if (v < bin.min_value) {
+      bin.min_time = t;
+      bin.min_value = v;
+   }
+
+   if (v > bin.max_value) {
+      bin.max_time = t;
+      bin.max_value = v;
+   }
+
+   // NOTE: this assumes t and v are sorted by time.
+   bin.last_time = t;
+   bin.last_value = v;
+}
+
+void MidasHistoryDecimatedBuffer::Finish()
+{
+   if (fNumBins <= 0)
+      return;
+
+   fTime.clear();
+   fValue.clear();
+
+   for (int i=0; i<fNumBins; i++) {
+      const Bin& bin = fBins[i];
+
+      if (bin.count == 0)
+         continue;
+
+      // data points of this bin in time order, without duplicates
+      time_t t[4];
+      double v[4];
+      int n = 0;
+
+      t[n] = bin.first_time; v[n] = bin.first_value; n++;
+
+      if (bin.min_time <= bin.max_time) {
+         t[n] = bin.min_time; v[n] = bin.min_value; n++;
+         t[n] = bin.max_time; v[n] = bin.max_value; n++;
+      } else {
+         t[n] = bin.max_time; v[n] = bin.max_value; n++;
+         t[n] = bin.min_time; v[n] = bin.min_value; n++;
+      }
+
+      t[n] = bin.last_time; v[n] = bin.last_value; n++;
+
+      for (int j=0; j<n; j++) {
+         if (j > 0 && t[j] == t[j-1] && v[j] == v[j-1])
+            continue;
+         fTime.push_back(t[j]);
+         fValue.push_back(v[j]);
+      }
+   }
+
+   fBins.clear();
+}
+
 /* emacs
  * Local Variables:
  * tab-width: 8
@@ -636,6 +636,102 @@ HsSchema* HsSchemaVector::find_event(const char* event_name, time_t t, int debug
 //        Sql interface class             //
 ////////////////////////////////////////////
 
+// history rows of one table collected for a batched INSERT,
+// values are kept in binary form for parameter binding
+
+struct SqlRows
+{
+   std::vector<std::string> columns; // column names, without _t_time and _i_time
+   std::vector<int> types;           // MIDAS TID of each column
+   std::vector<int> offsets;         // offset of each value in a row
+   int row_size = 0;
+   std::vector<time_t> times;        // time stamp of each row
+   std::vector<char> data;           // row_size bytes for each row
+
+   size_t size() const { return times.size(); }
+   const char* value(size_t row, int column) const { return data.data() + row*row_size + offsets[column]; }
+};
+
+static bool SqlValueIsFloat(int type)
+{
+   return type == TID_FLOAT || type == TID_DOUBLE;
+}
+
+static int64_t SqlValueInt(int type, const char* p)
+{
+   switch (type) {
+   case TID_BYTE:  { uint8_t  v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_SBYTE: { int8_t   v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_CHAR:  { char     v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_WORD:  { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_SHORT: { int16_t  v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_DWORD: { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_INT:   { int32_t  v; memcpy(&v, p, sizeof(v)); return v; }
+   case TID_BOOL:  { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+   default: return 0;
+   }
+}
+
+static double SqlValueDouble(int type, const char* p)
+{
+   if (type == TID_FLOAT) {
+      float v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+   } else if (type == TID_DOUBLE) {
+      double v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+   }
+   return SqlValueInt(type, p);
+}
+
+static std::string SqlValueText(int type, const char* p)
+{
+   char buf[256];
+
+   switch (type) {
+   default:
+      sprintf(buf, "unknownType%d", type);
+      break;
+   case TID_CHAR:
+      // FIXME: quotes
+      sprintf(buf, "\'%c\'", (char)SqlValueInt(type, p));
+      break;
+   case TID_BYTE:
+   case TID_WORD:
+   case TID_DWORD:
+   case TID_BOOL:
+      sprintf(buf, "%u", (unsigned)SqlValueInt(type, p));
+      break;
+   case TID_SBYTE:
+   case TID_SHORT:
+   case TID_INT:
+      sprintf(buf, "%d", (int)SqlValueInt(type, p));
+      break;
+   case TID_FLOAT:
+      // FIXME: quotes
+      sprintf(buf, "\'%.8g\'", SqlValueDouble(type, p));
+      break;
+   case TID_DOUBLE:
+      // FIXME: quotes
+      sprintf(buf, "\'%.16g\'", SqlValueDouble(type, p));
+      break;
+   }
+
+   return buf;
+}
+
+// value of the _t_time column: 2001-02-16 20:38:40.0
+static std::string SqlTimeText(time_t t)
+{
+   struct tm tms;
+   localtime_r(&t, &tms); // somebody must call tzset() before this.
+   char buf[1024];
+   strftime(buf, sizeof(buf)-1, "%Y-%m-%d %H:%M:%S.0", &tms);
+   return buf;
+}
+
 class SqlBase
 {
 public:
@@ -688,18 +784,104 @@ public:
    // string quoting
    virtual std::string QuoteString(const char* s) = 0; // quote text string
    virtual std::string QuoteId(const char* s) = 0; // quote identifier, such as table or column name
+
+   // batched inserts, backends with prepared statements bind the binary values
+   virtual int InsertRows(const char* table_name, const SqlRows& rows) { return InsertRowsText(table_name, rows, false); }
+   int InsertRowsText(const char* table_name, const SqlRows& rows, bool disconnected, size_t first_row = 0);
+   std::string InsertCommand(const char* table_name, const SqlRows& rows, size_t nrows, bool numbered_params);
 };
 
+// INSERT command for nrows rows with parameters "?" or "$1, $2, ..."
+std::string SqlBase::InsertCommand(const char* table_name, const SqlRows& rows, size_t nrows, bool numbered_params)
+{
+   std::string cmd;
+   cmd = "INSERT INTO ";
+   cmd += QuoteId(table_name);
+   cmd += " (_t_time, _i_time";
+   for (const auto& c : rows.columns) {
+      cmd += ", ";
+      cmd += QuoteId(c.c_str());
+   }
+   cmd += ") VALUES ";
+
+   size_t ncols = rows.columns.size() + 2;
+   int iparam = 1;
+   for (size_t r=0; r<nrows; r++) {
+      cmd += (r == 0) ? "(" : ", (";
+      for (size_t c=0; c<ncols; c++) {
+         if (c > 0)
+            cmd += ", ";
+         if (numbered_params) {
+            cmd += "$";
+            cmd += std::to_string(iparam++);
+         } else {
+            cmd += "?";
+         }
+      }
+      cmd += ")";
+   }
+   cmd += ";";
+
+   return cmd;
+}
+
+// rows from first_row on as SQL text, one INSERT per row while disconnected, otherwise multi-row INSERTs
+int SqlBase::InsertRowsText(const char* table_name, const SqlRows& rows, bool disconnected, size_t first_row)
+{
+   const size_t max_rows = disconnected ? 1 : 1000;
+
+   std::string head;
+   head = "INSERT INTO ";
+   head += QuoteId(table_name);
+   head += " (_t_time, _i_time";
+   for (const auto& c : rows.columns) {
+      head += ", ";
+      head += QuoteId(c.c_str());
+   }
+   head += ") VALUES ";
+
+   for (size_t r0=first_row; r0<rows.size(); r0+=max_rows) {
+      std::string cmd = head;
+      for (size_t r=r0; r<rows.size() && r<r0+max_rows; r++) {
+         cmd += (r == r0) ? "(" : ", (";
+         cmd += QuoteString(SqlTimeText(rows.times[r]).c_str());
+         cmd += ", ";
+         cmd += QuoteString(TimeToString(rows.times[r]).c_str());
+         for (size_t c=0; c<rows.columns.size(); c++) {
+            cmd += ", ";
+            cmd += SqlValueText(rows.types[c], rows.value(r, c));
+         }
+         cmd += ")";
+      }
+      cmd += ";";
+
+      int status;
+      if (disconnected)
+         status = ExecDisconnected(table_name, cmd.c_str());
+      else
+         status = Exec(table_name, cmd.c_str());
+      if (status != DB_SUCCESS)
+         return status;
+   }
+
+   return DB_SUCCESS;
+}
+
 ////////////////////////////////////////////
 //        Schema concrete classes         //
 ////////////////////////////////////////////
 
+// rows are inserted in batches of this size, or by hs_flush_buffers()
+#define HS_SQL_BATCH_ROWS 1000
+
 struct HsSqlSchema : public HsSchema {
    SqlBase* sql;
    std::vector<std::string> disconnected_buffer;
    std::string table_name;
    std::vector<std::string> column_names;
    std::vector<std::string> column_types;
+   SqlRows rows;                     // rows not yet written, see flush_rows()
+   std::vector<int> rows_src_offsets; // offsets of the row values in the event data
 
    HsSqlSchema() // ctor
    {
@@ -715,10 +897,11 @@ struct HsSqlSchema : public HsSchema {
    void print(bool print_tags = true) const;
    int get_transaction_count();
    void reset_transaction_count();
-   void increment_transaction_count();
+   void increment_transaction_count(int count = 1);
    int close_transaction();
-   int flush_buffers() { return close_transaction(); }
-   int close() { return close_transaction(); }
+   int flush_rows();
+   int flush_buffers();
+   int close() { return flush_buffers(); }
    int write_event(const time_t t, const char* data, const int data_size);
    int match_event_var(const char* event_name, const char* var_name, const int var_index);
    int read_last_written(const time_t timestamp,
@@ -855,6 +1038,9 @@ public:
    int fNextReconnectDelaySec;
    int fDisconnectedLost;
 
+   // prepared INSERT statements by SQL text
+   std::map<std::string, MYSQL_STMT*> fInsertStmt;
+
    Mysql(); // ctor
    ~Mysql(); // dtor
 
@@ -886,6 +1072,8 @@ public:
 
    std::string QuoteId(const char* s);
    std::string QuoteString(const char* s);
+
+   int InsertRows(const char* table_name, const SqlRows& rows);
 };
 
 Mysql::Mysql() // ctor
@@ -1046,6 +1234,10 @@ int Mysql::Disconnect()
    if (fResult)
       mysql_free_result(fResult);
 
+   for (auto& iter : fInsertStmt)
+      mysql_stmt_close(iter.second);
+   fInsertStmt.clear();
+
    if (fMysql)
       mysql_close(fMysql);
 
@@ -1412,6 +1604,112 @@ std::string Mysql::QuoteString(const char* s)
    return q;
 }
 
+int Mysql::InsertRows(const char* table_name, const SqlRows& rows)
+{
+   if (!fMysql)
+      return DB_FILE_ERROR;
+
+   // multi-row statements, at most 65535 parameters per statement
+   const size_t ncols = rows.columns.size() + 2;
+   const size_t max_rows = std::max<size_t>(1, std::min<size_t>(100, 65535 / ncols));
+
+   std::vector<MYSQL_BIND> bind;
+   std::vector<long long> ivalues;
+   std::vector<double> dvalues;
+   std::vector<std::string> tvalues;
+
+   size_t r0 = 0;
+   while (r0 < rows.size()) {
+      // statements of max_rows rows are prepared once and kept,
+      // the shorter statement for the remaining rows is used only once
+      size_t n = std::min(max_rows, rows.size() - r0);
+      bool keep = (n == max_rows);
+
+      std::string cmd = InsertCommand(table_name, rows, n, false);
+
+      if (fDebug)
+         printf("Mysql::InsertRows(%s, %s)\n", table_name, cmd.c_str());
+
+      MYSQL_STMT* stmt = keep ? fInsertStmt[cmd] : NULL;
+
+      if (!stmt) {
+         stmt = mysql_stmt_init(fMysql);
+         if (!stmt) {
+            cm_msg(MERROR, "Mysql::InsertRows", "mysql_stmt_init() error %d (%s)", mysql_errno(fMysql), mysql_error(fMysql));
+            fInsertStmt.erase(cmd);
+            return DB_FILE_ERROR;
+         }
+         if (mysql_stmt_prepare(stmt, cmd.c_str(), cmd.length())) {
+            cm_msg(MERROR, "Mysql::InsertRows", "Table %s: mysql_stmt_prepare(%s...) error %d (%s)", table_name, cmd.substr(0,60).c_str(), mysql_stmt_errno(stmt), mysql_stmt_error(stmt));
+            mysql_stmt_close(stmt);
+            fInsertStmt.erase(cmd);
+            return DB_FILE_ERROR;
+         }
+         if (keep)
+            fInsertStmt[cmd] = stmt;
+      }
+
+      size_t nparams = n*ncols;
+      bind.assign(nparams, MYSQL_BIND());
+      ivalues.assign(nparams, 0);
+      dvalues.assign(nparams, 0);
+      tvalues.assign(n, "");
+
+      for (size_t i=0; i<n; i++) {
+         size_t r = r0 + i;
+         size_t k = i*ncols;
+
+         tvalues[i] = SqlTimeText(rows.times[r]);
+         bind[k].buffer_type = MYSQL_TYPE_STRING;
+         bind[k].buffer = (void*)tvalues[i].c_str();
+         bind[k].buffer_length = tvalues[i].length();
+
+         ivalues[k+1] = rows.times[r];
+         bind[k+1].buffer_type = MYSQL_TYPE_LONGLONG;
+         bind[k+1].buffer = &ivalues[k+1];
+
+         for (size_t c=0; c<rows.columns.size(); c++) {
+            size_t kk = k + 2 + c;
+            int type = rows.types[c];
+            const char* p = rows.value(r, c);
+            if (type == TID_CHAR) {
+               bind[kk].buffer_type = MYSQL_TYPE_STRING;
+               bind[kk].buffer = (void*)p;
+               bind[kk].buffer_length = 1;
+            } else if (SqlValueIsFloat(type)) {
+               dvalues[kk] = SqlValueDouble(type, p);
+               bind[kk].buffer_type = MYSQL_TYPE_DOUBLE;
+               bind[kk].buffer = &dvalues[kk];
+            } else {
+               ivalues[kk] = SqlValueInt(type, p);
+               bind[kk].buffer_type = MYSQL_TYPE_LONGLONG;
+               bind[kk].buffer = &ivalues[kk];
+            }
+         }
+      }
+
+      bool ok = !mysql_stmt_bind_param(stmt, bind.data()) && !mysql_stmt_execute(stmt);
+      unsigned err = mysql_stmt_errno(stmt);
+      if (!ok)
+         cm_msg(MERROR, "Mysql::InsertRows", "Table %s: mysql_stmt_execute() error %d (%s)", table_name, err, mysql_stmt_error(stmt));
+      if (!keep)
+         mysql_stmt_close(stmt);
+
+      if (!ok) {
+         if (err == 2006 || err == 2013) { // "MySQL server has gone away", "Lost connection to MySQL server"
+            // rows before r0 are in the database already
+            Disconnect();
+            return InsertRowsText(table_name, rows, true, r0);
+         }
+         return DB_FILE_ERROR;
+      }
+
+      r0 += n;
+   }
+
+   return DB_SUCCESS;
+}
+
 #endif // HAVE_MYSQL
 
 #ifdef HAVE_PGSQL
@@ -1423,6 +1721,7 @@ std::string Mysql::QuoteString(const char* s)
 //#warning !!!HAVE_PGSQL!!!
 
 #include <libpq-fe.h>
+#include <endian.h>
 
 class Pgsql: public SqlBase
 {
@@ -1443,6 +1742,9 @@ public:
    int fNextReconnectDelaySec;
    int fDisconnectedLost;
 
+   // names of prepared INSERT statements by SQL text
+   std::map<std::string, std::string> fInsertStmt;
+
    Pgsql(); // ctor
    ~Pgsql(); // dtor
 
@@ -1475,6 +1777,8 @@ public:
 
    std::string QuoteId(const char* s);
    std::string QuoteString(const char* s);
+
+   int InsertRows(const char* table_name, const SqlRows& rows);
 };
 
 Pgsql::Pgsql() // ctor
@@ -1635,6 +1939,9 @@ int Pgsql::Disconnect()
    if (fPgsql)
       PQfinish(fPgsql);
 
+   // prepared statements go away with the session
+   fInsertStmt.clear();
+
    fPgsql = NULL;
    fRow = -1;
 
@@ -1950,6 +2257,130 @@ std::string Pgsql::QuoteString(const char* s)
    return q;
 }
 
+int Pgsql::InsertRows(const char* table_name, const SqlRows& rows)
+{
+   if (!fPgsql)
+      return DB_FILE_ERROR;
+
+   // parameter types of the binary values, the server casts them to the column types
+   const Oid oid_int8 = 20;
+   const Oid oid_text = 25;
+   const Oid oid_float8 = 701;
+
+   // multi-row statements, at most 65535 parameters per statement
+   const size_t ncols = rows.columns.size() + 2;
+   const size_t max_rows = std::max<size_t>(1, std::min<size_t>(100, 65535 / ncols));
+
+   std::vector<Oid> types;
+   std::vector<const char*> values;
+   std::vector<int> lengths;
+   std::vector<int> formats;
+   std::vector<uint64_t> bvalues;
+   std::vector<std::string> tvalues;
+
+   size_t r0 = 0;
+   while (r0 < rows.size()) {
+      // statements of max_rows rows are prepared once and kept,
+      // the shorter statement for the remaining rows is used only once
+      size_t n = std::min(max_rows, rows.size() - r0);
+      bool keep = (n == max_rows);
+      size_t nparams = n*ncols;
+
+      types.assign(nparams, 0);
+      values.assign(nparams, NULL);
+      lengths.assign(nparams, 0);
+      formats.assign(nparams, 1);
+      bvalues.assign(nparams, 0);
+      tvalues.assign(n, "");
+
+      for (size_t i=0; i<n; i++) {
+         size_t r = r0 + i;
+         size_t k = i*ncols;
+
+         // _t_time is sent as text, type is taken from the column
+         tvalues[i] = SqlTimeText(rows.times[r]);
+         values[k] = tvalues[i].c_str();
+         formats[k] = 0;
+
+         types[k+1] = oid_int8;
+         bvalues[k+1] = htobe64((uint64_t)(int64_t)rows.times[r]);
+
+         for (size_t c=0; c<rows.columns.size(); c++) {
+            size_t kk = k + 2 + c;
+            int type = rows.types[c];
+            const char* p = rows.value(r, c);
+            if (type == TID_CHAR) {
+               types[kk] = oid_text;
+               values[kk] = p;
+               lengths[kk] = 1;
+            } else if (SqlValueIsFloat(type)) {
+               double v = SqlValueDouble(type, p);
+               uint64_t u;
+               memcpy(&u, &v, sizeof(u));
+               types[kk] = oid_float8;
+               bvalues[kk] = htobe64(u);
+            } else {
+               types[kk] = oid_int8;
+               bvalues[kk] = htobe64((uint64_t)SqlValueInt(type, p));
+            }
+         }
+
+         for (size_t kk=k+1; kk<k+ncols; kk++) {
+            if (!values[kk]) {
+               values[kk] = (const char*)&bvalues[kk];
+               lengths[kk] = sizeof(uint64_t);
+            }
+         }
+      }
+
+      std::string cmd = InsertCommand(table_name, rows, n, true);
+
+      if (fDebug)
+         printf("Pgsql::InsertRows(%s, %s)\n", table_name, cmd.c_str());
+
+      std::string name = keep ? fInsertStmt[cmd] : "";
+
+      if (keep && name.empty()) {
+         name = "mh_insert_" + std::to_string(fInsertStmt.size());
+         PGresult* res = PQprepare(fPgsql, name.c_str(), cmd.c_str(), nparams, types.data());
+         if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            cm_msg(MERROR, "Pgsql::InsertRows", "Table %s: PQprepare(%s...) error (%s)", table_name, cmd.substr(0,60).c_str(), PQresultErrorMessage(res));
+            PQclear(res);
+            fInsertStmt.erase(cmd);
+            if (PQstatus(fPgsql) == CONNECTION_BAD) {
+               // rows before r0 are in the database already
+               Disconnect();
+               return InsertRowsText(table_name, rows, true, r0);
+            }
+            return DB_FILE_ERROR;
+         }
+         PQclear(res);
+         fInsertStmt[cmd] = name;
+      }
+
+      PGresult* res;
+      if (keep)
+         res = PQexecPrepared(fPgsql, name.c_str(), nparams, values.data(), lengths.data(), formats.data(), 0);
+      else
+         res = PQexecParams(fPgsql, cmd.c_str(), nparams, types.data(), values.data(), lengths.data(), formats.data(), 0);
+      if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+         cm_msg(MERROR, "Pgsql::InsertRows", "Table %s: %s() error (%s)", table_name, keep ? "PQexecPrepared" : "PQexecParams", PQresultErrorMessage(res));
+         PQclear(res);
+         if (PQstatus(fPgsql) == CONNECTION_BAD) {
+            // rows before r0 are in the database already
+            Disconnect();
+            return InsertRowsText(table_name, rows, true, r0);
+         }
+         return DB_FILE_ERROR;
+      }
+      PQclear(res);
+
+      r0 += n;
+   }
+
+   return DB_SUCCESS;
+}
+
 #endif // HAVE_PGSQL
 
 #ifdef HAVE_SQLITE
@@ -1973,6 +2404,10 @@ public:
    sqlite3* fTempDB;
    sqlite3_stmt* fTempStmt;
 
+   // prepared INSERT statement and its SQL text for each table
+   std::map<std::string, sqlite3_stmt*> fInsertStmt;
+   std::map<std::string, std::string> fInsertSql;
+
    Sqlite(); // ctor
    ~Sqlite(); // dtor
 
@@ -2005,6 +2440,8 @@ public:
 
    std::string QuoteId(const char* s);
    std::string QuoteString(const char* s);
+
+   int InsertRows(const char* table_name, const SqlRows& rows);
 };
 
 std::string Sqlite::QuoteId(const char* s)
@@ -2175,6 +2612,11 @@ int Sqlite::Disconnect()
    if (!fIsConnected)
       return DB_SUCCESS;
 
+   for (auto& iter : fInsertStmt)
+      sqlite3_finalize(iter.second);
+   fInsertStmt.clear();
+   fInsertSql.clear();
+
    for (DbMap::iterator iter = fMap.begin(); iter != fMap.end(); ++iter) {
       const char* table_name = iter->first.c_str();
       sqlite3* db = iter->second;
@@ -2451,6 +2893,72 @@ int Sqlite::ExecDisconnected(const char* table_name, const char* sql)
    return DB_FILE_ERROR;
 }
 
+int Sqlite::InsertRows(const char* table_name, const SqlRows& rows)
+{
+   if (!fIsConnected)
+      return DB_FILE_ERROR;
+
+   sqlite3* db = GetTable(table_name);
+   if (!db)
+      return DB_FILE_ERROR;
+
+   // one row per statement: inside a transaction sqlite gains nothing from multi-row inserts
+   std::string cmd = InsertCommand(table_name, rows, 1, false);
+
+   if (fDebug)
+      printf("Sqlite::InsertRows(%s, %s), %d rows\n", table_name, cmd.c_str(), (int)rows.size());
+
+   sqlite3_stmt* stmt = fInsertStmt[table_name];
+
+   if (stmt && fInsertSql[table_name] != cmd) {
+      sqlite3_finalize(stmt);
+      stmt = NULL;
+   }
+
+   if (!stmt) {
+#if SQLITE_VERSION_NUMBER >= 3006020
+      int status = sqlite3_prepare_v2(db, cmd.c_str(), cmd.length(), &stmt, NULL);
+#else
+#warning Missing sqlite3_prepare_v2()!
+      int status = sqlite3_prepare(db, cmd.c_str(), cmd.length(), &stmt, NULL);
+#endif
+      if (status != SQLITE_OK) {
+         cm_msg(MERROR, "Sqlite::InsertRows", "Table %s: sqlite3_prepare_v2(%s...) error %d (%s)", table_name, cmd.substr(0,60).c_str(), status, xsqlite3_errstr(db, status));
+         fInsertStmt[table_name] = NULL;
+         return DB_FILE_ERROR;
+      }
+      fInsertStmt[table_name] = stmt;
+      fInsertSql[table_name] = cmd;
+   }
+
+   for (size_t r=0; r<rows.size(); r++) {
+      std::string t_time = SqlTimeText(rows.times[r]);
+      sqlite3_bind_text(stmt, 1, t_time.c_str(), t_time.length(), SQLITE_TRANSIENT);
+      sqlite3_bind_int64(stmt, 2, rows.times[r]);
+
+      for (size_t c=0; c<rows.columns.size(); c++) {
+         int type = rows.types[c];
+         const char* p = rows.value(r, c);
+         if (type == TID_CHAR)
+            sqlite3_bind_text(stmt, c+3, p, 1, SQLITE_TRANSIENT);
+         else if (SqlValueIsFloat(type))
+            sqlite3_bind_double(stmt, c+3, SqlValueDouble(type, p));
+         else
+            sqlite3_bind_int64(stmt, c+3, SqlValueInt(type, p));
+      }
+
+      int status = sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+
+      if (status != SQLITE_DONE) {
+         cm_msg(MERROR, "Sqlite::InsertRows", "Table %s: sqlite3_step() error %d (%s)", table_name, status, xsqlite3_errstr(db, status));
+         return DB_FILE_ERROR;
+      }
+   }
+
+   return DB_SUCCESS;
+}
+
 #endif // HAVE_SQLITE
 
 ////////////////////////////////////
@@ -4042,6 +4550,15 @@ int HsSqlSchema::close_transaction()
    return status;
 }
 
+int HsSqlSchema::flush_buffers()
+{
+   int status = flush_rows();
+   int xstatus = close_transaction();
+   if (status != HS_SUCCESS)
+      return status;
+   return xstatus;
+}
+
 int HsSchema::match_event_var(const char* event_name, const char* var_name, const int var_index)
 {
    if (!MatchEventName(this->event_name.c_str(), event_name))
@@ -4118,6 +4635,7 @@ static HsSqlSchema* NewSqlSchema(HsSchemaVector* sv, const char* table_name, tim
    if (j >= 0) {
       HsSqlSchema* s = new HsSqlSchema;
       *s = *(HsSqlSchema*)(*sv)[j]; // make a copy
+      s->rows = SqlRows();
       s->time_from = t;
       sv->add(s);
 
@@ -4132,6 +4650,7 @@ static HsSqlSchema* NewSqlSchema(HsSchemaVector* sv, const char* table_name, tim
 
       HsSqlSchema* s = new HsSqlSchema;
       *s = *(HsSqlSchema*)(*sv)[jjx]; // make a copy
+      s->rows = SqlRows();
       s->time_from = t;
       s->time_to = ttx;
       sv->add(s);
@@ -4150,123 +4669,83 @@ int HsSqlSchema::write_event(const time_t t, const char* data, const int data_si
 {
    HsSqlSchema* s = this;
 
-   std::string tags;
-   std::string values;
+   // row layout is set up with the first row of a batch
+   if (rows.size() == 0) {
+      rows.columns.clear();
+      rows.types.clear();
+      rows.offsets.clear();
+      rows.row_size = 0;
+      rows_src_offsets.clear();
 
-   for (unsigned i=0; i<s->variables.size(); i++) {
-      if (s->variables[i].inactive)
-         continue;
+      for (unsigned i=0; i<s->variables.size(); i++) {
+         if (s->variables[i].inactive)
+            continue;
 
-      int type   = s->variables[i].type;
-      int n_data = s->variables[i].n_data;
-      int offset = s->offsets[i];
-      const char* column_name = s->column_names[i].c_str();
+         int offset = s->offsets[i];
 
-      if (offset < 0)
-         continue;
+         if (offset < 0)
+            continue;
 
-      assert(n_data == 1);
-      assert(strlen(column_name) > 0);
-      assert(offset < data_size);
+         assert(s->variables[i].n_data == 1);
+         assert(s->column_names[i].length() > 0);
 
-      void* ptr = (void*)(data+offset);
+         rows.columns.push_back(s->column_names[i]);
+         rows.types.push_back(s->variables[i].type);
+         rows.offsets.push_back(rows.row_size);
+         rows_src_offsets.push_back(offset);
+         rows.row_size += rpc_tid_size(s->variables[i].type);
+      }
+   }
 
-      tags += ", ";
-      tags += sql->QuoteId(column_name);
+   size_t pos = rows.data.size();
+   rows.data.resize(pos + rows.row_size);
+   rows.times.push_back(t);
 
-      values += ", ";
+   for (size_t c=0; c<rows.columns.size(); c++) {
+      int size = rpc_tid_size(rows.types[c]);
+      assert(rows_src_offsets[c] + size <= data_size);
+      memcpy(rows.data.data() + pos + rows.offsets[c], data + rows_src_offsets[c], size);
+   }
 
-      char buf[1024];
-      int j=0;
+   if (rows.size() >= HS_SQL_BATCH_ROWS)
+      return flush_rows();
 
-      switch (type) {
-      default:
-         sprintf(buf, "unknownType%d", type);
-         break;
-      case TID_BYTE:
-         sprintf(buf, "%u",((unsigned char *)ptr)[j]);
-         break;
-      case TID_SBYTE:
-         sprintf(buf, "%d",((signed char*)ptr)[j]);
-         break;
-      case TID_CHAR:
-         // FIXME: quotes
-         sprintf(buf, "\'%c\'",((char*)ptr)[j]);
-         break;
-      case TID_WORD:
-         sprintf(buf, "%u",((unsigned short *)ptr)[j]);
-         break;
-      case TID_SHORT:
-         sprintf(buf, "%d",((short *)ptr)[j]);
-         break;
-      case TID_DWORD:
-         sprintf(buf, "%u",((unsigned int *)ptr)[j]);
-         break;
-      case TID_INT:
-         sprintf(buf, "%d",((int *)ptr)[j]);
-         break;
-      case TID_BOOL:
-         sprintf(buf, "%u",((unsigned int *)ptr)[j]);
-         break;
-      case TID_FLOAT:
-         // FIXME: quotes
-         sprintf(buf, "\'%.8g\'",((float*)ptr)[j]);
-         break;
-      case TID_DOUBLE:
-         // FIXME: quotes
-         sprintf(buf, "\'%.16g\'",((double*)ptr)[j]);
-         break;
-      }
-
-      values += buf;
-   }
+   return HS_SUCCESS;
+}
 
-   // 2001-02-16 20:38:40.1
-   struct tm tms;
-   localtime_r(&t, &tms); // somebody must call tzset() before this.
-   char buf[1024];
-   strftime(buf, sizeof(buf)-1, "%Y-%m-%d %H:%M:%S.0", &tms);
+int HsSqlSchema::flush_rows()
+{
+   if (rows.size() == 0)
+      return HS_SUCCESS;
 
-   std::string cmd;
-   cmd = "INSERT INTO ";
-   cmd += sql->QuoteId(s->table_name.c_str());
-   cmd += " (_t_time, _i_time";
-   cmd += tags;
-   cmd += ") VALUES (";
-   cmd += sql->QuoteString(buf);
-   cmd += ", ";
-   cmd += sql->QuoteString(TimeToString(t).c_str());
-   cmd += "";
-   cmd += values;
-   cmd += ");";
+   int status;
 
    if (sql->IsConnected()) {
-      if (s->get_transaction_count() == 0)
-         sql->OpenTransaction(s->table_name.c_str());
+      if (get_transaction_count() == 0)
+         sql->OpenTransaction(table_name.c_str());
 
-      s->increment_transaction_count();
+      increment_transaction_count(rows.size());
 
-      int status = sql->Exec(s->table_name.c_str(), cmd.c_str());
+      status = sql->InsertRows(table_name.c_str(), rows);
 
       // mh2sql who does not call hs_flush_buffers()
       // so we should flush the transaction by hand
       // some SQL engines have limited transaction buffers... K.O.
-      if (s->get_transaction_count() > 100000) {
+      if (get_transaction_count() > 100000) {
          //printf("flush table %s\n", table_name);
-         sql->CommitTransaction(s->table_name.c_str());
-         s->reset_transaction_count();
-      }
-      
-      if (status != DB_SUCCESS) {
-         return status;
+         sql->CommitTransaction(table_name.c_str());
+         reset_transaction_count();
       }
    } else {
-      int status = sql->ExecDisconnected(s->table_name.c_str(), cmd.c_str());
-      if (status != DB_SUCCESS) {
-         return status;
-      }
+      status = sql->InsertRowsText(table_name.c_str(), rows, true);
    }
 
+   rows.times.clear();
+   rows.data.clear();
+
+   if (status != DB_SUCCESS)
+      return status;
+
    return HS_SUCCESS;
 }
 
@@ -4422,11 +4901,11 @@ void HsSqlSchema::reset_transaction_count() {
    }
 }
 
-void HsSqlSchema::increment_transaction_count() {
+void HsSqlSchema::increment_transaction_count(int count) {
    if (!sql || sql->fTransactionPerTable) {
-      table_transaction_count++;
+      table_transaction_count += count;
    } else {
-      global_transaction_count[sql]++;
+      global_transaction_count[sql] += count;
    }
 }
 
@@ -5,12 +5,24 @@
 
   Contents:     JSON decoder for ODB
 
+  db_paste_json() and db_load_json() decode the JSON text as a
+  stream: ODB keys are created while the text is parsed, without
+  building an MJsonNode tree of the whole document. Arrays are
+  written with one db_set_data() call, and the ODB stays locked
+  while the values of one directory are written.
+
+  db_paste_json_node() pastes an already parsed MJsonNode
+  (JSON-RPC "db_paste"), using the same value conversions.
+
 \********************************************************************/
 
 #include "midas.h"
 #include "msystem.h"
 #include "mjson.h"
 
+#include <math.h>
+#include <map>
+
 #ifndef HAVE_STRLCPY
 #include "strlcpy.h"
 #endif
@@ -28,9 +40,14 @@ INT EXPRT db_load_json(HNDLE hDB, HNDLE hKey, const char *filename)
 
    std::string data;
 
+   /* read the whole file with as few read() calls as possible */
+   struct stat st;
+   if (fstat(fileno(fp), &st) == 0 && st.st_size > 0)
+      data.reserve(st.st_size);
+
    while (1) {
-      char buf[102400];
-      int rd = read(fileno(fp), buf, sizeof(buf)-1);
+      char buf[1024*1024];
+      int rd = read(fileno(fp), buf, sizeof(buf));
       if (rd == 0)
          break; // end of file
       if (rd < 0) {
@@ -39,9 +56,7 @@ INT EXPRT db_load_json(HNDLE hDB, HNDLE hKey, const char *filename)
          fclose(fp);
          return DB_FILE_ERROR;
       }
-      // make sure string is nul terminated
-      buf[sizeof(buf)-1] = 0;
-      data += buf;
+      data.append(buf, rd);
    }
 
    fclose(fp);
@@ -53,7 +68,6 @@ INT EXPRT db_load_json(HNDLE hDB, HNDLE hKey, const char *filename)
 
    if (!jptr) {
       cm_msg(MERROR, "db_load_json", "file \"%s\" does not look like JSON data", filename);
-      fclose(fp);
       return DB_FILE_ERROR;
    }
 
@@ -67,48 +81,65 @@ INT EXPRT db_load_json(HNDLE hDB, HNDLE hKey, const char *filename)
    return status;
 }
 
-static int tid_from_key(const MJsonNode* key)
+/*---- JSON values -------------------------------------------------*/
+
+/* A JSON value other than an object or array, from the JSON stream or from an MJsonNode */
+
+struct JsonScalar {
+   int type = MJSON_NULL; // MJSON_STRING, MJSON_INT, MJSON_NUMBER, MJSON_BOOL or MJSON_NULL
+   std::string s;         // MJSON_STRING
+   long long ll = 0;      // MJSON_INT, MJSON_BOOL
+   double d = 0;          // MJSON_NUMBER
+};
+
+typedef std::vector<JsonScalar> JsonScalarVector;
+
+/* ODB key type and string length from the "name/key" entry written by "ODB save" */
+
+struct JsonKeyInfo {
+   int tid = 0;
+   int item_size = 0;
+};
+
+static void scalar_from_node(const MJsonNode* node, JsonScalar* v)
 {
-   if (!key)
-      return 0;
-   const MJsonNode* n = key->FindObjectNode("type");
-   if (!n)
-      return 0;
-   int tid = n->GetInt();
-   if (tid > 0)
-      return tid;
-   return 0;
+   v->type = node->GetType();
+   switch (v->type) {
+   case MJSON_STRING: v->s = node->GetString(); break;
+   case MJSON_INT:    v->ll = node->GetLL(); break;
+   case MJSON_NUMBER: v->d = node->GetDouble(); break;
+   case MJSON_BOOL:   v->ll = node->GetBool(); break;
+   }
 }
 
-static int item_size_from_key(const MJsonNode* key)
+static JsonKeyInfo key_info_from_node(const MJsonNode* key)
 {
+   JsonKeyInfo info;
    if (!key)
-      return 0;
-   const MJsonNode* n = key->FindObjectNode("item_size");
-   if (!n)
-      return 0;
-   int item_size = n->GetInt();
-   if (item_size > 0)
-      return item_size;
-   return 0;
+      return info;
+   const MJsonNode* n = key->FindObjectNode("type");
+   if (n && n->GetInt() > 0)
+      info.tid = n->GetInt();
+   n = key->FindObjectNode("item_size");
+   if (n && n->GetInt() > 0)
+      info.item_size = n->GetInt();
+   return info;
 }
 
-static int guess_tid(const MJsonNode* node)
+static int guess_tid(const JsonScalar& v)
 {
-   switch (node->GetType()) {
-   case MJSON_ARRAY:  { const MJsonNodeVector* a = node->GetArray(); if (a && a->size()>0) return guess_tid((*a)[0]); else return 0; }
-   case MJSON_OBJECT: return TID_KEY;
+   switch (v.type) {
    case MJSON_STRING: {
-      std::string v = node->GetString();
-      if (v == "NaN")
+      const char* s = v.s.c_str();
+      if (v.s == "NaN")
          return TID_DOUBLE;
-      else if (v == "Infinity")
+      else if (v.s == "Infinity")
          return TID_DOUBLE;
-      else if (v == "-Infinity")
+      else if (v.s == "-Infinity")
          return TID_DOUBLE;
-      else if (v[0]=='0' && v[1]=='x' && isxdigit(v[2]) && v.length() > 10)
+      else if (s[0]=='0' && s[1]=='x' && isxdigit(s[2]) && v.s.length() > 10)
          return TID_UINT64;
-      else if (v[0]=='0' && v[1]=='x' && isxdigit(v[2]))
+      else if (s[0]=='0' && s[1]=='x' && isxdigit(s[2]))
          return TID_DWORD;
       else
          return TID_STRING;
@@ -120,191 +151,36 @@ static int guess_tid(const MJsonNode* node)
    }
 }
 
-static int paste_node(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, int index, const MJsonNode* node, int tid, int string_length, const MJsonNode* key);
-
-static int paste_array(HNDLE hDB, HNDLE hKey, const char* path, const MJsonNode* node, int tid, int string_length, const MJsonNode* key)
-{
-   int status, slength = 0;
-   const MJsonNodeVector* a = node->GetArray();
-
-   if (a==NULL) {
-      cm_msg(MERROR, "db_paste_json", "invalid array at \"%s\"", path);
-      return DB_FILE_ERROR;
-   }
-
-   if (string_length == 0) {
-      int slength = item_size_from_key(key);
-      if (slength == 0)
-         slength = NAME_LENGTH;
-   } else {
-      slength = string_length;
-   }
-
-   KEY odbkey;
-   status = db_get_key(hDB, hKey, &odbkey);
-   if (status != DB_SUCCESS) {
-      cm_msg(MERROR, "db_paste_json", "cannot get odb key at \"%s\", status %d", path, status);
-      return DB_FILE_ERROR;
-   }
-
-   if (odbkey.item_size > 0 && (INT) a->size() != odbkey.num_values) {
-      status = db_set_num_values(hDB, hKey, a->size());
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot resize key \"%s\", status = %d", path, status);
-         return status;
-      }
-   }
-
-   bool is_array = (a->size() > 1);
-   for (unsigned i=a->size(); ;) {
-      if (i==0)
-         break;
-      i--;
-      MJsonNode* n = (*a)[i];
-      if (!n)
-         continue;
-      status = paste_node(hDB, hKey, path, is_array, i, n, tid, slength, key);
-      if (status == DB_NO_ACCESS) {
-         cm_msg(MERROR, "db_paste_json", "skipping write-protected array \"%s\"", path);
-         return DB_SUCCESS;
-      } else if (status != DB_SUCCESS)
-         return status;
-   }
-
-   return DB_SUCCESS;
-}
-
-static int paste_object(HNDLE hDB, HNDLE hKey, const char* path, const MJsonNode* objnode)
-{
-   if (equal_ustring(path, "/system/clients")) {
-      // do not reload ODB /system/clients
-      return DB_SUCCESS;
-   }
-   int status;
-   const MJsonStringVector* names = objnode->GetObjectNames();
-   const MJsonNodeVector* nodes = objnode->GetObjectNodes();
-   if (names==NULL||nodes==NULL||names->size()!=nodes->size()) {
-      cm_msg(MERROR, "db_paste_json", "invalid object at \"%s\"", path);
-      return DB_FILE_ERROR;
-   }
-   for(unsigned i=0; i<names->size(); i++) {
-      const char* name = (*names)[i].c_str();
-      const MJsonNode* node = (*nodes)[i];
-      const MJsonNode* key = NULL;
-      if (strchr(name, '/')) // skip special entries
-         continue;
-      int tid = 0;
-      if (node->GetType() == MJSON_OBJECT)
-         tid = TID_KEY;
-      else {
-         key = objnode->FindObjectNode((std::string(name) + "/key").c_str());
-         if (key)
-            tid = tid_from_key(key);
-         if (!tid)
-            tid = guess_tid(node);
-         //printf("entry [%s] type %s, tid %d\n", name, MJsonNode::TypeToString(node->GetType()), tid);
-      }
-
-      status = db_create_key(hDB, hKey, name, tid);
-
-      if (status == DB_KEY_EXIST) {
-         HNDLE hSubkey;
-         KEY key;
-         status = db_find_link(hDB, hKey, name, &hSubkey);
-         if (status != DB_SUCCESS) {
-            cm_msg(MERROR, "db_paste_json", "key exists, but cannot find it \"%s\" of type %d in \"%s\", db_find_link() status %d", name, tid, path, status);
-            return status;
-         }
-
-         status = db_get_key(hDB, hSubkey, &key);
-         if (status != DB_SUCCESS) {
-            cm_msg(MERROR, "db_paste_json", "cannot create \"%s\" of type %d in \"%s\", db_create_key() status %d", name, tid, path, status);
-            return status;
-         }
-
-         if ((int)key.type == tid) {
-            // existing item is of the same type, continue with overwriting it
-            status = DB_SUCCESS;
-         } else {
-            // FIXME: delete wrong item, create item with correct tid
-            cm_msg(MERROR, "db_paste_json", "cannot overwrite existing item \"%s\" of type %d in \"%s\" with new tid %d", name, key.type, path, tid);
-            return status;
-         }
-      }
-
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot create \"%s\" of type %d in \"%s\", db_create_key() status %d", name, tid, path, status);
-         return status;
-      }
-
-      HNDLE hSubkey;
-      status = db_find_link(hDB, hKey, name, &hSubkey);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot find \"%s\" of type %d in \"%s\", db_find_link() status %d", name, tid, path, status);
-         return status;
-      }
-
-      std::string node_name;
-      if (strcmp(path, "/") != 0) {
-         node_name += path;
-      }
-      node_name += "/";
-      node_name += name;
-
-      status = paste_node(hDB, hSubkey, node_name.c_str(), false, 0, node, tid, 0, key);
-      if (status == DB_NO_ACCESS) {
-         cm_msg(MERROR, "db_paste_json", "skipping write-protected node \"%s\"", node_name.c_str());
-      } else if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "paste of \"%s\" is incomplete", node_name.c_str());
-         //cm_msg(MERROR, "db_paste_json", "cannot..."); // paste_node() reports it's own failures
-         return status;
-      }
-   }
-   return DB_SUCCESS;
-}
-
-static int paste_bool(HNDLE hDB, HNDLE hKey, const char* path, int index, const MJsonNode* node)
-{
-   int status;
-   BOOL value = node->GetBool();
-   int size = sizeof(value);
-   status = db_set_data_index(hDB, hKey, &value, size, index, TID_BOOL);
-   if (status != DB_SUCCESS) {
-      cm_msg(MERROR, "db_paste_json", "cannot set TID_BOOL value for \"%s\", db_set_data_index() status %d", path, status);
-      return status;
-   }
-   return DB_SUCCESS;
-}
-
-static int GetDWORD(const MJsonNode* node, const char* path, DWORD* dw)
+static int GetDWORD(const JsonScalar& v, const char* path, DWORD* dw)
 {
-   switch (node->GetType()) {
+   switch (v.type) {
    default:
-      cm_msg(MERROR, "db_paste_json", "GetDWORD: unexpected node type %d at \"%s\"", node->GetType(), path);
+      cm_msg(MERROR, "db_paste_json", "GetDWORD: unexpected node type %d at \"%s\"", v.type, path);
       *dw = 0;
       return DB_FILE_ERROR;
    case MJSON_INT:
-      *dw = node->GetInt();
+   case MJSON_BOOL:
+      *dw = (DWORD)v.ll;
       return SUCCESS;
    case MJSON_NUMBER:
-      *dw = (DWORD)node->GetDouble();
+      *dw = (DWORD)v.d;
       return SUCCESS;
    case MJSON_STRING:
-      std::string s = node->GetString();
+      const char* s = v.s.c_str();
       errno = 0;
       if (s[0] == '0' && s[1] == 'x') { // hex encoded number
-         *dw = strtoul(s.c_str(), NULL, 16);
-      } else if (s.back() == 'b') { // binary number
-         *dw = strtoul(s.c_str(), NULL, 2);
+         *dw = strtoul(s, NULL, 16);
+      } else if (v.s.length() > 0 && v.s.back() == 'b') { // binary number
+         *dw = strtoul(s, NULL, 2);
       } else if (isdigit(s[0]) || (s[0]=='-' && isdigit(s[1]))) { // probably a number
-         *dw = strtoul(s.c_str(), NULL, 0);
+         *dw = strtoul(s, NULL, 0);
       } else {
-         cm_msg(MERROR, "db_paste_json", "GetDWORD: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s.c_str(), path);
+         cm_msg(MERROR, "db_paste_json", "GetDWORD: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s, path);
          *dw = 0;
          return DB_FILE_ERROR;
       }
       if (errno != 0) {
-         cm_msg(MERROR, "db_paste_json", "GetDWORD: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s.c_str(), errno, strerror(errno), path);
+         cm_msg(MERROR, "db_paste_json", "GetDWORD: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s, errno, strerror(errno), path);
          *dw = 0;
          return DB_FILE_ERROR;
       }
@@ -313,35 +189,36 @@ static int GetDWORD(const MJsonNode* node, const char* path, DWORD* dw)
    // NOT REACHED
 }
 
-static int GetQWORD(const MJsonNode* node, const char* path, UINT64* qw)
+static int GetQWORD(const JsonScalar& v, const char* path, UINT64* qw)
 {
-   switch (node->GetType()) {
+   switch (v.type) {
    default:
-      cm_msg(MERROR, "db_paste_json", "GetQWORD: unexpected node type %d at \"%s\"", node->GetType(), path);
+      cm_msg(MERROR, "db_paste_json", "GetQWORD: unexpected node type %d at \"%s\"", v.type, path);
       *qw = 0;
       return DB_FILE_ERROR;
    case MJSON_INT:
-      *qw = node->GetLL();
+   case MJSON_BOOL:
+      *qw = v.ll;
       return SUCCESS;
    case MJSON_NUMBER:
-      *qw = node->GetDouble();
+      *qw = v.d;
       return SUCCESS;
    case MJSON_STRING:
-      std::string s = node->GetString();
+      const char* s = v.s.c_str();
       errno = 0;
       if (s[0] == '0' && s[1] == 'x') { // hex encoded number
-         *qw = strtoull(s.c_str(), NULL, 16);
-      } else if (s.back() == 'b') { // binary number
-         *qw = strtoull(s.c_str(), NULL, 2);
+         *qw = strtoull(s, NULL, 16);
+      } else if (v.s.length() > 0 && v.s.back() == 'b') { // binary number
+         *qw = strtoull(s, NULL, 2);
       } else if (isdigit(s[0]) || (s[0]=='-' && isdigit(s[1]))) { // probably a number
-         *qw = strtoull(s.c_str(), NULL, 0);
+         *qw = strtoull(s, NULL, 0);
       } else {
-         cm_msg(MERROR, "db_paste_json", "GetQWORD: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s.c_str(), path);
+         cm_msg(MERROR, "db_paste_json", "GetQWORD: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s, path);
          *qw = 0;
          return DB_FILE_ERROR;
       }
       if (errno != 0) {
-         cm_msg(MERROR, "db_paste_json", "GetQWORD: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s.c_str(), errno, strerror(errno), path);
+         cm_msg(MERROR, "db_paste_json", "GetQWORD: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s, errno, strerror(errno), path);
          *qw = 0;
          return DB_FILE_ERROR;
       }
@@ -350,35 +227,40 @@ static int GetQWORD(const MJsonNode* node, const char* path, UINT64* qw)
    // NOT REACHED
 }
 
-static int GetDOUBLE(const MJsonNode* node, const char* path, double* dw)
+static int GetDOUBLE(const JsonScalar& v, const char* path, double* dw)
 {
-   switch (node->GetType()) {
+   switch (v.type) {
    default:
-      cm_msg(MERROR, "db_paste_json", "GetDOUBLE: unexpected node type %d at \"%s\"", node->GetType(), path);
+      cm_msg(MERROR, "db_paste_json", "GetDOUBLE: unexpected node type %d at \"%s\"", v.type, path);
       *dw = 0;
       return DB_FILE_ERROR;
    case MJSON_INT:
-      *dw = node->GetInt();
+   case MJSON_BOOL:
+      *dw = v.ll;
       return SUCCESS;
    case MJSON_NUMBER:
-      *dw = node->GetDouble();
+      *dw = v.d;
       return SUCCESS;
    case MJSON_STRING:
-      std::string s = node->GetString();
+      const char* s = v.s.c_str();
       errno = 0;
-      if (s == "NaN" || s == "Infinity" || s == "-Infinity") {
-         *dw = node->GetDouble();
+      if (v.s == "NaN") {
+         *dw = NAN;
+      } else if (v.s == "Infinity") {
+         *dw = INFINITY;
+      } else if (v.s == "-Infinity") {
+         *dw = -INFINITY;
       } else if (s[0] == '0' && s[1] == 'x') { // hex encoded number
-         *dw = strtoul(s.c_str(), NULL, 16);
+         *dw = strtoul(s, NULL, 16);
       } else if (isdigit(s[0]) || (s[0]=='-' && isdigit(s[1]))) { // probably a number
-         *dw = strtod(s.c_str(), NULL);
+         *dw = strtod(s, NULL);
       } else {
-         cm_msg(MERROR, "db_paste_json", "GetDOUBLE: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s.c_str(), path);
+         cm_msg(MERROR, "db_paste_json", "GetDOUBLE: MJSON_STRING node invalid numeric value \'%s\' at \"%s\"", s, path);
          *dw = 0;
          return DB_FILE_ERROR;
       }
       if (errno != 0) {
-         cm_msg(MERROR, "db_paste_json", "GetDOUBLE: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s.c_str(), errno, strerror(errno), path);
+         cm_msg(MERROR, "db_paste_json", "GetDOUBLE: MJSON_STRING node invalid numeric value \'%s\', strtoul() errno %d (%s) at \"%s\"", s, errno, strerror(errno), path);
          *dw = 0;
          return DB_FILE_ERROR;
       }
@@ -387,294 +269,544 @@ static int GetDOUBLE(const MJsonNode* node, const char* path, double* dw)
    // NOT REACHED
 }
 
-static int paste_value(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, int index, const MJsonNode* node, int tid, int string_length, const MJsonNode* key)
+/* convert a value to ODB type tid, for all types of fixed size */
+
+static int convert_value(const JsonScalar& v, const char* path, int tid, void* dst)
 {
    int status;
-   //printf("paste_value: path [%s], index %d, tid %d, slength %d, key %p\n", path, index, tid, string_length, key);
 
    switch (tid) {
-   default:
-      cm_msg(MERROR, "db_paste_json", "do not know what to do with tid %d at \"%s\"", tid, path);
-      // keep loading remaining data, ignore this error return DB_FILE_ERROR;
-      return DB_SUCCESS;
-   case TID_ARRAY:
-      cm_msg(MERROR, "db_paste_json", "paste of TID_ARRAY is not implemented at \"%s\"", path);
-      return DB_SUCCESS;
-   case TID_STRUCT:
-      cm_msg(MERROR, "db_paste_json", "paste of TID_STRUCT is not implemented at \"%s\"", path);
-      return DB_SUCCESS;
-   case TID_BITFIELD:
-      cm_msg(MERROR, "db_paste_json", "paste of TID_BITFIELD is not implemented at \"%s\"", path);
-      return DB_SUCCESS;
    case TID_CHAR: {
-      const std::string value = node->GetString();
-      int size = 1;
-      status = db_set_data_index(hDB, hKey, value.c_str(), size, index, TID_CHAR);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_CHAR value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
-      return DB_SUCCESS;
+      *(char*)dst = (v.type == MJSON_STRING) ? v.s[0] : 0;
+      return SUCCESS;
    }
    case TID_BOOL: {
-      BOOL v;
-      if (node->GetType() == MJSON_STRING && node->GetString() == "true") {
-         v = true;
-      } else if (node->GetType() == MJSON_STRING && node->GetString() == "false") {
-         v = false;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'y') {
-         v = true;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'n') {
-         v = false;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'Y') {
-         v = true;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'N') {
-         v = false;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 't') {
-         v = true;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'f') {
-         v = false;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'T') {
-         v = true;
-      } else if (node->GetType() == MJSON_STRING && node->GetString()[0] == 'F') {
-         v = false;
+      BOOL b;
+      char c = (v.type == MJSON_STRING) ? v.s[0] : 0;
+      if (v.type == MJSON_STRING && v.s == "true") {
+         b = true;
+      } else if (v.type == MJSON_STRING && v.s == "false") {
+         b = false;
+      } else if (c == 'y' || c == 'Y' || c == 't' || c == 'T') {
+         b = true;
+      } else if (c == 'n' || c == 'N' || c == 'f' || c == 'F') {
+         b = false;
       } else {
          DWORD dw;
-         status = GetDWORD(node, path, &dw);
+         status = GetDWORD(v, path, &dw);
          if (status != SUCCESS)
             return status;
-         if (dw) v = TRUE;
-         else v = FALSE;
-      }
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_BOOL);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_BOOL value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
+         if (dw) b = TRUE;
+         else b = FALSE;
       }
-      return DB_SUCCESS;
+      *(BOOL*)dst = b;
+      return SUCCESS;
    }
    case TID_BYTE:
    case TID_SBYTE: {
       DWORD dw;
-      status = GetDWORD(node, path, &dw);
+      status = GetDWORD(v, path, &dw);
       if (status != SUCCESS)
          return status;
-      BYTE b = (BYTE)dw;
-      int size = sizeof(b);
-      status = db_set_data_index(hDB, hKey, &b, size, index, tid);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_BYTE/TID_SBYTE value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
-      return DB_SUCCESS;
+      *(BYTE*)dst = (BYTE)dw;
+      return SUCCESS;
    }
    case TID_WORD:
    case TID_SHORT: {
       DWORD dw;
-      status = GetDWORD(node, path, &dw);
+      status = GetDWORD(v, path, &dw);
       if (status != SUCCESS)
          return status;
-      WORD v = (WORD)dw;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, tid);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_WORD/TID_SHORT value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
-      return DB_SUCCESS;
+      *(WORD*)dst = (WORD)dw;
+      return SUCCESS;
    }
    case TID_DWORD: {
-      DWORD v;
-      status = GetDWORD(node, path, &v);
-      if (status != SUCCESS)
-         return status;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_DWORD);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_DWORD value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
-      return DB_SUCCESS;
+      return GetDWORD(v, path, (DWORD*)dst);
    }
    case TID_INT: {
-      int v = 0;
-      switch (node->GetType()) {
+      int i = 0;
+      switch (v.type) {
       default:
-         cm_msg(MERROR, "db_paste_json", "unexpected node type %d at \"%s\"", node->GetType(), path);
+         cm_msg(MERROR, "db_paste_json", "unexpected node type %d at \"%s\"", v.type, path);
          return DB_FILE_ERROR;
-      case MJSON_INT: {
-         v = node->GetInt();
+      case MJSON_INT:
+      case MJSON_BOOL:
+         i = (int)v.ll;
          break;
-      }
-      case MJSON_NUMBER: {
-         double dv = node->GetDouble();
-         if (dv > INT_MAX || dv < INT_MIN) {
-            cm_msg(MERROR, "db_paste_json", "numeric value %f out of range at \"%s\"", dv, path);
+      case MJSON_NUMBER:
+         if (v.d > INT_MAX || v.d < INT_MIN) {
+            cm_msg(MERROR, "db_paste_json", "numeric value %f out of range at \"%s\"", v.d, path);
             return DB_FILE_ERROR;
          }
-         v = (int)dv;
+         i = (int)v.d;
          break;
-      }
-      case MJSON_STRING: {
-         status = GetDWORD(node, path, (DWORD*)&v);
+      case MJSON_STRING:
+         status = GetDWORD(v, path, (DWORD*)&i);
          if (status != SUCCESS)
             return status;
          break;
       }
-      }
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_INT);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_INT value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
-      return DB_SUCCESS;
+      *(int*)dst = i;
+      return SUCCESS;
    }
-
-   case TID_UINT64: {
-      UINT64 v;
-      status = GetQWORD(node, path, &v);
+   case TID_UINT64:
+   case TID_INT64: {
+      return GetQWORD(v, path, (UINT64*)dst);
+   }
+   case TID_FLOAT: {
+      double dv;
+      status = GetDOUBLE(v, path, &dv);
       if (status != SUCCESS)
          return status;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_UINT64);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_UINT64 value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
-      }
+      *(float*)dst = dv;
+      return SUCCESS;
+   }
+   case TID_DOUBLE: {
+      return GetDOUBLE(v, path, (double*)dst);
+   }
+   }
+
+   cm_msg(MERROR, "db_paste_json", "do not know what to do with tid %d at \"%s\"", tid, path);
+   return DB_FILE_ERROR;
+}
+
+static bool is_fixed_size(int tid)
+{
+   switch (tid) {
+   case TID_CHAR: case TID_BOOL:
+   case TID_BYTE: case TID_SBYTE: case TID_WORD: case TID_SHORT:
+   case TID_DWORD: case TID_INT: case TID_UINT64: case TID_INT64:
+   case TID_FLOAT: case TID_DOUBLE:
+      return true;
+   }
+   return false;
+}
+
+/* report types which cannot be pasted, return true if tid is one of them */
+
+static bool unsupported_tid(int tid, const char* path)
+{
+   switch (tid) {
+   case TID_ARRAY:
+      cm_msg(MERROR, "db_paste_json", "paste of TID_ARRAY is not implemented at \"%s\"", path);
+      return true;
+   case TID_STRUCT:
+      cm_msg(MERROR, "db_paste_json", "paste of TID_STRUCT is not implemented at \"%s\"", path);
+      return true;
+   case TID_BITFIELD:
+      cm_msg(MERROR, "db_paste_json", "paste of TID_BITFIELD is not implemented at \"%s\"", path);
+      return true;
+   }
+   if (!is_fixed_size(tid) && tid != TID_STRING && tid != TID_LINK) {
+      cm_msg(MERROR, "db_paste_json", "do not know what to do with tid %d at \"%s\"", tid, path);
+      return true;
+   }
+   return false;
+}
+
+/*---- writing values to ODB ---------------------------------------*/
+
+static int paste_bool(HNDLE hDB, HNDLE hKey, const char* path, int index, const JsonScalar& v)
+{
+   int status;
+   BOOL value = (v.ll != 0);
+   int size = sizeof(value);
+   status = db_set_data_index(hDB, hKey, &value, size, index, TID_BOOL);
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "cannot set TID_BOOL value for \"%s\", db_set_data_index() status %d", path, status);
+      return status;
+   }
+   return DB_SUCCESS;
+}
+
+static int paste_value(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, int index, const JsonScalar& v, int tid, int string_length, const JsonKeyInfo& info)
+{
+   int status;
+   //printf("paste_value: path [%s], index %d, tid %d, slength %d\n", path, index, tid, string_length);
+
+   if (v.type == MJSON_BOOL)
+      return paste_bool(hDB, hKey, path, index, v);
+
+   if (unsupported_tid(tid, path)) {
+      // keep loading remaining data, ignore this error
       return DB_SUCCESS;
    }
 
-   case TID_INT64: {
-      INT64 v;
-      status = GetQWORD(node, path, (UINT64 *)&v);
+   if (is_fixed_size(tid)) {
+      char buf[8];
+      status = convert_value(v, path, tid, buf);
       if (status != SUCCESS)
          return status;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_INT64);
+      status = db_set_data_index(hDB, hKey, buf, rpc_tid_size(tid), index, tid);
       if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_INT64 value for \"%s\", db_set_data_index() status %d", path, status);
+         cm_msg(MERROR, "db_paste_json", "cannot set TID_%s value for \"%s\", db_set_data_index() status %d", rpc_tid_name(tid), path, status);
          return status;
       }
       return DB_SUCCESS;
    }
 
-   case TID_FLOAT: {
-      double dv;
-      status = GetDOUBLE(node, path, &dv);
-      if (status != SUCCESS)
-         return status;
-      float v = dv;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_FLOAT);
+   if (tid == TID_LINK) {
+      const char* value = v.s.c_str();
+      int size = strlen(value) + 1;
+
+      status = db_set_data(hDB, hKey, value, size, 1, TID_LINK);
+
       if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_FLOAT value for \"%s\", db_set_data_index() status %d", path, status);
+         cm_msg(MERROR, "db_paste_json", "cannot set TID_LINK value for \"%s\", db_set_data() status %d", path, status);
          return status;
       }
+
       return DB_SUCCESS;
    }
-   case TID_DOUBLE: {
-      double v;
-      status = GetDOUBLE(node, path, &v);
-      if (status != SUCCESS)
-         return status;
-      int size = sizeof(v);
-      status = db_set_data_index(hDB, hKey, &v, size, index, TID_DOUBLE);
+
+   // TID_STRING
+   char* buf = NULL;
+   const char* ptr = NULL;
+   int size = 0;
+   if (string_length == 0)
+      string_length = info.item_size;
+   //printf("string_length %d\n", string_length);
+   if (string_length) {
+      buf = new char[string_length];
+      strlcpy(buf, v.s.c_str(), string_length);
+      ptr = buf;
+      size = string_length;
+   } else {
+      ptr = v.s.c_str();
+      size = strlen(ptr) + 1;
+   }
+
+   if (is_array) {
+      KEY key;
+      status = db_get_key(hDB, hKey, &key);
       if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_DOUBLE value for \"%s\", db_set_data_index() status %d", path, status);
+         cm_msg(MERROR, "db_paste_json", "cannot get key of string array for \"%s\", db_get_key() status %d", path, status);
+         delete[] buf;
          return status;
       }
-      return DB_SUCCESS;
-   }
-   case TID_STRING: {
-      char* buf = NULL;
-      const char* ptr = NULL;
-      int size = 0;
-      const std::string value = node->GetString();
-      if (string_length == 0)
-         string_length = item_size_from_key(key);
-      //printf("string_length %d\n", string_length);
-      if (string_length) {
-         buf = new char[string_length];
-         strlcpy(buf, value.c_str(), string_length);
-         ptr = buf;
-         size = string_length;
-      } else {
-         ptr = value.c_str();
-         size = strlen(ptr) + 1;
-      }
 
-      if (is_array) {
-         KEY key;
-         status = db_get_key(hDB, hKey, &key);
+      if (key.item_size < size) {
+         status = db_resize_string(hDB, hKey, NULL, key.num_values, size);
          if (status != DB_SUCCESS) {
-            cm_msg(MERROR, "db_paste_json", "cannot get key of string array for \"%s\", db_get_key() status %d", path, status);
+            cm_msg(MERROR, "db_paste_json", "cannot change array string length from %d to %d for \"%s\", db_resize_string() status %d", key.item_size, size, path, status);
+            delete[] buf;
             return status;
          }
-         
-         if (key.item_size < size) {
-            status = db_resize_string(hDB, hKey, NULL, key.num_values, size);
-            if (status != DB_SUCCESS) {
-               cm_msg(MERROR, "db_paste_json", "cannot change array string length from %d to %d for \"%s\", db_resize_string() status %d", key.item_size, size, path, status);
-               return status;
-            }
-         }
       }
+   }
 
-      //printf("set_data_index index %d, size %d\n", index, size);
+   //printf("set_data_index index %d, size %d\n", index, size);
 
-      if (string_length > 0) {
-         if (is_array) {
-            status = db_set_data_index(hDB, hKey, ptr, size, index, TID_STRING);
-         } else {
-            status = db_set_data(hDB, hKey, ptr, size, 1, TID_STRING);
-         }
-      } else if (index != 0) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_STRING value for \"%s\" index %d, it is not an array", path, index);
-         status = DB_OUT_OF_RANGE;
+   if (string_length > 0) {
+      if (is_array) {
+         status = db_set_data_index(hDB, hKey, ptr, size, index, TID_STRING);
       } else {
          status = db_set_data(hDB, hKey, ptr, size, 1, TID_STRING);
       }
+   } else if (index != 0) {
+      cm_msg(MERROR, "db_paste_json", "cannot set TID_STRING value for \"%s\" index %d, it is not an array", path, index);
+      status = DB_OUT_OF_RANGE;
+   } else {
+      status = db_set_data(hDB, hKey, ptr, size, 1, TID_STRING);
+   }
 
-      if (buf)
-         delete[] buf;
+   if (buf)
+      delete[] buf;
 
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_STRING value for \"%s\", db_set_data_index() status %d", path, status);
-         return status;
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "cannot set TID_STRING value for \"%s\", db_set_data_index() status %d", path, status);
+      return status;
+   }
+
+   return DB_SUCCESS;
+}
+
+/* write a whole array with a single db_set_data() */
+
+static int paste_array(HNDLE hDB, HNDLE hKey, const char* path, const JsonScalarVector& a, int tid, int string_length, const JsonKeyInfo& info)
+{
+   int status;
+   int n = a.size();
+
+   for (int i=0; i<n; i++) {
+      if (a[i].type == MJSON_NULL) {
+         cm_msg(MERROR, "db_paste_json", "unexpected JSON null value at \"%s\" index %d", path, i);
+         return DB_FILE_ERROR;
       }
+   }
 
+   KEY odbkey;
+   status = db_get_key(hDB, hKey, &odbkey);
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "cannot get odb key at \"%s\", status %d", path, status);
+      return DB_FILE_ERROR;
+   }
+
+   if (n == 0) {
+      if (odbkey.item_size > 0 && odbkey.num_values != 0) {
+         status = db_set_num_values(hDB, hKey, 0);
+         if (status != DB_SUCCESS) {
+            cm_msg(MERROR, "db_paste_json", "cannot resize key \"%s\", status = %d", path, status);
+            return status;
+         }
+      }
       return DB_SUCCESS;
    }
-   case TID_LINK: {
-      std::string value_string = node->GetString();
-      const char* value = value_string.c_str();
-      int size = strlen(value) + 1;
 
-      status = db_set_data(hDB, hKey, value, size, 1, TID_LINK);
+   /* JSON booleans are always written as TID_BOOL */
+   if (a[0].type == MJSON_BOOL)
+      tid = TID_BOOL;
 
+   if (unsupported_tid(tid, path))
+      return DB_SUCCESS;
+
+   if (tid == TID_LINK) {
+      for (int i=n-1; i>=0; i--) {
+         status = paste_value(hDB, hKey, path, n > 1, i, a[i], tid, string_length, info);
+         if (status != DB_SUCCESS)
+            return status;
+      }
+      return DB_SUCCESS;
+   }
+
+   int item_size;
+
+   if (tid == TID_STRING) {
+      item_size = string_length;
+      if (item_size == 0)
+         item_size = info.item_size;
+      if (item_size == 0) {
+         for (int i=0; i<n; i++)
+            if ((int)a[i].s.length() + 1 > item_size)
+               item_size = a[i].s.length() + 1;
+      }
+      // do not shorten the strings of an existing array
+      if (n > 1 && odbkey.type == TID_STRING && odbkey.item_size > item_size)
+         item_size = odbkey.item_size;
+   } else {
+      item_size = rpc_tid_size(tid);
+   }
+
+   std::vector<char> buf((size_t)n * item_size);
+
+   for (int i=0; i<n; i++) {
+      char* dst = buf.data() + (size_t)i * item_size;
+      if (tid == TID_STRING) {
+         strlcpy(dst, a[i].s.c_str(), item_size);
+      } else {
+         status = convert_value(a[i], path, tid, dst);
+         if (status != SUCCESS)
+            return status;
+      }
+   }
+
+   status = db_set_data(hDB, hKey, buf.data(), buf.size(), n, tid);
+   if (status != DB_SUCCESS) {
+      if (status != DB_NO_ACCESS)
+         cm_msg(MERROR, "db_paste_json", "cannot set TID_%s array of %d values for \"%s\", db_set_data() status %d", rpc_tid_name(tid), n, path, status);
+      return status;
+   }
+
+   return DB_SUCCESS;
+}
+
+/* create (or find existing) subkey "name" of type tid in hKey */
+
+static int create_subkey(HNDLE hDB, HNDLE hKey, const char* path, const char* name, int tid, HNDLE* phSubkey)
+{
+   int status = db_create_key(hDB, hKey, name, tid);
+
+   if (status == DB_KEY_EXIST) {
+      KEY key;
+      status = db_find_link(hDB, hKey, name, phSubkey);
       if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_paste_json", "cannot set TID_LINK value for \"%s\", db_set_data() status %d", path, status);
+         cm_msg(MERROR, "db_paste_json", "key exists, but cannot find it \"%s\" of type %d in \"%s\", db_find_link() status %d", name, tid, path, status);
          return status;
       }
 
+      status = db_get_key(hDB, *phSubkey, &key);
+      if (status != DB_SUCCESS) {
+         cm_msg(MERROR, "db_paste_json", "cannot create \"%s\" of type %d in \"%s\", db_create_key() status %d", name, tid, path, status);
+         return status;
+      }
+
+      if ((int)key.type == tid) {
+         // existing item is of the same type, continue with overwriting it
+         return DB_SUCCESS;
+      } else {
+         // FIXME: delete wrong item, create item with correct tid
+         cm_msg(MERROR, "db_paste_json", "cannot overwrite existing item \"%s\" of type %d in \"%s\" with new tid %d", name, key.type, path, tid);
+         return DB_KEY_EXIST;
+      }
+   }
+
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "cannot create \"%s\" of type %d in \"%s\", db_create_key() status %d", name, tid, path, status);
+      return status;
+   }
+
+   status = db_find_link(hDB, hKey, name, phSubkey);
+   if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "cannot find \"%s\" of type %d in \"%s\", db_find_link() status %d", name, tid, path, status);
+      return status;
+   }
+
+   return DB_SUCCESS;
+}
+
+static std::string subkey_path(const char* path, const char* name)
+{
+   std::string node_name;
+   if (strcmp(path, "/") != 0) {
+      node_name += path;
+   }
+   node_name += "/";
+   node_name += name;
+   return node_name;
+}
+
+/* status of pasting one entry of an object: write-protected entries are skipped */
+
+static int paste_entry_status(int status, const std::string& node_name)
+{
+   if (status == DB_NO_ACCESS) {
+      cm_msg(MERROR, "db_paste_json", "skipping write-protected node \"%s\"", node_name.c_str());
       return DB_SUCCESS;
+   } else if (status != DB_SUCCESS) {
+      cm_msg(MERROR, "db_paste_json", "paste of \"%s\" is incomplete", node_name.c_str());
+      //cm_msg(MERROR, "db_paste_json", "cannot..."); // paste_node() reports it's own failures
+   }
+   return status;
+}
+
+/* Hold the ODB lock while pasting the values of one directory,
+   instead of locking and unlocking in every db_xxx() call. It is
+   released before descending into a subdirectory, so other clients
+   are not blocked for the whole paste. */
+
+class PasteLock
+{
+public:
+   PasteLock(HNDLE hDB) : fDB(hDB) {}
+   ~PasteLock() { Unlock(); }
+
+   void Lock() {
+      if (!fLocked && !rpc_is_remote()) {
+         db_lock_database(fDB);
+         fLocked = true;
+      }
    }
+
+   void Unlock() {
+      if (fLocked) {
+         db_unlock_database(fDB);
+         fLocked = false;
+      }
    }
-   // NOT REACHED
+
+private:
+   HNDLE fDB;
+   bool fLocked = false;
+};
+
+/*---- paste of a parsed MJsonNode ---------------------------------*/
+
+static int paste_node(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, int index, const MJsonNode* node, int tid, int string_length, const MJsonNode* key);
+
+static int paste_object(HNDLE hDB, HNDLE hKey, const char* path, const MJsonNode* objnode)
+{
+   if (equal_ustring(path, "/system/clients")) {
+      // do not reload ODB /system/clients
+      return DB_SUCCESS;
+   }
+   int status;
+   const MJsonStringVector* names = objnode->GetObjectNames();
+   const MJsonNodeVector* nodes = objnode->GetObjectNodes();
+   if (names==NULL||nodes==NULL||names->size()!=nodes->size()) {
+      cm_msg(MERROR, "db_paste_json", "invalid object at \"%s\"", path);
+      return DB_FILE_ERROR;
+   }
+   for(unsigned i=0; i<names->size(); i++) {
+      const char* name = (*names)[i].c_str();
+      const MJsonNode* node = (*nodes)[i];
+      const MJsonNode* key = NULL;
+      if (strchr(name, '/')) // skip special entries
+         continue;
+      int tid = 0;
+      if (node->GetType() == MJSON_OBJECT)
+         tid = TID_KEY;
+      else {
+         key = objnode->FindObjectNode((std::string(name) + "/key").c_str());
+         if (key)
+            tid = key_info_from_node(key).tid;
+         if (!tid && node->GetType() == MJSON_ARRAY) {
+            const MJsonNodeVector* a = node->GetArray();
+            if (a && a->size() > 0 && (*a)[0]) {
+               JsonScalar v;
+               scalar_from_node((*a)[0], &v);
+               tid = guess_tid(v);
+            }
+         } else if (!tid) {
+            JsonScalar v;
+            scalar_from_node(node, &v);
+            tid = guess_tid(v);
+         }
+         //printf("entry [%s] type %s, tid %d\n", name, MJsonNode::TypeToString(node->GetType()), tid);
+      }
+
+      HNDLE hSubkey;
+      status = create_subkey(hDB, hKey, path, name, tid, &hSubkey);
+      if (status != DB_SUCCESS)
+         return status;
+
+      std::string node_name = subkey_path(path, name);
+
+      status = paste_node(hDB, hSubkey, node_name.c_str(), false, 0, node, tid, 0, key);
+      status = paste_entry_status(status, node_name);
+      if (status != DB_SUCCESS)
+         return status;
+   }
+   return DB_SUCCESS;
 }
 
 static int paste_node(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, int index, const MJsonNode* node, int tid, int string_length, const MJsonNode* key)
 {
    //node->Dump();
    switch (node->GetType()) {
-   case MJSON_ARRAY:  return paste_array(hDB, hKey, path, node, tid, string_length, key);
+   case MJSON_ARRAY: {
+      const MJsonNodeVector* a = node->GetArray();
+      if (a==NULL) {
+         cm_msg(MERROR, "db_paste_json", "invalid array at \"%s\"", path);
+         return DB_FILE_ERROR;
+      }
+      JsonScalarVector values(a->size());
+      for (unsigned i=0; i<a->size(); i++) {
+         const MJsonNode* n = (*a)[i];
+         if (n && (n->GetType() == MJSON_ARRAY || n->GetType() == MJSON_OBJECT)) {
+            cm_msg(MERROR, "db_paste_json", "unexpected JSON %s in array at \"%s\"", MJsonNode::TypeToString(n->GetType()), path);
+            return DB_FILE_ERROR;
+         }
+         if (n)
+            scalar_from_node(n, &values[i]);
+      }
+      int status = paste_array(hDB, hKey, path, values, tid, string_length, key_info_from_node(key));
+      if (status == DB_NO_ACCESS) {
+         cm_msg(MERROR, "db_paste_json", "skipping write-protected array \"%s\"", path);
+         return DB_SUCCESS;
+      }
+      return status;
+   }
    case MJSON_OBJECT: return paste_object(hDB, hKey, path, node);
-   case MJSON_STRING: return paste_value(hDB, hKey, path, is_array, index, node, tid, string_length, key);
-   case MJSON_INT:    return paste_value(hDB, hKey, path, is_array, index, node, tid, 0, key);
-   case MJSON_NUMBER: return paste_value(hDB, hKey, path, is_array, index, node, tid, 0, key);
-   case MJSON_BOOL:   return paste_bool(hDB, hKey, path, index, node);
+   case MJSON_STRING:
+   case MJSON_INT:
+   case MJSON_NUMBER:
+   case MJSON_BOOL: {
+      JsonScalar v;
+      scalar_from_node(node, &v);
+      if (v.type != MJSON_STRING)
+         string_length = 0;
+      return paste_value(hDB, hKey, path, is_array, index, v, tid, string_length, key_info_from_node(key));
+   }
    case MJSON_ERROR:
       cm_msg(MERROR, "db_paste_json", "JSON parse error: \"%s\" at \"%s\"", node->GetError().c_str(), path);
       return DB_FILE_ERROR;
@@ -688,20 +820,497 @@ static int paste_node(HNDLE hDB, HNDLE hKey, const char* path, bool is_array, in
    // NOT REACHED
 }
 
+/*---- streaming JSON decoder --------------------------------------*/
+
+/* Pull parser over a nul-terminated JSON text. Only scalars (and the
+   arrays of scalars of one ODB key) are decoded into memory, objects
+   are walked entry by entry. */
+
+class JsonStream
+{
+public:
+   const char* fStart;
+   const char* fPtr;
+   std::string fError;
+
+   JsonStream(const char* text) : fStart(text), fPtr(text) {}
+
+   char Peek() {
+      while (*fPtr == ' ' || *fPtr == '\t' || *fPtr == '\n' || *fPtr == '\r')
+         fPtr++;
+      return *fPtr;
+   }
+
+   bool Expect(char c) {
+      if (Peek() != c)
+         return Error(std::string("expected \'") + c + "\'");
+      fPtr++;
+      return true;
+   }
+
+   /* after an object or array entry: true if another entry follows */
+   bool Next(char close, bool* more) {
+      char c = Peek();
+      if (c == ',') {
+         fPtr++;
+         *more = true;
+         return true;
+      }
+      if (c == close) {
+         fPtr++;
+         *more = false;
+         return true;
+      }
+      return Error(std::string("expected \',\' or \'") + close + "\'");
+   }
+
+   /* true for '{' or '[' followed by '}' or ']', the empty object or array is consumed */
+   bool Empty(char close) {
+      const char* p = fPtr + 1;
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+         p++;
+      if (*p != close)
+         return false;
+      fPtr = p + 1;
+      return true;
+   }
+
+   bool Error(const std::string& msg) {
+      if (fError.empty()) {
+         int line = 1;
+         for (const char* p = fStart; p < fPtr && *p; p++)
+            if (*p == '\n')
+               line++;
+         fError = msg + msprintf(" at line %d, offset %d", line, (int)(fPtr - fStart));
+      }
+      return false;
+   }
+
+   bool ParseString(std::string* s) {
+      if (!Expect('"'))
+         return false;
+      s->clear();
+      while (1) {
+         const char* p = fPtr;
+         while (*p && *p != '"' && *p != '\\')
+            p++;
+         s->append(fPtr, p - fPtr);
+         fPtr = p;
+         if (*p == '"') {
+            fPtr++;
+            return true;
+         }
+         if (*p == 0)
+            return Error("unterminated string");
+         // backslash escape
+         fPtr++;
+         switch (*fPtr++) {
+         case '"': *s += '"'; break;
+         case '\\': *s += '\\'; break;
+         case '/': *s += '/'; break;
+         case 'b': *s += '\b'; break;
+         case 'f': *s += '\f'; break;
+         case 'n': *s += '\n'; break;
+         case 'r': *s += '\r'; break;
+         case 't': *s += '\t'; break;
+         case 'u': {
+            unsigned u = 0;
+            for (int i=0; i<4; i++) {
+               char c = *fPtr++;
+               u <<= 4;
+               if (c >= '0' && c <= '9') u |= c - '0';
+               else if (c >= 'a' && c <= 'f') u |= c - 'a' + 10;
+               else if (c >= 'A' && c <= 'F') u |= c - 'A' + 10;
+               else return Error("invalid \\u escape");
+            }
+            // encode as UTF-8
+            if (u < 0x80) {
+               *s += (char)u;
+            } else if (u < 0x800) {
+               *s += (char)(0xC0 | (u >> 6));
+               *s += (char)(0x80 | (u & 0x3F));
+            } else {
+               *s += (char)(0xE0 | (u >> 12));
+               *s += (char)(0x80 | ((u >> 6) & 0x3F));
+               *s += (char)(0x80 | (u & 0x3F));
+            }
+            break;
+         }
+         default:
+            fPtr--;
+            return Error("invalid escape sequence");
+         }
+      }
+   }
+
+   bool ParseScalar(JsonScalar* v, bool check_only = false) {
+      char c = Peek();
+      if (c == '"') {
+         v->type = MJSON_STRING;
+         if (check_only)
+            return SkipString();
+         return ParseString(&v->s);
+      }
+      if (strncmp(fPtr, "true", 4) == 0) {
+         v->type = MJSON_BOOL;
+         v->ll = 1;
+         fPtr += 4;
+         return true;
+      }
+      if (strncmp(fPtr, "false", 5) == 0) {
+         v->type = MJSON_BOOL;
+         v->ll = 0;
+         fPtr += 5;
+         return true;
+      }
+      if (strncmp(fPtr, "null", 4) == 0) {
+         v->type = MJSON_NULL;
+         fPtr += 4;
+         return true;
+      }
+      if (c == '-' || isdigit(c)) {
+         const char* p = fPtr;
+         bool is_int = true;
+         if (*p == '-')
+            p++;
+         if (!isdigit(*p))
+            return Error("invalid number");
+         while (isdigit(*p))
+            p++;
+         if (*p == '.') {
+            is_int = false;
+            p++;
+            while (isdigit(*p))
+               p++;
+         }
+         if (*p == 'e' || *p == 'E') {
+            is_int = false;
+            p++;
+            if (*p == '+' || *p == '-')
+               p++;
+            if (!isdigit(*p))
+               return Error("invalid number");
+            while (isdigit(*p))
+               p++;
+         }
+         if (check_only) {
+            fPtr = p;
+            return true;
+         }
+         if (is_int) {
+            errno = 0;
+            v->ll = strtoll(fPtr, NULL, 10);
+            if (errno == 0) {
+               v->type = MJSON_INT;
+               fPtr = p;
+               return true;
+            }
+            // too big for an integer
+         }
+         v->type = MJSON_NUMBER;
+         v->d = strtod(fPtr, NULL);
+         fPtr = p;
+         return true;
+      }
+      return Error("unexpected character");
+   }
+
+   /* parse and discard one value, used to check the syntax of the whole text before pasting */
+   bool SkipValue(int depth = 0) {
+      if (depth > 1000)
+         return Error("too deeply nested");
+      char c = Peek();
+      if (c == '{') {
+         if (Empty('}'))
+            return true;
+         fPtr++;
+         std::string name;
+         for (bool more = true; more; ) {
+            if (!ParseString(&name) || !Expect(':') || !SkipValue(depth + 1) || !Next('}', &more))
+               return false;
+         }
+         return true;
+      }
+      if (c == '[') {
+         if (Empty(']'))
+            return true;
+         fPtr++;
+         for (bool more = true; more; ) {
+            if (!SkipValue(depth + 1) || !Next(']', &more))
+               return false;
+         }
+         return true;
+      }
+      JsonScalar v;
+      return ParseScalar(&v, true);
+   }
+
+   /* check a string without decoding it */
+   bool SkipString() {
+      const char* p = ++fPtr;
+      while (*p && *p != '"') {
+         if (*p == '\\') {
+            switch (p[1]) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+               p += 2;
+               continue;
+            case 'u':
+               if (isxdigit(p[2]) && isxdigit(p[3]) && isxdigit(p[4]) && isxdigit(p[5])) {
+                  p += 6;
+                  continue;
+               }
+               fPtr = p;
+               return Error("invalid \\u escape");
+            default:
+               fPtr = p;
+               return Error("invalid escape sequence");
+            }
+         }
+         p++;
+      }
+      fPtr = p;
+      if (*p == 0)
+         return Error("unterminated string");
+      fPtr++;
+      return true;
+   }
+
+   /* parse a scalar or an array of scalars */
+   bool ParseValues(JsonScalarVector* a, bool* is_array) {
+      a->clear();
+      if (Peek() != '[') {
+         *is_array = false;
+         a->resize(1);
+         return ParseScalar(&(*a)[0]);
+      }
+      *is_array = true;
+      if (Empty(']'))
+         return true;
+      fPtr++;
+      for (bool more = true; more; ) {
+         char c = Peek();
+         if (c == '{' || c == '[')
+            return Error("unexpected object or array in array");
+         a->emplace_back();
+         if (!ParseScalar(&a->back()) || !Next(']', &more))
+            return false;
+      }
+      return true;
+   }
+
+   /* parse the "name/key" object of "ODB save" */
+   bool ParseKeyInfo(JsonKeyInfo* info) {
+      if (Peek() != '{')
+         return SkipValue();
+      if (Empty('}'))
+         return true;
+      fPtr++;
+      std::string name;
+      for (bool more = true; more; ) {
+         if (!ParseString(&name) || !Expect(':'))
+            return false;
+         if (name == "type" || name == "item_size") {
+            JsonScalar v;
+            if (!ParseScalar(&v))
+               return false;
+            int i = (v.type == MJSON_INT) ? (int)v.ll : (v.type == MJSON_NUMBER) ? (int)v.d : 0;
+            if (i > 0) {
+               if (name == "type")
+                  info->tid = i;
+               else
+                  info->item_size = i;
+            }
+         } else if (!SkipValue()) {
+            return false;
+         }
+         if (!Next('}', &more))
+            return false;
+      }
+      return true;
+   }
+};
+
+typedef std::map<std::string, JsonKeyInfo> JsonKeyInfoMap;
+
+/* collect the "name/key" entries in the rest of the current object */
+
+static bool scan_key_info(JsonStream js, JsonKeyInfoMap* infos)
+{
+   std::string name;
+   bool more = true;
+   // we are just after a value, continue with the next entry
+   if (!js.Next('}', &more))
+      return false;
+   while (more) {
+      if (!js.ParseString(&name) || !js.Expect(':'))
+         return false;
+      size_t len = name.length();
+      if (len > 4 && name.compare(len - 4, 4, "/key") == 0) {
+         JsonKeyInfo info;
+         if (!js.ParseKeyInfo(&info))
+            return false;
+         infos->insert(std::make_pair(name.substr(0, len - 4), info));
+      } else if (!js.SkipValue()) {
+         return false;
+      }
+      if (!js.Next('}', &more))
+         return false;
+   }
+   return true;
+}
+
+static int paste_stream_object(HNDLE hDB, HNDLE hKey, const char* path, JsonStream* js);
+
+static int paste_stream_error(JsonStream* js, const char* path)
+{
+   cm_msg(MERROR, "db_paste_json", "JSON parse error: \"%s\" at \"%s\"", js->fError.c_str(), path);
+   return DB_FILE_ERROR;
+}
+
+static int paste_stream_values(HNDLE hDB, HNDLE hKey, const char* path, const JsonScalarVector& a, bool is_array, int tid, const JsonKeyInfo& info)
+{
+   if (is_array) {
+      int status = paste_array(hDB, hKey, path, a, tid, 0, info);
+      if (status == DB_NO_ACCESS) {
+         cm_msg(MERROR, "db_paste_json", "skipping write-protected array \"%s\"", path);
+         return DB_SUCCESS;
+      }
+      return status;
+   }
+
+   if (a[0].type == MJSON_NULL) {
+      cm_msg(MERROR, "db_paste_json", "unexpected JSON null value at \"%s\"", path);
+      return DB_FILE_ERROR;
+   }
+
+   return paste_value(hDB, hKey, path, false, 0, a[0], tid, 0, info);
+}
+
+static int paste_stream_object(HNDLE hDB, HNDLE hKey, const char* path, JsonStream* js)
+{
+   if (equal_ustring(path, "/system/clients")) {
+      // do not reload ODB /system/clients
+      if (!js->SkipValue())
+         return paste_stream_error(js, path);
+      return DB_SUCCESS;
+   }
+
+   if (js->Peek() != '{') {
+      js->Error("expected \'{\'");
+      return paste_stream_error(js, path);
+   }
+
+   if (js->Empty('}'))
+      return DB_SUCCESS;
+
+   js->fPtr++;
+
+   int status;
+   PasteLock lock(hDB);
+   JsonKeyInfoMap infos;   // "name/key" entries seen so far
+   bool scanned = false;   // infos has all the "name/key" entries of this object
+   std::string name;
+   JsonScalarVector values;
+
+   for (bool more = true; more; ) {
+      if (!js->ParseString(&name) || !js->Expect(':'))
+         return paste_stream_error(js, path);
+
+      size_t slash = name.find('/');
+      if (slash != std::string::npos) { // special entries
+         if (name.compare(slash, std::string::npos, "/key") == 0) {
+            JsonKeyInfo info;
+            if (!js->ParseKeyInfo(&info))
+               return paste_stream_error(js, path);
+            infos.insert(std::make_pair(name.substr(0, slash), info));
+         } else if (!js->SkipValue()) {
+            return paste_stream_error(js, path);
+         }
+      } else if (js->Peek() == '{') {
+         HNDLE hSubkey;
+         lock.Lock();
+         status = create_subkey(hDB, hKey, path, name.c_str(), TID_KEY, &hSubkey);
+         lock.Unlock();
+         if (status != DB_SUCCESS)
+            return status;
+
+         std::string node_name = subkey_path(path, name.c_str());
+         status = paste_stream_object(hDB, hSubkey, node_name.c_str(), js);
+         status = paste_entry_status(status, node_name);
+         if (status != DB_SUCCESS)
+            return status;
+      } else {
+         bool is_array;
+         if (!js->ParseValues(&values, &is_array))
+            return paste_stream_error(js, path);
+
+         /* "ODB save" writes "name/key" before the value, look
+            further only for other JSON, and only once per object */
+         JsonKeyInfoMap::const_iterator it = infos.find(name);
+         if (it == infos.end() && !scanned) {
+            if (!scan_key_info(*js, &infos))
+               return paste_stream_error(js, path);
+            scanned = true;
+            it = infos.find(name);
+         }
+
+         JsonKeyInfo info;
+         if (it != infos.end())
+            info = it->second;
+
+         int tid = info.tid;
+         if (!tid && values.size() > 0)
+            tid = guess_tid(values[0]);
+         //printf("entry [%s] tid %d\n", name.c_str(), tid);
+
+         std::string node_name = subkey_path(path, name.c_str());
+
+         HNDLE hSubkey;
+         lock.Lock();
+         status = create_subkey(hDB, hKey, path, name.c_str(), tid, &hSubkey);
+         if (status != DB_SUCCESS)
+            return status;
+
+         status = paste_stream_values(hDB, hSubkey, node_name.c_str(), values, is_array, tid, info);
+         status = paste_entry_status(status, node_name);
+         if (status != DB_SUCCESS)
+            return status;
+      }
+
+      if (!js->Next('}', &more))
+         return paste_stream_error(js, path);
+   }
+
+   return DB_SUCCESS;
+}
+
 INT EXPRT db_paste_json(HNDLE hDB, HNDLE hKeyRoot, const char *buffer)
 {
    int status;
    char path[MAX_ODB_PATH];
 
    status = db_get_path(hDB, hKeyRoot, path, sizeof(path));
+   if (status != DB_SUCCESS)
+      return status;
 
    //printf("db_paste_json: handle %d, path [%s]\n", hKeyRoot, path);
 
-   MJsonNode* node = MJsonNode::Parse(buffer);
-   status = paste_node(hDB, hKeyRoot, path, false, 0, node, 0, 0, NULL);
-   delete node;
+   /* check the syntax first, so nothing is written for bad JSON */
+   JsonStream check(buffer);
+   if (!check.SkipValue())
+      return paste_stream_error(&check, path);
 
-   return status;
+   JsonStream js(buffer);
+
+   if (js.Peek() == '{')
+      return paste_stream_object(hDB, hKeyRoot, path, &js);
+
+   /* not an object: a value without a key type */
+   JsonScalarVector values;
+   bool is_array;
+   if (!js.ParseValues(&values, &is_array))
+      return paste_stream_error(&js, path);
+   return paste_stream_values(hDB, hKeyRoot, path, values, is_array, 0, JsonKeyInfo());
 }
 
 INT EXPRT db_paste_json_node(HNDLE hDB, HNDLE hKeyRoot, int index, const MJsonNode *node)
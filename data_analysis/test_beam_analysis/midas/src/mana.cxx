@@ -18,6 +18,14 @@
 #include "mdsupport.h"
 
 #include "zlib.h"
+#include "mlz4frame.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <map>
 
 /*------------------------------------------------------------------*/
 
@@ -260,6 +268,7 @@ static struct {
    INT pvm_buf_size;
    INT root_port;
    BOOL start_rint;
+   INT n_thread;
 } clp;
 
 static struct {
@@ -309,7 +318,10 @@ static struct {
                    offline mode.", &clp.quiet, TID_BOOL, 0}, {
    'r', "<range>       Range of run numbers to analyzer like \"-r 120 125\"\n\
                    to analyze runs 120 to 125 (inclusive). The \"-r\"\n\
-                   flag must be used with a '%05d' in the input file name.", clp.run_number, TID_INT, 2},
+                   flag must be used with a '%05d' in the input file name.", clp.run_number, TID_INT, 2}, {
+   'T', "<n>           Analyze events offline with <n> worker threads. Only\n\
+                   modules flagged \"multithread\" run in the workers,\n\
+                   all others run in event order in the main thread.", &clp.n_thread, TID_INT, 1},
 #ifdef HAVE_PVM
    {
    't', "<n>           Parallelize analyzer using <n> tasks with PVM.", &clp.n_task,
@@ -335,6 +347,10 @@ BOOL out_gzip;
 INT out_format;
 BOOL out_append;
 
+/* input statistics, maps to /<analyzer>/Input */
+static double ma_input_bytes = 0;
+static double ma_input_queue = 0;
+
 void update_stats();
 void odb_load(EVENT_HEADER * pevent);
 
@@ -1511,6 +1527,66 @@ INT CloseRootOutputFile()
 
 #endif                          /* HAVE_ROOT */
 
+/*-- worker thread support -----------------------------------------*/
+
+/* index of the current worker thread, -1 in the main thread */
+static thread_local INT ma_thread_index = -1;
+
+/* number of running worker threads */
+static INT ma_n_thread = 0;
+
+/* protects the worker queues and histogram cloning */
+static std::mutex ma_mt_mutex;
+
+INT mana_thread_index()
+{
+   return ma_thread_index;
+}
+
+INT mana_thread_count()
+{
+   return ma_n_thread;
+}
+
+#ifdef HAVE_ROOT
+
+/* per-thread histogram clones, added to the originals at EOR */
+static std::vector<std::map<TH1 *, TH1 *> > ma_thread_histos;
+
+TH1 *mana_thread_histo(TH1 * h)
+{
+   if (ma_thread_index < 0 || h == NULL)
+      return h;
+
+   std::map<TH1 *, TH1 *> &clones = ma_thread_histos[ma_thread_index];
+   std::map<TH1 *, TH1 *>::iterator it = clones.find(h);
+   if (it != clones.end())
+      return it->second;
+
+   /* ROOT object creation is not thread safe */
+   std::lock_guard<std::mutex> lock(ma_mt_mutex);
+   TH1 *clone = (TH1 *) h->Clone();
+   clone->SetDirectory(NULL);
+   clone->Reset();
+   clones[h] = clone;
+
+   return clone;
+}
+
+static void merge_thread_histos()
+{
+   for (unsigned i = 0; i < ma_thread_histos.size(); i++) {
+      std::map<TH1 *, TH1 *>::iterator it;
+      for (it = ma_thread_histos[i].begin(); it != ma_thread_histos[i].end(); it++) {
+         it->first->Add(it->second);
+         delete it->second;
+      }
+      ma_thread_histos[i].clear();
+   }
+}
+
+#endif                          /* HAVE_ROOT */
+
 /*-- analyzer init routine -----------------------------------------*/
 
 INT mana_init()
@@ -1918,6 +1994,11 @@ INT eor(INT run_number, char *error)
    INT i, j, status;
    char str[256], file_name[256];
 
+#ifdef HAVE_ROOT
+   /* collect histograms filled in worker threads */
+   merge_thread_histos();
+#endif
+
    /* call EOR routines modules */
    for (i = 0; analyze_request[i].event_name[0]; i++) {
       module = analyze_request[i].ana_module;
@@ -3078,14 +3159,19 @@ void correct_num_events(INT i)
       _current_par->events_received += i - 1;
 }
 
-INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
+/* Everything in front of the analyzer modules: counters, keyboard,
+   BOR handling and byte swapping. Sets *pevent_def to NULL if the
+   event should not be analyzed, in which case the return value is
+   the final status of process_event() */
+static INT process_event_begin(ANALYZE_REQUEST * par, EVENT_HEADER * pevent,
+                               EVENT_DEF ** pevent_def)
 {
-   INT i, status = SUCCESS, ch;
-   ANA_MODULE **module;
+   INT status = SUCCESS, ch;
    DWORD actual_time;
    EVENT_DEF *event_def;
    static DWORD last_time_kb = 0;
-   static char *orig_event = NULL;
+
+   *pevent_def = NULL;
 
    /* verbose output */
    if (clp.verbose)
@@ -3158,17 +3244,23 @@ INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
    if (event_def->format == FORMAT_MIDAS)
       bk_swap((BANK_HEADER *) (pevent + 1), FALSE);
 
-   /* keep copy of original event */
-   if (clp.filter) {
-      if (orig_event == NULL)
-         orig_event = (char *) malloc(sys_max_event_size + sizeof(EVENT_HEADER));
-      memcpy(orig_event, pevent, pevent->data_size + sizeof(EVENT_HEADER));
-   }
+   *pevent_def = event_def;
+   return SUCCESS;
+}
+
+/* Run the analyzer modules starting at first_module, then write the
+   event. orig_event is the unmodified event in filter mode or NULL */
+static INT process_event_end(ANALYZE_REQUEST * par, EVENT_HEADER * pevent,
+                             EVENT_DEF * event_def, INT first_module, char *orig_event)
+{
+   INT i, status = SUCCESS;
+   ANA_MODULE **module;
+   DWORD actual_time;
 
   /*---- analyze event ----*/
 
    /* call non-modular analyzer if defined */
-   if (par->analyzer) {
+   if (par->analyzer && first_module == 0) {
       status = par->analyzer(pevent, (void *) (pevent + 1));
 
       /* don't continue if event was rejected */
@@ -3178,7 +3270,7 @@ INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
 
    /* loop over analyzer modules */
    module = par->ana_module;
-   for (i = 0; module != NULL && module[i] != NULL; i++) {
+   for (i = first_module; module != NULL && module[i] != NULL; i++) {
       if (module[i]->enabled) {
 
          status = module[i]->analyzer(pevent, (void *) (pevent + 1));
@@ -3208,7 +3300,7 @@ INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
       test_increment();
 
    /* in filter mode, use original event */
-   if (clp.filter)
+   if (orig_event)
       pevent = (EVENT_HEADER *) orig_event;
 
    /* write resulting event */
@@ -3247,6 +3339,7 @@ INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
 
 
    /* put event in ODB once every second */
+   actual_time = ss_millitime();
    if (out_info.events_to_odb)
       for (i = 0; i < 50; i++) {
          if (last_time_event[i].event_id == pevent->event_id) {
@@ -3271,6 +3364,28 @@ INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
 
 /*------------------------------------------------------------------*/
 
+INT process_event(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
+{
+   INT status;
+   EVENT_DEF *event_def;
+   static char *orig_event = NULL;
+
+   status = process_event_begin(par, pevent, &event_def);
+   if (event_def == NULL)
+      return status;
+
+   /* keep copy of original event */
+   if (clp.filter) {
+      if (orig_event == NULL)
+         orig_event = (char *) malloc(sys_max_event_size + sizeof(EVENT_HEADER));
+      memcpy(orig_event, pevent, pevent->data_size + sizeof(EVENT_HEADER));
+   }
+
+   return process_event_end(par, pevent, event_def, 0, clp.filter ? orig_event : NULL);
+}
+
+/*------------------------------------------------------------------*/
+
 void receive_event(HNDLE buffer_handle, HNDLE request_id, EVENT_HEADER * pheader,
                    void *pevent)
 /* receive online event */
@@ -3405,6 +3520,8 @@ void update_stats()
    AR_STATS *ar_stats;
    static DWORD last_time = 0;
    DWORD actual_time;
+   double d;
+   char str[256];
 
    actual_time = ss_millitime();
 
@@ -3424,6 +3541,16 @@ void update_stats()
       analyze_request[i].events_written = 0;
    }
 
+   /* input rate and read-ahead queue fill level in offline mode */
+   if (!clp.online) {
+      d = ma_input_bytes / 1E6 / ((actual_time - last_time) / 1000.0);
+      sprintf(str, "/%s/Input/MB per sec", analyzer_name);
+      db_set_value(hDB, 0, str, &d, sizeof(d), 1, TID_DOUBLE);
+      sprintf(str, "/%s/Input/Queue occupancy", analyzer_name);
+      db_set_value(hDB, 0, str, &ma_input_queue, sizeof(ma_input_queue), 1, TID_DOUBLE);
+      ma_input_bytes = 0;
+   }
+
    /* propagate new statistics to ODB */
    db_send_changed_records();
 
@@ -3834,6 +3961,25 @@ void odb_load(EVENT_HEADER * pevent)
 #define MA_FORMAT_MIDAS       (1<<0)
 #define MA_FORMAT_YBOS        (1<<2)
 #define MA_FORMAT_GZIP        (1<<3)
+#define MA_FORMAT_LZ4         (1<<4)
+
+/* maximum size of events waiting in the read-ahead queue */
+#define MA_READAHEAD_SIZE     (64*1024*1024)
+
+/* size of compressed input buffer for LZ4 files */
+#define MA_LZ4_BUFFER_SIZE    (1024*1024)
+
+/* events read and decompressed by a background thread */
+typedef struct {
+   std::thread thread;
+   std::mutex mutex;
+   std::condition_variable cond_event;   /* event queued or end of file */
+   std::condition_variable cond_space;   /* event removed or stop request */
+   std::deque<EVENT_HEADER *> queue;
+   size_t queue_size;
+   BOOL eof;
+   BOOL stop;
+} MA_READAHEAD;
 
 typedef struct {
    char file_name[256];
@@ -3841,11 +3987,17 @@ typedef struct {
    int device;
    int fd;
    gzFile gzfile;
+   MLZ4F_decompressionContext_t lz4ctx;
+   char *lz4buf;
+   size_t lz4_wp, lz4_rp;
+   MA_READAHEAD *readahead;
    char *buffer;
    int wp, rp;
    /*FTP_CON ftp_con; */
 } MA_FILE;
 
+static void ma_readahead_thread(MA_FILE * file);
+
 /*------------------------------------------------------------------*/
 
 MA_FILE *ma_open(char *file_name)
@@ -3881,7 +4033,9 @@ MA_FILE *ma_open(char *file_name)
    } else
       ext_str = (char *)"";
 
-   if (strncmp(ext_str, ".gz", 3) == 0) {
+   if (strncmp(ext_str, ".gz", 3) == 0 || strncmp(ext_str, ".lz4", 4) == 0) {
+      if (ext_str[1] == 'l')
+         file->format |= MA_FORMAT_LZ4;
       ext_str--;
       while (*ext_str != '.' && ext_str > file_name)
          ext_str--;
@@ -3890,12 +4044,12 @@ MA_FILE *ma_open(char *file_name)
    if (strncmp(file_name, "/dev/", 4) == 0)     /* assume MIDAS tape */
       file->format = MA_FORMAT_MIDAS;
    else if (strncmp(ext_str, ".mid", 4) == 0)
-      file->format = MA_FORMAT_MIDAS;
+      file->format |= MA_FORMAT_MIDAS;
    else if (strncmp(ext_str, ".ybs", 4) == 0)
      assert(!"YBOS not supported anymore");
    else {
       printf
-          ("Unknown input data format \"%s\". Please use file extension .mid or mid.gz.\n",
+          ("Unknown input data format \"%s\". Please use file extension .mid, .mid.gz or .mid.lz4.\n",
            ext_str);
       return NULL;
    }
@@ -3903,11 +4057,32 @@ MA_FILE *ma_open(char *file_name)
    if (file->device == MA_DEVICE_DISK) {
       if (file->format == MA_FORMAT_YBOS) {
 	assert(!"YBOS not supported anymore");
+      } else if (file->format & MA_FORMAT_LZ4) {
+         file->fd = open(file_name, O_RDONLY | O_BINARY);
+         if (file->fd < 0)
+            return NULL;
+
+         MLZ4F_errorCode_t error = MLZ4F_createDecompressionContext(&file->lz4ctx, MLZ4F_VERSION);
+         if (MLZ4F_isError(error)) {
+            cm_msg(MERROR, "ma_open", "LZ4F_createDecompressionContext() error %d (%s)",
+                   (int) error, MLZ4F_getErrorName(error));
+            close(file->fd);
+            return NULL;
+         }
+         file->lz4buf = (char *) malloc(MA_LZ4_BUFFER_SIZE);
+         file->lz4_wp = file->lz4_rp = 0;
       } else {
          file->gzfile = gzopen(file_name, "rb");
          if (file->gzfile == NULL)
             return NULL;
       }
+
+      /* start reading and decompressing in the background */
+      file->readahead = new MA_READAHEAD;
+      file->readahead->queue_size = 0;
+      file->readahead->eof = FALSE;
+      file->readahead->stop = FALSE;
+      file->readahead->thread = std::thread(ma_readahead_thread, file);
    }
 
    return file;
@@ -3917,9 +4092,31 @@ MA_FILE *ma_open(char *file_name)
 
 int ma_close(MA_FILE * file)
 {
+   MA_READAHEAD *ra = file->readahead;
+
+   /* stop reader thread and drop unread events */
+   if (ra) {
+      {
+         std::lock_guard<std::mutex> lock(ra->mutex);
+         ra->stop = TRUE;
+         ra->cond_space.notify_all();
+      }
+      ra->thread.join();
+
+      while (!ra->queue.empty()) {
+         free(ra->queue.front());
+         ra->queue.pop_front();
+      }
+      delete ra;
+   }
+
    if (file->format == MA_FORMAT_YBOS)
      assert(!"YBOS not supported anymore");
-   else
+   else if (file->format & MA_FORMAT_LZ4) {
+      MLZ4F_freeDecompressionContext(file->lz4ctx);
+      free(file->lz4buf);
+      close(file->fd);
+   } else if (file->gzfile)
       gzclose((gzFile)file->gzfile);
 
    free(file);
@@ -3928,10 +4125,157 @@ int ma_close(MA_FILE * file)
 
 /*------------------------------------------------------------------*/
 
+/* read size bytes of uncompressed data, returns less at end of file */
+static int ma_read_raw(MA_FILE * file, void *buf, int size)
+{
+   int n, rd;
+   size_t dst_size, src_size, hint;
+
+   if (!(file->format & MA_FORMAT_LZ4))
+      return gzread(file->gzfile, buf, size);
+
+   n = 0;
+   while (n < size) {
+      if (file->lz4_rp == file->lz4_wp) {
+         rd = read(file->fd, file->lz4buf, MA_LZ4_BUFFER_SIZE);
+         if (rd < 0) {
+            cm_msg(MERROR, "ma_read_raw", "Cannot read from file \"%s\", read() errno %d (%s)",
+                   file->file_name, errno, strerror(errno));
+            return -1;
+         }
+         if (rd == 0)
+            break;
+         file->lz4_rp = 0;
+         file->lz4_wp = rd;
+      }
+
+      dst_size = size - n;
+      src_size = file->lz4_wp - file->lz4_rp;
+      hint = MLZ4F_decompress(file->lz4ctx, (char *) buf + n, &dst_size,
+                              file->lz4buf + file->lz4_rp, &src_size, NULL);
+      if (MLZ4F_isError(hint)) {
+         cm_msg(MERROR, "ma_read_raw", "LZ4F_decompress() error %d (%s) in file \"%s\"",
+                (int) hint, MLZ4F_getErrorName(hint), file->file_name);
+         return -1;
+      }
+
+      file->lz4_rp += src_size;
+      n += dst_size;
+   }
+
+   return n;
+}
+
+/* background thread filling the read-ahead queue */
+static void ma_readahead_thread(MA_FILE * file)
+{
+   MA_READAHEAD *ra = file->readahead;
+   EVENT_HEADER header, *pevent;
+   int n, max_size;
+
+   max_size = 2 * (sys_max_event_size + sizeof(EVENT_HEADER));
+
+   do {
+      /* read event header */
+      n = ma_read_raw(file, &header, sizeof(EVENT_HEADER));
+      if (n < (int) sizeof(EVENT_HEADER)) {
+         if (n > 0)
+            printf("Unexpected end of file %s, last event skipped\n", file->file_name);
+         break;
+      }
+
+      /* swap event header if in wrong format */
+#ifdef SWAP_EVENTS
+      WORD_SWAP(&header.event_id);
+      WORD_SWAP(&header.trigger_mask);
+      DWORD_SWAP(&header.serial_number);
+      DWORD_SWAP(&header.time_stamp);
+      DWORD_SWAP(&header.data_size);
+#endif
+
+      if (header.data_size > (DWORD) max_size - sizeof(EVENT_HEADER)) {
+         cm_msg(MERROR, "ma_readahead_thread", "Event size %d too large in file %s",
+                (int) header.data_size, file->file_name);
+         break;
+      }
+
+      /* read event */
+      pevent = (EVENT_HEADER *) malloc(sizeof(EVENT_HEADER) + header.data_size);
+      if (pevent == NULL) {
+         cm_msg(MERROR, "ma_readahead_thread", "Not enough memory for event of %d bytes",
+                (int) header.data_size);
+         break;
+      }
+      memcpy(pevent, &header, sizeof(EVENT_HEADER));
+
+      if (header.data_size > 0) {
+         n = ma_read_raw(file, pevent + 1, header.data_size);
+         if (n != (int) header.data_size) {
+            printf("Unexpected end of file %s, last event skipped\n", file->file_name);
+            free(pevent);
+            break;
+         }
+      }
+
+      /* wait for space in queue */
+      std::unique_lock<std::mutex> lock(ra->mutex);
+      while (!ra->stop && !ra->queue.empty() && ra->queue_size > MA_READAHEAD_SIZE)
+         ra->cond_space.wait(lock);
+      if (ra->stop) {
+         free(pevent);
+         break;
+      }
+
+      ra->queue.push_back(pevent);
+      ra->queue_size += sizeof(EVENT_HEADER) + header.data_size;
+      ra->cond_event.notify_one();
+   } while (1);
+
+   std::lock_guard<std::mutex> lock(ra->mutex);
+   ra->eof = TRUE;
+   ra->cond_event.notify_one();
+}
+
+/*------------------------------------------------------------------*/
+
 int ma_read_event(MA_FILE * file, EVENT_HEADER * pevent, int size)
 {
    int n;
 
+   if (file->device == MA_DEVICE_DISK && file->readahead) {
+      MA_READAHEAD *ra = file->readahead;
+      EVENT_HEADER *pe;
+
+      /* take next event from read-ahead queue */
+      {
+         std::unique_lock<std::mutex> lock(ra->mutex);
+         while (ra->queue.empty() && !ra->eof)
+            ra->cond_event.wait(lock);
+         if (ra->queue.empty())
+            return -1;
+
+         ma_input_queue = 100.0 * ra->queue_size / MA_READAHEAD_SIZE;
+
+         pe = ra->queue.front();
+         ra->queue.pop_front();
+         ra->queue_size -= sizeof(EVENT_HEADER) + pe->data_size;
+         ra->cond_space.notify_one();
+      }
+
+      n = sizeof(EVENT_HEADER) + pe->data_size;
+      if (size < n) {
+         cm_msg(MERROR, "ma_read_event", "Buffer size too small");
+         free(pe);
+         return -1;
+      }
+
+      memcpy(pevent, pe, n);
+      free(pe);
+
+      ma_input_bytes += n;
+      return n;
+   }
+
    if (file->device == MA_DEVICE_DISK) {
       if (file->format == MA_FORMAT_MIDAS) {
          if (size < (int) sizeof(EVENT_HEADER)) {
@@ -4039,6 +4383,271 @@ int ma_read_event(MA_FILE * file, EVENT_HEADER * pevent, int size)
    return 0;
 }
 
+/*---- multithreaded offline analysis ------------------------------*/
+
+/* An event job carries a private copy of one event through the worker
+   threads. The workers run the leading "multithread" modules of the
+   request, the main thread runs the remaining modules and writes the
+   output in the original event order. */
+
+typedef struct {
+   char *buffer;                       /* unaligned event buffer        */
+   EVENT_HEADER *pevent;               /* aligned event copy            */
+   char *orig_event;                   /* original event in filter mode */
+   ANALYZE_REQUEST *par;
+   EVENT_DEF *event_def;
+   INT module_index;                   /* first module left to run      */
+   INT status;
+   BOOL done;
+} MA_JOB;
+
+/* number of events in flight per worker thread */
+#define MA_JOBS_PER_THREAD 2
+
+static std::condition_variable ma_mt_cond_todo;
+static std::condition_variable ma_mt_cond_done;
+static std::deque<MA_JOB *> ma_mt_todo;        /* waiting for a worker */
+static std::deque<MA_JOB *> ma_mt_order;       /* all jobs in event order */
+static std::vector<MA_JOB *> ma_mt_free;
+static std::vector<std::thread> ma_mt_thread;
+static BOOL ma_mt_exit = FALSE;
+
+static void ma_mt_worker(INT index)
+{
+   ANA_MODULE **module;
+   MA_JOB *job;
+   INT i;
+
+   ma_thread_index = index;
+
+   std::unique_lock<std::mutex> lock(ma_mt_mutex);
+   do {
+      while (ma_mt_todo.empty() && !ma_mt_exit)
+         ma_mt_cond_todo.wait(lock);
+      if (ma_mt_todo.empty())
+         break;
+
+      job = ma_mt_todo.front();
+      ma_mt_todo.pop_front();
+      lock.unlock();
+
+      /* run modules up to the first one which needs event order */
+      job->status = SUCCESS;
+      module = job->par->ana_module;
+      for (i = 0; module != NULL && module[i] != NULL; i++) {
+         if (!module[i]->enabled)
+            continue;
+         if (!module[i]->multithread)
+            break;
+
+         job->status = module[i]->analyzer(job->pevent, (void *) (job->pevent + 1));
+         if (job->status == ANA_SKIP)
+            break;
+      }
+      job->module_index = i;
+
+      lock.lock();
+      job->done = TRUE;
+      ma_mt_cond_done.notify_all();
+   } while (1);
+}
+
+static void ma_mt_start(INT n_thread)
+{
+   INT i;
+
+   if (ma_n_thread > 0)
+      return;
+
+#ifdef HAVE_ROOT
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+   ROOT::EnableThreadSafety();
+#endif
+   ma_thread_histos.resize(n_thread);
+#endif
+
+   ma_mt_exit = FALSE;
+   for (i = 0; i < n_thread; i++)
+      ma_mt_thread.push_back(std::thread(ma_mt_worker, i));
+   ma_n_thread = n_thread;
+}
+
+static void ma_mt_stop()
+{
+   unsigned i;
+
+   {
+      std::lock_guard<std::mutex> lock(ma_mt_mutex);
+      ma_mt_exit = TRUE;
+      ma_mt_cond_todo.notify_all();
+   }
+
+   for (i = 0; i < ma_mt_thread.size(); i++)
+      ma_mt_thread[i].join();
+   ma_mt_thread.clear();
+   ma_n_thread = 0;
+
+   for (i = 0; i < ma_mt_free.size(); i++) {
+      free(ma_mt_free[i]->buffer);
+      if (ma_mt_free[i]->orig_event)
+         free(ma_mt_free[i]->orig_event);
+      free(ma_mt_free[i]);
+   }
+   ma_mt_free.clear();
+}
+
+/* Finish jobs in event order until at most max_pending are left. If
+   discard is set, jobs are retired without being analyzed further */
+static INT ma_mt_complete(INT max_pending, BOOL discard, DWORD * num_events_out)
+{
+   INT status = SUCCESS, s;
+   MA_JOB *job;
+
+   std::unique_lock<std::mutex> lock(ma_mt_mutex);
+   while (!ma_mt_order.empty()) {
+      job = ma_mt_order.front();
+      if (!job->done) {
+         if ((INT) ma_mt_order.size() <= max_pending)
+            break;
+         ma_mt_cond_done.wait(lock);
+         continue;
+      }
+      ma_mt_order.pop_front();
+      lock.unlock();
+
+      if (!discard && job->status != ANA_SKIP) {
+         s = process_event_end(job->par, job->pevent, job->event_def,
+                               job->module_index, job->orig_event);
+         if (s == SUCCESS)
+            (*num_events_out)++;
+         if (s < 0 || s == RPC_SHUTDOWN) {
+            /* disk full/stop analyzer, drop remaining events */
+            status = s;
+            discard = TRUE;
+         }
+      }
+
+      lock.lock();
+      ma_mt_free.push_back(job);
+   }
+
+   return status;
+}
+
+/* check if the leading modules of a request may run in worker threads */
+static BOOL ma_mt_parallel(ANALYZE_REQUEST * par)
+{
+   ANA_MODULE **module;
+   INT i;
+
+   if (par->analyzer)
+      return FALSE;
+
+   module = par->ana_module;
+   for (i = 0; module != NULL && module[i] != NULL; i++)
+      if (module[i]->enabled)
+         return module[i]->multithread;
+
+   return FALSE;
+}
+
+static BOOL ma_request_matches(ANALYZE_REQUEST * par, EVENT_HEADER * pevent)
+{
+   return (par->ar_info.event_id == EVENTID_ALL ||
+           par->ar_info.event_id == pevent->event_id) &&
+       (par->ar_info.trigger_mask == TRIGGER_ALL ||
+        (par->ar_info.trigger_mask & pevent->trigger_mask))
+       && par->ar_info.enabled;
+}
+
+/* Hand an event to the worker threads. Events which match more than one
+   request or whose first module needs event order are analyzed directly
+   after all earlier events are finished */
+static INT ma_mt_process(EVENT_HEADER * pevent, INT ext_event_size, DWORD * num_events_out)
+{
+   ANALYZE_REQUEST *par, *match;
+   EVENT_DEF *event_def;
+   MA_JOB *job;
+   INT status, n_match;
+
+   match = NULL;
+   n_match = 0;
+   for (par = analyze_request; par->event_name[0]; par++)
+      if (ma_request_matches(par, pevent)) {
+         match = par;
+         n_match++;
+      }
+
+   if (n_match == 0)
+      return SUCCESS;
+
+   if (n_match > 1 || !ma_mt_parallel(match)) {
+      status = ma_mt_complete(0, FALSE, num_events_out);
+      if (status != SUCCESS)
+         return status;
+
+      for (par = analyze_request; par->event_name[0]; par++)
+         if (ma_request_matches(par, pevent)) {
+            status = process_event(par, pevent);
+            if (status == SUCCESS)
+               (*num_events_out)++;
+            if (status < 0 || status == RPC_SHUTDOWN)
+               break;
+         }
+      return status;
+   }
+
+   status = process_event_begin(match, pevent, &event_def);
+   if (event_def == NULL)
+      return status;
+
+   /* get a job, wait for a free one if too many are in flight */
+   status = ma_mt_complete(ma_n_thread * MA_JOBS_PER_THREAD - 1, FALSE, num_events_out);
+   if (status != SUCCESS)
+      return status;
+
+   {
+      std::lock_guard<std::mutex> lock(ma_mt_mutex);
+      if (ma_mt_free.empty())
+         job = NULL;
+      else {
+         job = ma_mt_free.back();
+         ma_mt_free.pop_back();
+      }
+   }
+
+   if (job == NULL) {
+      job = (MA_JOB *) calloc(1, sizeof(MA_JOB));
+      job->buffer = (char *) malloc(ext_event_size);
+      if (job->buffer == NULL) {
+         cm_msg(MERROR, "ma_mt_process", "Not enough memory for event buffer");
+         free(job);
+         return -1;
+      }
+      job->pevent = (EVENT_HEADER *) ALIGN8((POINTER_T) job->buffer);
+   }
+
+   memcpy(job->pevent, pevent, pevent->data_size + sizeof(EVENT_HEADER));
+   if (clp.filter) {
+      if (job->orig_event == NULL)
+         job->orig_event = (char *) malloc(sys_max_event_size + sizeof(EVENT_HEADER));
+      memcpy(job->orig_event, pevent, pevent->data_size + sizeof(EVENT_HEADER));
+   }
+
+   job->par = match;
+   job->event_def = event_def;
+   job->module_index = 0;
+   job->status = SUCCESS;
+   job->done = FALSE;
+
+   std::lock_guard<std::mutex> lock(ma_mt_mutex);
+   ma_mt_order.push_back(job);
+   ma_mt_todo.push_back(job);
+   ma_mt_cond_todo.notify_one();
+
+   return SUCCESS;
+}
+
 /*------------------------------------------------------------------*/
 
 INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
@@ -4050,7 +4659,7 @@ INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
    char error[256], str[256];
    INT status = SUCCESS;
    MA_FILE *file;
-   BOOL skip;
+   BOOL skip, mt;
    DWORD start_time;
 
    /* set output file name and flags in ODB */
@@ -4092,6 +4701,11 @@ INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
    /* call analyzer bor routines */
    bor(run_number, error);
 
+   /* start worker threads */
+   mt = clp.n_thread > 0 && !pvm_master && !pvm_slave;
+   if (mt)
+      ma_mt_start(clp.n_thread);
+
    num_events_in = num_events_out = 0;
 
    start_time = ss_millitime();
@@ -4107,6 +4721,13 @@ INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
 
       /* copy system events (BOR, EOR, MESSAGE) to output file */
       if (pevent->event_id < 0) {
+         /* finish pending events before ODB gets reloaded */
+         if (mt) {
+            status = ma_mt_complete(0, FALSE, &num_events_out);
+            if (status < 0 || status == RPC_SHUTDOWN)
+               break;
+         }
+
          status = process_event(NULL, pevent);
          if (status < 0 || status == RPC_SHUTDOWN)      /* disk full/stop analyzer */
             break;
@@ -4158,7 +4779,16 @@ INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
          }
       }
 
-      if (!skip) {
+      if (!skip && mt) {
+         status = ma_mt_process(pevent, ext_event_size, &num_events_out);
+         if (status < 0 || status == RPC_SHUTDOWN)
+            break;
+
+         /* check for Ctrl-C */
+         status = cm_yield(0);
+         if (status == RPC_SHUTDOWN)
+            break;
+      } else if (!skip) {
          /* find request belonging to this event */
          par = analyze_request;
          status = SUCCESS;
@@ -4199,6 +4829,14 @@ INT analyze_run(INT run_number, char *input_file_name, char *output_file_name)
       }
    } while (1);
 
+   /* finish events still in the worker threads */
+   if (mt) {
+      n = ma_mt_complete(0, status < 0 || status == RPC_SHUTDOWN, &num_events_out);
+      if (n < 0 || n == RPC_SHUTDOWN)
+         status = n;
+      ma_mt_stop();
+   }
+
 #ifdef HAVE_PVM
    PVM_DEBUG("analyze_run: event loop finished, status = %d", status);
 #endif
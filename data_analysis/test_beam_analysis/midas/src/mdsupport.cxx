@@ -44,6 +44,7 @@ FTP_CON *ftp_con;
 #include "zlib.h"
 
 #include "mdsupport.h"
+#include "mlz4.h"
 
 INT md_dev_os_read(INT handle, INT type, void *prec, DWORD nbytes, DWORD *nread);
 
@@ -1677,6 +1678,365 @@ none
    return;
 }
 
+/*------------------------------------------------------------------*/
+std::string md_index_file_name(const char *data_file)
+/********************************************************************\
+Routine: md_index_file_name
+Purpose: Name of the event index file written by mlogger for a data file
+Input:
+const char * data_file : data file name (.mid or .mid.lz4)
+Function value:
+index file name
+\********************************************************************/
+{
+   return std::string(data_file) + ".idx";
+}
+
+/*------------------------------------------------------------------*/
+INT md_index_load(const char *index_file, MD_INDEX *index)
+/********************************************************************\
+Routine: md_index_load
+Purpose: Read an event index file. An index without trailer (data file
+         still being written, or mlogger crashed) is loaded up to the
+         last complete entry, with index->complete = false.
+Input:
+const char * index_file : index file name
+Output:
+MD_INDEX * index        : entries, LZ4 blocks
+Function value:
+MD_SUCCESS         Ok
+SS_FILE_ERROR      Cannot open or read the file
+MD_UNKNOWN_FORMAT  Not an index file
+\********************************************************************/
+{
+   index->entries.clear();
+   index->blocks.clear();
+   index->by_event_id.clear();
+   index->compression = MD_INDEX_RAW;
+   index->block_size = 0;
+   index->complete = false;
+
+   FILE *f = fopen(index_file, "rb");
+   if (f == NULL)
+      return SS_FILE_ERROR;
+
+   MD_INDEX_HEADER header;
+   if (fread(&header, sizeof(header), 1, f) != 1 ||
+       memcmp(header.magic, MD_INDEX_MAGIC, 8) != 0 ||
+       header.version != MD_INDEX_VERSION ||
+       header.entry_size != sizeof(MD_INDEX_ENTRY)) {
+      fclose(f);
+      return MD_UNKNOWN_FORMAT;
+   }
+
+   fseeko(f, 0, SEEK_END);
+   off_t size = ftello(f) - sizeof(header);
+
+   /* check for the trailer written when the data file was closed */
+   MD_INDEX_TRAILER trailer;
+   if (size >= (off_t) sizeof(trailer)) {
+      fseeko(f, -(off_t) sizeof(trailer), SEEK_END);
+      if (fread(&trailer, sizeof(trailer), 1, f) == 1 &&
+          memcmp(trailer.magic, MD_INDEX_END_MAGIC, 8) == 0 &&
+          (trailer.num_entries * sizeof(MD_INDEX_ENTRY) + trailer.num_blocks * sizeof(uint64_t) + sizeof(trailer)) == (uint64_t) size)
+         index->complete = true;
+   }
+
+   size_t num_entries = size / sizeof(MD_INDEX_ENTRY);
+   if (index->complete)
+      num_entries = trailer.num_entries;
+
+   index->entries.resize(num_entries);
+   fseeko(f, sizeof(header), SEEK_SET);
+   if (fread(index->entries.data(), sizeof(MD_INDEX_ENTRY), num_entries, f) != num_entries) {
+      fclose(f);
+      return SS_FILE_ERROR;
+   }
+
+   if (index->complete) {
+      index->compression = trailer.compression;
+      index->block_size = trailer.block_size;
+      index->blocks.resize(trailer.num_blocks);
+      if (fread(index->blocks.data(), sizeof(uint64_t), trailer.num_blocks, f) != trailer.num_blocks) {
+         fclose(f);
+         return SS_FILE_ERROR;
+      }
+   }
+
+   fclose(f);
+
+   for (size_t i = 0; i < index->entries.size(); i++)
+      index->by_event_id[index->entries[i].event_id].push_back(i);
+
+   return MD_SUCCESS;
+}
+
+/*------------------------------------------------------------------*/
+size_t md_index_find_time(const MD_INDEX *index, DWORD time_stamp)
+/********************************************************************\
+Routine: md_index_find_time
+Purpose: Binary search for the first event at or after a given time.
+         Time stamps are in the order the events were written, which
+         is increasing up to the one second resolution of the stamps.
+Input:
+const MD_INDEX * index : index
+DWORD time_stamp       : time (seconds since 1970)
+Function value:
+entry number, index->entries.size() if none
+\********************************************************************/
+{
+   size_t lo = 0, hi = index->entries.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (index->entries[mid].time_stamp < time_stamp)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+/*------------------------------------------------------------------*/
+size_t md_index_find_serial(const MD_INDEX *index, WORD event_id, DWORD serial_number)
+/********************************************************************\
+Routine: md_index_find_serial
+Purpose: Binary search for the first event of a given ID with a serial
+         number at or after serial_number. Serial numbers are counted
+         separately for each event ID by the frontends.
+Input:
+const MD_INDEX * index : index
+WORD event_id          : event ID
+DWORD serial_number    : serial number
+Function value:
+entry number, index->entries.size() if none
+\********************************************************************/
+{
+   auto it = index->by_event_id.find(event_id);
+   if (it == index->by_event_id.end())
+      return index->entries.size();
+
+   const std::vector<size_t> &pos = it->second;
+   size_t lo = 0, hi = pos.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (index->entries[pos[mid]].serial_number < serial_number)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo < pos.size() ? pos[lo] : index->entries.size();
+}
+
+/*------------------------------------------------------------------*/
+std::vector<size_t> md_index_split(const MD_INDEX *index, int nparts)
+/********************************************************************\
+Routine: md_index_split
+Purpose: Split a data file into parts of about the same size for
+         parallel processing.
+Input:
+const MD_INDEX * index : index
+int nparts             : number of parts
+Function value:
+first entry of each part, followed by index->entries.size()
+\********************************************************************/
+{
+   std::vector<size_t> split;
+   size_t n = index->entries.size();
+
+   if (nparts < 1)
+      nparts = 1;
+
+   split.push_back(0);
+   if (n > 0) {
+      uint64_t total = index->entries[n - 1].offset + sizeof(EVENT_HEADER) + index->entries[n - 1].data_size;
+      size_t i = 0;
+      for (int p = 1; p < nparts; p++) {
+         uint64_t target = total / nparts * p;
+         while (i < n && index->entries[i].offset < target)
+            i++;
+         split.push_back(i);
+      }
+   } else {
+      for (int p = 1; p < nparts; p++)
+         split.push_back(0);
+   }
+   split.push_back(n);
+
+   return split;
+}
+
+/*------------------------------------------------------------------*/
+
+struct MD_INDEX_FILE {
+   int handle;
+   const MD_INDEX *index;
+   uint64_t pos;                /* current uncompressed offset */
+   std::vector<char> block;     /* current LZ4 block, uncompressed */
+   std::vector<char> cblock;    /* current LZ4 block, compressed */
+   int64_t block_number;        /* -1: none */
+};
+
+INT md_index_open(const char *data_file, const MD_INDEX *index, MD_INDEX_FILE **pfile)
+/********************************************************************\
+Routine: md_index_open
+Purpose: Open a data file for random access through its index. The
+         index must remain valid until md_index_close().
+Input:
+const char * data_file : data file name
+const MD_INDEX * index : index of the file, see md_index_load()
+Output:
+MD_INDEX_FILE ** pfile : file handle for md_index_seek/read/close
+Function value:
+MD_SUCCESS         Ok
+SS_FILE_ERROR      Cannot open the data file
+MD_UNKNOWN_FORMAT  Index of an LZ4 file without block list (incomplete)
+\********************************************************************/
+{
+   *pfile = NULL;
+
+   std::string name = data_file;
+   bool lz4 = name.size() > 4 && name.substr(name.size() - 4) == ".lz4";
+
+   if (lz4 && (index->compression != MD_INDEX_LZ4 || index->block_size == 0))
+      return MD_UNKNOWN_FORMAT;
+   if (!lz4 && index->compression != MD_INDEX_RAW)
+      return MD_UNKNOWN_FORMAT;
+
+   int handle = open(data_file, O_RDONLY | O_BINARY | O_LARGEFILE, 0644);
+   if (handle < 0)
+      return SS_FILE_ERROR;
+
+   MD_INDEX_FILE *file = new MD_INDEX_FILE;
+   file->handle = handle;
+   file->index = index;
+   file->pos = 0;
+   file->block_number = -1;
+
+   *pfile = file;
+   return MD_SUCCESS;
+}
+
+/*------------------------------------------------------------------*/
+INT md_index_seek(MD_INDEX_FILE *file, size_t entry)
+/********************************************************************\
+Routine: md_index_seek
+Purpose: Position the file at an event, the next md_index_read() starts
+         with its header.
+Input:
+MD_INDEX_FILE * file : file handle
+size_t entry         : entry number in the index
+Function value:
+MD_SUCCESS           Ok
+MD_DONE              entry past the end of the index
+\********************************************************************/
+{
+   if (entry >= file->index->entries.size())
+      return MD_DONE;
+
+   file->pos = file->index->entries[entry].offset;
+   return MD_SUCCESS;
+}
+
+static bool md_index_read_block(MD_INDEX_FILE *file, int64_t block_number)
+{
+   const MD_INDEX *index = file->index;
+
+   file->block.clear();
+   file->block_number = block_number;
+
+   if (block_number >= (int64_t) index->blocks.size())
+      return false;
+
+   DWORD bsize;
+   if (lseek(file->handle, index->blocks[block_number], SEEK_SET) < 0 ||
+       read(file->handle, &bsize, sizeof(bsize)) != sizeof(bsize))
+      return false;
+
+   bool uncompressed = (bsize & 0x80000000) != 0;
+   bsize &= 0x7FFFFFFF;
+   if (bsize == 0 || bsize > index->block_size)
+      return false;             /* end mark or corrupted */
+
+   file->cblock.resize(bsize);
+   if (read(file->handle, file->cblock.data(), bsize) != (ssize_t) bsize)
+      return false;
+
+   if (uncompressed) {
+      file->block.swap(file->cblock);
+   } else {
+      file->block.resize(index->block_size);
+      int n = MLZ4_decompress_safe(file->cblock.data(), file->block.data(), bsize, index->block_size);
+      if (n < 0) {
+         file->block.clear();
+         return false;
+      }
+      file->block.resize(n);
+   }
+
+   return true;
+}
+
+/*------------------------------------------------------------------*/
+int md_index_read(MD_INDEX_FILE *file, void *buf, int count)
+/********************************************************************\
+Routine: md_index_read
+Purpose: Read uncompressed data from the current position, the file
+         can be read on sequentially after md_index_seek().
+Input:
+MD_INDEX_FILE * file : file handle
+void * buf           : destination
+int count            : number of bytes to read
+Function value:
+number of bytes read, 0 at the end of the file, -1 on error
+\********************************************************************/
+{
+   if (file->index->compression == MD_INDEX_RAW) {
+      if (lseek(file->handle, file->pos, SEEK_SET) < 0)
+         return -1;
+      int n = read(file->handle, buf, count);
+      if (n > 0)
+         file->pos += n;
+      return n;
+   }
+
+   char *p = (char *) buf;
+   int done = 0;
+   DWORD block_size = file->index->block_size;
+
+   while (done < count) {
+      int64_t block_number = file->pos / block_size;
+      if (block_number != file->block_number)
+         if (!md_index_read_block(file, block_number))
+            break;
+
+      uint64_t offset = file->pos - (uint64_t) block_number * block_size;
+      if (offset >= file->block.size())
+         break;
+
+      int n = file->block.size() - offset;
+      if (n > count - done)
+         n = count - done;
+      memcpy(p + done, file->block.data() + offset, n);
+      done += n;
+      file->pos += n;
+   }
+
+   return done;
+}
+
+/*------------------------------------------------------------------*/
+void md_index_close(MD_INDEX_FILE *file)
+/********************************************************************\
+Routine: md_index_close
+Purpose: Close a data file opened with md_index_open()
+\********************************************************************/
+{
+   if (file == NULL)
+      return;
+   close(file->handle);
+   delete file;
+}
+
 /*------------------------------------------------------------------*/
 /*--END of MDSUPPORT.C----------------------------------------------*/
 /*------------------------------------------------------------------*/
@@ -16,6 +16,14 @@
 #include "msystem.h"
 #include <assert.h>
 #include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef OS_LINUX
+#include <sys/epoll.h>
+#endif
 
 #ifndef HAVE_STRLCPY
 #include "strlcpy.h"
@@ -33,6 +41,8 @@ INT rpc_mode = 1; // 0 for RPC socket, 1 for event socket
 
 #define MAX_N_THREADS          32       /* maximum number of readout threads */
 
+#define POLL_IDLE_SPIN        100       /* empty polls before the scheduler starts to back off */
+
 INT run_state = 0;              /* STATE_RUNNING, STATE_STOPPED, STATE_PAUSED */
 INT run_number = 0;
 DWORD actual_time = 0;          /* current time in seconds since 1970 */
@@ -54,6 +64,7 @@ INT manual_trigger_event_id = 0;        /* set from the manual_trigger callback
 static INT frontend_index = -1;        /* frontend index for event building */
 INT verbosity_level = 0;        /* can be used by user code for debugging output */
 BOOL lockout_readout_thread = TRUE; /* manual triggers, periodic events and 1Hz flush cache lockout the readout thread */
+INT poll_backoff_max = 0;       /* max. sleep in ms between polls of an idle EQ_POLLED equipment, 0 for calibrated busy polling */
 BOOL mfe_debug = FALSE;
 
 HNDLE hDB = 0;
@@ -561,6 +572,7 @@ static INT register_equipment(void) {
       eq_stats->events_sent = 0;
       eq_stats->events_per_sec = 0;
       eq_stats->kbytes_per_sec = 0;
+      eq_stats->readback_time = 0;
 
       /* open hot link to statistics tree */
       status = db_open_record1(hDB, hKey, eq_stats, sizeof(EQUIPMENT_STATS), MODE_WRITE, NULL, NULL, EQUIPMENT_STATISTICS_STR);
@@ -695,40 +707,47 @@ static INT initialize_equipment(void) {
          } else
             polled_eq = &equipment[idx];
 
-         if (display_period)
-            printf("\nCalibrating");
-
-         count = 1;
-         do {
+         /* with poll_backoff_max > 0 (set by the frontend) the scheduler backs
+            off when the equipment is idle, a busy-polling count which fills
+            the period is not needed */
+         if ((eq_info->eq_type & EQ_POLLED) && poll_backoff_max > 0) {
+            equipment[idx].poll_count = 1;
+         } else {
             if (display_period)
-               printf(".");
+               printf("\nCalibrating");
 
-            start_time = ss_millitime();
+            count = 1;
+            do {
+               if (display_period)
+                  printf(".");
 
-            poll_event(equipment[idx].info.source, (INT) count, TRUE);
+               start_time = ss_millitime();
 
-            delta_time = ss_millitime() - start_time;
+               poll_event(equipment[idx].info.source, (INT) count, TRUE);
 
-            if (count == 1 && delta_time > eq_info->period * 1.2) {
-               cm_msg(MERROR, "register_equipment", "Polling routine with count=1 takes %d ms", delta_time);
-               ss_sleep(3000);
-               break;
-            }
+               delta_time = ss_millitime() - start_time;
 
-            if (delta_time > 0)
-               count = count * eq_info->period / delta_time;
-            else
-               count *= 100;
+               if (count == 1 && delta_time > eq_info->period * 1.2) {
+                  cm_msg(MERROR, "register_equipment", "Polling routine with count=1 takes %d ms", delta_time);
+                  ss_sleep(3000);
+                  break;
+               }
 
-            // avoid overflows
-            if (count > 2147483647.0) {
-               count = 2147483647.0;
-               break;
-            }
+               if (delta_time > 0)
+                  count = count * eq_info->period / delta_time;
+               else
+                  count *= 100;
+
+               // avoid overflows
+               if (count > 2147483647.0) {
+                  count = 2147483647.0;
+                  break;
+               }
 
-         } while (delta_time > eq_info->period * 1.2 || delta_time < eq_info->period * 0.8);
+            } while (delta_time > eq_info->period * 1.2 || delta_time < eq_info->period * 0.8);
 
-         equipment[idx].poll_count = (INT) count;
+            equipment[idx].poll_count = (INT) count;
+         }
       }
 
       /*---- initialize multithread events -------------------------*/
@@ -909,6 +928,24 @@ int set_equipment_status(const char *name, const char *equipment_status, const c
 
 /*------------------------------------------------------------------*/
 
+static double get_readback_time(const EQUIPMENT *eq) {
+   /* slowest full readout cycle of all multithreaded devices of a slow control equipment */
+   double t = 0;
+
+   if (!(eq->info.eq_type & EQ_SLOW) || eq->driver == NULL)
+      return 0;
+
+   for (int i = 0; eq->driver[i].dd != NULL; i++) {
+      const DEVICE_DRIVER *drv = &eq->driver[i];
+      if ((drv->flags & DF_MULTITHREAD) && drv->mt_buffer != NULL)
+         t = MAX(t, drv->mt_buffer->readback_time);
+   }
+
+   return t;
+}
+
+/*------------------------------------------------------------------*/
+
 static void update_odb(const EVENT_HEADER *pevent, HNDLE hKey, INT format) {
    cm_write_event_to_odb(hDB, hKey, pevent, format);
 }
@@ -1139,6 +1176,9 @@ static void interrupt_routine(void) {
          /* put event into ring buffer */
          rb_increment_wp(get_event_rbh(0), sizeof(EVENT_HEADER) + pevent->data_size);
 
+         /* let the scheduler pick it up now */
+         mfe_wakeup();
+
       } else
          interrupt_eq->serial_number--;
    }
@@ -1182,6 +1222,132 @@ void signal_readout_thread_active(int index, int flag) {
    readout_thread_active[index] = flag;
 }
 
+/*-- Event-driven wakeup of the scheduler ---------------------------*/
+
+/* The scheduler sleeps in cm_yield() when it has nothing to do. mfe_wakeup()
+   sends a message to its IPC socket, which ends the cm_yield() right away.
+   Only one message is sent per scheduler pass. */
+
+static INT _wakeup_port = 0;
+static std::atomic<int> _wakeup_pending(0);
+
+void mfe_wakeup() {
+   if (_wakeup_port && !_wakeup_pending.exchange(1))
+      ss_resume(_wakeup_port, "W");
+}
+
+#ifdef OS_LINUX
+
+/* File descriptors registered with mfe_add_poll_fd() are watched by a helper
+   thread with epoll. Each descriptor is armed one-shot and re-armed by the
+   scheduler before it polls the hardware, so a readable descriptor wakes up
+   the scheduler once per pass instead of flooding it. */
+
+static int _epoll_fd = -1;
+static std::thread* _poll_fd_thread = NULL;
+static std::mutex _poll_fd_mutex;
+static std::vector<int> _poll_fd_fired;
+static std::atomic<int> _poll_fd_nfired(0);
+
+static void poll_fd_thread() {
+   struct epoll_event ev[16];
+
+   while (!stop_all_threads) {
+      int n = epoll_wait(_epoll_fd, ev, 16, 100);
+      if (n <= 0)
+         continue;
+
+      {
+         std::lock_guard<std::mutex> lock(_poll_fd_mutex);
+         for (int i = 0; i < n; i++)
+            _poll_fd_fired.push_back(ev[i].data.fd);
+         _poll_fd_nfired = _poll_fd_fired.size();
+      }
+
+      mfe_wakeup();
+   }
+}
+
+static void poll_fd_rearm() {
+   if (_poll_fd_nfired == 0)
+      return;
+
+   std::vector<int> fired;
+   {
+      std::lock_guard<std::mutex> lock(_poll_fd_mutex);
+      fired.swap(_poll_fd_fired);
+      _poll_fd_nfired = 0;
+   }
+
+   for (unsigned i = 0; i < fired.size(); i++) {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLONESHOT;
+      ev.data.fd = fired[i];
+      epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fired[i], &ev);
+   }
+}
+
+static void poll_fd_stop() {
+   if (_poll_fd_thread) {
+      _poll_fd_thread->join();
+      delete _poll_fd_thread;
+      _poll_fd_thread = NULL;
+   }
+   if (_epoll_fd >= 0) {
+      close(_epoll_fd);
+      _epoll_fd = -1;
+   }
+}
+
+#else
+
+static void poll_fd_rearm() {}
+static void poll_fd_stop() {}
+
+#endif
+
+INT mfe_add_poll_fd(int fd) {
+#ifdef OS_LINUX
+   if (_epoll_fd < 0) {
+      _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      if (_epoll_fd < 0) {
+         cm_msg(MERROR, "mfe_add_poll_fd", "epoll_create1() failed, errno %d (%s)", errno, strerror(errno));
+         return FE_ERR_DRIVER;
+      }
+   }
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLONESHOT;
+   ev.data.fd = fd;
+   if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      cm_msg(MERROR, "mfe_add_poll_fd", "epoll_ctl(%d) failed, errno %d (%s)", fd, errno, strerror(errno));
+      return FE_ERR_DRIVER;
+   }
+
+   if (!_poll_fd_thread)
+      _poll_fd_thread = new std::thread(poll_fd_thread);
+
+   return FE_SUCCESS;
+#else
+   cm_msg(MERROR, "mfe_add_poll_fd", "Waiting on file descriptors is not supported on this platform");
+   return FE_ERR_DRIVER;
+#endif
+}
+
+INT mfe_remove_poll_fd(int fd) {
+#ifdef OS_LINUX
+   if (_epoll_fd < 0)
+      return FE_SUCCESS;
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+#endif
+   return FE_SUCCESS;
+}
+
 /*------------------------------------------------------------------*/
 
 static int _readout_thread(void *param) {
@@ -1349,7 +1515,7 @@ static int flush_user_events() {
    for (int idx = 0; equipment[idx].name[0]; idx++) {
       EQUIPMENT *eq = &equipment[idx];
 
-      if (eq->info.eq_type == EQ_USER) {
+      if (eq->info.eq_type & EQ_USER) {
          for (index = 0; get_event_rbh(index); index++) {
             do {
                status = rb_get_rp(get_event_rbh(index), &p, 10);
@@ -1819,6 +1985,10 @@ static INT scheduler() {
    INT opt_max = 0, opt_index = 0, opt_tcp_size = 128, opt_cnt = 0;
    INT err;
 
+   /* time in ms until the next periodic event is due, and polling back-off */
+   INT periodic_wait, poll_idle = 0, poll_backoff = 0;
+   BOOL polled_idle;
+
 #ifdef OS_VXWORKS
    rpc_set_opt_tcp_size(1024);
 #ifdef PPCxxx
@@ -1830,10 +2000,20 @@ static INT scheduler() {
 
    last_time_rate = ss_millitime();
 
+   /* port for mfe_wakeup() from interrupt routines and helper threads */
+   ss_suspend_get_buffer_port(ss_gettid(), &_wakeup_port);
+
    do {
       actual_millitime = ss_millitime();
       actual_time = ss_time();
 
+      /* wakeups from here on end the next cm_yield() */
+      _wakeup_pending = 0;
+      poll_fd_rearm();
+
+      periodic_wait = 100000;
+      polled_idle = FALSE;
+
       /*---- loop over equipment table -------------------------------*/
       for (idx = 0;; idx++) {
          eq = &equipment[idx];
@@ -1891,6 +2071,10 @@ static INT scheduler() {
                if (old_flag)
                   readout_enable(TRUE);
             }
+
+            /* keep track of the earliest deadline */
+            INT wait = (INT) (eq->last_called + eq_info->period - actual_millitime);
+            periodic_wait = MIN(periodic_wait, MAX(wait, 0));
          }
 
          /*---- check polled events ----*/
@@ -2087,6 +2271,9 @@ static INT scheduler() {
                if (eq_info->event_limit > 0 && eq->stats.events_sent + eq->events_sent >= eq_info->event_limit)
                   break;
             }
+
+            if (pevent == NULL)
+               polled_idle = TRUE;
          }
 
          /*---- send interrupt events ----*/
@@ -2215,6 +2402,8 @@ static INT scheduler() {
 
                e = eq->bytes_sent / 1000.0 / ((actual_millitime - last_time_rate) / 1000.0);
                eq->stats.kbytes_per_sec = ((int)(e * 1000 + 0.5)) / 1000.0;
+
+               eq->stats.readback_time = get_readback_time(eq);
                
                if ((INT) eq->bytes_sent > max_bytes_per_sec)
                   max_bytes_per_sec = (INT) eq->bytes_sent;
@@ -2353,13 +2542,28 @@ static INT scheduler() {
          }
       }
 
+      /*---- adapt polling of idle polled equipment -----------------*/
+      if (poll_backoff_max > 0) {
+         if (!polled_idle) {
+            poll_idle = 0;
+            poll_backoff = 0;
+         } else if (++poll_idle > POLL_IDLE_SPIN) {
+            poll_backoff = poll_backoff ? MIN(2 * poll_backoff, poll_backoff_max) : 1;
+         }
+      }
+
       /*---- check network messages ----------------------------------*/
       if ((run_state == STATE_RUNNING && interrupt_eq == NULL) || slowcont_eq || frontend_call_loop) {
 
          /* yield 10 ms if no polled equipment present */
          if (polled_eq == NULL && !slowcont_eq && !frontend_call_loop)
-            status = cm_yield(10);
-         else {
+            status = cm_yield(MIN(10, periodic_wait));
+         else if (poll_backoff > 0) {
+            /* polled equipment is idle: sleep until the next poll,
+               a mfe_wakeup() or the next periodic event */
+            status = cm_yield(MIN(poll_backoff, periodic_wait));
+            last_time_network = actual_millitime;
+         } else {
             /* only call yield once every 10ms when running */
             if (actual_millitime - last_time_network > 10) {
                status = cm_yield(0);
@@ -2368,9 +2572,9 @@ static INT scheduler() {
                status = RPC_SUCCESS;
          }
       } else
-         /* when run is stopped or interrupts used,
-            call yield with 100ms timeout */
-         status = cm_yield(100);
+         /* when run is stopped or interrupts used, call yield with 100ms
+            timeout, interrupt events end it early through mfe_wakeup() */
+         status = cm_yield(MIN(100, periodic_wait));
 
       /* exit for VxWorks */
       if (fe_stop)
@@ -2728,6 +2932,7 @@ int main(int argc, char *argv[])
 
    /* stop readout thread */
    stop_readout_threads();
+   poll_fd_stop();
    rb_set_nonblocking();
    while (is_readout_thread_active()) {
       flush_user_events();
@@ -18,15 +18,19 @@
 #include <assert.h>
 #include <signal.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 
 #ifndef HAVE_STRLCPY
 #include "strlcpy.h"
 #endif
 
+#include "mlz4frame.h"
+
 #include <mutex>
 #include <deque>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
 #include <algorithm>
 
 /**dox***************************************************************/
@@ -654,6 +658,163 @@ INT cm_set_msg_print(INT system_mask, INT user_mask, int (*func)(const char *))
    return BM_SUCCESS;
 }
 
+/********************************************************************/
+/* Message log index.
+ *
+ * For every message written to a log file, cm_msg_log() appends
+ * a (time, offset) record to the sidecar file "<logfile>.idx".
+ * cm_msg_retrieve1() uses it to locate the part of the log file
+ * holding the requested messages instead of reading and parsing
+ * the whole tail of the file. Records are appended in write order,
+ * with concurrent writers time stamps may be slightly out of
+ * order, this is absorbed by reading a few extra records. */
+
+typedef struct {
+   INT64 time;                  // time of the message, seconds
+   INT64 offset;                // offset of the message in the log file
+} MSG_INDEX_ENTRY;
+
+static std::string cm_msg_index_filename(const std::string& logfile) {
+   return logfile + ".idx";
+}
+
+static void cm_msg_index_append(const std::string& logfile, time_t t, off_t offset) {
+   int flags = O_WRONLY | O_CREAT | O_APPEND | O_LARGEFILE | O_BINARY;
+
+   // first message in a new log file, discard stale index of a previous file
+   if (offset == 0)
+      flags |= O_TRUNC;
+
+   int fh = open(cm_msg_index_filename(logfile).c_str(), flags, 0644);
+   if (fh < 0)
+      return;
+
+   MSG_INDEX_ENTRY e;
+   e.time = t;
+   e.offset = offset;
+
+   /* atomic write, no need to take a semaphore */
+   ssize_t wr = write(fh, &e, sizeof(e));
+   if (wr != sizeof(e)) {
+      fprintf(stderr, "cm_msg_log: Cannot write message index \"%s\", write() returned %d, errno %d (%s)\n", cm_msg_index_filename(logfile).c_str(), (int)wr, errno, strerror(errno));
+   }
+
+   close(fh);
+}
+
+static bool cm_msg_index_read(int fh, INT64 i, MSG_INDEX_ENTRY* e) {
+   if (lseek(fh, i * sizeof(MSG_INDEX_ENTRY), SEEK_SET) < 0)
+      return false;
+   return read(fh, e, sizeof(MSG_INDEX_ENTRY)) == sizeof(MSG_INDEX_ENTRY);
+}
+
+/* Find the range [*start, *end) of the log file which contains the
+ * messages requested from cm_msg_retrieve1(). Returns false if there
+ * is no usable index, in which case the caller has to scan the file. */
+static bool cm_msg_index_lookup(const char *logfile, off_t logsize, time_t t, INT n_messages, off_t *start, off_t *end) {
+   int fh = open(cm_msg_index_filename(logfile).c_str(), O_RDONLY | O_BINARY, 0644);
+   if (fh < 0)
+      return false;
+
+   struct stat stat_buf;
+   fstat(fh, &stat_buf);
+   INT64 n = stat_buf.st_size / sizeof(MSG_INDEX_ENTRY);
+
+   MSG_INDEX_ENTRY first, last;
+   if (n < 1 || !cm_msg_index_read(fh, 0, &first) || !cm_msg_index_read(fh, n - 1, &last)) {
+      close(fh);
+      return false;
+   }
+
+   // index must not be stale: the log file was truncated or replaced,
+   // or messages were written without updating the index
+   if (last.offset >= logsize || first.offset < 0) {
+      close(fh);
+      return false;
+   }
+
+   // number of extra index records to read around the requested
+   // range to cover time stamps written out of order
+   const INT64 slack = 16;
+
+   // binary search for the first record with time > t, for
+   // new messages (n_messages == 0) with time >= t
+   INT64 lo = 0;
+   INT64 hi = n;
+   if (t != 0) {
+      while (lo < hi) {
+         INT64 mid = lo + (hi - lo) / 2;
+         MSG_INDEX_ENTRY e;
+         if (!cm_msg_index_read(fh, mid, &e)) {
+            close(fh);
+            return false;
+         }
+         if (n_messages == 0 ? (e.time < t) : (e.time <= t))
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+   } else {
+      lo = n;
+   }
+
+   INT64 istart, iend;
+
+   if (n_messages == 0) {
+      // new messages since time t, read until the end of the file
+      istart = lo - slack;
+      iend = n;
+   } else {
+      // n_messages before and including time t. Messages with the
+      // same time stamp as the oldest one are also returned, take
+      // all of them plus a few more.
+      istart = lo - n_messages - slack;
+      iend = lo + slack;
+      if (istart > 0) {
+         MSG_INDEX_ENTRY e, p;
+         if (!cm_msg_index_read(fh, istart, &e)) {
+            close(fh);
+            return false;
+         }
+         while (istart > 0 && cm_msg_index_read(fh, istart - 1, &p) && p.time >= e.time)
+            istart--;
+      }
+   }
+
+   if (istart < 0)
+      istart = 0;
+
+   if (istart == 0) {
+      // messages written before the index was created are not indexed
+      *start = 0;
+   } else {
+      MSG_INDEX_ENTRY e;
+      if (!cm_msg_index_read(fh, istart, &e)) {
+         close(fh);
+         return false;
+      }
+      *start = e.offset;
+   }
+
+   if (iend >= n) {
+      *end = logsize;
+   } else {
+      MSG_INDEX_ENTRY e;
+      if (!cm_msg_index_read(fh, iend, &e)) {
+         close(fh);
+         return false;
+      }
+      *end = e.offset;
+   }
+
+   close(fh);
+
+   if (*start > *end || *end > logsize)
+      return false;
+
+   return true;
+}
+
 /********************************************************************/
 /**
 Write message to logging file. Called by cm_msg.
@@ -740,6 +901,11 @@ INT cm_msg_log(INT message_type, const char *facility, const char *message) {
             fprintf(stderr, "cm_msg_log: Message \"%s\" not written to \"%s\", write() error, errno %d (%s)\n", message, filename.c_str(), errno, strerror(errno));
          } else if (wr != len) {
             fprintf(stderr, "cm_msg_log: Message \"%s\" not written to \"%s\", short write() wrote %d instead of %d bytes\n", message, filename.c_str(), (int)wr, (int)len);
+         } else {
+            /* with O_APPEND, file position is at the end of our own message */
+            off_t pos = lseek(fh, 0, SEEK_CUR);
+            if (pos >= len)
+               cm_msg_index_append(filename, tv.tv_sec, pos - len);
          }
 
          close(fh);
@@ -1114,13 +1280,26 @@ static int cm_msg_retrieve1(const char *filename, time_t t, INT n_messages, char
       return SS_FILE_ERROR;
    }
 
-   /* read whole file into memory */
    fstat(fh, &stat_buf);
    ssize_t size = stat_buf.st_size;
 
    /* if file is too big, only read tail of file */
    ssize_t maxsize = 10 * 1024 * 1024;
-   if (size > maxsize) {
+
+   off_t start, end;
+   if (cm_msg_index_lookup(filename, stat_buf.st_size, t, n_messages, &start, &end)) {
+      /* read only the part of the file given by the index */
+      size = end - start;
+      if (size > maxsize) {
+         start = end - maxsize;
+         size = maxsize;
+      }
+      if (size == 0) {
+         close(fh);
+         return CM_SUCCESS;
+      }
+      lseek(fh, start, SEEK_SET);
+   } else if (size > maxsize) {
       lseek(fh, -maxsize, SEEK_END);
       //printf("lseek status %d, errno %d (%s)\n", status, errno, strerror(errno));
       size = maxsize;
@@ -2548,6 +2727,25 @@ INT cm_connect_experiment1(const char *host_name, const char *default_exp_name,
    db_get_value(hDB, 0, str, &watchdog_timeout, &size, TID_INT32, TRUE);
    cm_set_watchdog_params(call_watchdog, watchdog_timeout);
 
+   /* compress event stream to mserver or use several event streams if
+      requested, the keys are not created, so that /Programs does not
+      fill up with remote clients */
+   if (rpc_is_remote()) {
+      BOOL event_compression = FALSE;
+      size = sizeof(event_compression);
+      sprintf(str, "/Programs/%s/Event compression", client_name);
+      db_get_value(hDB, 0, str, &event_compression, &size, TID_BOOL, FALSE);
+      if (event_compression)
+         rpc_set_event_compression(TRUE);
+
+      INT event_streams = 0;
+      size = sizeof(event_streams);
+      sprintf(str, "/Programs/%s/Event streams", client_name);
+      db_get_value(hDB, 0, str, &event_streams, &size, TID_INT32, FALSE);
+      if (event_streams > 0)
+         rpc_set_event_streams(event_streams, TRUE);
+   }
+
    /* get final client name */
    std::string xclient_name = rpc_get_name();
 
@@ -5577,6 +5775,8 @@ Programs that do not use cm_yield(), i.e. the mserver,
 should call this function periodically, every 1 or 2 seconds.
 @return CM_SUCCESS
 */
+static void rpc_write_event_statistics_to_odb();
+
 INT cm_periodic_tasks() {
    static DWORD alarm_last_checked_sec = 0;
    DWORD now_sec = ss_time();
@@ -5615,6 +5815,17 @@ INT cm_periodic_tasks() {
       db_cleanup("cm_periodic_tasks", now_millitime, wrong_interval);
 
       bm_write_statistics_to_odb();
+      rpc_write_event_statistics_to_odb();
+
+      if (!rpc_is_remote()) {
+         /* flush the pages of the ODB modified by this process to its binary file.
+            For remote clients, this is done by their mserver process, which
+            makes the modifications and calls this from rpc_server_loop() */
+         HNDLE hDB;
+         cm_get_experiment_database(&hDB, NULL);
+         if (hDB)
+            db_flush_database(hDB);
+      }
 
       last_millitime = now_millitime;
    }
@@ -5654,14 +5865,6 @@ INT cm_yield(INT millisec) {
    /* flush the cm_msg buffer */
    cm_msg_flush_buffer();
 
-   if (!rpc_is_remote()) {
-      /* flush the ODB to its binary file */
-      /* for remote clients, ODB is flushed by the mserver */
-      HNDLE hDB;
-      cm_get_experiment_database(&hDB, NULL);
-      db_flush_database(hDB);
-   }
-
    /* check for available events */
    if (rpc_is_remote()) {
       //printf("cm_yield() calling bm_poll_event()\n");
@@ -5914,8 +6117,46 @@ std::string cm_get_history_path(const char* history_channel)
 
 static DWORD _bm_max_event_size = 0;
 
+// fill the buffer latency histograms, see bm_enable_histograms()
+static std::atomic_bool _bm_histograms{false};
+
 #ifdef LOCAL_ROUTINES
 
+/* USDT probes "midas:lock_wait", "midas:space_wait", "midas:wakeup" and "midas:copy"
+ * for perf, bpftrace & co, arguments are the buffer name and the histogram value.
+ * The probes fire whether or not the histograms are enabled. The semaphores are
+ * set by the tracer when it attaches, BM_PROBE_ENABLED() lets the lock path skip
+ * taking timestamps nobody looks at. */
+#ifdef HAVE_SDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+unsigned short midas_lock_wait_semaphore __attribute__((unused)) __attribute__((section(".probes")));
+unsigned short midas_space_wait_semaphore __attribute__((unused)) __attribute__((section(".probes")));
+unsigned short midas_wakeup_semaphore __attribute__((unused)) __attribute__((section(".probes")));
+unsigned short midas_copy_semaphore __attribute__((unused)) __attribute__((section(".probes")));
+#define BM_PROBE(name, buffer_name, value) DTRACE_PROBE2(midas, name, buffer_name, value)
+#define BM_PROBE_ENABLED(name) (midas_##name##_semaphore != 0)
+#else
+#define BM_PROBE(name, buffer_name, value)
+#define BM_PROBE_ENABLED(name) false
+#endif
+
+static void bm_histogram_fill(BUFFER *pbuf, int ihisto, DWORD value)
+{
+   // NB: the buffer must be locked, histograms are protected by the buffer mutex
+   BM_HISTOGRAM *h = &pbuf->histo[ihisto];
+
+   int bin = 0;
+   while (bin < BM_HISTOGRAM_BINS - 1 && (value >> bin))
+      bin++;
+
+   h->bins[bin]++;
+   h->entries++;
+   h->sum += value;
+   if (value > h->max)
+      h->max = value;
+}
+
 // see locking code in xbm_lock_buffer()
 static int _bm_lock_timeout = 5 * 60 * 1000;
 static double _bm_mutex_timeout_sec = _bm_lock_timeout/1000 + 15.000;
@@ -6405,6 +6646,7 @@ struct BUFFER_INFO
    double bytes_read = 0;             /**< count how many bytes we read */
    int client_count_write_wait[MAX_CLIENTS]; /**< per-client count_write_wait */
    DWORD client_time_write_wait[MAX_CLIENTS]; /**< per-client time_write_wait */
+   BM_HISTOGRAM histo[BM_HISTO_MAX];  /**< latency histograms */
 
    BUFFER_INFO(BUFFER* pbuf)
    {
@@ -6427,6 +6669,8 @@ struct BUFFER_INFO
          client_count_write_wait[i] = pbuf->client_count_write_wait[i];
          client_time_write_wait[i] = pbuf->client_time_write_wait[i];
       }
+
+      memcpy(histo, pbuf->histo, sizeof(histo));
    };
 };
 
@@ -6548,6 +6792,21 @@ static void bm_write_buffer_statistics_to_odb_copy(HNDLE hDB, const char* buffer
       db_set_value(hDB, hKeyClient, str, &pbuf->client_time_write_wait[i], sizeof(DWORD), 1, TID_UINT32);
    }
 
+   if (_bm_histograms) {
+      static const char* const histo_names[BM_HISTO_MAX] = { "lock_wait_usec", "space_wait_usec", "wakeup_usec", "copy_bytes" };
+
+      for (int i = 0; i < BM_HISTO_MAX; i++) {
+         const BM_HISTOGRAM *h = &pbuf->histo[i];
+         double mean = h->entries ? h->sum / h->entries : 0;
+         std::string path = std::string("histograms/") + histo_names[i];
+
+         db_set_value(hDB, hKeyClient, (path + "/entries").c_str(), &h->entries, sizeof(DWORD), 1, TID_UINT32);
+         db_set_value(hDB, hKeyClient, (path + "/mean").c_str(), &mean, sizeof(double), 1, TID_DOUBLE);
+         db_set_value(hDB, hKeyClient, (path + "/max").c_str(), &h->max, sizeof(DWORD), 1, TID_UINT32);
+         db_set_value(hDB, hKeyClient, (path + "/bins").c_str(), h->bins, sizeof(h->bins), BM_HISTOGRAM_BINS, TID_UINT32);
+      }
+   }
+
    db_set_value(hDB, hKeyBuffer, "Last updated", &now, sizeof(DWORD), 1, TID_UINT32);
    db_set_value(hDB, hKeyClient, "last_updated", &now, sizeof(DWORD), 1, TID_UINT32);
 }
@@ -6761,6 +7020,13 @@ INT bm_open_buffer(const char *buffer_name, INT buffer_size, INT *buffer_handle)
          return status;
       }
 
+      /* latency histograms can be enabled for all clients in ODB */
+      BOOL histograms = FALSE;
+      size = sizeof(BOOL);
+      status = db_get_value(hDB, 0, "/Experiment/Buffer histograms", &histograms, &size, TID_BOOL, FALSE);
+      if (status == DB_SUCCESS && histograms)
+         _bm_histograms = true;
+
       /* check if buffer already is open */
       gBuffersMutex.lock();
       for (size_t i = 0; i < gBuffers.size(); i++) {
@@ -6804,6 +7070,8 @@ INT bm_open_buffer(const char *buffer_name, INT buffer_size, INT *buffer_handle)
          pbuf->client_time_write_wait[i] = 0;
       }
 
+      memset(pbuf->histo, 0, sizeof(pbuf->histo));
+
       /* create buffer semaphore */
 
       status = ss_semaphore_create(buffer_name, &(pbuf->semaphore));
@@ -7276,6 +7544,61 @@ INT bm_write_statistics_to_odb(void) {
    return BM_SUCCESS;
 }
 
+/********************************************************************/
+/**
+Enable or disable the latency histograms of all buffers of this process:
+time to lock the buffer, time waiting for free space, wake-up latency
+and bytes copied per buffer lock. They are also enabled by ODB
+"/Experiment/Buffer histograms" when a buffer is opened. The histograms
+are written to /System/Buffers/<buffer>/Clients/<client>/histograms
+together with the buffer statistics (use /History/Links to record
+them in the history), and the values are passed to the USDT probes
+"midas:lock_wait", "midas:space_wait", "midas:wakeup" and "midas:copy"
+if midas was built with sys/sdt.h.
+
+For clients connected through the mserver, the buffers and their
+histograms are in the mserver.
+@param enable TRUE to fill the histograms
+@return BM_SUCCESS
+*/
+INT bm_enable_histograms(BOOL enable)
+{
+   _bm_histograms = enable;
+   return BM_SUCCESS;
+}
+
+/********************************************************************/
+/**
+Get a copy of the latency histograms of a buffer, see bm_enable_histograms().
+@param buffer_handle buffer handle obtained via bm_open_buffer()
+@param histo histograms, indexed by BM_HISTO_xxx
+@return BM_SUCCESS, BM_INVALID_HANDLE, RPC_NOT_REGISTERED for remote clients
+*/
+INT bm_get_histograms(INT buffer_handle, BM_HISTOGRAM histo[BM_HISTO_MAX])
+{
+   if (rpc_is_remote())
+      return RPC_NOT_REGISTERED;
+
+#ifdef LOCAL_ROUTINES
+   {
+      int status = 0;
+      BUFFER *pbuf = bm_get_buffer("bm_get_histograms", buffer_handle, &status);
+
+      if (!pbuf)
+         return status;
+
+      bm_lock_buffer_guard pbuf_guard(pbuf);
+
+      if (!pbuf_guard.is_locked())
+         return pbuf_guard.get_status();
+
+      memcpy(histo, pbuf->histo, sizeof(pbuf->histo));
+   }
+#endif /* LOCAL_ROUTINES */
+
+   return BM_SUCCESS;
+}
+
 /**dox***************************************************************/
 /** @} *//* end of bmfunctionc */
 
@@ -7953,6 +8276,10 @@ static int xbm_lock_buffer(BUFFER *pbuf)
    //   abort();
    //}
 
+   bool histo = _bm_histograms;
+   bool timed = histo || BM_PROBE_ENABLED(lock_wait);
+   DWORD lock_start = timed ? ss_microtime() : 0;
+
    status = bm_lock_buffer_mutex(pbuf);
 
    if (status != BM_SUCCESS)
@@ -8000,6 +8327,13 @@ static int xbm_lock_buffer(BUFFER *pbuf)
 
    pbuf->count_lock++;
 
+   if (timed) {
+      DWORD wait_usec = ss_microtime() - lock_start;
+      if (histo)
+         bm_histogram_fill(pbuf, BM_HISTO_LOCK_WAIT, wait_usec);
+      BM_PROBE(lock_wait, pbuf->buffer_name, wait_usec);
+   }
+
    return BM_SUCCESS;
 }
 
@@ -8756,7 +9090,7 @@ static BOOL bm_update_read_pointer_locked(const char *caller_name, BUFFER_HEADER
    return TRUE;
 }
 
-static void bm_wakeup_producers_locked(const BUFFER_HEADER *pheader, const BUFFER_CLIENT *pc) {
+static void bm_wakeup_producers_locked(BUFFER_HEADER *pheader, const BUFFER_CLIENT *pc) {
    int i;
    int have_get_all_requests = 0;
 
@@ -8780,11 +9114,12 @@ static void bm_wakeup_producers_locked(const BUFFER_HEADER *pheader, const BUFFE
 
    if (free_space >= pheader->size * 0.5) {
       for (i = 0; i < pheader->max_client_index; i++) {
-         const BUFFER_CLIENT *pc = pheader->client + i;
+         BUFFER_CLIENT *pc = pheader->client + i;
          if (pc->pid && pc->write_wait) {
             BOOL send_wakeup = (pc->write_wait < free_space);
             //printf("bm_wakeup_producers: buffer [%s] client [%s] write_wait %d, free_space %d, sending wakeup message %d\n", pheader->name, pc->name, pc->write_wait, free_space, send_wakeup);
             if (send_wakeup) {
+               pc->wakeup_time = ss_microtime();
                ss_resume(pc->port, "B  ");
             }
          }
@@ -8961,6 +9296,22 @@ static BOOL bm_check_requests(const BUFFER_CLIENT *pc, const EVENT_HEADER *peven
 
 static int bm_wait_for_more_events_locked(bm_lock_buffer_guard& pbuf_guard, BUFFER_CLIENT *pc, int timeout_msec, BOOL unlock_read_cache);
 
+static void bm_wakeup_latency_locked(BUFFER *pbuf, BUFFER_CLIENT *pc, DWORD wakeup_usec)
+{
+   // pc->wakeup_time is set by the client that sent us the wake-up message,
+   // it is cleared before we go to sleep. A message sent after we woke up
+   // by timeout gives a negative latency and is not counted.
+   if (pc->wakeup_time) {
+      int latency = wakeup_usec - pc->wakeup_time;
+      if (latency >= 0) {
+         if (_bm_histograms)
+            bm_histogram_fill(pbuf, BM_HISTO_WAKEUP, latency);
+         BM_PROBE(wakeup, pbuf->buffer_name, latency);
+      }
+      pc->wakeup_time = 0;
+   }
+}
+
 static int bm_fill_read_cache_locked(bm_lock_buffer_guard& pbuf_guard, int timeout_msec)
 {
    BUFFER* pbuf = pbuf_guard.get_pbuf();
@@ -9099,6 +9450,14 @@ static int bm_wait_for_free_space_locked(bm_lock_buffer_guard& pbuf_guard, int t
             //   printf("blocking client \"%s\", time %d ms, loops %d\n", blocking_client_name, wait_time, blocking_loops);
             //}
 
+            if (pbuf->wait_start_usec != 0) {
+               DWORD wait_usec = ss_microtime() - pbuf->wait_start_usec;
+               pbuf->wait_start_usec = 0;
+               if (_bm_histograms)
+                  bm_histogram_fill(pbuf, BM_HISTO_SPACE_WAIT, wait_usec);
+               BM_PROBE(space_wait, pbuf->buffer_name, wait_usec);
+            }
+
             if (pbuf->wait_start_time != 0) {
                DWORD now = ss_millitime();
                DWORD wait_time = now - pbuf->wait_start_time;
@@ -9234,6 +9593,7 @@ static int bm_wait_for_free_space_locked(bm_lock_buffer_guard& pbuf_guard, int t
 
       if (pbuf->wait_start_time == 0) {
          pbuf->wait_start_time = ss_millitime();
+         pbuf->wait_start_usec = ss_microtime();
          pbuf->count_write_wait++;
          if (requested_space > pbuf->max_requested_space)
             pbuf->max_requested_space = requested_space;
@@ -9269,6 +9629,8 @@ static int bm_wait_for_free_space_locked(bm_lock_buffer_guard& pbuf_guard, int t
 
       ss_suspend_get_buffer_port(ss_gettid(), &pc->port);
 
+      pc->wakeup_time = 0;
+
       /* before waiting, unlock everything in the correct order */
 
       pbuf_guard.unlock();
@@ -9291,6 +9653,8 @@ static int bm_wait_for_free_space_locked(bm_lock_buffer_guard& pbuf_guard, int t
 
       status = ss_suspend(sleep_time_msec, MSG_BM);
 
+      DWORD wakeup_usec = ss_microtime();
+
       /* we are told to shutdown */
       if (status == SS_ABORT) {
          // NB: buffer is locked!
@@ -9345,6 +9709,8 @@ static int bm_wait_for_free_space_locked(bm_lock_buffer_guard& pbuf_guard, int t
 
       pc->write_wait = 0;
 
+      bm_wakeup_latency_locked(pbuf, pc, wakeup_usec);
+
       ///* validate client index: we could have been removed from the buffer */
       //idx = bm_validate_client_index(pbuf, FALSE);
       //if (idx >= 0)
@@ -9408,6 +9774,8 @@ static int bm_wait_for_more_events_locked(bm_lock_buffer_guard& pbuf_guard, BUFF
 
       ss_suspend_get_buffer_port(ss_gettid(), &pc->port);
 
+      pc->wakeup_time = 0;
+
       // NB: locking order is: 1st read cache lock, 2nd buffer lock, unlock in reverse order
 
       pbuf_guard.unlock();
@@ -9417,6 +9785,8 @@ static int bm_wait_for_more_events_locked(bm_lock_buffer_guard& pbuf_guard, BUFF
 
       int status = ss_suspend(sleep_time, MSG_BM);
 
+      DWORD wakeup_usec = ss_microtime();
+
       if (timeout_msec == BM_NO_WAIT) {
          // return immediately
       } else if (timeout_msec == BM_WAIT) {
@@ -9457,6 +9827,8 @@ static int bm_wait_for_more_events_locked(bm_lock_buffer_guard& pbuf_guard, BUFF
        * due to a timeout or whatever. */
       pc = bm_get_my_client(pbuf, pheader);
 
+      bm_wakeup_latency_locked(pbuf, pc, wakeup_usec);
+
       /* return if TCP connection broken */
       if (status == SS_ABORT)
          return SS_ABORT;
@@ -9578,6 +9950,7 @@ static void bm_notify_reader_locked(BUFFER_HEADER *pheader, BUFFER_CLIENT *pc, i
       if (pc->read_wait) {
          char str[80];
          sprintf(str, "B %s %d", pheader->name, request_id);
+         pc->wakeup_time = ss_microtime();
          ss_resume(pc->port, str);
          //printf("bm_notify_reader_locked: buffer [%s] client [%s] request_id %d, port %d, message [%s]\n", pheader->name, pc->name, request_id, pc->port, str);
          //printf("bm_notify_reader_locked: buffer [%s] client [%s] clear read_wait!\n", pheader->name, pc->name);
@@ -9950,6 +10323,10 @@ int bm_send_event_sg(int buffer_handle, int sg_n, const char* const sg_ptr[], co
       pheader->num_in_events++;
       pbuf->count_sent += 1;
       pbuf->bytes_sent += total_size;
+
+      if (_bm_histograms)
+         bm_histogram_fill(pbuf, BM_HISTO_COPY_BYTES, total_size);
+      BM_PROBE(copy, pbuf->buffer_name, total_size);
    }
 #endif                          /* LOCAL_ROUTINES */
 
@@ -9960,6 +10337,11 @@ static int bm_flush_cache_rpc(int buffer_handle, int timeout_msec)
 {
    //printf("bm_flush_cache_rpc: handle %d, timeout %d\n", buffer_handle, timeout_msec);
 
+   /* events still queued for the event socket must reach the mserver first */
+   int flush_status = rpc_flush_event();
+   if (flush_status != RPC_SUCCESS)
+      return flush_status;
+
    DWORD time_start = ss_millitime();
    DWORD time_end = time_start + timeout_msec;
    
@@ -10103,6 +10485,8 @@ static INT bm_flush_cache_locked(bm_lock_buffer_guard& pbuf_guard, int timeout_m
          return BM_SUCCESS;
       }
 
+      size_t copied = 0;
+
       //size_t written = 0;
       while (pbuf->write_cache_rp < pbuf->write_cache_wp) {
          /* loop over all events in cache */
@@ -10133,6 +10517,7 @@ static INT bm_flush_cache_locked(bm_lock_buffer_guard& pbuf_guard, int timeout_m
          pheader->num_in_events++;
          pbuf->count_sent += 1;
          pbuf->bytes_sent += total_size;
+         copied += total_size;
 
          /* see comment for the same code in bm_send_event().
           * We make sure the buffer is never 100% full */
@@ -10164,6 +10549,10 @@ static INT bm_flush_cache_locked(bm_lock_buffer_guard& pbuf_guard, int timeout_m
       pbuf->write_cache_wp = 0;
       pbuf->write_cache_rp = 0;
 
+      if (_bm_histograms)
+         bm_histogram_fill(pbuf, BM_HISTO_COPY_BYTES, copied);
+      BM_PROBE(copy, pbuf->buffer_name, copied);
+
       /* check which clients are waiting */
       for (int i = 0; i < pheader->max_client_index; i++) {
          BUFFER_CLIENT *pc = pheader->client + i;
@@ -10276,6 +10665,13 @@ static INT bm_read_buffer(BUFFER *pbuf, INT buffer_handle, void **bufptr, void *
             return status;
          }
 
+         if (pbuf->read_cache_wp > 0) {
+            // the read cache was empty, all of it was copied now
+            if (_bm_histograms)
+               bm_histogram_fill(pbuf, BM_HISTO_COPY_BYTES, pbuf->read_cache_wp);
+            BM_PROBE(copy, pbuf->buffer_name, pbuf->read_cache_wp);
+         }
+
          // buffer remains locked here
       }
       EVENT_HEADER *pevent;
@@ -10406,6 +10802,10 @@ static INT bm_read_buffer(BUFFER *pbuf, INT buffer_handle, void **bufptr, void *
             pbuf->bytes_read += event_size;
          }
 
+         if (_bm_histograms)
+            bm_histogram_fill(pbuf, BM_HISTO_COPY_BYTES, event_size);
+         BM_PROBE(copy, pbuf->buffer_name, event_size);
+
          int new_read_pointer = bm_incr_rp_no_check(pheader, pc->read_pointer, total_size);
          pc->read_pointer = new_read_pointer;
 
@@ -11469,6 +11869,9 @@ static std::vector<RPC_CLIENT_CONNECTION*> _client_connections;
 
 static RPC_SERVER_CONNECTION _server_connection; // connection to the mserver
 static bool _rpc_is_remote = false;
+static void rpc_event_ring_stop(); // stop event socket sender thread
+struct RPC_EVENT_STREAMS;
+static void rpc_server_event_streams_close(RPC_EVENT_STREAMS* es); // stop mserver event stream threads
    
 //static RPC_SERVER_ACCEPTION _server_acception[MAX_RPC_CONNECTION];
 static std::vector<RPC_SERVER_ACCEPTION*> _server_acceptions;
@@ -11538,6 +11941,16 @@ void RPC_SERVER_ACCEPTION::close()
       net_buffer_size = 0;
    }
 
+   /* stop event stream receivers */
+   if (event_streams)
+      rpc_server_event_streams_close(event_streams);
+
+   /* free LZ4 event decompression */
+   if (lz4_dctx)
+      MLZ4F_freeDecompressionContext((MLZ4F_decompressionContext_t)lz4_dctx);
+   if (lz4_buffer)
+      free(lz4_buffer);
+
    /* mark this entry as invalid */
    clear();
 }
@@ -12572,6 +12985,10 @@ INT rpc_server_connect(const char *host_name, const char *exp_name)
    sscanf(str, "%d", &remote_hw_type);
    _server_connection.remote_hw_type = remote_hw_type;
 
+   /* newer servers announce support for LZ4 compressed event frames and event streams */
+   _server_connection.event_lz4 = (strstr(str, " lz4") != NULL);
+   _server_connection.event_streams = (strstr(str, " streams") != NULL);
+
    ss_suspend_set_client_connection(&_server_connection);
 
    _rpc_is_remote = true;
@@ -12704,6 +13121,7 @@ INT rpc_server_disconnect()
 
    /* flush remaining events */
    rpc_flush_event();
+   rpc_event_ring_stop();
 
    /* notify server about exit */
    if (rpc_is_connected()) {
@@ -13894,120 +14312,778 @@ INT rpc_send_event1(INT buffer_handle, const EVENT_HEADER *pevent)
    return rpc_send_event_sg(buffer_handle, 1, (char**)&pevent, &event_size);
 }
 
-INT rpc_send_event_sg(INT buffer_handle, int sg_n, const char* const sg_ptr[], const size_t sg_len[])
-{
-   if (sg_n < 1) {
-      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_n %d", sg_n);
-      return BM_INVALID_SIZE;
-   }
+/********************************************************************/
 
-   if (sg_ptr[0] == NULL) {
-      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_ptr[0] is NULL");
-      return BM_INVALID_SIZE;
-   }
+/*
+ * Events for the event socket are copied into a ring buffer and written
+ * to the socket by a background thread using writev(), so that many
+ * small events go out with one system call. The sender waits at most
+ * RPC_EVENT_FLUSH_MSEC for RPC_EVENT_BATCH_SIZE bytes to accumulate.
+ * Writers only block if the ring is full. The ring is protected by
+ * _server_connection.event_sock_mutex.
+ *
+ * With compression enabled, whole events are packed into LZ4 frames of
+ * up to RPC_EVENT_LZ4_FRAME_SIZE bytes. A frame starts with the marker
+ * RPC_EVENT_LZ4_FRAME in place of the buffer handle, followed by the
+ * compressed and uncompressed sizes and two reserved words, then the
+ * compressed data padded to 8 bytes. The mserver decompresses the frame
+ * and handles the events inside as if they were sent one by one.
+ *
+ * With event streams enabled (rpc_set_event_streams()), the mserver
+ * connects back to the client with additional sockets and each socket
+ * gets its own sender thread. Every thread takes the next chunk of whole
+ * events out of the ring and sends it as a frame with the marker
+ * RPC_EVENT_SEQ_FRAME, a sequence number, the compressed and uncompressed
+ * sizes and flags (bit 0: LZ4 compressed). On the mserver side, one
+ * receiver thread per socket writes the events into the buffers; in
+ * ordered mode the frames are written in sequence number order, so the
+ * event order in the buffer is the same as with a single socket.
+ */
 
-   if (sg_len[0] < sizeof(EVENT_HEADER)) {
-      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_len[0] value %d is smaller than event header size %d", (int)sg_len[0], (int)sizeof(EVENT_HEADER));
-      return BM_INVALID_SIZE;
-   }
+#define RPC_EVENT_RING_SIZE   (8*1024*1024)
+#define RPC_EVENT_BATCH_SIZE  (256*1024)
+#define RPC_EVENT_FLUSH_MSEC  10
 
-   const EVENT_HEADER* pevent = (const EVENT_HEADER*)sg_ptr[0];
-   
-   const DWORD MAX_DATA_SIZE = (0x7FFFFFF0 - 16); // event size computations are not 32-bit clean, limit event size to 2GB. K.O.
-   const DWORD data_size = pevent->data_size; // 32-bit unsigned value
+#define RPC_EVENT_LZ4_FRAME      0x345A4C80   // never a valid buffer handle
+#define RPC_EVENT_LZ4_FRAME_SIZE (1024*1024)
 
-   if (data_size == 0) {
-      cm_msg(MERROR, "rpc_send_event_sg", "invalid event data size zero");
-      return BM_INVALID_SIZE;
-   }
+#define RPC_EVENT_SEQ_FRAME      0x5153454D   // never a valid buffer handle
+#define RPC_EVENT_SEQ_LZ4        0x00000001   // frame flag: data is LZ4 compressed
+#define RPC_EVENT_MAX_STREAMS    16
 
-   if (data_size > MAX_DATA_SIZE) {
-      cm_msg(MERROR, "rpc_send_event_sg", "invalid event data size %d (0x%x) maximum is %d (0x%x)", data_size, data_size, MAX_DATA_SIZE, MAX_DATA_SIZE);
-      return BM_INVALID_SIZE;
-   }
+struct RPC_EVENT_RING {
+   char* buf = NULL;
+   size_t size = 0;
+   size_t rp = 0;                       // next byte to send
+   size_t wp = 0;                       // next byte to fill
+   size_t used = 0;                     // bytes queued, including bytes being sent
+   DWORD first_time = 0;                // ss_millitime() of oldest unsent byte
+   int flush = 0;                       // number of rpc_flush_event() callers waiting
+   bool stop = false;
+   bool compress = false;               // send LZ4 frames
+   double bytes_in = 0;                 // compression statistics
+   double bytes_out = 0;
+   double cpu_time = 0;
+   char* lz4_buf = NULL;                // used only by the sender thread
+   size_t lz4_buf_size = 0;
+   char* lz4_copy = NULL;
+   size_t lz4_copy_size = 0;
+   std::thread* thread = NULL;
+   std::vector<int> stream_socks;       // event stream sockets, empty if not used
+   std::vector<std::thread*> stream_threads;
+   DWORD next_seq = 0;                  // sequence number of next event stream frame
+   int in_flight = 0;                   // frames taken out of the ring, not yet sent
+   std::condition_variable cond_data;   // data queued, flush or stop request
+   std::condition_variable cond_space;  // data sent or socket closed
+};
 
-   const size_t event_size = sizeof(EVENT_HEADER) + data_size;
-   const size_t total_size = ALIGN8(event_size);
+static RPC_EVENT_RING _event_ring;
 
-   size_t count = 0;
-   for (int i=0; i<sg_n; i++) {
-      count += sg_len[i];
-   }
+/* write iovec array to socket, handle partial writes */
+static int rpc_writev_tcp(int sock, struct iovec* iov, int iovcnt)
+{
+   while (iovcnt > 0) {
+      ssize_t wr = writev(sock, iov, std::min(iovcnt, 64));
 
-   if (count != event_size) {
-      cm_msg(MERROR, "rpc_send_event_sg", "data size mismatch: event data_size %d, event_size %d not same as sum of sg_len %d", (int)data_size, (int)event_size, (int)count);
-      return BM_INVALID_SIZE;
-   }
+      if (wr < 0 && errno == EINTR)
+         continue;
 
-   // protect non-atomic access to _server_connection.event_sock. K.O.
-   
-   std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+      if (wr <= 0) {
+         cm_msg(MERROR, "rpc_writev_tcp", "writev(socket=%d) returned %d, errno: %d (%s)", sock, (int)wr, errno, strerror(errno));
+         return SS_SOCKET_ERROR;
+      }
 
-   //printf("rpc_send_event_sg: pevent %p, event_id 0x%04x, serial 0x%08x, data_size %d, event_size %d, total_size %d\n", pevent, pevent->event_id, pevent->serial_number, (int)data_size, (int)event_size, (int)total_size);
+      while (iovcnt > 0 && (size_t)wr >= iov->iov_len) {
+         wr -= iov->iov_len;
+         iov++;
+         iovcnt--;
+      }
 
-   if (_server_connection.event_sock == 0) {
-      return RPC_NO_CONNECTION;
+      if (iovcnt > 0) {
+         iov->iov_base = (char*)iov->iov_base + wr;
+         iov->iov_len -= wr;
+      }
    }
 
-   //
-   // event socket wire protocol: (see also rpc_server_receive_event() and recv_event_server_realloc())
-   //
-   // 4 bytes of buffer handle
-   // 16 bytes of event header, includes data_size
-   // ALIGN8(data_size) bytes of event data
-   // 
+   return SS_SUCCESS;
+}
 
-   int status;
+/* copy data out of the ring starting at pos, handles wrap-around */
+static void rpc_event_ring_get(size_t pos, void* data, size_t len)
+{
+   pos %= _event_ring.size;
+   size_t n1 = std::min(len, _event_ring.size - pos);
+   memcpy(data, _event_ring.buf + pos, n1);
+   if (len > n1)
+      memcpy((char*)data + n1, _event_ring.buf, len - n1);
+}
 
-   /* send buffer handle */
+/* number of bytes of whole events starting at rp to pack into one LZ4 frame */
+static size_t rpc_event_ring_frame_size(size_t rp, size_t used)
+{
+   size_t n = 0;
 
-   assert(sizeof(DWORD) == 4);
-   DWORD bh_buf = buffer_handle;
-   
-   status = ss_write_tcp(_server_connection.event_sock, (const char *) &bh_buf, sizeof(DWORD));
-   if (status != SS_SUCCESS) {
-      ss_socket_close(&_server_connection.event_sock);
-      cm_msg(MERROR, "rpc_send_event_sg", "ss_write_tcp(buffer handle) failed, event socket is now closed");
-      return RPC_NET_ERROR;
+   while (n < used) {
+      EVENT_HEADER header;
+      rpc_event_ring_get(rp + n + sizeof(DWORD), &header, sizeof(EVENT_HEADER));
+      size_t wire_size = sizeof(DWORD) + ALIGN8(sizeof(EVENT_HEADER) + header.data_size);
+      if (n > 0 && n + wire_size > RPC_EVENT_LZ4_FRAME_SIZE)
+         break;
+      n += wire_size;
    }
 
-   /* send data */
+   return n;
+}
 
-   for (int i=0; i<sg_n; i++) {
-      status = ss_write_tcp(_server_connection.event_sock, sg_ptr[i], sg_len[i]);
-      if (status != SS_SUCCESS) {
-         ss_socket_close(&_server_connection.event_sock);
-         cm_msg(MERROR, "rpc_send_event_sg", "ss_write_tcp(event data) failed, event socket is now closed");
-         return RPC_NET_ERROR;
+static double rpc_thread_cpu_time()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* compress n bytes of events and send them as one LZ4 frame */
+static int rpc_send_event_lz4(int sock, struct iovec* iov, int iovcnt, size_t n, size_t* pwire_size, double* pcpu_time)
+{
+   const size_t header_size = 5 * sizeof(DWORD);
+   double start_cpu = rpc_thread_cpu_time();
+
+   const char* src = (const char*)iov[0].iov_base;
+
+   /* events wrap around the end of the ring, compress a contiguous copy */
+   if (iovcnt > 1) {
+      if (_event_ring.lz4_copy_size < n) {
+         free(_event_ring.lz4_copy);
+         _event_ring.lz4_copy = (char*)malloc(n);
+         assert(_event_ring.lz4_copy);
+         _event_ring.lz4_copy_size = n;
       }
+      memcpy(_event_ring.lz4_copy, iov[0].iov_base, iov[0].iov_len);
+      memcpy(_event_ring.lz4_copy + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+      src = _event_ring.lz4_copy;
    }
 
-   /* send padding */
+   MLZ4F_preferences_t prefs;
+   memset(&prefs, 0, sizeof(prefs));
 
-   if (count < total_size) {
-      char padding[8] = { 0,0,0,0,0,0,0,0 };
-      size_t padlen = total_size - count;
-      assert(padlen < 8);
-      status = ss_write_tcp(_server_connection.event_sock, padding, padlen);
-      if (status != SS_SUCCESS) {
-         ss_socket_close(&_server_connection.event_sock);
-         cm_msg(MERROR, "rpc_send_event_sg", "ss_write_tcp(padding) failed, event socket is now closed");
-         return RPC_NET_ERROR;
-      }
+   size_t bound = MLZ4F_compressFrameBound(n, &prefs);
+   if (_event_ring.lz4_buf_size < header_size + bound + 8) {
+      free(_event_ring.lz4_buf);
+      _event_ring.lz4_buf_size = header_size + bound + 8;
+      _event_ring.lz4_buf = (char*)malloc(_event_ring.lz4_buf_size);
+      assert(_event_ring.lz4_buf);
    }
 
-   return RPC_SUCCESS;
-}
+   size_t csize = MLZ4F_compressFrame(_event_ring.lz4_buf + header_size, bound, src, n, &prefs);
 
-/********************************************************************/
-/**
-Send event residing in the TCP cache buffer filled by
-           rpc_send_event. This routine should be called when a
-           run is stopped.
+   *pcpu_time = rpc_thread_cpu_time() - start_cpu;
 
-@return RPC_SUCCESS, RPC_NET_ERROR
-*/
+   if (MLZ4F_isError(csize)) {
+      cm_msg(MERROR, "rpc_send_event_lz4", "LZ4F_compressFrame() error %d (%s), sending uncompressed", (int)csize, MLZ4F_getErrorName(csize));
+      csize = n;
+   }
+
+   /* send incompressible data as it is */
+   if (header_size + csize >= n) {
+      *pwire_size = n;
+      return rpc_writev_tcp(sock, iov, iovcnt);
+   }
+
+   DWORD* header = (DWORD*)_event_ring.lz4_buf;
+   header[0] = RPC_EVENT_LZ4_FRAME;
+   header[1] = csize;
+   header[2] = n;
+   header[3] = 0;
+   header[4] = 0;
+
+   size_t wire_size = header_size + ALIGN8(csize);
+   memset(_event_ring.lz4_buf + header_size + csize, 0, wire_size - header_size - csize);
+
+   *pwire_size = wire_size;
+   return ss_write_tcp(sock, _event_ring.lz4_buf, wire_size);
+}
+
+static void rpc_event_sender_thread()
+{
+   ss_thread_set_name("mEventSend");
+
+   std::unique_lock<std::mutex> lock(_server_connection.event_sock_mutex);
+
+   while (!_event_ring.stop) {
+      if (_event_ring.used == 0) {
+         _event_ring.cond_data.wait(lock);
+         continue;
+      }
+
+      /* wait for a full batch unless the oldest data is due or a flush is requested */
+      if (_event_ring.used < RPC_EVENT_BATCH_SIZE && _event_ring.flush == 0) {
+         DWORD age = ss_millitime() - _event_ring.first_time;
+         if (age < RPC_EVENT_FLUSH_MSEC) {
+            _event_ring.cond_data.wait_for(lock, std::chrono::milliseconds(RPC_EVENT_FLUSH_MSEC - age));
+            continue;
+         }
+      }
+
+      /* send all queued data, in two pieces if it wraps around */
+      size_t rp = _event_ring.rp;
+      size_t n = _event_ring.used;
+      bool compress = _event_ring.compress;
+      if (compress)
+         n = rpc_event_ring_frame_size(rp, n);
+      size_t n1 = std::min(n, _event_ring.size - rp);
+      struct iovec iov[2];
+      int iovcnt = 1;
+      iov[0].iov_base = _event_ring.buf + rp;
+      iov[0].iov_len = n1;
+      if (n > n1) {
+         iov[1].iov_base = _event_ring.buf;
+         iov[1].iov_len = n - n1;
+         iovcnt = 2;
+      }
+
+      int sock = _server_connection.event_sock;
+      DWORD start_time = ss_millitime();
+
+      size_t wire_size = n;
+      double cpu_time = 0;
+
+      lock.unlock();
+      int status;
+      if (compress)
+         status = rpc_send_event_lz4(sock, iov, iovcnt, n, &wire_size, &cpu_time);
+      else
+         status = rpc_writev_tcp(sock, iov, iovcnt);
+      lock.lock();
+
+      if (compress) {
+         _event_ring.bytes_in += n;
+         _event_ring.bytes_out += wire_size;
+         _event_ring.cpu_time += cpu_time;
+      }
+
+      _event_ring.rp = (rp + n) % _event_ring.size;
+      _event_ring.used -= n;
+      _event_ring.first_time = start_time;
+
+      if (status != SS_SUCCESS) {
+         ss_socket_close(&_server_connection.event_sock);
+         cm_msg(MERROR, "rpc_event_sender_thread", "writev(event data) failed, event socket is now closed");
+         _event_ring.rp = _event_ring.wp = _event_ring.used = 0;
+      }
+
+      _event_ring.cond_space.notify_all();
+   }
+}
+
+/* send n bytes of events as one event stream frame, compressed if requested and worth it */
+static int rpc_send_event_seq_frame(int sock, DWORD seq, const char* data, size_t n, bool compress, std::vector<char>& cbuf, size_t* pwire_size, double* pcpu_time)
+{
+   const size_t header_size = 5 * sizeof(DWORD);
+   char padding[8] = { 0,0,0,0,0,0,0,0 };
+   DWORD header[5] = { RPC_EVENT_SEQ_FRAME, seq, (DWORD)n, (DWORD)n, 0 };
+
+   *pcpu_time = 0;
+
+   if (compress) {
+      double start_cpu = rpc_thread_cpu_time();
+
+      MLZ4F_preferences_t prefs;
+      memset(&prefs, 0, sizeof(prefs));
+
+      size_t bound = MLZ4F_compressFrameBound(n, &prefs);
+      if (cbuf.size() < header_size + bound + 8)
+         cbuf.resize(header_size + bound + 8);
+
+      size_t csize = MLZ4F_compressFrame(cbuf.data() + header_size, bound, data, n, &prefs);
+
+      *pcpu_time = rpc_thread_cpu_time() - start_cpu;
+
+      if (MLZ4F_isError(csize)) {
+         cm_msg(MERROR, "rpc_send_event_seq_frame", "LZ4F_compressFrame() error %d (%s), sending uncompressed", (int)csize, MLZ4F_getErrorName(csize));
+      } else if (csize < n) {
+         header[2] = csize;
+         header[4] = RPC_EVENT_SEQ_LZ4;
+         memcpy(cbuf.data(), header, header_size);
+         size_t wire_size = header_size + ALIGN8(csize);
+         memset(cbuf.data() + header_size + csize, 0, wire_size - header_size - csize);
+         *pwire_size = wire_size;
+         return ss_write_tcp(sock, cbuf.data(), wire_size);
+      }
+   }
+
+   struct iovec iov[3];
+   iov[0].iov_base = header;
+   iov[0].iov_len = header_size;
+   iov[1].iov_base = (void*)data;
+   iov[1].iov_len = n;
+   iov[2].iov_base = padding;
+   iov[2].iov_len = ALIGN8(n) - n;
+
+   *pwire_size = header_size + ALIGN8(n);
+   return rpc_writev_tcp(sock, iov, 3);
+}
+
+static void rpc_event_stream_thread(int stream)
+{
+   ss_thread_set_name("mEventStream" + std::to_string(stream));
+
+   std::vector<char> chunk;
+   std::vector<char> cbuf;
+
+   std::unique_lock<std::mutex> lock(_server_connection.event_sock_mutex);
+
+   while (!_event_ring.stop) {
+      if (_event_ring.used == 0) {
+         _event_ring.cond_data.wait(lock);
+         continue;
+      }
+
+      if (_event_ring.used < RPC_EVENT_BATCH_SIZE && _event_ring.flush == 0) {
+         DWORD age = ss_millitime() - _event_ring.first_time;
+         if (age < RPC_EVENT_FLUSH_MSEC) {
+            _event_ring.cond_data.wait_for(lock, std::chrono::milliseconds(RPC_EVENT_FLUSH_MSEC - age));
+            continue;
+         }
+      }
+
+      /* take the next chunk of whole events out of the ring, so other streams can send the rest in parallel */
+      size_t n = rpc_event_ring_frame_size(_event_ring.rp, _event_ring.used);
+      chunk.resize(n);
+      rpc_event_ring_get(_event_ring.rp, chunk.data(), n);
+      _event_ring.rp = (_event_ring.rp + n) % _event_ring.size;
+      _event_ring.used -= n;
+      DWORD seq = _event_ring.next_seq++;
+      _event_ring.in_flight++;
+
+      bool compress = _event_ring.compress;
+      int sock = _event_ring.stream_socks[stream];
+
+      if (_event_ring.used > 0)
+         _event_ring.cond_data.notify_one();
+      _event_ring.cond_space.notify_all();
+
+      size_t wire_size = n;
+      double cpu_time = 0;
+
+      lock.unlock();
+      int status = rpc_send_event_seq_frame(sock, seq, chunk.data(), n, compress, cbuf, &wire_size, &cpu_time);
+      lock.lock();
+
+      _event_ring.in_flight--;
+
+      if (compress) {
+         _event_ring.bytes_in += n;
+         _event_ring.bytes_out += wire_size;
+         _event_ring.cpu_time += cpu_time;
+      }
+
+      if (status != SS_SUCCESS) {
+         /* a lost frame breaks the sequence, treat it like a broken event socket */
+         ss_socket_close(&_server_connection.event_sock);
+         cm_msg(MERROR, "rpc_event_stream_thread", "write(event stream %d) failed, event socket is now closed", stream);
+         _event_ring.rp = _event_ring.wp = _event_ring.used = 0;
+      }
+
+      _event_ring.cond_space.notify_all();
+   }
+}
+
+/* start sender thread or event stream threads, called with event_sock_mutex locked */
+static void rpc_event_ring_start()
+{
+   if (_event_ring.thread || !_event_ring.stream_threads.empty())
+      return;
+
+   _event_ring.buf = (char*)malloc(RPC_EVENT_RING_SIZE);
+   assert(_event_ring.buf);
+   _event_ring.size = RPC_EVENT_RING_SIZE;
+   _event_ring.rp = _event_ring.wp = _event_ring.used = 0;
+   _event_ring.stop = false;
+   if (_event_ring.stream_socks.empty()) {
+      _event_ring.thread = new std::thread(rpc_event_sender_thread);
+   } else {
+      for (size_t i=0; i<_event_ring.stream_socks.size(); i++)
+         _event_ring.stream_threads.push_back(new std::thread(rpc_event_stream_thread, (int)i));
+   }
+}
+
+/* stop sender threads and close event streams, unsent data is dropped */
+static void rpc_event_ring_stop()
+{
+   std::vector<std::thread*> threads;
+
+   {
+      std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+      if (_event_ring.thread)
+         threads.push_back(_event_ring.thread);
+      for (auto t : _event_ring.stream_threads)
+         threads.push_back(t);
+      _event_ring.thread = NULL;
+      _event_ring.stream_threads.clear();
+      _event_ring.stop = true;
+      _event_ring.cond_data.notify_all();
+   }
+
+   for (auto t : threads) {
+      t->join();
+      delete t;
+   }
+
+   std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+   for (auto& s : _event_ring.stream_socks)
+      ss_socket_close(&s);
+   _event_ring.stream_socks.clear();
+   _event_ring.next_seq = 0;
+   _event_ring.in_flight = 0;
+   free(_event_ring.buf);
+   _event_ring.buf = NULL;
+   free(_event_ring.lz4_buf);
+   _event_ring.lz4_buf = NULL;
+   _event_ring.lz4_buf_size = 0;
+   free(_event_ring.lz4_copy);
+   _event_ring.lz4_copy = NULL;
+   _event_ring.lz4_copy_size = 0;
+   _event_ring.size = _event_ring.rp = _event_ring.wp = _event_ring.used = 0;
+   _event_ring.stop = false;
+}
+
+/* copy data into the ring, caller checked for space */
+static void rpc_event_ring_put(const void* data, size_t len)
+{
+   size_t n1 = std::min(len, _event_ring.size - _event_ring.wp);
+   memcpy(_event_ring.buf + _event_ring.wp, data, n1);
+   if (len > n1)
+      memcpy(_event_ring.buf, (const char*)data + n1, len - n1);
+   _event_ring.wp = (_event_ring.wp + len) % _event_ring.size;
+   _event_ring.used += len;
+}
+
+/********************************************************************/
+/**
+Enable or disable LZ4 compression of the event stream to the mserver.
+Events are compressed in the background sender thread in frames of
+up to 1 MB. Compression is only possible if the mserver supports it
+and uses the same byte order.
+@param enable             TRUE to compress events
+@return RPC_SUCCESS, RPC_NO_CONNECTION, CM_VERSION_MISMATCH
+*/
+INT rpc_set_event_compression(BOOL enable)
+{
+   std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+
+   if (_server_connection.event_sock == 0)
+      return RPC_NO_CONNECTION;
+
+   if (enable) {
+      if (!_server_connection.event_lz4) {
+         cm_msg(MINFO, "rpc_set_event_compression", "mserver on \"%s\" does not support event compression, events are sent uncompressed", _server_connection.host_name.c_str());
+         return CM_VERSION_MISMATCH;
+      }
+
+      INT convert_flags = 0;
+      rpc_calc_convert_flags(rpc_get_hw_type(), _server_connection.remote_hw_type, &convert_flags);
+      if (convert_flags) {
+         cm_msg(MINFO, "rpc_set_event_compression", "mserver on \"%s\" has different byte order, events are sent uncompressed", _server_connection.host_name.c_str());
+         return CM_VERSION_MISMATCH;
+      }
+   }
+
+   _event_ring.compress = enable;
+
+   return RPC_SUCCESS;
+}
+
+/********************************************************************/
+/**
+Send events to the mserver over several event streams (TCP connections)
+in parallel. Each stream has its own sender thread which takes chunks of
+whole events from the event ring buffer, compresses them if event
+compression is enabled and sends them with a sequence number. With
+ordered set, the mserver writes the chunks to the event buffers in
+sequence number order, as required for example by the event builder;
+otherwise each stream writes its chunks as soon as they arrive. Events
+queued before the call are flushed over the old connection first.
+@param n_streams          number of event streams, 0 to go back to the event socket
+@param ordered            TRUE to keep the event order of the sender
+@return RPC_SUCCESS, RPC_NO_CONNECTION, RPC_NET_ERROR, BM_INVALID_PARAM, CM_VERSION_MISMATCH
+*/
+INT rpc_set_event_streams(int n_streams, BOOL ordered)
+{
+   if (n_streams < 0 || n_streams > RPC_EVENT_MAX_STREAMS) {
+      cm_msg(MERROR, "rpc_set_event_streams", "invalid number of event streams %d, maximum is %d", n_streams, RPC_EVENT_MAX_STREAMS);
+      return BM_INVALID_PARAM;
+   }
+
+   {
+      std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+
+      if (_server_connection.event_sock == 0)
+         return RPC_NO_CONNECTION;
+
+      if (n_streams > 0) {
+         if (!_server_connection.event_streams) {
+            cm_msg(MINFO, "rpc_set_event_streams", "mserver on \"%s\" does not support event streams, events are sent over the event socket", _server_connection.host_name.c_str());
+            return CM_VERSION_MISMATCH;
+         }
+
+         INT convert_flags = 0;
+         rpc_calc_convert_flags(rpc_get_hw_type(), _server_connection.remote_hw_type, &convert_flags);
+         if (convert_flags) {
+            cm_msg(MINFO, "rpc_set_event_streams", "mserver on \"%s\" has different byte order, events are sent over the event socket", _server_connection.host_name.c_str());
+            return CM_VERSION_MISMATCH;
+         }
+      }
+   }
+
+   int status = rpc_flush_event();
+   if (status != RPC_SUCCESS)
+      return status;
+
+   rpc_event_ring_stop();
+
+   if (n_streams == 0)
+      return RPC_SUCCESS;
+
+   /* the mserver connects back to us, same as for the main connection in rpc_server_connect() */
+
+   bool listen_localhost = (_server_connection.host_name == "localhost");
+   int lsock, lport;
+   std::string errmsg;
+
+   status = ss_socket_listen_tcp(listen_localhost, 0, &lsock, &lport, &errmsg);
+   if (status != SS_SUCCESS) {
+      cm_msg(MERROR, "rpc_set_event_streams", "cannot create listener socket: %s", errmsg.c_str());
+      return RPC_NET_ERROR;
+   }
+
+   status = rpc_call(RPC_BM_EVENT_STREAMS, lport, n_streams, ordered);
+   if (status != RPC_SUCCESS) {
+      cm_msg(MERROR, "rpc_set_event_streams", "mserver could not open %d event streams, status %d", n_streams, status);
+      ss_socket_close(&lsock);
+      return status;
+   }
+
+   std::vector<int> socks;
+
+   for (int i=0; i<n_streams; i++) {
+      int sock = -1;
+      if (ss_socket_wait(lsock, _rpc_connect_timeout) == SS_SUCCESS)
+         sock = accept(lsock, NULL, NULL);
+
+      if (sock < 0) {
+         cm_msg(MERROR, "rpc_set_event_streams", "accept() of event stream %d failed", i);
+         for (auto& s : socks)
+            ss_socket_close(&s);
+         ss_socket_close(&lsock);
+         return RPC_NET_ERROR;
+      }
+
+      int flag = 2 * 1024 * 1024;
+      status = setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *) &flag, sizeof(flag));
+      if (status != 0)
+         cm_msg(MERROR, "rpc_set_event_streams", "cannot setsockopt(SOL_SOCKET, SO_SNDBUF), errno %d (%s)", errno, strerror(errno));
+
+      socks.push_back(sock);
+   }
+
+   ss_socket_close(&lsock);
+
+   std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+   _event_ring.stream_socks = socks;
+   _event_ring.next_seq = 0;
+
+   return RPC_SUCCESS;
+}
+
+/* write event compression statistics to /System/Clients/<pid>/Event compression */
+static void rpc_write_event_statistics_to_odb()
+{
+   double bytes_in, bytes_out, cpu_time;
+
+   {
+      std::lock_guard<std::mutex> guard(_server_connection.event_sock_mutex);
+      if (!_event_ring.compress)
+         return;
+      bytes_in = _event_ring.bytes_in;
+      bytes_out = _event_ring.bytes_out;
+      cpu_time = _event_ring.cpu_time;
+   }
+
+   HNDLE hDB, hKeyClient;
+   cm_get_experiment_database(&hDB, &hKeyClient);
+   if (!hDB || !hKeyClient)
+      return;
+
+   double ratio = 0;
+   if (bytes_out > 0)
+      ratio = bytes_in / bytes_out;
+
+   db_set_value(hDB, hKeyClient, "Event compression/Bytes in", &bytes_in, sizeof(double), 1, TID_DOUBLE);
+   db_set_value(hDB, hKeyClient, "Event compression/Bytes out", &bytes_out, sizeof(double), 1, TID_DOUBLE);
+   db_set_value(hDB, hKeyClient, "Event compression/Ratio", &ratio, sizeof(double), 1, TID_DOUBLE);
+   db_set_value(hDB, hKeyClient, "Event compression/CPU seconds", &cpu_time, sizeof(double), 1, TID_DOUBLE);
+}
+
+INT rpc_send_event_sg(INT buffer_handle, int sg_n, const char* const sg_ptr[], const size_t sg_len[])
+{
+   if (sg_n < 1) {
+      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_n %d", sg_n);
+      return BM_INVALID_SIZE;
+   }
+
+   if (sg_ptr[0] == NULL) {
+      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_ptr[0] is NULL");
+      return BM_INVALID_SIZE;
+   }
+
+   if (sg_len[0] < sizeof(EVENT_HEADER)) {
+      cm_msg(MERROR, "rpc_send_event_sg", "invalid sg_len[0] value %d is smaller than event header size %d", (int)sg_len[0], (int)sizeof(EVENT_HEADER));
+      return BM_INVALID_SIZE;
+   }
+
+   const EVENT_HEADER* pevent = (const EVENT_HEADER*)sg_ptr[0];
+   
+   const DWORD MAX_DATA_SIZE = (0x7FFFFFF0 - 16); // event size computations are not 32-bit clean, limit event size to 2GB. K.O.
+   const DWORD data_size = pevent->data_size; // 32-bit unsigned value
+
+   if (data_size == 0) {
+      cm_msg(MERROR, "rpc_send_event_sg", "invalid event data size zero");
+      return BM_INVALID_SIZE;
+   }
+
+   if (data_size > MAX_DATA_SIZE) {
+      cm_msg(MERROR, "rpc_send_event_sg", "invalid event data size %d (0x%x) maximum is %d (0x%x)", data_size, data_size, MAX_DATA_SIZE, MAX_DATA_SIZE);
+      return BM_INVALID_SIZE;
+   }
+
+   const size_t event_size = sizeof(EVENT_HEADER) + data_size;
+   const size_t total_size = ALIGN8(event_size);
+
+   size_t count = 0;
+   for (int i=0; i<sg_n; i++) {
+      count += sg_len[i];
+   }
+
+   if (count != event_size) {
+      cm_msg(MERROR, "rpc_send_event_sg", "data size mismatch: event data_size %d, event_size %d not same as sum of sg_len %d", (int)data_size, (int)event_size, (int)count);
+      return BM_INVALID_SIZE;
+   }
+
+   // protect non-atomic access to _server_connection.event_sock. K.O.
+   
+   std::unique_lock<std::mutex> lock(_server_connection.event_sock_mutex);
+
+   //printf("rpc_send_event_sg: pevent %p, event_id 0x%04x, serial 0x%08x, data_size %d, event_size %d, total_size %d\n", pevent, pevent->event_id, pevent->serial_number, (int)data_size, (int)event_size, (int)total_size);
+
+   if (_server_connection.event_sock == 0) {
+      return RPC_NO_CONNECTION;
+   }
+
+   //
+   // event socket wire protocol: (see also rpc_server_receive_event() and recv_event_server_realloc())
+   //
+   // 4 bytes of buffer handle
+   // 16 bytes of event header, includes data_size
+   // ALIGN8(data_size) bytes of event data
+   // 
+
+   assert(sizeof(DWORD) == 4);
+   DWORD bh_buf = buffer_handle;
+   char padding[8] = { 0,0,0,0,0,0,0,0 };
+   size_t padlen = total_size - count;
+   assert(padlen < 8);
+
+   const size_t wire_size = sizeof(DWORD) + total_size;
+
+   /* large events bypass the ring, they are sent directly once all queued events are out */
+
+   if (wire_size > RPC_EVENT_RING_SIZE / 2) {
+      while ((_event_ring.used > 0 || _event_ring.in_flight > 0) && _server_connection.event_sock)
+         _event_ring.cond_space.wait(lock);
+
+      if (_server_connection.event_sock == 0)
+         return RPC_NET_ERROR;
+
+      /* with event streams, send it as a frame on the first stream, all stream threads are idle now */
+      bool streams = !_event_ring.stream_socks.empty();
+      DWORD frame_header[5] = { RPC_EVENT_SEQ_FRAME, 0, (DWORD)wire_size, (DWORD)wire_size, 0 };
+      int sock = _server_connection.event_sock;
+
+      std::vector<struct iovec> iov;
+      if (streams) {
+         frame_header[1] = _event_ring.next_seq++;
+         sock = _event_ring.stream_socks[0];
+         iov.push_back({ frame_header, sizeof(frame_header) });
+      }
+      iov.push_back({ &bh_buf, sizeof(DWORD) });
+      for (int i=0; i<sg_n; i++)
+         iov.push_back({ (void*)sg_ptr[i], sg_len[i] });
+      iov.push_back({ padding, padlen });
+      if (streams) // frame data is padded to 8 bytes
+         iov.push_back({ padding, ALIGN8(wire_size) - wire_size });
+
+      int status = rpc_writev_tcp(sock, iov.data(), iov.size());
+      if (status != SS_SUCCESS) {
+         ss_socket_close(&_server_connection.event_sock);
+         cm_msg(MERROR, "rpc_send_event_sg", "writev(event data) failed, event socket is now closed");
+         return RPC_NET_ERROR;
+      }
+
+      return RPC_SUCCESS;
+   }
+
+   /* queue event for the sender thread, wait only if the ring is full */
+
+   rpc_event_ring_start();
+
+   while (_event_ring.size - _event_ring.used < wire_size) {
+      _event_ring.cond_data.notify_one();
+      _event_ring.cond_space.wait(lock);
+      if (_server_connection.event_sock == 0)
+         return RPC_NET_ERROR;
+   }
+
+   bool was_empty = (_event_ring.used == 0);
+   if (was_empty)
+      _event_ring.first_time = ss_millitime();
+
+   rpc_event_ring_put(&bh_buf, sizeof(DWORD));
+   for (int i=0; i<sg_n; i++)
+      rpc_event_ring_put(sg_ptr[i], sg_len[i]);
+   if (padlen > 0)
+      rpc_event_ring_put(padding, padlen);
+
+   if (was_empty || _event_ring.used >= RPC_EVENT_BATCH_SIZE)
+      _event_ring.cond_data.notify_one();
+
+   return RPC_SUCCESS;
+}
+
+/********************************************************************/
+/**
+Send events queued in the event socket ring buffer by
+           rpc_send_event and wait until they are written. This
+           routine should be called when a run is stopped.
+
+@return RPC_SUCCESS, RPC_NET_ERROR
+*/
 INT rpc_flush_event() {
+   std::unique_lock<std::mutex> lock(_server_connection.event_sock_mutex);
+
+   if (!_event_ring.thread && _event_ring.stream_threads.empty())
+      return RPC_SUCCESS;
+
+   _event_ring.flush++;
+   _event_ring.cond_data.notify_one();
+
+   while ((_event_ring.used > 0 || _event_ring.in_flight > 0) && _server_connection.event_sock)
+      _event_ring.cond_space.wait(lock);
+
+   _event_ring.flush--;
+
+   if (_server_connection.event_sock == 0)
+      return RPC_NET_ERROR;
+
    return RPC_SUCCESS;
 }
 
@@ -14356,6 +15432,393 @@ INT recv_tcp_check(int sock)
 
 
 /********************************************************************/
+/* decompress one LZ4 frame of csize bytes into exactly usize bytes */
+static bool rpc_lz4_decompress_frame(MLZ4F_decompressionContext_t dctx, char* dst, size_t usize, const char* src, size_t csize)
+{
+   size_t dst_pos = 0;
+   size_t src_pos = 0;
+
+   while (src_pos < csize) {
+      size_t dst_size = usize - dst_pos;
+      size_t src_size = csize - src_pos;
+      size_t hint = MLZ4F_decompress(dctx, dst + dst_pos, &dst_size, src + src_pos, &src_size, NULL);
+      if (MLZ4F_isError(hint)) {
+         cm_msg(MERROR, "recv_event_server", "LZ4F_decompress() error %d (%s)", (int)hint, MLZ4F_getErrorName(hint));
+         return false;
+      }
+      dst_pos += dst_size;
+      src_pos += src_size;
+      if (hint == 0 || (dst_size == 0 && src_size == 0))
+         break;
+   }
+
+   if (dst_pos != usize) {
+      cm_msg(MERROR, "recv_event_server", "LZ4 event frame decompressed to %d bytes instead of %d", (int)dst_pos, (int)usize);
+      return false;
+   }
+
+   return true;
+}
+
+/* read an LZ4 frame of events from the event socket and decompress it */
+static int recv_event_server_lz4_frame(RPC_SERVER_ACCEPTION* psa, const char* header_buf)
+{
+   const DWORD* header = (const DWORD*) header_buf;
+   size_t csize = header[1];
+   size_t usize = header[2];
+
+   if (csize == 0 || csize >= usize || usize > RPC_EVENT_RING_SIZE) {
+      cm_msg(MERROR, "recv_event_server", "received LZ4 event frame with invalid sizes: compressed %d, uncompressed %d", (int)csize, (int)usize);
+      return -1;
+   }
+
+   /* compressed data goes behind the space for the decompressed events */
+   size_t to_read = ALIGN8(csize);
+   if (psa->lz4_buffer_size < usize + to_read) {
+      char *newbuf = (char *) realloc(psa->lz4_buffer, usize + to_read);
+      if (newbuf == NULL) {
+         cm_msg(MERROR, "recv_event_server", "cannot realloc() LZ4 event buffer from %d to %d bytes", (int)psa->lz4_buffer_size, (int)(usize + to_read));
+         return -1;
+      }
+      psa->lz4_buffer = newbuf;
+      psa->lz4_buffer_size = usize + to_read;
+   }
+
+   char* src = psa->lz4_buffer + usize;
+
+   int drd = recv_tcp2(psa->event_sock, src, to_read, 0);
+   if (drd != (int)to_read) {
+      cm_msg(MERROR, "recv_event_server", "recv_tcp2(LZ4 frame) returned %d instead of %d", drd, (int)to_read);
+      return -1;
+   }
+
+   if (!psa->lz4_dctx) {
+      MLZ4F_decompressionContext_t dctx;
+      MLZ4F_errorCode_t error = MLZ4F_createDecompressionContext(&dctx, MLZ4F_VERSION);
+      if (MLZ4F_isError(error)) {
+         cm_msg(MERROR, "recv_event_server", "LZ4F_createDecompressionContext() error %d (%s)", (int)error, MLZ4F_getErrorName(error));
+         return -1;
+      }
+      psa->lz4_dctx = dctx;
+   }
+
+   if (!rpc_lz4_decompress_frame((MLZ4F_decompressionContext_t)psa->lz4_dctx, psa->lz4_buffer, usize, src, csize))
+      return -1;
+
+   psa->lz4_rp = 0;
+   psa->lz4_wp = usize;
+
+   return usize;
+}
+
+/* copy next event from a decompressed LZ4 frame */
+static int recv_event_server_lz4(RPC_SERVER_ACCEPTION* psa, char **pbuffer, int *pbuffer_size)
+{
+   const size_t header_size = (sizeof(EVENT_HEADER) + sizeof(INT));
+   size_t avail = psa->lz4_wp - psa->lz4_rp;
+   const char* p = psa->lz4_buffer + psa->lz4_rp;
+
+   if (avail < header_size) {
+      cm_msg(MERROR, "recv_event_server", "truncated event in LZ4 event frame");
+      return -1;
+   }
+
+   const EVENT_HEADER* pevent = (const EVENT_HEADER*) (p + sizeof(INT));
+   size_t bufsize = sizeof(INT) + ALIGN8(sizeof(EVENT_HEADER) + (size_t)pevent->data_size);
+
+   if (pevent->data_size == 0 || bufsize > avail) {
+      cm_msg(MERROR, "recv_event_server", "invalid event data_size %d in LZ4 event frame", (int)pevent->data_size);
+      return -1;
+   }
+
+   if (*pbuffer_size < (int)bufsize) {
+      int newsize = 1024 + ALIGN8(bufsize);
+      char *newbuf = (char *) realloc(*pbuffer, newsize);
+      if (newbuf == NULL) {
+         cm_msg(MERROR, "recv_event_server", "cannot realloc() event buffer from %d to %d bytes", *pbuffer_size, newsize);
+         return -1;
+      }
+      *pbuffer = newbuf;
+      *pbuffer_size = newsize;
+   }
+
+   memcpy(*pbuffer, p, bufsize);
+   psa->lz4_rp += bufsize;
+
+   return bufsize;
+}
+
+/********************************************************************/
+/* mserver side of the event streams, see rpc_set_event_streams() */
+
+struct RPC_EVENT_STREAMS {
+   std::mutex mutex;
+   std::condition_variable cond;        // next_seq or busy changed, stop request
+   DWORD next_seq = 0;                  // next frame to write in ordered mode
+   bool ordered = true;
+   std::atomic<bool> stop{false};       // also read without the mutex by the receiver threads
+   int busy = 0;                        // number of threads handling a frame
+   std::vector<int> socks;
+   std::vector<std::thread*> threads;
+};
+
+/* read exactly size bytes, returns 0 if the connection was closed before the first byte */
+static int rpc_event_stream_recv(int sock, char* buf, size_t size)
+{
+   size_t n = 0;
+
+   while (n < size) {
+      ssize_t rd = recv(sock, buf + n, size - n, 0);
+      if (rd < 0 && errno == EINTR)
+         continue;
+      if (rd <= 0)
+         return (rd == 0 && n == 0) ? 0 : -1;
+      n += rd;
+   }
+
+   return n;
+}
+
+/* write the events of one frame into their buffers */
+static bool rpc_event_stream_deliver(RPC_EVENT_STREAMS* es, const char* p, size_t size)
+{
+   const size_t header_size = (sizeof(EVENT_HEADER) + sizeof(INT));
+   size_t pos = 0;
+
+   while (pos < size) {
+      if (size - pos < header_size) {
+         cm_msg(MERROR, "rpc_event_stream_deliver", "truncated event in event stream frame");
+         return false;
+      }
+
+      INT bh = *(const INT*)(p + pos);
+      const EVENT_HEADER* pevent = (const EVENT_HEADER*)(p + pos + sizeof(INT));
+      size_t bufsize = sizeof(INT) + ALIGN8(sizeof(EVENT_HEADER) + (size_t)pevent->data_size);
+
+      if (pevent->data_size == 0 || bufsize > size - pos) {
+         cm_msg(MERROR, "rpc_event_stream_deliver", "invalid event data_size %d in event stream frame", (int)pevent->data_size);
+         return false;
+      }
+
+      int status;
+      do {
+         status = bm_send_event(bh, pevent, 0, 1000);
+      } while (status == BM_ASYNC_RETURN && !es->stop);
+
+      if (status == SS_ABORT) {
+         cm_msg(MERROR, "rpc_event_stream_deliver", "bm_send_event() error %d (SS_ABORT), abort", status);
+         return false;
+      }
+
+      if (status != BM_SUCCESS && !es->stop)
+         cm_msg(MERROR, "rpc_event_stream_deliver", "bm_send_event() error %d, mserver dropped this event", status);
+
+      pos += bufsize;
+   }
+
+   return true;
+}
+
+static void rpc_server_event_stream_thread(RPC_EVENT_STREAMS* es, int stream)
+{
+   ss_thread_set_name("mEventStream" + std::to_string(stream));
+
+   int sock = es->socks[stream];
+   std::vector<char> cbuf;
+   std::vector<char> ubuf;
+   MLZ4F_decompressionContext_t dctx = NULL;
+   bool error = false;
+
+   while (!es->stop) {
+      if (ss_socket_wait(sock, 1000) == SS_TIMEOUT)
+         continue;
+
+      {
+         std::lock_guard<std::mutex> guard(es->mutex);
+         es->busy++;
+      }
+
+      DWORD header[5];
+      int rd = rpc_event_stream_recv(sock, (char*)header, sizeof(header));
+
+      if (rd == 0) {
+         /* client closed the stream */
+         std::lock_guard<std::mutex> guard(es->mutex);
+         es->busy--;
+         es->cond.notify_all();
+         break;
+      }
+
+      DWORD seq = header[1];
+      size_t csize = header[2];
+      size_t usize = header[3];
+      bool lz4 = (header[4] & RPC_EVENT_SEQ_LZ4) != 0;
+
+      if (rd < 0) {
+         if (!es->stop)
+            cm_msg(MERROR, "rpc_server_event_stream_thread", "event stream %d: connection broken", stream);
+         error = true;
+      } else if (header[0] != RPC_EVENT_SEQ_FRAME || csize == 0 || usize > 0x7FFFFFF0 || (lz4 ? csize >= usize : csize != usize)) {
+         cm_msg(MERROR, "rpc_server_event_stream_thread", "event stream %d: invalid frame header 0x%08x, compressed %d, uncompressed %d", stream, header[0], (int)csize, (int)usize);
+         error = true;
+      }
+
+      if (!error) {
+         cbuf.resize(ALIGN8(csize));
+         if (rpc_event_stream_recv(sock, cbuf.data(), cbuf.size()) != (int)cbuf.size()) {
+            cm_msg(MERROR, "rpc_server_event_stream_thread", "event stream %d: truncated frame", stream);
+            error = true;
+         }
+      }
+
+      const char* events = cbuf.data();
+
+      if (!error && lz4) {
+         if (!dctx) {
+            MLZ4F_errorCode_t status = MLZ4F_createDecompressionContext(&dctx, MLZ4F_VERSION);
+            if (MLZ4F_isError(status)) {
+               cm_msg(MERROR, "rpc_server_event_stream_thread", "LZ4F_createDecompressionContext() error %d (%s)", (int)status, MLZ4F_getErrorName(status));
+               dctx = NULL;
+               error = true;
+            }
+         }
+         if (!error) {
+            ubuf.resize(usize);
+            if (rpc_lz4_decompress_frame(dctx, ubuf.data(), usize, cbuf.data(), csize))
+               events = ubuf.data();
+            else
+               error = true;
+         }
+      }
+
+      /* in ordered mode wait for our turn */
+      if (!error && es->ordered) {
+         std::unique_lock<std::mutex> lock(es->mutex);
+         while (!es->stop && es->next_seq != seq)
+            es->cond.wait(lock);
+      }
+
+      if (!error && !es->stop)
+         error = !rpc_event_stream_deliver(es, events, usize);
+
+      std::lock_guard<std::mutex> guard(es->mutex);
+      if (es->ordered && !error)
+         es->next_seq++;
+      es->busy--;
+      if (error && !es->stop) {
+         /* a lost frame breaks the sequence, close all streams so that the client sees the error */
+         es->stop = true;
+         for (int s : es->socks)
+            shutdown(s, SHUT_RDWR);
+      }
+      es->cond.notify_all();
+      if (error)
+         break;
+   }
+
+   if (dctx)
+      MLZ4F_freeDecompressionContext(dctx);
+}
+
+/* stop receiver threads and close event streams */
+static void rpc_server_event_streams_close(RPC_EVENT_STREAMS* es)
+{
+   {
+      std::lock_guard<std::mutex> guard(es->mutex);
+      es->stop = true;
+      for (int s : es->socks)
+         shutdown(s, SHUT_RDWR);
+      es->cond.notify_all();
+   }
+
+   for (auto t : es->threads) {
+      t->join();
+      delete t;
+   }
+
+   for (auto& s : es->socks)
+      ss_socket_close(&s);
+
+   delete es;
+}
+
+/* TRUE if an event stream has unread data or a frame not yet written to the buffers */
+static bool rpc_server_event_streams_busy(RPC_EVENT_STREAMS* es)
+{
+   {
+      std::lock_guard<std::mutex> guard(es->mutex);
+      if (es->stop)
+         return false;
+      if (es->busy > 0)
+         return true;
+   }
+
+   for (int s : es->socks)
+      if (ss_socket_wait(s, 0) == SS_SUCCESS)
+         return true;
+
+   return false;
+}
+
+/********************************************************************/
+/**
+Connect event streams back to the client and start one receiver thread
+for each, called by the mserver on request of rpc_set_event_streams().
+@param port               TCP port the client listens on
+@param n_streams          number of event streams, 0 to close the streams
+@param ordered            TRUE to write frames in sequence number order
+@return RPC_SUCCESS, RPC_NO_CONNECTION, RPC_NET_ERROR, BM_INVALID_PARAM
+*/
+INT rpc_server_event_streams(INT port, INT n_streams, BOOL ordered)
+{
+   RPC_SERVER_ACCEPTION* sa = _mserver_acception;
+
+   if (!sa)
+      return RPC_NO_CONNECTION;
+
+   if (n_streams < 0 || n_streams > RPC_EVENT_MAX_STREAMS) {
+      cm_msg(MERROR, "rpc_server_event_streams", "invalid number of event streams %d, maximum is %d", n_streams, RPC_EVENT_MAX_STREAMS);
+      return BM_INVALID_PARAM;
+   }
+
+   if (sa->event_streams) {
+      rpc_server_event_streams_close(sa->event_streams);
+      sa->event_streams = NULL;
+   }
+
+   if (n_streams == 0)
+      return RPC_SUCCESS;
+
+   RPC_EVENT_STREAMS* es = new RPC_EVENT_STREAMS;
+   es->ordered = ordered;
+
+   for (int i=0; i<n_streams; i++) {
+      int sock;
+      std::string errmsg;
+      int status = ss_socket_connect_tcp(sa->host_name.c_str(), port, &sock, &errmsg);
+
+      if (status != SS_SUCCESS) {
+         cm_msg(MERROR, "rpc_server_event_streams", "cannot connect event stream %d, host \"%s\", port %d: %s", i, sa->host_name.c_str(), port, errmsg.c_str());
+         rpc_server_event_streams_close(es);
+         return RPC_NET_ERROR;
+      }
+
+      int flag = 2 * 1024 * 1024;
+      status = setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char *) &flag, sizeof(INT));
+      if (status != 0)
+         cm_msg(MERROR, "rpc_server_event_streams", "cannot setsockopt(SOL_SOCKET, SO_RCVBUF), errno %d (%s)", errno, strerror(errno));
+
+      es->socks.push_back(sock);
+   }
+
+   for (int i=0; i<n_streams; i++)
+      es->threads.push_back(new std::thread(rpc_server_event_stream_thread, es, i));
+
+   sa->event_streams = es;
+
+   return RPC_SUCCESS;
+}
+
 static int recv_event_server_realloc(INT idx, RPC_SERVER_ACCEPTION* psa, char **pbuffer, int *pbuffer_size)
 /********************************************************************\
 
@@ -14383,6 +15846,10 @@ static int recv_event_server_realloc(INT idx, RPC_SERVER_ACCEPTION* psa, char **
 
    //printf("recv_event_server: idx %d, buffer %p, buffer_size %d\n", idx, buffer, buffer_size);
 
+   /* events left from a decompressed LZ4 frame come first */
+   if (psa->lz4_rp < psa->lz4_wp)
+      return recv_event_server_lz4(psa, pbuffer, pbuffer_size);
+
    const size_t header_size = (sizeof(EVENT_HEADER) + sizeof(INT));
 
    char header_buf[header_size];
@@ -14430,6 +15897,13 @@ static int recv_event_server_realloc(INT idx, RPC_SERVER_ACCEPTION* psa, char **
    INT *pbh = (INT *) header_buf;
    EVENT_HEADER *pevent = (EVENT_HEADER *) (((INT *) header_buf) + 1);
 
+   /* LZ4 frame of several events, see rpc_send_event_sg() */
+   if ((DWORD) *pbh == RPC_EVENT_LZ4_FRAME) {
+      if (recv_event_server_lz4_frame(psa, header_buf) < 0)
+         return -1;
+      return recv_event_server_lz4(psa, pbuffer, pbuffer_size);
+   }
+
    /* convert header little endian/big endian */
    if (psa->convert_flags) {
       rpc_convert_single(&pbh, TID_INT32, 0, psa->convert_flags);
@@ -15793,9 +17267,9 @@ INT rpc_server_callback(struct callback_addr *pcallback)
 
    //printf("rpc_server_callback: _mserver_acception %p\n", _mserver_acception);
 
-   /* send my own computer id */
+   /* send my own computer id and announce LZ4 event frames and event streams, older clients ignore it */
    hw_type = rpc_get_hw_type();
-   sprintf(str, "%d", hw_type);
+   sprintf(str, "%d lz4 streams", hw_type);
    send(recv_sock, str, strlen(str) + 1, 0);
 
    rpc_calc_convert_flags(hw_type, client_hw_type, &convert_flags);
@@ -15980,6 +17454,10 @@ INT rpc_server_receive_event(int idx, RPC_SERVER_ACCEPTION* sa, int timeout_msec
    static int   xbufsize = 0;
    static bool  xbufempty = true;
 
+   // events left from a decompressed LZ4 frame do not show up on the socket
+   if (sa == NULL && _mserver_acception && _mserver_acception->lz4_rp < _mserver_acception->lz4_wp)
+      sa = _mserver_acception;
+
    // short cut
    if (sa == NULL && xbufempty)
       return RPC_SUCCESS;
@@ -16121,6 +17599,16 @@ int rpc_flush_event_socket(int timeout_msec)
 \********************************************************************/
 {
    bool has_data = ss_event_socket_has_data();
+
+   /* events still on their way through the event streams */
+   if (!has_data && _mserver_acception && _mserver_acception->event_streams) {
+      DWORD start_time = ss_millitime();
+      while (rpc_server_event_streams_busy(_mserver_acception->event_streams)) {
+         if (timeout_msec <= 0 || ss_millitime() - start_time > (DWORD)timeout_msec)
+            return BM_ASYNC_RETURN;
+         ss_sleep(1);
+      }
+   }
    
    //printf("ss_event_socket_has_data() returned %d\n", has_data);
 
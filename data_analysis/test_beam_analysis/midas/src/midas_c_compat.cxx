@@ -180,6 +180,136 @@ INT c_al_define_odb_alarm(const char *name, const char *condition, const char *a
    return al_define_odb_alarm(name, condition, aclass, message);
 }
 
+/*
+Functions for python/midas/fast_reader.py. Python maps or decompresses a midas
+file into memory, these functions find the events and banks in it, and python
+then returns the bank data as numpy views of the memory without copying it.
+
+c_bk_index_events() fills the header and the offset in buf of each event. With
+headers and offsets NULL it only counts the events, so python can allocate its
+arrays first. It stops at the first event that doesn't fit into buf (e.g. the
+end of a file still being written).
+ */
+INT c_bk_index_events(const char* buf, uint64_t buf_size, EVENT_HEADER* headers, uint64_t* offsets, INT max_events, INT* num_events) {
+   uint64_t pos = 0;
+   INT n = 0;
+
+   while (pos + sizeof(EVENT_HEADER) <= buf_size) {
+      EVENT_HEADER header;
+      memcpy(&header, buf + pos, sizeof(EVENT_HEADER));
+
+      if (pos + sizeof(EVENT_HEADER) + header.data_size > buf_size) {
+         break;
+      }
+
+      if (headers || offsets) {
+         if (n >= max_events) {
+            break;
+         }
+         if (headers) {
+            headers[n] = header;
+         }
+         if (offsets) {
+            offsets[n] = pos;
+         }
+      }
+
+      n++;
+      pos += sizeof(EVENT_HEADER) + header.data_size;
+   }
+
+   *num_events = n;
+   return SUCCESS;
+}
+
+/*
+Add the banks of one event to the index, for the three bank formats with
+bk_iterate(), bk_iterate32() and bk_iterate32a(). Unlike bk_find() we check
+that each bank lies inside the event, as the file may be corrupted.
+ */
+template <class T> static INT c_bk_index_event(const char* buf, INT event, const BANK_HEADER* pbh, INT (*iterate)(const void*, T**, void*),
+                                               const char* bank_name, C_BANK_INDEX* banks, INT max_banks, INT n) {
+   const char* pend = (const char*)(pbh + 1) + pbh->data_size;
+   T* pbk = NULL;
+   char* pdata;
+
+   while (iterate(pbh, &pbk, &pdata), pbk != NULL) {
+      if ((const char*)(pbk + 1) > pend || pdata + pbk->data_size > pend) {
+         break;
+      }
+
+      if (bank_name && strncmp(pbk->name, bank_name, 4) != 0) {
+         continue;
+      }
+
+      if (banks) {
+         if (n >= max_banks) {
+            break;
+         }
+         banks[n].event = event;
+         memcpy(banks[n].name, pbk->name, 4);
+         banks[n].type = pbk->type;
+         banks[n].data_size = pbk->data_size;
+         banks[n].offset = pdata - buf;
+      }
+
+      n++;
+
+      if (bank_name) {
+         break; // first bank of that name, like bk_find()
+      }
+   }
+
+   return n;
+}
+
+/*
+c_bk_index_banks() fills the index of the banks in the events found by
+c_bk_index_events(). With bank_name NULL or empty all banks are listed,
+otherwise only the first bank of that name in each event. With banks NULL it
+only counts them. Events without banks (BOR/EOR ODB dumps, messages) are
+skipped.
+ */
+INT c_bk_index_banks(const char* buf, uint64_t buf_size, const uint64_t* event_offsets, INT num_events, const char* bank_name, C_BANK_INDEX* banks, INT max_banks, INT* num_banks) {
+   INT n = 0;
+
+   if (bank_name && bank_name[0] == 0) {
+      bank_name = NULL;
+   }
+
+   for (INT i = 0; i < num_events; i++) {
+      if (event_offsets[i] + sizeof(EVENT_HEADER) + sizeof(BANK_HEADER) > buf_size) {
+         continue;
+      }
+
+      const EVENT_HEADER* pevent = (const EVENT_HEADER*)(buf + event_offsets[i]);
+      const BANK_HEADER* pbh = (const BANK_HEADER*)(pevent + 1);
+
+      if (pevent->event_id == EVENTID_BOR || pevent->event_id == EVENTID_EOR || pevent->event_id == EVENTID_MESSAGE) {
+         continue;
+      }
+
+      if (pevent->data_size < sizeof(BANK_HEADER) || pbh->data_size > pevent->data_size - sizeof(BANK_HEADER)) {
+         continue;
+      }
+
+      if (bk_is32a(pbh)) {
+         n = c_bk_index_event<BANK32A>(buf, i, pbh, bk_iterate32a, bank_name, banks, max_banks, n);
+      } else if (bk_is32(pbh)) {
+         n = c_bk_index_event<BANK32>(buf, i, pbh, bk_iterate32, bank_name, banks, max_banks, n);
+      } else {
+         n = c_bk_index_event<BANK>(buf, i, pbh, bk_iterate, bank_name, banks, max_banks, n);
+      }
+
+      if (banks && n >= max_banks) {
+         break;
+      }
+   }
+
+   *num_banks = n;
+   return SUCCESS;
+}
+
 INT c_bm_flush_cache(INT buffer_handle, INT async_flag) {
    return bm_flush_cache(buffer_handle, async_flag);
 }
@@ -172,6 +172,146 @@ MJsonNode* mjsonrpc_make_result(const char* name, MJsonNode* value, const char*
    return result;
 }
 
+/////////////////////////////////////////////////////////////////////////////////
+//
+// Streaming JSON writer
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+MJsonStreamWriter::~MJsonStreamWriter() // dtor
+{
+   if (fBuf)
+      free(fBuf);
+   fBuf = NULL;
+   fSize = 0;
+   fEnd = 0;
+}
+
+int MJsonStreamWriter::Value()
+{
+   if (fAfterKey) {
+      fAfterKey = false;
+   } else if (!fFirst.empty()) {
+      if (!fFirst.back())
+         json_write(&fBuf, &fSize, &fEnd, 0, ",", 0);
+      fFirst.back() = false;
+   }
+   return fEnd;
+}
+
+void MJsonStreamWriter::Raw(const char* s)
+{
+   json_write(&fBuf, &fSize, &fEnd, 0, s, 0);
+}
+
+void MJsonStreamWriter::Rewind(int pos)
+{
+   assert(pos >= 0 && pos <= fEnd);
+   fEnd = pos;
+   if (fBuf)
+      fBuf[fEnd] = 0;
+}
+
+void MJsonStreamWriter::Reset()
+{
+   Rewind(0);
+   fFirst.clear();
+   fAfterKey = false;
+}
+
+void MJsonStreamWriter::BeginObject()
+{
+   Value();
+   Raw("{");
+   fFirst.push_back(true);
+}
+
+void MJsonStreamWriter::EndObject()
+{
+   assert(!fFirst.empty());
+   fFirst.pop_back();
+   Raw("}");
+}
+
+void MJsonStreamWriter::BeginArray()
+{
+   Value();
+   Raw("[");
+   fFirst.push_back(true);
+}
+
+void MJsonStreamWriter::EndArray()
+{
+   assert(!fFirst.empty());
+   fFirst.pop_back();
+   Raw("]");
+}
+
+void MJsonStreamWriter::Key(const char* name)
+{
+   Value();
+   json_write(&fBuf, &fSize, &fEnd, 0, name, 1);
+   Raw(":");
+   fAfterKey = true;
+}
+
+void MJsonStreamWriter::String(const char* s)
+{
+   Value();
+   json_write(&fBuf, &fSize, &fEnd, 0, s, 1);
+}
+
+void MJsonStreamWriter::Int(long long v)
+{
+   char buf[32];
+   snprintf(buf, sizeof(buf), "%lld", v);
+   Value();
+   Raw(buf);
+}
+
+void MJsonStreamWriter::Number(double v)
+{
+   Value();
+   Raw(MJsonNode::EncodeDouble(v).c_str());
+}
+
+void MJsonStreamWriter::Bool(bool v)
+{
+   Value();
+   Raw(v ? "true" : "false");
+}
+
+void MJsonStreamWriter::Null()
+{
+   Value();
+   Raw("null");
+}
+
+void MJsonStreamWriter::JSON(const char* json)
+{
+   Value();
+   Raw(json);
+}
+
+void MJsonStreamWriter::Node(const MJsonNode* node)
+{
+   Value();
+   Raw(node->Stringify().c_str());
+}
+
+// finish ODB data appended to the stream by db_copy_json_xxx() starting at position pos
+static void js_end_odb_value(MJsonStreamWriter* w, int pos, int status)
+{
+   if (status == DB_SUCCESS) {
+      if (w->fBuf)
+         ss_repair_utf8(w->fBuf + pos);
+   } else {
+      // discard partial output
+      w->Rewind(pos);
+      w->Raw("null");
+   }
+}
+
 static MJsonNode* gNullNode = NULL;
 
 const MJsonNode* mjsonrpc_get_param(const MJsonNode* params, const char* name, MJsonNode** error)
@@ -636,7 +776,7 @@ static int parse_array_index_list(const char* method, const char* path, std::vec
    return SUCCESS;
 }
 
-static MJsonNode* js_db_get_values(const MJsonNode* params)
+static MJsonNode* js_db_get_values(const MJsonNode* params, MJsonStreamWriter* w)
 {
    if (!params) {
       MJSO* doc = MJSO::I();
@@ -664,8 +804,9 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
    double xomit_old_timestamp = mjsonrpc_get_param(params, "omit_old_timestamp", NULL)->GetDouble();
    time_t omit_old_timestamp = (time_t)xomit_old_timestamp;
    bool preserve_case = mjsonrpc_get_param(params, "preserve_case", NULL)->GetBool();
-   
-   MJsonNode* dresult = MJsonNode::MakeArray();
+
+   // ODB data is written directly into the reply,
+   // the small status, tid and last_written arrays are written after it
    MJsonNode* sresult = MJsonNode::MakeArray();
    MJsonNode* tresult = MJsonNode::MakeArray();
    MJsonNode* lwresult = MJsonNode::MakeArray();
@@ -673,6 +814,10 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
    HNDLE hDB;
    cm_get_experiment_database(&hDB, NULL);
 
+   w->BeginObject();
+   w->Key("data");
+   w->BeginArray();
+
    for (unsigned i=0; i<paths->size(); i++) {
       int status = 0;
       HNDLE hkey;
@@ -681,7 +826,7 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
 
       status = db_find_key(hDB, 0, path.c_str(), &hkey);
       if (status != DB_SUCCESS) {
-         dresult->AddToArray(MJsonNode::MakeNull());
+         w->Null();
          sresult->AddToArray(MJsonNode::MakeInt(status));
          tresult->AddToArray(MJsonNode::MakeNull());
          lwresult->AddToArray(MJsonNode::MakeNull());
@@ -690,7 +835,7 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
 
       status = db_get_key(hDB, hkey, &key);
       if (status != DB_SUCCESS) {
-         dresult->AddToArray(MJsonNode::MakeNull());
+         w->Null();
          sresult->AddToArray(MJsonNode::MakeInt(status));
          tresult->AddToArray(MJsonNode::MakeNull());
          lwresult->AddToArray(MJsonNode::MakeNull());
@@ -702,7 +847,7 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
          status = parse_array_index_list("js_db_get_values", path.c_str(), &list);
 
          if (status != SUCCESS) {
-            dresult->AddToArray(MJsonNode::MakeNull());
+            w->Null();
             sresult->AddToArray(MJsonNode::MakeInt(status));
             tresult->AddToArray(MJsonNode::MakeInt(key.type));
             lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
@@ -710,98 +855,68 @@ static MJsonNode* js_db_get_values(const MJsonNode* params)
          }
 
          if (list.size() > 1) {
-            MJsonNode *ddresult = MJsonNode::MakeArray();
             MJsonNode *ssresult = MJsonNode::MakeArray();
 
+            w->BeginArray();
+
             for (unsigned i=0; i<list.size(); i++) {
-               char* buf = NULL;
-               int bufsize = 0;
-               int end = 0;
-               
-               status = db_copy_json_index(hDB, hkey, list[i], &buf, &bufsize, &end);
-               if (status == DB_SUCCESS) {
-                  ss_repair_utf8(buf);
-                  ddresult->AddToArray(MJsonNode::MakeJSON(buf));
-                  ssresult->AddToArray(MJsonNode::MakeInt(status));
-               } else {
-                  ddresult->AddToArray(MJsonNode::MakeNull());
-                  ssresult->AddToArray(MJsonNode::MakeInt(status));
-               }
+               int pos = w->Value();
+               status = db_copy_json_index(hDB, hkey, list[i], &w->fBuf, &w->fSize, &w->fEnd);
+               js_end_odb_value(w, pos, status);
 
-               if (buf)
-                  free(buf);
+               ssresult->AddToArray(MJsonNode::MakeInt(status));
             }
 
-            dresult->AddToArray(ddresult);
+            w->EndArray();
+
             sresult->AddToArray(ssresult);
             tresult->AddToArray(MJsonNode::MakeInt(key.type));
             lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
 
          } else {
-            char* buf = NULL;
-            int bufsize = 0;
-            int end = 0;
-            
-            status = db_copy_json_index(hDB, hkey, list[0], &buf, &bufsize, &end);
-            if (status == DB_SUCCESS) {
-               ss_repair_utf8(buf);
-               dresult->AddToArray(MJsonNode::MakeJSON(buf));
-               sresult->AddToArray(MJsonNode::MakeInt(status));
-               tresult->AddToArray(MJsonNode::MakeInt(key.type));
-               lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
-            } else {
-               dresult->AddToArray(MJsonNode::MakeNull());
-               sresult->AddToArray(MJsonNode::MakeInt(status));
-               tresult->AddToArray(MJsonNode::MakeInt(key.type));
-               lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
-            }
-            
-            if (buf)
-               free(buf);
-         }
-      } else {
-         char* buf = NULL;
-         int bufsize = 0;
-         int end = 0;
+            int pos = w->Value();
+            status = db_copy_json_index(hDB, hkey, list[0], &w->fBuf, &w->fSize, &w->fEnd);
+            js_end_odb_value(w, pos, status);
 
-         status = db_copy_json_values(hDB, hkey, &buf, &bufsize, &end, omit_names,
-                                      omit_last_written, omit_old_timestamp, preserve_case);
-
-         if (status == DB_SUCCESS) {
-            ss_repair_utf8(buf);
-            dresult->AddToArray(MJsonNode::MakeJSON(buf));
-            sresult->AddToArray(MJsonNode::MakeInt(status));
-            tresult->AddToArray(MJsonNode::MakeInt(key.type));
-            lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
-         } else {
-            dresult->AddToArray(MJsonNode::MakeNull());
             sresult->AddToArray(MJsonNode::MakeInt(status));
             tresult->AddToArray(MJsonNode::MakeInt(key.type));
             lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
          }
+      } else {
+         int pos = w->Value();
+         status = db_copy_json_values(hDB, hkey, &w->fBuf, &w->fSize, &w->fEnd, omit_names,
+                                      omit_last_written, omit_old_timestamp, preserve_case);
+         js_end_odb_value(w, pos, status);
 
-         if (buf)
-            free(buf);
+         sresult->AddToArray(MJsonNode::MakeInt(status));
+         tresult->AddToArray(MJsonNode::MakeInt(key.type));
+         lwresult->AddToArray(MJsonNode::MakeInt(key.last_written));
       }
    }
 
-   MJsonNode* result = MJsonNode::MakeObject();
+   w->EndArray();
 
-   result->AddToObject("data", dresult);
-   result->AddToObject("status", sresult);
-   if (!omit_tid)
-      result->AddToObject("tid", tresult);
-   else
-      delete tresult;
-   if (!omit_last_written)
-      result->AddToObject("last_written", lwresult);
-   else
-      delete lwresult;
+   w->Key("status");
+   w->Node(sresult);
+   if (!omit_tid) {
+      w->Key("tid");
+      w->Node(tresult);
+   }
+   if (!omit_last_written) {
+      w->Key("last_written");
+      w->Node(lwresult);
+   }
 
-   return mjsonrpc_make_result(result);
+   w->EndObject();
+
+   delete sresult;
+   delete tresult;
+   delete lwresult;
+
+   return NULL;
 }
 
-static MJsonNode* js_db_ls(const MJsonNode* params)
+static MJsonNode* js_db_ls(const MJsonNode* params, MJsonStreamWriter* w)
 {
    if (!params) {
       MJSO* doc = MJSO::I();
@@ -816,12 +931,15 @@ static MJsonNode* js_db_ls(const MJsonNode* params)
 
    const MJsonNodeVector* paths = mjsonrpc_get_param_array(params, "paths", &error); if (error) return error;
 
-   MJsonNode* dresult = MJsonNode::MakeArray();
    MJsonNode* sresult = MJsonNode::MakeArray();
 
    HNDLE hDB;
    cm_get_experiment_database(&hDB, NULL);
 
+   w->BeginObject();
+   w->Key("data");
+   w->BeginArray();
+
    for (unsigned i=0; i<paths->size(); i++) {
       int status = 0;
       HNDLE hkey;
@@ -829,34 +947,29 @@ static MJsonNode* js_db_ls(const MJsonNode* params)
 
       status = db_find_key(hDB, 0, path.c_str(), &hkey);
       if (status != DB_SUCCESS) {
-         dresult->AddToArray(MJsonNode::MakeNull());
+         w->Null();
          sresult->AddToArray(MJsonNode::MakeInt(status));
          continue;
       }
 
-      char* buf = NULL;
-      int bufsize = 0;
-      int end = 0;
+      int pos = w->Value();
+      status = db_copy_json_ls(hDB, hkey, &w->fBuf, &w->fSize, &w->fEnd);
+      js_end_odb_value(w, pos, status);
 
-      status = db_copy_json_ls(hDB, hkey, &buf, &bufsize, &end);
+      sresult->AddToArray(MJsonNode::MakeInt(status));
+   }
 
-      if (status == DB_SUCCESS) {
-         ss_repair_utf8(buf);
-         dresult->AddToArray(MJsonNode::MakeJSON(buf));
-         sresult->AddToArray(MJsonNode::MakeInt(status));
-      } else {
-         dresult->AddToArray(MJsonNode::MakeNull());
-         sresult->AddToArray(MJsonNode::MakeInt(status));
-      }
+   w->EndArray();
+   w->Key("status");
+   w->Node(sresult);
+   w->EndObject();
 
-      if (buf)
-         free(buf);
-   }
+   delete sresult;
 
-   return mjsonrpc_make_result("data", dresult, "status", sresult);
+   return NULL;
 }
 
-static MJsonNode* js_db_copy(const MJsonNode* params)
+static MJsonNode* js_db_copy(const MJsonNode* params, MJsonStreamWriter* w)
 {
    if (!params) {
       MJSO* doc = MJSO::I();
@@ -871,12 +984,15 @@ static MJsonNode* js_db_copy(const MJsonNode* params)
 
    const MJsonNodeVector* paths = mjsonrpc_get_param_array(params, "paths", &error); if (error) return error;
 
-   MJsonNode* dresult = MJsonNode::MakeArray();
    MJsonNode* sresult = MJsonNode::MakeArray();
 
    HNDLE hDB;
    cm_get_experiment_database(&hDB, NULL);
 
+   w->BeginObject();
+   w->Key("data");
+   w->BeginArray();
+
    for (unsigned i=0; i<paths->size(); i++) {
       int status = 0;
       HNDLE hkey;
@@ -884,31 +1000,26 @@ static MJsonNode* js_db_copy(const MJsonNode* params)
 
       status = db_find_key(hDB, 0, path.c_str(), &hkey);
       if (status != DB_SUCCESS) {
-         dresult->AddToArray(MJsonNode::MakeNull());
+         w->Null();
          sresult->AddToArray(MJsonNode::MakeInt(status));
          continue;
       }
 
-      char* buf = NULL;
-      int bufsize = 0;
-      int end = 0;
+      int pos = w->Value();
+      status = db_copy_json_save(hDB, hkey, &w->fBuf, &w->fSize, &w->fEnd);
+      js_end_odb_value(w, pos, status);
 
-      status = db_copy_json_save(hDB, hkey, &buf, &bufsize, &end);
+      sresult->AddToArray(MJsonNode::MakeInt(status));
+   }
 
-      if (status == DB_SUCCESS) {
-         ss_repair_utf8(buf);
-         dresult->AddToArray(MJsonNode::MakeJSON(buf));
-         sresult->AddToArray(MJsonNode::MakeInt(status));
-      } else {
-         dresult->AddToArray(MJsonNode::MakeNull());
-         sresult->AddToArray(MJsonNode::MakeInt(status));
-      }
+   w->EndArray();
+   w->Key("status");
+   w->Node(sresult);
+   w->EndObject();
 
-      if (buf)
-         free(buf);
-   }
+   delete sresult;
 
-   return mjsonrpc_make_result("data", dresult, "status", sresult);
+   return NULL;
 }
 
 static MJsonNode* js_db_paste(const MJsonNode* params)
@@ -2102,7 +2213,7 @@ public:
    }
 };
 
-static MJsonNode* js_hs_read(const MJsonNode* params)
+static MJsonNode* js_hs_read(const MJsonNode* params, MJsonStreamWriter* w)
 {
    if (!params) {
       MJSO* doc = MJSO::I();
@@ -2186,21 +2297,38 @@ static MJsonNode* js_hs_read(const MJsonNode* params)
 
    int status = mh->hs_read_buffer(start_time, end_time, num_var, event_name, tag_name, var_index, buf, hs_status);
 
+   delete data;
+
+   w->BeginObject();
+   w->Key("status");
+   w->Int(status);
+   w->Key("channel");
+   w->String(mh->name);
+   w->Key("data");
+   w->BeginArray();
+
    for (unsigned i=0; i<num_var; i++) {
       jbuf[i]->Finish();
 
-      MJsonNode* obj = MJsonNode::MakeObject();
-      obj->AddToObject("status", MJsonNode::MakeInt(hs_status[i]));
-      obj->AddToObject("count", MJsonNode::MakeInt(jbuf[i]->fCount));
-      obj->AddToObject("time", MJsonNode::MakeJSON(jbuf[i]->fTimeJson.c_str()));
-      obj->AddToObject("value", MJsonNode::MakeJSON(jbuf[i]->fValueJson.c_str()));
-      data->AddToArray(obj);
+      w->BeginObject();
+      w->Key("status");
+      w->Int(hs_status[i]);
+      w->Key("count");
+      w->Int(jbuf[i]->fCount);
+      w->Key("time");
+      w->JSON(jbuf[i]->fTimeJson.c_str());
+      w->Key("value");
+      w->JSON(jbuf[i]->fValueJson.c_str());
+      w->EndObject();
 
       delete jbuf[i];
       jbuf[i] = NULL;
       buf[i] = NULL;
    }
 
+   w->EndArray();
+   w->EndObject();
+
    delete[] event_name;
    delete[] tag_name;
    delete[] var_index;
@@ -2208,7 +2336,7 @@ static MJsonNode* js_hs_read(const MJsonNode* params)
    delete[] jbuf;
    delete[] hs_status;
 
-   return mjsonrpc_make_result("status", MJsonNode::MakeInt(status), "channel", MJsonNode::MakeString(mh->name), "data", data);
+   return NULL;
 }
 
 static MJsonNode* js_hs_read_binned(const MJsonNode* params)
@@ -2419,6 +2547,127 @@ static MJsonNode* js_hs_read_binned(const MJsonNode* params)
    return mjsonrpc_make_result("status", MJsonNode::MakeInt(status), "channel", MJsonNode::MakeString(mh->name), "data", data);
 }
 
+// each pixel keeps a bin of four points for every variable
+#define HS_READ_DECIMATED_MAX_WIDTH 16384
+
+static MJsonNode* js_hs_read_decimated(const MJsonNode* params, MJsonStreamWriter* w)
+{
+   if (!params) {
+      MJSO* doc = MJSO::I();
+      doc->D("get history data decimated for plotting: for each pixel only the first, last, minimum and maximum data points are returned, using hs_read_buffer()");
+      doc->P("channel?", MJSON_STRING, "midas history channel, default is the default reader channel");
+      doc->P("start_time", MJSON_NUMBER, "start time of the data");
+      doc->P("end_time", MJSON_NUMBER, "end time of the data");
+      doc->P("width", MJSON_INT, "width of the plot in pixels, at most 16384");
+      doc->P("events[]", MJSON_STRING, "array of history event names");
+      doc->P("tags[]", MJSON_STRING, "array of history event tag names");
+      doc->P("index[]", MJSON_STRING, "array of history event tag array indices");
+      doc->R("status", MJSON_INT, "return status");
+      doc->R("channel", MJSON_STRING, "logger history channel name");
+      doc->R("data[]", MJSON_ARRAY, "array of history data");
+      doc->R("data[].status", MJSON_INT, "status for each event");
+      doc->R("data[].num_entries", MJSON_INT, "number of data points read for each event");
+      doc->R("data[].count", MJSON_INT, "number of data points returned for each event");
+      doc->R("data[].time[]", MJSON_NUMBER, "time data");
+      doc->R("data[].value[]", MJSON_NUMBER, "value data");
+      return doc;
+   }
+
+   MJsonNode* error = NULL;
+
+   std::string channel = mjsonrpc_get_param(params, "channel", NULL)->GetString();
+   double start_time = mjsonrpc_get_param(params, "start_time", &error)->GetDouble(); if (error) return error;
+   double end_time = mjsonrpc_get_param(params, "end_time", &error)->GetDouble(); if (error) return error;
+   int width = mjsonrpc_get_param(params, "width", &error)->GetInt(); if (error) return error;
+
+   if (width < 1 || width > HS_READ_DECIMATED_MAX_WIDTH) {
+      return mjsonrpc_make_error(-32602, "Invalid params", msprintf("Value of width should be between 1 and %d", HS_READ_DECIMATED_MAX_WIDTH).c_str());
+   }
+
+   const MJsonNodeVector* events_array = mjsonrpc_get_param_array(params, "events", NULL);
+   const MJsonNodeVector* tags_array = mjsonrpc_get_param_array(params, "tags", NULL);
+   const MJsonNodeVector* index_array = mjsonrpc_get_param_array(params, "index", NULL);
+
+   MidasHistoryInterface* mh = GetHistory(channel.c_str());
+
+   if (!mh) {
+      int status = HS_FILE_ERROR;
+      return mjsonrpc_make_result("status", MJsonNode::MakeInt(status), "data", MJsonNode::MakeArray());
+   }
+
+   unsigned num_var = events_array->size();
+
+   if (tags_array->size() != num_var) {
+      return mjsonrpc_make_error(-32602, "Invalid params", "Arrays events and tags should have the same length");
+   }
+
+   if (index_array->size() != num_var) {
+      return mjsonrpc_make_error(-32602, "Invalid params", "Arrays events and index should have the same length");
+   }
+
+   std::vector<std::string> event_names(num_var);
+   std::vector<std::string> tag_names(num_var);
+   std::vector<const char*> event_name(num_var);
+   std::vector<const char*> tag_name(num_var);
+   std::vector<int> var_index(num_var);
+   std::vector<int> hs_status(num_var);
+   std::vector<MidasHistoryDecimatedBuffer*> dbuf(num_var);
+   std::vector<MidasHistoryBufferInterface*> buf(num_var);
+
+   for (unsigned i=0; i<num_var; i++) {
+      event_names[i] = (*events_array)[i]->GetString();
+      tag_names[i] = (*tags_array)[i]->GetString();
+      event_name[i] = event_names[i].c_str();
+      tag_name[i] = tag_names[i].c_str();
+      var_index[i] = (*index_array)[i]->GetInt();
+      hs_status[i] = 0;
+      dbuf[i] = new MidasHistoryDecimatedBuffer(start_time, end_time, width);
+      buf[i] = dbuf[i];
+   }
+
+   int status = mh->hs_read_buffer(start_time, end_time, num_var, event_name.data(), tag_name.data(), var_index.data(), buf.data(), hs_status.data());
+
+   w->BeginObject();
+   w->Key("status");
+   w->Int(status);
+   w->Key("channel");
+   w->String(mh->name);
+   w->Key("data");
+   w->BeginArray();
+
+   for (unsigned i=0; i<num_var; i++) {
+      dbuf[i]->Finish();
+
+      w->BeginObject();
+      w->Key("status");
+      w->Int(hs_status[i]);
+      w->Key("num_entries");
+      w->Int(dbuf[i]->fNumEntries);
+      w->Key("count");
+      w->Int(dbuf[i]->fTime.size());
+      w->Key("time");
+      w->BeginArray();
+      for (size_t j=0; j<dbuf[i]->fTime.size(); j++)
+         w->Number(dbuf[i]->fTime[j]);
+      w->EndArray();
+      w->Key("value");
+      w->BeginArray();
+      for (size_t j=0; j<dbuf[i]->fValue.size(); j++)
+         w->Number(dbuf[i]->fValue[j]);
+      w->EndArray();
+      w->EndObject();
+
+      delete dbuf[i];
+      dbuf[i] = NULL;
+      buf[i] = NULL;
+   }
+
+   w->EndArray();
+   w->EndObject();
+
+   return NULL;
+}
+
 class BinaryHistoryBuffer: public MidasHistoryBufferInterface
 {
 public:
@@ -4619,6 +4868,7 @@ static MJsonNode* js_get_timezone(const MJsonNode* params)
 struct MethodsTableEntry
 {
    mjsonrpc_handler_t* fHandler = NULL;
+   mjsonrpc_stream_handler_t* fStreamHandler = NULL;
    bool fNeedsLocking = false;
 };
    
@@ -4636,6 +4886,14 @@ void mjsonrpc_add_handler(const char* method, mjsonrpc_handler_t* handler, bool
    gMethodsTable[method] = e;
 }
 
+void mjsonrpc_add_stream_handler(const char* method, mjsonrpc_stream_handler_t* handler, bool needs_locking)
+{
+   MethodsTableEntry e;
+   e.fStreamHandler = handler;
+   e.fNeedsLocking = needs_locking;
+   gMethodsTable[method] = e;
+}
+
 void mjsonrpc_set_std_mutex(void* mutex)
 {
    gMutex = (std::mutex*)mutex;
@@ -4672,10 +4930,10 @@ void mjsonrpc_init()
    mjsonrpc_add_handler("cm_transition", js_cm_transition, true);
    mjsonrpc_add_handler("bm_receive_event", js_bm_receive_event, true);
    // interface to odb functions
-   mjsonrpc_add_handler("db_copy",     js_db_copy);
+   mjsonrpc_add_stream_handler("db_copy",     js_db_copy);
    mjsonrpc_add_handler("db_paste",    js_db_paste);
-   mjsonrpc_add_handler("db_get_values", js_db_get_values);
-   mjsonrpc_add_handler("db_ls",       js_db_ls);
+   mjsonrpc_add_stream_handler("db_get_values", js_db_get_values);
+   mjsonrpc_add_stream_handler("db_ls",       js_db_ls);
    mjsonrpc_add_handler("db_create", js_db_create);
    mjsonrpc_add_handler("db_delete", js_db_delete);
    mjsonrpc_add_handler("db_resize", js_db_resize);
@@ -4697,8 +4955,9 @@ void mjsonrpc_init()
    mjsonrpc_add_handler("hs_get_tags", js_hs_get_tags, true);
    mjsonrpc_add_handler("hs_get_last_written", js_hs_get_last_written, true);
    mjsonrpc_add_handler("hs_reopen", js_hs_reopen, true);
-   mjsonrpc_add_handler("hs_read", js_hs_read, true);
+   mjsonrpc_add_stream_handler("hs_read", js_hs_read, true);
    mjsonrpc_add_handler("hs_read_binned", js_hs_read_binned, true);
+   mjsonrpc_add_stream_handler("hs_read_decimated", js_hs_read_decimated, true);
    mjsonrpc_add_handler("hs_read_arraybuffer", js_hs_read_arraybuffer, true);
    mjsonrpc_add_handler("hs_read_binned_arraybuffer", js_hs_read_binned_arraybuffer, true);
    // interface to image history
@@ -4751,7 +5010,11 @@ static MJsonNode* mjsonrpc_make_schema(MethodsTable* h)
       // iterator->first = key
       // iterator->second = value
       //printf("build schema for method \"%s\"!\n", iterator->first.c_str());
-      MJsonNode* doc = iterator->second.fHandler(NULL);
+      MJsonNode* doc = NULL;
+      if (iterator->second.fStreamHandler)
+         doc = iterator->second.fStreamHandler(NULL, NULL);
+      else
+         doc = iterator->second.fHandler(NULL);
       if (doc == NULL)
          doc = MJsonNode::MakeObject();
       m->AddToObject(iterator->first.c_str(), doc);
@@ -5094,7 +5357,7 @@ static void add(std::string* s, const char* text)
    *s += text;
 }
 
-static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request)
+static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request, MJsonStreamWriter* stream)
 {
    // find required request elements
    const MJsonNode* version = request->FindObjectNode("jsonrpc");
@@ -5191,7 +5454,24 @@ static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request)
          bool lock = s->second.fNeedsLocking;
          if (lock && gMutex)
             gMutex->lock();
-         result = s->second.fHandler(params);
+         if (s->second.fStreamHandler && stream) {
+            // write the reply directly into the stream
+            stream->Reset();
+            stream->BeginObject();
+            stream->Key("jsonrpc");
+            stream->String("2.0");
+            stream->Key("result");
+            result = s->second.fStreamHandler(params, stream);
+            if (result)
+               stream->Reset();
+         } else if (s->second.fStreamHandler) {
+            MJsonStreamWriter w;
+            result = s->second.fStreamHandler(params, &w);
+            if (!result)
+               result = mjsonrpc_make_result(MJsonNode::MakeJSON(w.fBuf));
+         } else {
+            result = s->second.fHandler(params);
+         }
          if (lock && gMutex)
             gMutex->unlock();
       } else {
@@ -5201,7 +5481,10 @@ static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request)
 
    if (mjsonrpc_debug) {
       printf("mjsonrpc: handler reply:\n");
-      result->Dump();
+      if (result)
+         result->Dump();
+      else
+         printf("%s", stream->fBuf);
       printf("\n");
    }
 
@@ -5215,6 +5498,21 @@ static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request)
       }
    }
 
+   if (!result) {
+      // reply of streaming handler, finish it
+      if (mjsonrpc_time) {
+         stream->Key("elapsed_time");
+         stream->Number(elapsed_time);
+      }
+      stream->Key("id");
+      if (id)
+         stream->Node(id);
+      else
+         stream->Null();
+      stream->EndObject();
+      return NULL;
+   }
+
    if (result->GetType() == MJSON_ARRAYBUFFER) {
       return result;
    }
@@ -5249,6 +5547,11 @@ static MJsonNode* mjsonrpc_handle_request(const MJsonNode* request)
 }
 
 MJsonNode* mjsonrpc_decode_post_data(const char* post_data)
+{
+   return mjsonrpc_decode_post_data(post_data, NULL);
+}
+
+MJsonNode* mjsonrpc_decode_post_data(const char* post_data, MJsonStreamWriter* stream)
 {
    //printf("mjsonrpc call, data [%s]\n", post_data);
    MJsonNode *request = MJsonNode::Parse(post_data);
@@ -5284,7 +5587,7 @@ MJsonNode* mjsonrpc_decode_post_data(const char* post_data)
       delete request;
       return reply;
    } else if (request->GetType() == MJSON_OBJECT) {
-      MJsonNode* reply = mjsonrpc_handle_request(request);
+      MJsonNode* reply = mjsonrpc_handle_request(request, stream);
       delete request;
       return reply;
    } else if (request->GetType() == MJSON_ARRAY) {
@@ -5308,7 +5611,7 @@ MJsonNode* mjsonrpc_decode_post_data(const char* post_data)
       MJsonNode* reply = MJsonNode::MakeArray();
 
       for (unsigned i=0; i<a->size(); i++) {
-         MJsonNode* r = mjsonrpc_handle_request(a->at(i));
+         MJsonNode* r = mjsonrpc_handle_request(a->at(i), NULL);
          reply->AddToArray(r);
          if (r->GetType() == MJSON_ARRAYBUFFER) {
             delete request;
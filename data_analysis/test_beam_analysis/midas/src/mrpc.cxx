@@ -195,6 +195,12 @@ static RPC_LIST rpc_list_library[] = {
     {{TID_INT32, RPC_IN},
      {0}}},
 
+   {RPC_BM_EVENT_STREAMS, "bm_event_streams",
+    {{TID_INT32, RPC_IN},
+     {TID_INT32, RPC_IN},
+     {TID_BOOL, RPC_IN},
+     {0}}},
+
    {RPC_BM_MARK_READ_WAITING, "bm_mark_read_waiting",
     {{TID_BOOL, RPC_IN},
      {0}}},
@@ -38,6 +38,10 @@ The Online Database file
 #include <assert.h>
 #include <signal.h>
 #include <math.h>
+#include <algorithm> // std::find
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "mjson.h"
 
@@ -56,6 +60,15 @@ The Online Database file
 #ifdef LOCAL_ROUTINES
 static DATABASE *_database;
 static INT _database_entries = 0;
+
+/* background flusher, see db_flush_database() */
+static std::mutex _db_flush_mutex; // held by the flusher while it uses _database
+static std::mutex _db_flush_request_mutex; // protects the variables below
+static std::condition_variable _db_flush_cv;
+static std::vector<HNDLE> _db_flush_request;
+static bool _db_flush_exit = false;
+static std::thread* _db_flush_thread = NULL;
+static int _db_flush_pid = 0;
 #endif
 
 static RECORD_LIST *_record_list;
@@ -89,6 +102,7 @@ static INT db_set_data_index_wlocked(DATABASE_HEADER* pheader, KEY* pkey, int id
 static INT db_check_set_data_locked(DATABASE_HEADER* pheader, const KEY* pkey, const void *data, INT data_size, INT num_values, DWORD type, const char* caller, db_err_msg** msg);
 static INT db_check_set_data_index_locked(DATABASE_HEADER* pheader, const KEY* pkey, int idx, const void *data, INT data_size, DWORD type, const char* caller, db_err_msg** msg);
 static int db_remove_open_record_wlocked(DATABASE* pdb, DATABASE_HEADER* pheader, HNDLE hKey);
+static INT db_allow_write_tracked_locked(DATABASE* p, const char* caller_name);
 #endif // LOCAL_ROUTINES
 
 /*------------------------------------------------------------------*/
@@ -193,6 +207,177 @@ void db_flush_msg(db_err_msg** msgp)
 
 #ifdef LOCAL_ROUTINES
 
+/*
+ * Dirty page tracking
+ *
+ * Each process remembers which pages of the ODB shared memory it has
+ * modified since its last flush, and db_flush_database() writes only
+ * these pages to the .ODB.SHM file. The bitmap lives in the per-process
+ * DATABASE structure, the shared DATABASE_HEADER is not changed.
+ */
+
+#define ODB_PAGE_SIZE 4096
+
+static DATABASE* db_get_database_locked(const DATABASE_HEADER* pheader)
+{
+   for (int i = 0; i < _database_entries; i++)
+      if (_database[i].database_header == pheader)
+         return &_database[i];
+   return NULL;
+}
+
+static void db_mark_dirty_locked(DATABASE* pdb, const void* addr, size_t size)
+{
+   if (!pdb || !pdb->dirty_pages || size == 0)
+      return;
+
+   size_t offset = (const char*) addr - (const char*) pdb->database_header;
+   size_t first = offset / ODB_PAGE_SIZE;
+   size_t last = (offset + size - 1) / ODB_PAGE_SIZE;
+
+   if (first >= (size_t) pdb->dirty_npages)
+      return;
+   if (last >= (size_t) pdb->dirty_npages)
+      last = pdb->dirty_npages - 1;
+
+   memset(pdb->dirty_pages + first, 1, last - first + 1);
+   pdb->dirty = TRUE;
+}
+
+static void db_mark_dirty_locked(const DATABASE_HEADER* pheader, const void* addr, size_t size)
+{
+   db_mark_dirty_locked(db_get_database_locked(pheader), addr, size);
+}
+
+static void db_mark_dirty_all_locked(DATABASE* pdb)
+{
+   if (!pdb || !pdb->dirty_pages)
+      return;
+
+   memset(pdb->dirty_pages, 1, pdb->dirty_npages);
+   pdb->dirty = TRUE;
+}
+
+static void db_mark_dirty_all_locked(const DATABASE_HEADER* pheader)
+{
+   db_mark_dirty_all_locked(db_get_database_locked(pheader));
+}
+
+/* write pages modified by this process to disk, ODB has to be locked */
+static INT db_flush_dirty_locked(DATABASE* pdb)
+{
+   if (!pdb->dirty)
+      return DB_SUCCESS;
+
+   int status = ss_shm_flush(pdb->name, pdb->shm_adr, pdb->shm_size, pdb->shm_handle, pdb->dirty_pages, ODB_PAGE_SIZE);
+   if (status != SS_SUCCESS)
+      return DB_FILE_ERROR;
+
+   memset(pdb->dirty_pages, 0, pdb->dirty_npages);
+   pdb->dirty = FALSE;
+
+   return DB_SUCCESS;
+}
+
+static void db_flush_thread()
+{
+   ss_thread_set_name("db_flush");
+
+   std::unique_lock<std::mutex> lock(_db_flush_request_mutex);
+
+   while (!_db_flush_exit) {
+      _db_flush_cv.wait(lock, [] { return _db_flush_exit || !_db_flush_request.empty(); });
+
+      std::vector<HNDLE> request;
+      request.swap(_db_flush_request);
+      lock.unlock();
+
+      std::vector<char> copy; // dirty pages, written outside of the ODB lock
+
+      for (HNDLE hDB : request) {
+         std::lock_guard<std::mutex> guard(_db_flush_mutex);
+
+         if (hDB > _database_entries || hDB <= 0 || !_database[hDB - 1].attached)
+            continue;
+
+         DATABASE* pdb = &_database[hDB - 1];
+
+         /* copy our dirty pages under the lock, write them without it,
+            so that ODB writers do not wait for the disk */
+         db_lock_database_shared(hDB);
+         if (!pdb->dirty) {
+            db_unlock_database(hDB);
+            continue;
+         }
+         std::vector<unsigned char> pages(pdb->dirty_pages, pdb->dirty_pages + pdb->dirty_npages);
+         ss_shm_copy_dirty(pdb->shm_adr, pdb->shm_size, pages.data(), ODB_PAGE_SIZE, &copy);
+         memset(pdb->dirty_pages, 0, pdb->dirty_npages);
+         pdb->dirty = FALSE;
+         db_unlock_database(hDB);
+
+         int status = ss_shm_flush_copy(pdb->name, pdb->shm_adr, pdb->shm_size, pages.data(), ODB_PAGE_SIZE, copy);
+
+         if (status != SS_SUCCESS) {
+            /* try again next time */
+            db_lock_database_shared(hDB);
+            for (int i = 0; i < pdb->dirty_npages; i++)
+               pdb->dirty_pages[i] |= pages[i];
+            pdb->dirty = TRUE;
+            db_unlock_database(hDB);
+         }
+      }
+
+      lock.lock();
+   }
+}
+
+static void db_request_flush(HNDLE hDB)
+{
+   std::lock_guard<std::mutex> lock(_db_flush_request_mutex);
+
+   /* after fork() the flusher thread only exists in the parent */
+   if (_db_flush_thread && _db_flush_pid != ss_getpid())
+      _db_flush_thread = NULL;
+
+   if (!_db_flush_thread) {
+      _db_flush_exit = false;
+      _db_flush_pid = ss_getpid();
+      _db_flush_thread = new std::thread(db_flush_thread);
+   }
+
+   if (std::find(_db_flush_request.begin(), _db_flush_request.end(), hDB) == _db_flush_request.end())
+      _db_flush_request.push_back(hDB);
+
+   _db_flush_cv.notify_one();
+}
+
+static void db_stop_flush_thread()
+{
+   std::thread* thread = NULL;
+
+   {
+      std::lock_guard<std::mutex> lock(_db_flush_request_mutex);
+      if (_db_flush_pid == ss_getpid())
+         thread = _db_flush_thread;
+      _db_flush_thread = NULL;
+      _db_flush_exit = true;
+      _db_flush_request.clear();
+   }
+
+   _db_flush_cv.notify_one();
+
+   if (thread) {
+      thread->join();
+      delete thread;
+   }
+}
+
+#endif // LOCAL_ROUTINES
+
+/*------------------------------------------------------------------*/
+
+#ifdef LOCAL_ROUTINES
+
 /********************************************************************\
 *                                                                    *
 *            Shared Memory Allocation                                *
@@ -214,6 +399,8 @@ static void *malloc_key(DATABASE_HEADER * pheader, INT size, const char* caller)
 
    //printf("malloc_key(%d) from [%s]\n", size, caller);
 
+   db_mark_dirty_all_locked(pheader);
+
    if (!db_validate_key_offset(pheader, pheader->first_free_key)) {
       return NULL;
    }
@@ -286,6 +473,8 @@ static void free_key(DATABASE_HEADER * pheader, void *address, INT size)
 
    assert(address != pheader);
 
+   db_mark_dirty_all_locked(pheader);
+
    /* quadword alignment for alpha CPU */
    size = ALIGN8(size);
 
@@ -377,6 +566,8 @@ static void *malloc_data(DATABASE_HEADER * pheader, INT size)
       return NULL;
    }
 
+   db_mark_dirty_all_locked(pheader);
+
    /* search for free block */
    FREE_DESCRIP *pfree = (FREE_DESCRIP *) ((char *) pheader + pheader->first_free_data);
    FREE_DESCRIP *pprev = NULL;
@@ -461,6 +652,8 @@ static int free_data(DATABASE_HEADER * pheader, void *address, INT size, const c
    /* smallest allocation size is 8 bytes to make sure we can always create a new FREE_DESCRIP in free_data() */
    assert(size >= (int)sizeof(FREE_DESCRIP));
 
+   db_mark_dirty_all_locked(pheader);
+
    FREE_DESCRIP *pprev = NULL;
    FREE_DESCRIP *pfree = (FREE_DESCRIP *) address;
    int pfree_offset = (POINTER_T) address - (POINTER_T) pheader;
@@ -1484,7 +1677,7 @@ static void db_validate_sizes()
    assert(sizeof(DATABASE_HEADER) == 135232);
    assert(sizeof(EVENT_HEADER) == 16);
    //assert(sizeof(EQUIPMENT_INFO) == 696); has been moved to dynamic checking inside mhttpd.c
-   assert(sizeof(EQUIPMENT_STATS) == 24);
+   assert(sizeof(EQUIPMENT_STATS) == 32);
    assert(sizeof(BANK_HEADER) == 8);
    assert(sizeof(BANK) == 8);
    assert(sizeof(BANK32) == 12);
@@ -1840,6 +2033,7 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
 
       /* if not found, create new one */
       if (i == _database_entries) {
+         std::lock_guard<std::mutex> guard(_db_flush_mutex);
          _database = (DATABASE *) realloc(_database, sizeof(DATABASE) * (_database_entries + 1));
          memset(&_database[_database_entries], 0, sizeof(DATABASE));
 
@@ -1872,6 +2066,12 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
 
    _database[handle].database_header = (DATABASE_HEADER *) shm_adr;
 
+   /* nothing to flush yet, the disk file matches the shared memory */
+   _database[handle].dirty_npages = (shm_size + ODB_PAGE_SIZE - 1) / ODB_PAGE_SIZE;
+   _database[handle].dirty_pages = (unsigned char *) calloc(_database[handle].dirty_npages, 1);
+   _database[handle].dirty = FALSE;
+   _database[handle].last_flush = ss_time();
+
    /* shortcut to header */
    pheader = _database[handle].database_header;
 
@@ -1886,6 +2086,7 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
    if (shm_created && pheader->name[0] == 0) {
       /* setup header info if database was created */
       memset(pheader, 0, sizeof(DATABASE_HEADER) + 2 * ALIGN8(database_size / 2));
+      db_mark_dirty_all_locked(&_database[handle]);
 
       strcpy(pheader->name, database_name);
       pheader->version = DATABASE_VERSION;
@@ -1929,6 +2130,15 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
       pkeylist->first_key = 0;
    }
 
+   /* a version 3 ODB loaded from its file can be used as is, only the lock
+      changed. Not while it is shared with a running version 3 client,
+      which locks it with the old semaphore */
+   if (shm_created && pheader->version == 3) {
+      cm_msg(MINFO, "db_open_database", "Database \"%s\" converted from version 3 to version %d", database_name, DATABASE_VERSION);
+      pheader->version = DATABASE_VERSION;
+      db_mark_dirty_all_locked(&_database[handle]);
+   }
+
    /* check database version */
    if (pheader->version != DATABASE_VERSION) {
       cm_msg(MERROR, "db_open_database",
@@ -1985,13 +2195,14 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
       return DB_NO_SEMAPHORE;
    }
 
-   /* create semaphore for the database */
-   status = ss_semaphore_create(database_name, &(_database[handle].semaphore));
+   /* create reader/writer lock for the database */
+   status = ss_rwlock_create(database_name, &(_database[handle].semaphore));
    if (status != SS_SUCCESS && status != SS_CREATED) {
       *hDB = 0;
       return DB_NO_SEMAPHORE;
    }
    _database[handle].lock_cnt = 0;
+   _database[handle].lock_shared = FALSE;
 
    _database[handle].protect = FALSE;
    _database[handle].protect_read = FALSE;
@@ -2043,6 +2254,9 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
          /* clear entry from client structure in database header */
          memset(&(pheader->client[i]), 0, sizeof(DATABASE_CLIENT));
 
+         /* the client may have died with modifications it did not write to disk */
+         db_mark_dirty_all_locked(&_database[handle]);
+
          cm_msg(MERROR, "db_open_database", "Removed ODB client \'%s\', index %d because process pid %d does not exists", client_name_tmp, i, client_pid);
       }
    }
@@ -2087,9 +2301,15 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
    cm_get_watchdog_params(&call_watchdog, &timeout);
    pclient->watchdog_timeout = timeout;
 
+   db_mark_dirty_locked(&_database[handle], pclient, sizeof(DATABASE_CLIENT));
+   db_mark_dirty_locked(&_database[handle], &pheader->num_clients, sizeof(pheader->num_clients));
+   db_mark_dirty_locked(&_database[handle], &pheader->max_client_index, sizeof(pheader->max_client_index));
+
    /* check ODB for corruption */
    db_err_msg* msg = NULL;
    bool ok = db_validate_and_repair_db_wlocked(pheader, &msg);
+   if (msg || !ok)
+      db_mark_dirty_all_locked(&_database[handle]); // repairs are not tracked
    if (msg)
       db_flush_msg(&msg);
    if (!ok) {
@@ -2121,6 +2341,9 @@ INT db_open_database(const char *xdatabase_name, INT database_size, HNDLE * hDB,
       return status;
    }
 
+   if (msg)
+      db_mark_dirty_all_locked(&_database[handle]); // open record flags were corrected
+
    db_unlock_database(handle + 1);
 
    if (msg)
@@ -2158,6 +2381,11 @@ INT db_close_database(HNDLE hDB)
       /* flush database to disk */
       db_flush_database(hDB);
 
+      /* the flusher thread uses _database, stop it before we change it */
+      db_stop_flush_thread();
+
+      std::lock_guard<std::mutex> guard(_db_flush_mutex);
+
       /* first lock database */
       db_lock_database(hDB);
 
@@ -2172,7 +2400,7 @@ INT db_close_database(HNDLE hDB)
       DATABASE_HEADER *pheader = pdb->database_header;
       DATABASE_CLIENT *pclient = db_get_my_client_locked(pdb);
 
-      db_allow_write_locked(&_database[hDB-1], "db_close_database");
+      db_allow_write_tracked_locked(pdb, "db_close_database");
 
       /* close all open records */
       for (i = 0; i < pclient->max_index; i++)
@@ -2184,24 +2412,34 @@ INT db_close_database(HNDLE hDB)
 
       /* clear entry from client structure in database header */
       memset(pclient, 0, sizeof(DATABASE_CLIENT));
+      db_mark_dirty_locked(pdb, pclient, sizeof(DATABASE_CLIENT));
 
       /* calculate new max_client_index entry */
       for (i = MAX_CLIENTS - 1; i >= 0; i--)
          if (pheader->client[i].pid != 0)
             break;
       pheader->max_client_index = i + 1;
+      db_mark_dirty_locked(pdb, &pheader->max_client_index, sizeof(pheader->max_client_index));
 
       /* count new number of clients */
       for (i = MAX_CLIENTS - 1, j = 0; i >= 0; i--)
          if (pheader->client[i].pid != 0)
             j++;
       pheader->num_clients = j;
+      db_mark_dirty_locked(pdb, &pheader->num_clients, sizeof(pheader->num_clients));
 
       destroy_flag = (pheader->num_clients == 0);
 
-      /* flush shared memory to disk before it gets deleted */
+      /* write our modifications to disk, nobody else knows about them. If we
+         are the last one, flush everything before the shared memory gets deleted */
       if (destroy_flag)
-         ss_shm_flush(pheader->name, pdb->shm_adr, pdb->shm_size, pdb->shm_handle, true);
+         db_mark_dirty_all_locked(pdb);
+      db_flush_dirty_locked(pdb);
+
+      free(pdb->dirty_pages);
+      pdb->dirty_pages = NULL;
+      pdb->dirty_npages = 0;
+      pdb->dirty = FALSE;
 
       strlcpy(xname, pheader->name, sizeof(xname));
 
@@ -2214,8 +2452,8 @@ INT db_close_database(HNDLE hDB)
       /* unlock database */
       db_unlock_database(hDB);
 
-      /* delete semaphore */
-      ss_semaphore_delete(pdb->semaphore, destroy_flag);
+      /* delete reader/writer lock */
+      ss_rwlock_delete(pdb->semaphore, destroy_flag);
 
       /* delete mutex */
       ss_mutex_delete(pdb->mutex);
@@ -2262,6 +2500,8 @@ INT db_flush_database(HNDLE hDB)
   Routine: db_flush_database
 
   Purpose: Flushes the shared memory of a database to its disk file.
+           Once per flush period the pages modified by this process
+           are handed to a background thread which writes them.
 
   Input:
     HNDLE  hDB              Handle to the database, which is used as
@@ -2282,7 +2522,7 @@ INT db_flush_database(HNDLE hDB)
 
 #ifdef LOCAL_ROUTINES
    else {
-      int status, size;
+      int size;
       uint32_t flush_period = 60;
       uint32_t last_flush = 0;
 
@@ -2297,13 +2537,6 @@ INT db_flush_database(HNDLE hDB)
       size = sizeof(last_flush);
       db_get_value(hDB, 0, "/System/Flush/Last flush", &last_flush, &size, TID_UINT32, true);
 
-      HNDLE hkey;
-      status = db_find_key(hDB, 0, "/System/Flush/Last flush", &hkey);
-      if (status != DB_SUCCESS) {
-         cm_msg(MERROR, "db_flush_database", "Cannot obtain key /System/Flush/Last flush");
-         return DB_INVALID_HANDLE;
-      }
-
       db_lock_database(hDB);
       DATABASE *pdb = &_database[hDB - 1];
       DATABASE_HEADER *pheader = pdb->database_header;
@@ -2316,31 +2549,25 @@ INT db_flush_database(HNDLE hDB)
 
       db_err_msg *msg = nullptr;
 
-      const KEY *pkey = db_get_pkey(pheader, hkey, &status, "db_flush_database", &msg);
-
-      if (!pkey) {
-         db_unlock_database(hDB);
-         if (msg)
-            db_flush_msg(&msg);
-         return CM_NO_CLIENT;
-      }
-
-      size = sizeof(last_flush);
-      status = db_get_data_locked(pheader, pkey, 0, &last_flush, &size, TID_UINT32, &msg);
-
-      /* only flush if period has expired */
-      if (ss_time() > last_flush + flush_period) {
-         db_allow_write_locked(pdb, "db_flush_database");
+      /* only flush if period has expired. Each process writes the pages it
+         has modified itself, so the period is kept per process */
+      bool flush = (ss_time() > pdb->last_flush + flush_period);
+      if (flush) {
+         db_allow_write_tracked_locked(pdb, "db_flush_database");
 
          /* update last flush time in ODB */
-         last_flush = ss_time();
+         pdb->last_flush = ss_time();
+         last_flush = pdb->last_flush;
          db_set_value_wlocked(pheader, hDB, 0, "/System/Flush/Last flush", &last_flush, sizeof(last_flush), 1, TID_UINT32, &msg);
-
-         /* flush shared memory to disk */
-         ss_shm_flush(pheader->name, _database[hDB - 1].shm_adr, _database[hDB - 1].shm_size, _database[hDB - 1].shm_handle, false);
       }
 
       db_unlock_database(hDB);
+      if (msg)
+         db_flush_msg(&msg);
+
+      /* write dirty pages to disk from the flusher thread */
+      if (flush)
+         db_request_flush(hDB);
    }
 #endif                          /* LOCAL_ROUTINES */
 
@@ -2436,16 +2663,9 @@ INT db_set_client_name(HNDLE hDB, const char *client_name)
 /**dox***************************************************************/
 #endif                          /* DOXYGEN_SHOULD_SKIP_THIS */
 
-/********************************************************************/
-/**
-Lock a database for exclusive access via system semaphore calls.
-@param hDB   Handle to the database to lock
-@return DB_SUCCESS, DB_INVALID_HANDLE, DB_TIMEOUT
-*/
-
-INT db_lock_database(HNDLE hDB)
-{
 #ifdef LOCAL_ROUTINES
+static INT db_lock_database1(HNDLE hDB, BOOL shared)
+{
    int status;
 
    if (hDB > _database_entries || hDB <= 0) {
@@ -2486,8 +2706,12 @@ INT db_lock_database(HNDLE hDB)
 
    if (_database[hDB - 1].lock_cnt == 0) {
       _database[hDB - 1].lock_cnt = 1;
+      _database[hDB - 1].lock_shared = shared;
       /* wait max. 5 minutes for semaphore (required if locking process is being debugged) */
-      status = ss_semaphore_wait_for(_database[hDB - 1].semaphore, _database[hDB - 1].timeout);
+      if (shared)
+         status = ss_rwlock_read_lock(_database[hDB - 1].semaphore, _database[hDB - 1].timeout);
+      else
+         status = ss_rwlock_write_lock(_database[hDB - 1].semaphore, _database[hDB - 1].timeout);
       if (status == SS_TIMEOUT) {
          cm_msg(MERROR, "db_lock_database", "cannot lock ODB semaphore, timeout %d ms, exiting...", _database[hDB - 1].timeout);
          exit(1);
@@ -2497,6 +2721,11 @@ INT db_lock_database(HNDLE hDB)
          abort();
       }
    } else {
+      /* a shared lock cannot be upgraded, other readers may be inside */
+      if (_database[hDB - 1].lock_shared && !shared) {
+         fprintf(stderr, "db_lock_database: Detected exclusive lock request while holding a shared lock. Cannot continue, aborting...\n");
+         abort();
+      }
       _database[hDB - 1].lock_cnt++; // we have already the lock (recursive call), so just increase counter
    }
 
@@ -2528,15 +2757,52 @@ INT db_lock_database(HNDLE hDB)
 
    _database[hDB - 1].inside_lock_unlock = 0;
 
+   return DB_SUCCESS;
+}
 #endif                          /* LOCAL_ROUTINES */
-   
+
+/********************************************************************/
+/**
+Lock a database for exclusive access via system semaphore calls.
+@param hDB   Handle to the database to lock
+@return DB_SUCCESS, DB_INVALID_HANDLE, DB_TIMEOUT
+*/
+
+INT db_lock_database(HNDLE hDB)
+{
+#ifdef LOCAL_ROUTINES
+   return db_lock_database1(hDB, FALSE);
+#else
    return DB_SUCCESS;
+#endif
 }
 
+/********************************************************************/
+/**
+Lock a database for reading. Other processes holding a shared lock
+may read at the same time, writers are excluded. Inside a shared
+lock the database must not be modified and db_lock_database() must
+not be called. Unlock with db_unlock_database().
+@param hDB   Handle to the database to lock
+@return DB_SUCCESS, DB_INVALID_HANDLE, DB_TIMEOUT
+*/
+
+INT db_lock_database_shared(HNDLE hDB)
+{
 #ifdef LOCAL_ROUTINES
-INT db_allow_write_locked(DATABASE* p, const char* caller_name)
+   return db_lock_database1(hDB, TRUE);
+#else
+   return DB_SUCCESS;
+#endif
+}
+
+
+#ifdef LOCAL_ROUTINES
+/* same as db_allow_write_locked(), but the caller marks what it modifies via db_mark_dirty_locked() */
+static INT db_allow_write_tracked_locked(DATABASE* p, const char* caller_name)
 {
    assert(p);
+   assert(!p->lock_shared);
    if (p->protect && !p->protect_write) {
       int status;
       assert(p->lock_cnt > 0);
@@ -2554,6 +2820,14 @@ INT db_allow_write_locked(DATABASE* p, const char* caller_name)
    }
    return DB_SUCCESS;
 }
+
+INT db_allow_write_locked(DATABASE* p, const char* caller_name)
+{
+   db_allow_write_tracked_locked(p, caller_name);
+   /* we do not know what the caller is going to modify */
+   db_mark_dirty_all_locked(p);
+   return DB_SUCCESS;
+}
 #endif                          /* LOCAL_ROUTINES */
 
 /********************************************************************/
@@ -2595,7 +2869,11 @@ INT db_unlock_database(HNDLE hDB)
    //}
 
    if (_database[hDB - 1].lock_cnt == 1) {
-      ss_semaphore_release(_database[hDB - 1].semaphore);
+      if (_database[hDB - 1].lock_shared)
+         ss_rwlock_read_unlock(_database[hDB - 1].semaphore);
+      else
+         ss_rwlock_write_unlock(_database[hDB - 1].semaphore);
+      _database[hDB - 1].lock_shared = FALSE;
 
       if (_database[hDB - 1].protect && _database[hDB - 1].database_header) {
          int status;
@@ -2686,7 +2964,7 @@ INT db_update_last_activity(DWORD millitime)
    for (int i = 0; i < _database_entries; i++) {
       if (_database[i].attached) {
          db_lock_database(i + 1);
-         db_allow_write_locked(&_database[i], "db_update_last_activity");
+         db_allow_write_tracked_locked(&_database[i], "db_update_last_activity");
          assert(_database[i].database_header);
          /* update the last_activity entry to show that we are alive */
          for (int j=0; j<_database[i].database_header->max_client_index; j++) {
@@ -2694,6 +2972,7 @@ INT db_update_last_activity(DWORD millitime)
             //printf("client %d pid %d vs our pid %d\n", j, pdbclient->pid, pid);
             if (pdbclient->pid == pid) {
                pdbclient->last_activity = millitime;
+               db_mark_dirty_locked(&_database[i], &pdbclient->last_activity, sizeof(pdbclient->last_activity));
                found = true;
             }
          }
@@ -2716,6 +2995,9 @@ static void db_delete_client_wlocked(DATABASE_HEADER* pheader, int jclient, db_e
 {
    DATABASE_CLIENT* pdbclient = &pheader->client[jclient];
 
+   /* the client may have died with modifications it did not write to disk */
+   db_mark_dirty_all_locked(pheader);
+
    /* decrement notify_count for open records and clear exclusive mode */
    int k;
    for (k = 0; k < pdbclient->max_index; k++)
@@ -2825,13 +3107,14 @@ void db_cleanup(const char *who, DWORD actual_time, BOOL wrong_interval)
          continue;
 
       db_lock_database(i + 1);
-      db_allow_write_locked(pdb, "db_cleanup");
+      db_allow_write_tracked_locked(pdb, "db_cleanup");
 
       DATABASE_HEADER* pheader = pdb->database_header;
       DATABASE_CLIENT* pclient = db_get_my_client_locked(pdb);
       
       /* update the last_activity entry to show that we are alive */
       pclient->last_activity = actual_time;
+      db_mark_dirty_locked(pdb, &pclient->last_activity, sizeof(pclient->last_activity));
       
       /* don't check other clients if interval is stange */
       if (wrong_interval) {
@@ -2898,13 +3181,14 @@ void db_cleanup2(const char* client_name, int ignore_timeout, DWORD actual_time,
 
          DATABASE* pdb = &_database[i];
 
-         db_allow_write_locked(pdb, "db_cleanup2");
+         db_allow_write_tracked_locked(pdb, "db_cleanup2");
 
          DWORD now = ss_millitime();
 
          DATABASE_HEADER* pheader = pdb->database_header;
          DATABASE_CLIENT* pclient = db_get_my_client_locked(pdb);
          pclient->last_activity = now;
+         db_mark_dirty_locked(pdb, &pclient->last_activity, sizeof(pclient->last_activity));
          
          /* now check other clients */
          int j;
@@ -4090,7 +4374,7 @@ INT db_find_key(HNDLE hDB, HNDLE hKey, const char *key_name, HNDLE * subhKey)
 
       db_err_msg *msg = NULL;
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
       
@@ -5018,7 +5302,7 @@ INT db_get_path(HNDLE hDB, HNDLE hKey, char *path, INT buf_size)
          return DB_INVALID_HANDLE;
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -5074,7 +5358,7 @@ std::string db_get_path(HNDLE hDB, HNDLE hKey)
          return "(DB_INVALID_HANDLE)";
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -5265,7 +5549,7 @@ INT db_set_value(HNDLE hDB, HNDLE hKeyRoot, const char *key_name, const void *da
 
       DATABASE_HEADER* pheader = _database[hDB - 1].database_header;
 
-      db_allow_write_locked(&_database[hDB-1], "db_set_value");
+      db_allow_write_tracked_locked(&_database[hDB-1], "db_set_value");
 
       db_err_msg* msg = NULL;
 
@@ -5437,8 +5721,14 @@ INT db_get_value(HNDLE hDB, HNDLE hKeyRoot, const char *key_name, void *data, IN
          }
       }
 
-      /* now lock database */
-      db_lock_database(hDB);
+      /* now lock database, exclusive only if the key has to be created */
+      BOOL shared = TRUE;
+
+   retry:
+      if (shared)
+         db_lock_database_shared(hDB);
+      else
+         db_lock_database(hDB);
 
       DATABASE_HEADER* pheader = _database[hDB - 1].database_header;
       db_err_msg* msg = NULL;
@@ -5454,6 +5744,15 @@ INT db_get_value(HNDLE hDB, HNDLE hKeyRoot, const char *key_name, void *data, IN
 
       const KEY* pkey = db_find_pkey_locked(pheader, pkey_root, keyname, &status, &msg);
 
+      if (!pkey && create && shared) {
+         /* someone may create the key between unlock and lock, so look again */
+         db_unlock_database(hDB);
+         if (msg)
+            db_flush_msg(&msg);
+         shared = FALSE;
+         goto retry;
+      }
+
       if (!pkey) {
          if (create) {
             db_allow_write_locked(&_database[hDB-1], "db_get_value");
@@ -5598,7 +5897,7 @@ INT db_enum_key(HNDLE hDB, HNDLE hKey, INT idx, HNDLE * subkey_handle)
       *subkey_handle = 0;
 
       /* first lock database */
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
       if (!hKey)
@@ -5762,7 +6061,7 @@ INT db_enum_link(HNDLE hDB, HNDLE hKey, INT idx, HNDLE * subkey_handle)
       *subkey_handle = 0;
 
       /* first lock database */
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
       if (!hKey)
@@ -6033,7 +6332,7 @@ INT db_get_key(HNDLE hDB, HNDLE hKey, KEY * key)
 
       db_err_msg *msg = NULL;
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -6204,7 +6503,7 @@ INT db_get_key_info(HNDLE hDB, HNDLE hKey, char *name, INT name_size, INT * type
          return DB_INVALID_HANDLE;
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -6550,7 +6849,7 @@ INT db_get_data(HNDLE hDB, HNDLE hKey, void *data, INT * buf_size, DWORD type)
          return DB_INVALID_HANDLE;
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       DATABASE_HEADER* pheader = _database[hDB - 1].database_header;
       db_err_msg* msg = NULL;
@@ -6668,7 +6967,7 @@ INT db_get_link_data(HNDLE hDB, HNDLE hKey, void *data, INT * buf_size, DWORD ty
          return DB_INVALID_HANDLE;
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -6908,7 +7207,7 @@ INT db_get_data_index(HNDLE hDB, HNDLE hKey, void *data, INT * buf_size, INT idx
          return DB_INVALID_HANDLE;
       }
 
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       pheader = _database[hDB - 1].database_header;
 
@@ -7045,6 +7344,9 @@ static INT db_set_data_wlocked(DATABASE_HEADER* pheader, KEY* pkey, const void *
    /* update time */
    pkey->last_written = ss_time();
 
+   db_mark_dirty_locked(pheader, pkey, sizeof(KEY));
+   db_mark_dirty_locked(pheader, (char *) pheader + pkey->data, data_size);
+
    return DB_SUCCESS;
 }
 
@@ -7089,6 +7391,9 @@ static INT db_set_data_index_wlocked(DATABASE_HEADER* pheader, KEY* pkey, int id
    /* update time */
    pkey->last_written = ss_time();
 
+   db_mark_dirty_locked(pheader, pkey, sizeof(KEY));
+   db_mark_dirty_locked(pheader, (char *) pheader + pkey->data + idx * pkey->item_size, pkey->item_size);
+
    return DB_SUCCESS;
 }
 
@@ -7281,7 +7586,7 @@ INT db_set_data(HNDLE hDB, HNDLE hKey, const void *data, INT buf_size, INT num_v
          return status;
       }
 
-      db_allow_write_locked(&_database[hDB-1], "db_set_data");
+      db_allow_write_tracked_locked(&_database[hDB-1], "db_set_data");
 
       status = db_set_data_wlocked(pheader, pkey, data, buf_size, num_values, type, "db_set_data", &msg);
 
@@ -7384,7 +7689,7 @@ INT db_set_data1(HNDLE hDB, HNDLE hKey, const void *data, INT buf_size, INT num_
       return status;
    }
    
-   db_allow_write_locked(&_database[hDB - 1], "db_set_data1");
+   db_allow_write_tracked_locked(&_database[hDB - 1], "db_set_data1");
 
    status = db_set_data_wlocked(pheader, pkey, data, buf_size, num_values, type, "db_set_data1", &msg);
    
@@ -7467,7 +7772,7 @@ INT db_set_link_data(HNDLE hDB, HNDLE hKey, const void *data, INT buf_size, INT
          return status;
       }
 
-      db_allow_write_locked(&_database[hDB - 1], "db_set_link_data");
+      db_allow_write_tracked_locked(&_database[hDB - 1], "db_set_link_data");
 
       status = db_set_data_wlocked(pheader, pkey, data, buf_size, num_values, type, "db_set_link_data", &msg);
       
@@ -7711,7 +8016,7 @@ INT db_set_data_index(HNDLE hDB, HNDLE hKey, const void *data, INT data_size, IN
          return status;
       }
 
-      db_allow_write_locked(&_database[hDB-1], "db_set_data_index");
+      db_allow_write_tracked_locked(&_database[hDB-1], "db_set_data_index");
 
       status = db_set_data_index_wlocked(pheader, pkey, idx, data, data_size, type, "db_set_data_index", &msg);
       
@@ -7793,7 +8098,7 @@ INT db_set_link_data_index(HNDLE hDB, HNDLE hKey, const void *data, INT data_siz
          return status;
       }
 
-      db_allow_write_locked(&_database[hDB - 1], "db_set_link_data_index");
+      db_allow_write_tracked_locked(&_database[hDB - 1], "db_set_link_data_index");
 
       status = db_set_data_index_wlocked(pheader, pkey, idx, data, data_size, type, "db_set_link_data_index", &msg);
       
@@ -7893,7 +8198,7 @@ INT db_set_data_index1(HNDLE hDB, HNDLE hKey, const void *data, INT data_size, I
          return status;
       }
 
-      db_allow_write_locked(&_database[hDB - 1], "db_set_data_index1");
+      db_allow_write_tracked_locked(&_database[hDB - 1], "db_set_data_index1");
 
       status = db_set_data_index_wlocked(pheader, pkey, idx, data, data_size, type, "db_set_data_index1", &msg);
 
@@ -8011,6 +8316,7 @@ static int db_set_mode_wlocked(DATABASE_HEADER *pheader, KEY *pkey, WORD mode, i
 
    /* now set mode */
    pkey->access_mode = mode;
+   db_mark_dirty_locked(pheader, &pkey->access_mode, sizeof(pkey->access_mode));
 
    return DB_SUCCESS;
 }
@@ -11514,6 +11820,9 @@ static void db_recurse_record_tree_locked(HNDLE hDB, const DATABASE_HEADER* phea
                   /* update time */
                   wpkey->last_written = ss_time();
 
+                  db_mark_dirty_locked(pheader, pkey, sizeof(KEY));
+                  db_mark_dirty_locked(pheader, (char *) pheader + pkey->data, pkey->item_size * pkey->num_values);
+
                   /* notify clients which have key open */
                   db_notify_clients_locked(pheader, hDB, db_pkey_to_hkey(pheader, pkey), -1, TRUE, msg);
                }
@@ -11642,7 +11951,7 @@ INT db_get_record_size(HNDLE hDB, HNDLE hKey, INT align, INT * buf_size)
       }
 
       db_err_msg* msg = NULL;
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
 
       /* determine record size */
       *buf_size = max_align = 0;
@@ -11774,7 +12083,7 @@ INT db_get_record(HNDLE hDB, HNDLE hKey, void *data, INT * buf_size, INT align)
       total_size = 0;
 
       db_err_msg* msg = NULL;
-      db_lock_database(hDB);
+      db_lock_database_shared(hDB);
       db_recurse_record_tree_locked(hDB, hKey, &pdata, &total_size, align, NULL, FALSE, convert_flags, &msg);
       db_unlock_database(hDB);
       if (msg)
@@ -12349,7 +12658,7 @@ INT db_set_record(HNDLE hDB, HNDLE hKey, void *data, INT buf_size, INT align)
 
       db_lock_database(hDB);
       db_err_msg* msg = NULL;
-      db_allow_write_locked(&_database[hDB-1], "db_set_record");
+      db_allow_write_tracked_locked(&_database[hDB-1], "db_set_record");
       db_recurse_record_tree_locked(hDB, hKey, &pdata, &total_size, align, NULL, TRUE, convert_flags, &msg);
       db_unlock_database(hDB);
       if (msg)
@@ -12478,8 +12787,10 @@ static int db_remove_open_record_wlocked(DATABASE* pdb, DATABASE_HEADER* pheader
 
    if (pkey->notify_count > 0)
       pkey->notify_count--;
+   db_mark_dirty_locked(pdb, &pkey->notify_count, sizeof(pkey->notify_count));
    
    pclient->num_open_records--;
+   db_mark_dirty_locked(pdb, pclient, sizeof(DATABASE_CLIENT));
    
    /* remove exclusive flag */
    if (pclient->open_record[idx].access_mode & MODE_WRITE)
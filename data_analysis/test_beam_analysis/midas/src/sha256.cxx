@@ -38,6 +38,20 @@
 
 #include <string.h>
 
+/*
+ * Runtime dispatched x86-64 versions of the block function: SHA-NI
+ * (Goldmont, Ice Lake, Zen and later) and a BMI2 build of the portable
+ * code (rorx rotates). The portable code is used everywhere else.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_INLINE static inline __attribute__((always_inline))
+#else
+#define SHA256_INLINE static inline
+#endif
+
 #if defined(MBEDTLS_SELF_TEST)
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
@@ -178,7 +192,7 @@ static const uint32_t K[] =
     d += temp1; h = temp1 + temp2;              \
 }
 
-void mbedtls_sha256_process( mbedtls_sha256_context *ctx, const unsigned char data[64] )
+SHA256_INLINE void sha256_block( mbedtls_sha256_context *ctx, const unsigned char data[64] )
 {
     uint32_t temp1, temp2, W[64];
     uint32_t A[8];
@@ -232,6 +246,121 @@ void mbedtls_sha256_process( mbedtls_sha256_context *ctx, const unsigned char da
     for( i = 0; i < 8; i++ )
         ctx->state[i] += A[i];
 }
+
+static void sha256_blocks_c( mbedtls_sha256_context *ctx, const unsigned char *data, size_t n )
+{
+    for( ; n > 0; n--, data += 64 )
+        sha256_block( ctx, data );
+}
+
+#if defined(HAVE_SHA256_X86)
+__attribute__((target("bmi2")))
+static void sha256_blocks_bmi2( mbedtls_sha256_context *ctx, const unsigned char *data, size_t n )
+{
+    for( ; n > 0; n--, data += 64 )
+        sha256_block( ctx, data );
+}
+
+/* four rounds with message words msg */
+#define SHANI_ROUNDS(msg, k)                                            \
+do {                                                                    \
+    __m128i m_ = _mm_add_epi32( msg, _mm_loadu_si128( (const __m128i*) (k) ) ); \
+    state1 = _mm_sha256rnds2_epu32( state1, state0, m_ );               \
+    m_ = _mm_shuffle_epi32( m_, 0x0E );                                 \
+    state0 = _mm_sha256rnds2_epu32( state0, state1, m_ );               \
+} while( 0 )
+
+/* next four message words from the previous 16: m0 = W[t-16..t-13] ... m3 = W[t-4..t-1] */
+#define SHANI_SCHEDULE(m0, m1, m2, m3)                                  \
+    m0 = _mm_sha256msg2_epu32( _mm_add_epi32( _mm_sha256msg1_epu32( m0, m1 ), \
+                                              _mm_alignr_epi8( m3, m2, 4 ) ), m3 )
+
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani( mbedtls_sha256_context *ctx, const unsigned char *data, size_t n )
+{
+    const __m128i bswap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+    __m128i state0, state1, tmp, save0, save1, m0, m1, m2, m3;
+    int i;
+
+    /* state words are kept as ABEF and CDGH for sha256rnds2 */
+    tmp    = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*) &ctx->state[0] ), 0xB1 );
+    state1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*) &ctx->state[4] ), 0x1B );
+    state0 = _mm_alignr_epi8( tmp, state1, 8 );
+    state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+    for( ; n > 0; n--, data += 64 )
+    {
+        save0 = state0;
+        save1 = state1;
+
+        m0 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (data +  0) ), bswap );
+        SHANI_ROUNDS( m0, &K[0] );
+        m1 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (data + 16) ), bswap );
+        SHANI_ROUNDS( m1, &K[4] );
+        m2 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (data + 32) ), bswap );
+        SHANI_ROUNDS( m2, &K[8] );
+        m3 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (data + 48) ), bswap );
+        SHANI_ROUNDS( m3, &K[12] );
+
+        for( i = 16; i < 64; i += 16 )
+        {
+            SHANI_SCHEDULE( m0, m1, m2, m3 );
+            SHANI_ROUNDS( m0, &K[i] );
+            SHANI_SCHEDULE( m1, m2, m3, m0 );
+            SHANI_ROUNDS( m1, &K[i+4] );
+            SHANI_SCHEDULE( m2, m3, m0, m1 );
+            SHANI_ROUNDS( m2, &K[i+8] );
+            SHANI_SCHEDULE( m3, m0, m1, m2 );
+            SHANI_ROUNDS( m3, &K[i+12] );
+        }
+
+        state0 = _mm_add_epi32( state0, save0 );
+        state1 = _mm_add_epi32( state1, save1 );
+    }
+
+    /* back to ABCD and EFGH */
+    tmp    = _mm_shuffle_epi32( state0, 0x1B );
+    state1 = _mm_shuffle_epi32( state1, 0xB1 );
+    state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+    state1 = _mm_alignr_epi8( state1, tmp, 8 );
+    _mm_storeu_si128( (__m128i*) &ctx->state[0], state0 );
+    _mm_storeu_si128( (__m128i*) &ctx->state[4], state1 );
+}
+
+typedef void (*sha256_blocks_t)( mbedtls_sha256_context *, const unsigned char *, size_t );
+
+static sha256_blocks_t sha256_select( void )
+{
+    unsigned int eax, ebx, ecx, edx;
+    int sse41 = 0, sha = 0;
+
+    if( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+        sse41 = (ecx >> 19) & 1;
+    if( __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) )
+        sha = (ebx >> 29) & 1;
+
+    if( sha && sse41 )
+        return sha256_blocks_shani;
+    if( __builtin_cpu_supports( "bmi2" ) )
+        return sha256_blocks_bmi2;
+    return sha256_blocks_c;
+}
+#endif /* HAVE_SHA256_X86 */
+
+static void sha256_blocks( mbedtls_sha256_context *ctx, const unsigned char *data, size_t n )
+{
+#if defined(HAVE_SHA256_X86)
+    static const sha256_blocks_t blocks = sha256_select();
+    blocks( ctx, data, n );
+#else
+    sha256_blocks_c( ctx, data, n );
+#endif
+}
+
+void mbedtls_sha256_process( mbedtls_sha256_context *ctx, const unsigned char data[64] )
+{
+    sha256_blocks( ctx, data, 1 );
+}
 #endif /* !MBEDTLS_SHA256_PROCESS_ALT */
 
 /*
@@ -264,11 +393,11 @@ void mbedtls_sha256_update( mbedtls_sha256_context *ctx, const unsigned char *in
         left = 0;
     }
 
-    while( ilen >= 64 )
+    if( ilen >= 64 )
     {
-        mbedtls_sha256_process( ctx, input );
-        input += 64;
-        ilen  -= 64;
+        sha256_blocks( ctx, input, ilen / 64 );
+        input += ilen & ~(size_t) 0x3F;
+        ilen  &= 0x3F;
     }
 
     if( ilen > 0 )
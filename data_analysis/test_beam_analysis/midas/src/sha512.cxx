@@ -44,6 +44,19 @@
 
 #include <string.h>
 
+/*
+ * Runtime dispatched x86-64 version of the block function: message
+ * schedule with AVX2, rounds with BMI2 rotates. The portable code is used
+ * on CPUs without AVX2 and everywhere else.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_SHA512_X86 1
+#include <immintrin.h>
+#define SHA512_INLINE static inline __attribute__((always_inline))
+#else
+#define SHA512_INLINE static inline
+#endif
+
 #if defined(MBEDTLS_SELF_TEST)
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
@@ -194,12 +207,6 @@ void mbedtls_sha512_starts( mbedtls_sha512_context *ctx, int is384 )
 }
 
 #if !defined(MBEDTLS_SHA512_PROCESS_ALT)
-void mbedtls_sha512_process( mbedtls_sha512_context *ctx, const unsigned char data[128] )
-{
-    int i;
-    uint64_t temp1, temp2, W[80];
-    uint64_t A, B, C, D, E, F, G, H;
-
 #define  SHR(x,n) (x >> n)
 #define ROTR(x,n) (SHR(x,n) | (x << (64 - n)))
 
@@ -219,16 +226,12 @@ void mbedtls_sha512_process( mbedtls_sha512_context *ctx, const unsigned char da
     d += temp1; h = temp1 + temp2;              \
 }
 
-    for( i = 0; i < 16; i++ )
-    {
-        GET_UINT64_BE( W[i], data, i << 3 );
-    }
-
-    for( ; i < 80; i++ )
-    {
-        W[i] = S1(W[i -  2]) + W[i -  7] +
-               S0(W[i - 15]) + W[i - 16];
-    }
+/* 80 rounds on the expanded message W[] */
+SHA512_INLINE void sha512_rounds( mbedtls_sha512_context *ctx, const uint64_t W[80] )
+{
+    int i;
+    uint64_t temp1, temp2;
+    uint64_t A, B, C, D, E, F, G, H;
 
     A = ctx->state[0];
     B = ctx->state[1];
@@ -262,6 +265,88 @@ void mbedtls_sha512_process( mbedtls_sha512_context *ctx, const unsigned char da
     ctx->state[6] += G;
     ctx->state[7] += H;
 }
+
+static void sha512_blocks_c( mbedtls_sha512_context *ctx, const unsigned char *data, size_t n )
+{
+    int i;
+    uint64_t W[80];
+
+    for( ; n > 0; n--, data += 128 )
+    {
+        for( i = 0; i < 16; i++ )
+        {
+            GET_UINT64_BE( W[i], data, i << 3 );
+        }
+
+        for( ; i < 80; i++ )
+        {
+            W[i] = S1(W[i -  2]) + W[i -  7] +
+                   S0(W[i - 15]) + W[i - 16];
+        }
+
+        sha512_rounds( ctx, W );
+    }
+}
+
+#if defined(HAVE_SHA512_X86)
+#define ROTR128(x,n) _mm_or_si128( _mm_srli_epi64( x, n ), _mm_slli_epi64( x, 64 - (n) ) )
+
+__attribute__((target("avx2,bmi2")))
+static void sha512_blocks_avx2( mbedtls_sha512_context *ctx, const unsigned char *data, size_t n )
+{
+    const __m256i bswap = _mm256_set_epi64x( 0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL,
+                                             0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL );
+    uint64_t W[80] __attribute__((aligned(32)));
+    __m128i w2, w15, s0, s1;
+    int i;
+
+    for( ; n > 0; n--, data += 128 )
+    {
+        for( i = 0; i < 16; i += 4 )
+            _mm256_store_si256( (__m256i*) &W[i],
+                                _mm256_shuffle_epi8( _mm256_loadu_si256( (const __m256i*) (data + 8 * i) ), bswap ) );
+
+        /* two words per step, W[t+1] only depends on W[t-1] and older */
+        for( ; i < 80; i += 2 )
+        {
+            w2  = _mm_load_si128( (const __m128i*) &W[i - 2] );
+            w15 = _mm_loadu_si128( (const __m128i*) &W[i - 15] );
+            s1  = _mm_xor_si128( _mm_xor_si128( ROTR128( w2, 19 ), ROTR128( w2, 61 ) ), _mm_srli_epi64( w2, 6 ) );
+            s0  = _mm_xor_si128( _mm_xor_si128( ROTR128( w15, 1 ), ROTR128( w15, 8 ) ), _mm_srli_epi64( w15, 7 ) );
+            _mm_store_si128( (__m128i*) &W[i],
+                             _mm_add_epi64( _mm_add_epi64( s0, s1 ),
+                                            _mm_add_epi64( _mm_loadu_si128( (const __m128i*) &W[i - 7] ),
+                                                           _mm_load_si128( (const __m128i*) &W[i - 16] ) ) ) );
+        }
+
+        sha512_rounds( ctx, W );
+    }
+}
+
+typedef void (*sha512_blocks_t)( mbedtls_sha512_context *, const unsigned char *, size_t );
+
+static sha512_blocks_t sha512_select( void )
+{
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "bmi2" ) )
+        return sha512_blocks_avx2;
+    return sha512_blocks_c;
+}
+#endif /* HAVE_SHA512_X86 */
+
+static void sha512_blocks( mbedtls_sha512_context *ctx, const unsigned char *data, size_t n )
+{
+#if defined(HAVE_SHA512_X86)
+    static const sha512_blocks_t blocks = sha512_select();
+    blocks( ctx, data, n );
+#else
+    sha512_blocks_c( ctx, data, n );
+#endif
+}
+
+void mbedtls_sha512_process( mbedtls_sha512_context *ctx, const unsigned char data[128] )
+{
+    sha512_blocks( ctx, data, 1 );
+}
 #endif /* !MBEDTLS_SHA512_PROCESS_ALT */
 
 /*
@@ -293,11 +378,11 @@ void mbedtls_sha512_update( mbedtls_sha512_context *ctx, const unsigned char *in
         left = 0;
     }
 
-    while( ilen >= 128 )
+    if( ilen >= 128 )
     {
-        mbedtls_sha512_process( ctx, input );
-        input += 128;
-        ilen  -= 128;
+        sha512_blocks( ctx, input, ilen / 128 );
+        input += ilen & ~(size_t) 0x7F;
+        ilen  &= 0x7F;
     }
 
     if( ilen > 0 )
@@ -36,8 +36,9 @@ The Midas System file
 #include <math.h>
 #include <vector>
 #include <atomic> // std::atomic_int & co
-#include <thread>
+#include <algorithm> // std::min
 #include <array>
+#include <memory> // std::unique_ptr
 #include <stdexcept>
 
 #include "midas.h"
@@ -1132,65 +1133,94 @@ INT ss_shm_unprotect(HNDLE handle, void **adr, size_t shm_size, BOOL read, BOOL
 
 /*------------------------------------------------------------------*/
 
-typedef struct {
-   std::string file_name;
-   int fd;
-   void *buf;
-   int size;
-} FL_PARAM;
+#ifdef OS_UNIX
 
-INT ss_shm_flush_thread(void *p)
+/* write the shared memory image, or the runs of pages marked in dirty_pages,
+   to the backing file. With "packed", src holds only the dirty pages one
+   after the other, otherwise src is the whole image. */
+static INT ss_shm_write_file(const std::string &file_name, const char *src, size_t size, const unsigned char *dirty_pages, size_t page_size, bool packed)
 {
-   FL_PARAM *param = (FL_PARAM *)p;
-
-   //fprintf(stderr, "flush start!\n");
+   int fd = open(file_name.c_str(), O_RDWR | O_CREAT, 0777);
+   if (fd < 0) {
+      cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', fopen() errno %d (%s)", file_name.c_str(), errno, strerror(errno));
+      return SS_NO_MEMORY;
+   }
 
    uint32_t start = ss_time();
 
-   /* write shared memory to file */
-   ssize_t wr = write(param->fd, param->buf, param->size);
-   if ((size_t)wr != (size_t)param->size) {
-      cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', write() returned %d instead of %d, errno %d (%s)",
-             param->file_name.c_str(), (int)wr, (int)param->size, errno, strerror(errno));
-      close(param->fd);
-      free(param->buf);
-      param->buf = nullptr;
-      return -1;
+   size_t npages = dirty_pages ? (size + page_size - 1) / page_size : 1;
+   size_t i = 0;
+   size_t src_offset = 0;
+   while (i < npages) {
+      size_t offset, count;
+
+      if (dirty_pages) {
+         /* find next run of dirty pages */
+         while (i < npages && !dirty_pages[i])
+            i++;
+         if (i == npages)
+            break;
+         size_t first = i;
+         while (i < npages && dirty_pages[i])
+            i++;
+         offset = first * page_size;
+         count = std::min(i * page_size, size) - offset;
+      } else {
+         offset = 0;
+         count = size;
+         i = npages;
+      }
+
+      if (!packed)
+         src_offset = offset;
+
+      ssize_t wr = pwrite(fd, src + src_offset, count, offset);
+      if (wr < 0 || (size_t)wr != count) {
+         cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', pwrite() returned %d instead of %d, errno %d (%s)",
+                file_name.c_str(), (int)wr, (int)count, errno, strerror(errno));
+         close(fd);
+         return SS_NO_MEMORY;
+      }
+
+      src_offset += count;
    }
 
-   int ret = close(param->fd);
+   int ret = close(fd);
    if (ret < 0) {
       cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', close() errno %d (%s)",
-             param->file_name.c_str(), errno, strerror(errno));
-      free(param->buf);
-      param->buf = nullptr;
-      return -1;
+             file_name.c_str(), errno, strerror(errno));
+      return SS_NO_MEMORY;
    }
 
-   free(param->buf);
-   param->buf = nullptr;
-
    if (ss_time() - start > 4)
       cm_msg(MINFO, "ss_shm_flush", "Flushing shared memory took %d seconds", ss_time() - start);
 
-   //fprintf(stderr, "flush end!\n");
-
-   return 0;
+   return SS_SUCCESS;
 }
 
+#endif // OS_UNIX
 
-INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, bool wait_for_thread)
+INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, const unsigned char *dirty_pages, size_t page_size)
 /********************************************************************\
 
   Routine: ss_shm_flush
 
   Purpose: Flush a shared memory region to its disk file.
 
+           If dirty_pages is given, only pages with a non-zero entry
+           are written, page i covering bytes [i*page_size, (i+1)*page_size).
+           The data is written directly from shared memory, the caller
+           has to hold whatever lock protects its contents. To write
+           without the lock, see ss_shm_copy_dirty() and
+           ss_shm_flush_copy().
+
   Input:
     char *name              Name of the shared memory
     void *adr               Base address of shared memory
     INT  size               Size of shared memeory
     HNDLE handle            Handle of shared memory
+    unsigned char *dirty_pages  Pages to write, NULL to write everything
+    size_t page_size        Size of one page in dirty_pages
 
   Output:
     none
@@ -1198,6 +1228,7 @@ INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, b
   Function value:
     SS_SUCCESS              Successful completion
     SS_INVALID_ADDRESS      Invalid base address
+    SS_NO_MEMORY            Cannot write to file
 
 \********************************************************************/
 {
@@ -1208,7 +1239,7 @@ INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, b
    ss_shm_name(name, mem_name, file_name, shm_name);
 
    if (shm_trace)
-      printf("ss_shm_flush(\"%s\",%p,%.0f,%d), file_name [%s]\n", name, adr, (double)size, handle, file_name.c_str());
+      printf("ss_shm_flush(\"%s\",%p,%.0f,%d,%p), file_name [%s]\n", name, adr, (double)size, handle, dirty_pages, file_name.c_str());
 
 #ifdef OS_WINNT
 
@@ -1228,64 +1259,9 @@ INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, b
    if (use_sysv_shm || use_posix_shm) {
 
       assert(size > 0);
+      assert(dirty_pages == NULL || page_size > 0);
 
-      int fd = open(file_name.c_str(), O_RDWR | O_CREAT, 0777);
-      if (fd < 0) {
-         cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', fopen() errno %d (%s)", file_name.c_str(), errno, strerror(errno));
-         return SS_NO_MEMORY;
-      }
-
-      /* try to make a copy of the shared memory */
-      void *buffer = malloc(size);
-      if (buffer != nullptr) {
-         memcpy(buffer, adr, size);
-         static std::thread* thread = NULL; // THIS IS NOT THREAD SAFE!
-         if (thread) { // reap the long finished thread from the previous flush
-            thread->join();
-            delete thread;
-            thread = NULL;
-         }
-         static FL_PARAM param; // this is safe, thread is no longer running. K.O.
-         param.file_name = file_name;
-         param.fd = fd;
-         param.buf = buffer;
-         param.size = size;
-
-         thread = new std::thread(ss_shm_flush_thread, &param);
-
-         if (wait_for_thread) {
-            //fprintf(stderr, "waiting for flush thread!\n");
-            thread->join();
-            delete thread;
-            thread = NULL;
-            //fprintf(stderr, "thread joined!\n");
-         }
-
-         // buffer gets freed in ss_shm_flush_thread, so we don't have to free() it here...
-      } else {
-
-         /* not enough memory for ODB copy buffer, so write directly */
-         uint32_t start = ss_time();
-         ssize_t wr = write(fd, adr, size);
-         if ((size_t)wr != size) {
-            cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', write() returned %d instead of %d, errno %d (%s)", file_name.c_str(), (int)wr, (int)size, errno, strerror(errno));
-            close(fd);
-            return SS_NO_MEMORY;
-         }
-
-         int ret = close(fd);
-         if (ret < 0) {
-            cm_msg(MERROR, "ss_shm_flush", "Cannot write to file \'%s\', close() errno %d (%s)",
-                   file_name.c_str(), errno, strerror(errno));
-            return SS_NO_MEMORY;
-         }
-
-         if (ss_time() - start > 4)
-            cm_msg(MINFO, "ss_shm_flush", "Flushing shared memory took %d seconds", ss_time() - start);
-
-      }
-
-      return SS_SUCCESS;
+      return ss_shm_write_file(file_name, (const char *) adr, size, dirty_pages, page_size, false);
    }
 
    if (use_mmap_shm) {
@@ -1309,6 +1285,100 @@ INT ss_shm_flush(const char *name, const void *adr, size_t size, HNDLE handle, b
    return SS_SUCCESS;
 }
 
+/*------------------------------------------------------------------*/
+
+INT ss_shm_copy_dirty(const void *adr, size_t size, const unsigned char *dirty_pages, size_t page_size, std::vector<char> *copy)
+/********************************************************************\
+
+  Routine: ss_shm_copy_dirty
+
+  Purpose: Copy the pages marked in dirty_pages into a private buffer
+           for ss_shm_flush_copy(), so the disk write can run without
+           the lock that protects the shared memory. The pages are
+           packed one after the other.
+
+           With mmap'ed shared memory the mapping is the file itself,
+           nothing is copied.
+
+  Input:
+    void *adr               Base address of shared memory
+    INT  size               Size of shared memeory
+    unsigned char *dirty_pages  Pages to copy
+    size_t page_size        Size of one page in dirty_pages
+
+  Output:
+    std::vector<char> *copy Dirty pages
+
+  Function value:
+    SS_SUCCESS              Successful completion
+
+\********************************************************************/
+{
+   copy->clear();
+
+#ifdef OS_UNIX
+   if (use_sysv_shm || use_posix_shm) {
+      size_t npages = (size + page_size - 1) / page_size;
+      for (size_t i = 0; i < npages; i++) {
+         if (dirty_pages[i]) {
+            size_t offset = i * page_size;
+            size_t count = std::min(offset + page_size, size) - offset;
+            copy->insert(copy->end(), (const char *) adr + offset, (const char *) adr + offset + count);
+         }
+      }
+   }
+#endif // OS_UNIX
+
+   return SS_SUCCESS;
+}
+
+/*------------------------------------------------------------------*/
+
+INT ss_shm_flush_copy(const char *name, const void *adr, size_t size, const unsigned char *dirty_pages, size_t page_size, const std::vector<char> &copy)
+/********************************************************************\
+
+  Routine: ss_shm_flush_copy
+
+  Purpose: Write the dirty pages copied by ss_shm_copy_dirty() to the
+           disk file of the shared memory. Needs no lock, dirty_pages
+           has to be the page map used for the copy.
+
+  Input:
+    char *name              Name of the shared memory
+    void *adr               Base address of shared memory, for msync()
+    INT  size               Size of shared memeory
+    unsigned char *dirty_pages  Pages in copy
+    size_t page_size        Size of one page in dirty_pages
+    std::vector<char> copy  Dirty pages from ss_shm_copy_dirty()
+
+  Output:
+    none
+
+  Function value:
+    SS_SUCCESS              Successful completion
+    SS_INVALID_ADDRESS      Invalid base address
+    SS_NO_MEMORY            Cannot write to file
+
+\********************************************************************/
+{
+#ifdef OS_UNIX
+   if (use_sysv_shm || use_posix_shm) {
+      std::string mem_name;
+      std::string file_name;
+      std::string shm_name;
+
+      ss_shm_name(name, mem_name, file_name, shm_name);
+
+      if (shm_trace)
+         printf("ss_shm_flush_copy(\"%s\",%.0f,%.0f), file_name [%s]\n", name, (double)size, (double)copy.size(), file_name.c_str());
+
+      return ss_shm_write_file(file_name, copy.data(), size, dirty_pages, page_size, true);
+   }
+#endif // OS_UNIX
+
+   return ss_shm_flush(name, adr, size, 0, NULL, 0);
+}
+
 #endif                          /* LOCAL_ROUTINES */
 
 /*------------------------------------------------------------------*/
@@ -2877,6 +2947,257 @@ INT ss_semaphore_delete(HNDLE semaphore_handle, INT destroy_flag)
 
 /*------------------------------------------------------------------*/
 
+/*
+  Reader/writer lock shared between processes, used by the ODB.
+
+  Under UNIX it is a SysV semaphore set: RWLOCK_WRITER is one while a
+  writer holds the lock, RWLOCK_READERS counts the readers and
+  RWLOCK_WAITING counts the writers waiting for the lock. New readers
+  wait while a writer is waiting, so a steady stream of readers cannot
+  starve the writers. All operations use SEM_UNDO, the kernel releases
+  the lock held by a process which died.
+
+  On other systems the lock is an exclusive semaphore.
+*/
+
+#ifdef OS_UNIX
+
+#define RWLOCK_WRITER  0
+#define RWLOCK_READERS 1
+#define RWLOCK_WAITING 2
+#define RWLOCK_NSEMS   3
+
+static void ss_rwlock_sembuf(struct sembuf *sb, int sem_num, int sem_op, int sem_flg)
+{
+   sb->sem_num = sem_num;
+   sb->sem_op = sem_op;
+   sb->sem_flg = sem_flg;
+}
+
+static INT ss_rwlock_semop(HNDLE rwlock_handle, struct sembuf *sb, int nsops, INT timeout)
+{
+   DWORD start_time = ss_millitime();
+
+   do {
+#if defined(OS_LINUX)
+      struct timespec ts;
+      ts.tv_sec  = 1;
+      ts.tv_nsec = 0;
+
+      int status = semtimedop(rwlock_handle, sb, nsops, &ts);
+#else
+      int status = semop(rwlock_handle, sb, nsops);
+#endif
+
+      if (status == 0)
+         return SS_SUCCESS;
+
+      /* retry if interrupted by a ss_wake signal */
+      if (errno == EINTR || errno == EAGAIN) {
+         if (timeout > 0 && (int) (ss_millitime() - start_time) > timeout)
+            return SS_TIMEOUT;
+         continue;
+      }
+
+      fprintf(stderr, "ss_rwlock_semop: semop/semtimedop(%d) returned %d, errno %d (%s)\n", rwlock_handle, status, errno, strerror(errno));
+      return SS_NO_SEMAPHORE;
+   } while (1);
+}
+
+#endif                          /* OS_UNIX */
+
+INT ss_rwlock_create(const char *name, HNDLE * rwlock_handle)
+/********************************************************************\
+
+  Routine: ss_rwlock_create
+
+  Purpose: Create a reader/writer lock with a specific name
+
+  Input:
+    char   *name            Name of the lock, the key is derived from
+                            the file .<name>.SHM like for ss_semaphore_create()
+
+  Output:
+    HNDLE  *rwlock_handle   Handle of the created lock
+
+  Function value:
+    SS_CREATED              lock was created
+    SS_SUCCESS              lock existed already and was attached
+    SS_NO_SEMAPHORE         Cannot create lock
+
+\********************************************************************/
+{
+#ifdef OS_UNIX
+   std::string file_name = cm_get_path();
+   if (file_name.empty()) {
+      char cwd[256];
+      if (getcwd(cwd, sizeof(cwd)))
+         file_name = cwd;
+      file_name += "/";
+   }
+   file_name += ".";
+   file_name += name;
+   file_name += ".SHM";
+
+   /* use a different project id than ss_semaphore_create() for the same file */
+   key_t key = ftok(file_name.c_str(), 'R');
+   if (key < 0) {
+      int fh = open(file_name.c_str(), O_CREAT, 0644);
+      if (fh >= 0)
+         close(fh);
+      key = ftok(file_name.c_str(), 'R');
+   }
+
+   int status = SS_SUCCESS;
+
+   *rwlock_handle = (HNDLE) semget(key, RWLOCK_NSEMS, IPC_CREAT | IPC_EXCL | 0666);
+   if (*rwlock_handle >= 0) {
+      /* new lock: nobody reading, writing or waiting */
+      unsigned short zero[RWLOCK_NSEMS] = { 0, 0, 0 };
+#if (defined(OS_LINUX) && !defined(_SEM_SEMUN_UNDEFINED) && !defined(OS_CYGWIN)) || defined(OS_FREEBSD)
+      union semun arg;
+#else
+      union semun {
+         INT val;
+         struct semid_ds *buf;
+         ushort *array;
+      } arg;
+#endif
+      arg.array = zero;
+      semctl(*rwlock_handle, 0, SETALL, arg);
+      status = SS_CREATED;
+   } else if (errno == EEXIST) {
+      *rwlock_handle = (HNDLE) semget(key, RWLOCK_NSEMS, 0);
+   }
+
+   if (*rwlock_handle < 0) {
+      cm_msg(MERROR, "ss_rwlock_create", "Cannot create lock \'%s\', semget(0x%x) failed, errno %d (%s)", name, key, errno, strerror(errno));
+      return SS_NO_SEMAPHORE;
+   }
+
+   return status;
+#else
+   return ss_semaphore_create(name, rwlock_handle);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+INT ss_rwlock_read_lock(HNDLE rwlock_handle, INT timeout)
+/********************************************************************\
+
+  Routine: ss_rwlock_read_lock
+
+  Purpose: Obtain shared (read) access, other readers may hold the
+           lock at the same time
+
+  Input:
+    HNDLE  rwlock_handle    Handle of the lock
+    INT    timeout          Timeout in ms, zero for no timeout
+
+  Function value:
+    SS_SUCCESS              Successful completion
+    SS_NO_SEMAPHORE         Invalid lock handle
+    SS_TIMEOUT              Timeout
+
+\********************************************************************/
+{
+#ifdef OS_UNIX
+   struct sembuf sb[3];
+
+   /* wait until no writer holds or waits for the lock, then count us in */
+   ss_rwlock_sembuf(&sb[0], RWLOCK_WAITING, 0, 0);
+   ss_rwlock_sembuf(&sb[1], RWLOCK_WRITER, 0, 0);
+   ss_rwlock_sembuf(&sb[2], RWLOCK_READERS, 1, SEM_UNDO);
+
+   return ss_rwlock_semop(rwlock_handle, sb, 3, timeout);
+#else
+   return ss_semaphore_wait_for(rwlock_handle, timeout);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+INT ss_rwlock_read_unlock(HNDLE rwlock_handle)
+{
+#ifdef OS_UNIX
+   struct sembuf sb;
+   ss_rwlock_sembuf(&sb, RWLOCK_READERS, -1, SEM_UNDO);
+   return ss_rwlock_semop(rwlock_handle, &sb, 1, 0);
+#else
+   return ss_semaphore_release(rwlock_handle);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+INT ss_rwlock_write_lock(HNDLE rwlock_handle, INT timeout)
+/********************************************************************\
+
+  Routine: ss_rwlock_write_lock
+
+  Purpose: Obtain exclusive (write) access
+
+  Input:
+    HNDLE  rwlock_handle    Handle of the lock
+    INT    timeout          Timeout in ms, zero for no timeout
+
+  Function value:
+    SS_SUCCESS              Successful completion
+    SS_NO_SEMAPHORE         Invalid lock handle
+    SS_TIMEOUT              Timeout
+
+\********************************************************************/
+{
+#ifdef OS_UNIX
+   struct sembuf sb[3];
+
+   /* announce a waiting writer, this holds back new readers */
+   ss_rwlock_sembuf(&sb[0], RWLOCK_WAITING, 1, SEM_UNDO);
+   int status = ss_rwlock_semop(rwlock_handle, sb, 1, 0);
+   if (status != SS_SUCCESS)
+      return status;
+
+   /* wait for the readers and the writer to leave, then take the lock */
+   ss_rwlock_sembuf(&sb[0], RWLOCK_WRITER, 0, 0);
+   ss_rwlock_sembuf(&sb[1], RWLOCK_READERS, 0, 0);
+   ss_rwlock_sembuf(&sb[2], RWLOCK_WRITER, 1, SEM_UNDO);
+   status = ss_rwlock_semop(rwlock_handle, sb, 3, timeout);
+
+   ss_rwlock_sembuf(&sb[0], RWLOCK_WAITING, -1, SEM_UNDO);
+   ss_rwlock_semop(rwlock_handle, sb, 1, 0);
+
+   return status;
+#else
+   return ss_semaphore_wait_for(rwlock_handle, timeout);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+INT ss_rwlock_write_unlock(HNDLE rwlock_handle)
+{
+#ifdef OS_UNIX
+   struct sembuf sb;
+   ss_rwlock_sembuf(&sb, RWLOCK_WRITER, -1, SEM_UNDO);
+   return ss_rwlock_semop(rwlock_handle, &sb, 1, 0);
+#else
+   return ss_semaphore_release(rwlock_handle);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+INT ss_rwlock_delete(HNDLE rwlock_handle, INT destroy_flag)
+{
+#ifdef OS_UNIX
+   if (destroy_flag) {
+      if (semctl(rwlock_handle, 0, IPC_RMID) < 0)
+         return SS_NO_SEMAPHORE;
+   }
+   return SS_SUCCESS;
+#else
+   return ss_semaphore_delete(rwlock_handle, destroy_flag);
+#endif
+}
+
+/*------------------------------------------------------------------*/
+
 INT ss_mutex_create(MUTEX_T ** mutex, BOOL recursive)
 /********************************************************************\
 
@@ -3410,6 +3731,35 @@ double ss_time_sec()
    return tv.tv_sec*1.0 + tv.tv_usec/1000000.0; 
 }
 
+/********************************************************************/
+/**
+Returns a monotonic microsecond time stamp for measuring short time
+intervals, also between processes on the same computer. Like
+ss_millitime(), it wraps around (after 71 minutes), so only the
+difference of two time stamps is meaningful.
+@return microsecond time stamp.
+*/
+DWORD ss_microtime()
+{
+#ifdef OS_WINNT
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER count;
+
+   if (freq.QuadPart == 0)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+
+   return (DWORD) (count.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(OS_UNIX)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (DWORD) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+   return ss_millitime() * 1000;
+#endif
+}
+
 /*------------------------------------------------------------------*/
 DWORD ss_settime(DWORD seconds)
 /********************************************************************\